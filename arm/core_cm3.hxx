@@ -37,8 +37,8 @@
 #endif
 
 #define ARM_CORE_CM3_MAJOR_VERSION  1
-#define ARM_CORE_CM3_MINOR_VERSION  0
-#define ARM_CORE_CM3_MICRO_VERSION  1
+#define ARM_CORE_CM3_MINOR_VERSION  1
+#define ARM_CORE_CM3_MICRO_VERSION  0
 
 
 namespace arm {
@@ -102,6 +102,48 @@ struct SysTick {
 static_assert(sizeof(SysTick) == 16, "sizeof(SysTick) != 16");
 
 
+// Data Watchpoint and Trace unit, cycle counter only
+struct Dwt {
+    struct Ctrl {
+        using            pos_t = regbits::Pos<uint32_t, Ctrl>;
+        static constexpr pos_t
+           CYCCNTENA_POS = pos_t( 0);
+
+        using            bits_t = regbits::Bits<uint32_t, Ctrl>;
+        static constexpr bits_t
+            CYCCNTENA        = bits_t(1,    CYCCNTENA_POS);
+    };  // struct Ctrl
+    using ctrl_t = regbits::Reg<uint32_t, Ctrl>;
+          ctrl_t   ctrl;
+
+    // processor clock cycles, wraps at 32 bits
+                 uint32_t   cyccnt;
+
+};  // struct Dwt
+static_assert(sizeof(Dwt) == 8, "sizeof(Dwt) != 8");
+
+
+struct CoreDebug {
+                 uint32_t   dhcsr,
+                            dcrsr,
+                            dcrdr;
+
+    struct Demcr {
+        using            pos_t = regbits::Pos<uint32_t, Demcr>;
+        static constexpr pos_t
+              TRCENA_POS = pos_t(24);
+
+        using            bits_t = regbits::Bits<uint32_t, Demcr>;
+        static constexpr bits_t
+            TRCENA           = bits_t(1,       TRCENA_POS);  // enables DWT
+    };  // struct Demcr
+    using demcr_t = regbits::Reg<uint32_t, Demcr>;
+          demcr_t   demcr;
+
+};  // struct CoreDebug
+static_assert(sizeof(CoreDebug) == 16, "sizeof(CoreDebug) != 16");
+
+
 enum class NvicIrqn;
 
 
@@ -172,6 +214,10 @@ static const uint32_t   SYSTICK_BASE = SCS_BASE + 0x0010UL,
 static volatile SysTick* const
 sys_tick = reinterpret_cast<volatile SysTick*>(SYSTICK_BASE);
 static Nvic*    const   nvic    = reinterpret_cast<Nvic*   >(NVIC_BASE   );
+static volatile Dwt* const
+dwt        = reinterpret_cast<volatile Dwt*      >(DWT_BASE      );
+static volatile CoreDebug* const
+core_debug = reinterpret_cast<volatile CoreDebug*>(COREDEBUG_BASE);
 #if 0
 static Scb*     const   scb     = reinterpret_cast<Scb*    >(SCB_BASE    );
 #endif
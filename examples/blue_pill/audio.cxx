@@ -0,0 +1,145 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// UsbDevAudio USB speaker, PWM output:
+//   PA6    TIM3 channel 1 PWM (to amplifier via RC low-pass filter)
+// TIM3 period is one sample: its update event DMAs the next sample
+//   (DMA1 channel 3) into the channel 1 compare register, and clocks
+//   TIM2 (TRGO to ITR2), which counts samples for the feedback endpoint.
+//   Sampling frequencies not dividing the 72 MHz timer clock play
+//   slightly fast or slow, and the host follows.
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_audio.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   TIM_HZ = 72000000;  // usb_mcu_init(), PPRE1_DIV_1
+
+
+UsbDevAudio     usb_dev;
+
+
+
+static void rate_changed(
+const uint8_t             ,  // direction, only speaker
+const uint32_t   hz       ,
+      void      *          )
+{
+    uint16_t    period = TIM_HZ / hz;
+
+    gen_tim_3->arr = period - 1;  // ARPE, so at next update
+    usb_dev.pwm_range(period);
+}
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    rcc->ahbenr  |= Rcc::Ahbenr ::DMA1EN;
+    rcc->apb1enr |= Rcc::Apb1enr::TIM2EN | Rcc::Apb1enr::TIM3EN;
+
+    gpioa->crl.ins(  Gpio::Crl::CNF6_ALTFUNC_PUSH_PULL
+                   | Gpio::Crl::MODE6_OUTPUT_50_MHZ    );
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+    uint16_t    period = TIM_HZ / usb_dev.sampling_hz(UsbDevAudio::SPEAKER);
+
+    // sample clock and PWM, stopped until ring set up
+    gen_tim_3->cr1   = GenTim_2_3_4::Cr1::ARPE          ;
+    gen_tim_3->psc   = 0                                ;
+    gen_tim_3->arr   = period - 1                       ;
+    gen_tim_3->ccr1  = period / 2                       ;
+    gen_tim_3->ccmr1 =   GenTim_2_3_4::Ccmr1::OC1M_PWM_MODE_1
+                       | GenTim_2_3_4::Ccmr1::OC1PE     ;
+    gen_tim_3->ccer  = GenTim_2_3_4::Ccer::CC1E         ;
+    gen_tim_3->cr2   = GenTim_2_3_4::Cr2::MMS_UPDATE    ;
+    gen_tim_3->egr   = GenTim_2_3_4::Egr::UG            ;
+    gen_tim_3->sr    = 0                                ;
+    gen_tim_3->dier  = GenTim_2_3_4::Dier::UDE          ;
+
+    // sample counter, clocked by TIM3 update
+    gen_tim_2->cr1   = 0                                ;
+    gen_tim_2->arr   = 0xffff                           ;
+    gen_tim_2->smcr  =   GenTim_2_3_4::Smcr::TS_INT_2
+                       | GenTim_2_3_4::Smcr::SMS_EXT_1  ;
+    gen_tim_2->cnt   = 0                                ;
+    gen_tim_2->cr1   = GenTim_2_3_4::Cr1::CEN           ;
+
+    usb_dev.pwm_range    (period                                         );
+    usb_dev.speaker_init (dma1_channel3, &gen_tim_3->ccr1, &gen_tim_2->cnt);
+    usb_dev.rate_callback(rate_changed, 0                                );
+
+    gen_tim_3->cr1 |= GenTim_2_3_4::Cr1::CEN;
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+    usb_dev.register_recv_callback(UsbDevAudio::recv_callback    ,
+                                   UsbDevAudio::SPEAKER_ENDPOINT ,
+                                   &usb_dev                      );
+    usb_dev.register_send_callback(UsbDevAudio::send_callback    ,
+                                   UsbDevAudio::FEEDBACK_ENDPOINT,
+                                   &usb_dev                      );
+#endif
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    // audio_poll() every pass, for feedback measurement's frame timing
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        usb_dev.audio_poll();
+    }
+}
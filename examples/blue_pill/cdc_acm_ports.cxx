@@ -0,0 +1,116 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+// Echo data received on each port of UsbDevCdcAcmPorts composite device
+//   back to the same port, prefixed with port number, e.g. "1: hello".
+//   Each port appears as separate /dev/ttyACMn, COMn, etc. on host.
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_cdc_acm_multi.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+UsbDevCdcAcmPorts   usb_dev;
+
+// +2 for "n:" prefix, even for UsbDev::recv() 16-bit PMA copies
+uint8_t             buffer[(UsbDevCdcAcmPorts::DATA_SIZE + 2 + 1) & ~0x1];
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        if (usb_dev.device_state() != UsbDev::DeviceState::CONFIGURED)
+            continue;
+
+        for (uint8_t port = 0 ; port < UsbDevCdcAcmPorts::PORTS ; ++port) {
+            uint8_t     endpoint = UsbDevCdcAcmPorts::data_endpoint(port);
+
+            // receive only when can echo, else OUT endpoint NAKs host
+            if (!usb_dev.send_ready(1 << endpoint))
+                continue;
+
+            uint16_t    length;
+            if ((length = usb_dev.recv(endpoint, buffer + 2)) == 0)
+                continue;
+
+            buffer[0] = '0' + port;
+            buffer[1] = ':'       ;
+            length   += 2         ;
+
+            // split if prefix made it too long for one packet
+            if (length > UsbDevCdcAcmPorts::DATA_SIZE) {
+                usb_dev.send(endpoint, buffer, UsbDevCdcAcmPorts::DATA_SIZE);
+                while (!usb_dev.send(endpoint                                ,
+                                     buffer + UsbDevCdcAcmPorts::DATA_SIZE,
+                                     length - UsbDevCdcAcmPorts::DATA_SIZE))
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+                    usb_dev.poll();
+#else
+                    ;
+#endif
+            }
+            else
+                usb_dev.send(endpoint, buffer, length);
+        }
+
+        usb_dev.serial_state_poll();
+    }
+}
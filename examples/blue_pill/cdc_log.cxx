@@ -0,0 +1,102 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+// Binary deferred-format logging (UsbLog) over CDC-ACM. Decode on host
+//   with examples/linux/usb_log_decode, e.g.:
+//       usb_log_decode usb_cdc_log.elf /dev/ttyACM0
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_cdc_acm.hxx>
+#include <usb_log.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+UsbDevCdcAcm    usb_dev;
+UsbLog          usb_log(usb_dev, UsbDevCdcAcm::CDC_ENDPOINT_IN);
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    USB_LOG(usb_log, "cdc_log started");
+
+    uint32_t    count  = 0     ;
+    uint16_t    period = 0xffff;
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        usb_log.poll();
+
+        if (usb_dev.device_state() != UsbDev::DeviceState::CONFIGURED)
+            continue;
+
+        // one record per 100 USB frames (ms)
+        if (usb_dev.frame_number() / 100 == period)
+            continue;
+        period = usb_dev.frame_number() / 100;
+
+        USB_LOG(usb_log,
+                "count %6u  frame 0x%03x  ratio %8.3f  dropped %u",
+                count,
+                usb_dev.frame_number(),
+                count / 3.0f,
+                usb_log.dropped());
+        ++count;
+    }
+}
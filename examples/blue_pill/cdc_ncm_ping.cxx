@@ -0,0 +1,212 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+// Minimal "IP stack" on UsbDevCdcNcm frame queue interface: answers ARP
+//   requests and ICMP echo requests (ping) for DEVICE_IP. On Linux host:
+//       ip addr add 192.168.7.1/24 dev usb0  # or enx0200005c4e01, etc.
+//       ip link set usb0 up
+//       ping -f 192.168.7.2
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_cdc_ncm.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+UsbDevCdcNcm    usb_dev;
+
+static const uint8_t    DEVICE_MAC[6] = {0x02, 0x00, 0x00, 0x5c, 0x4e, 0x02},
+                        DEVICE_IP [4] = {192, 168, 7, 2};
+
+static const uint16_t   ETH_HEADER_SIZE = 14,
+                        ETH_TYPE_ARP    = 0x0806,
+                        ETH_TYPE_IPV4   = 0x0800,
+                        ARP_SIZE        = 28,
+                        IPV4_MIN_SIZE   = 20,
+                        ICMP_MIN_SIZE   =  8;
+
+static const uint8_t    IP_PROTO_ICMP   = 1,
+                        ICMP_ECHO_REPLY = 0,
+                        ICMP_ECHO       = 8;
+
+
+
+static uint16_t get16(
+const uint8_t   *bytes)
+{
+    return (bytes[0] << 8) | bytes[1];  // network byte order
+}
+
+static void copy(
+      uint8_t   *dst   ,
+const uint8_t   *src   ,
+const uint16_t   length)
+{
+    for (uint16_t ndx = 0 ; ndx < length ; ++ndx)
+        dst[ndx] = src[ndx];
+}
+
+static bool equal(
+const uint8_t   *one   ,
+const uint8_t   *two   ,
+const uint16_t   length)
+{
+    for (uint16_t ndx = 0 ; ndx < length ; ++ndx)
+        if (one[ndx] != two[ndx])
+            return false;
+    return true;
+}
+
+
+
+// Build reply to "frame" in "reply", return its length or 0 if none
+static uint16_t respond(
+const uint8_t   *frame ,
+const uint16_t   length,
+      uint8_t   *reply )
+{
+    if (length < ETH_HEADER_SIZE)
+        return 0;
+
+    const uint8_t   *payload = frame + ETH_HEADER_SIZE;
+    uint16_t         type    = get16(frame + 12)      ;
+
+    if (   type == ETH_TYPE_ARP
+        && length >= ETH_HEADER_SIZE + ARP_SIZE
+        && get16(payload + 6) == 1                  // request
+        && equal(payload + 24, DEVICE_IP, 4)) {     // target IP
+        copy(reply, frame, ETH_HEADER_SIZE + ARP_SIZE);
+
+        copy(reply     , frame + 6 , 6);            // to sender
+        copy(reply +  6, DEVICE_MAC, 6);
+
+        uint8_t     *arp = reply + ETH_HEADER_SIZE;
+        arp[7] = 2;                                 // reply
+        copy(arp + 18, payload +  8, 10);           // target = sender
+        copy(arp +  8, DEVICE_MAC  ,  6);           // sender = us
+        copy(arp + 14, DEVICE_IP   ,  4);
+
+        return ETH_HEADER_SIZE + ARP_SIZE;
+    }
+
+    if (   type == ETH_TYPE_IPV4
+        && length >= ETH_HEADER_SIZE + IPV4_MIN_SIZE + ICMP_MIN_SIZE) {
+        uint16_t    header_size = (payload[0] & 0x0f) * 4,
+                    total_size  = get16(payload + 2)     ;
+
+        if (   payload[9] != IP_PROTO_ICMP
+            || !equal(payload + 16, DEVICE_IP, 4)
+            || total_size + ETH_HEADER_SIZE > length
+            || total_size < header_size + ICMP_MIN_SIZE
+            || payload[header_size] != ICMP_ECHO)
+            return 0;
+
+        uint16_t    reply_length = ETH_HEADER_SIZE + total_size;
+
+        copy(reply     , frame + 6 , 6);
+        copy(reply +  6, DEVICE_MAC, 6);
+        copy(reply + 12, frame + 12, reply_length - 12);
+
+        // swapping addresses leaves IP header checksum unchanged
+        uint8_t     *ip = reply + ETH_HEADER_SIZE;
+        copy(ip + 12, payload + 16, 4);
+        copy(ip + 16, payload + 12, 4);
+
+        // ICMP type 8 -> 0: adjust one's complement checksum
+        uint8_t     *icmp     = ip + header_size;
+        uint32_t     checksum = get16(icmp + 2) + (ICMP_ECHO << 8);
+
+        icmp[0] = ICMP_ECHO_REPLY                          ;
+        checksum = (checksum & 0xffff) + (checksum >> 16)  ;
+        icmp[2] = checksum >> 8                            ;
+        icmp[3] = checksum & 0xff                          ;
+
+        return reply_length;
+    }
+
+    return 0;
+
+}  // respond()
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        usb_dev.ntb_poll();
+
+        if (!usb_dev.link_up())
+            continue;
+
+        const uint8_t   *frame;
+        uint16_t         length;
+
+        // replies are aggregated into IN NTBs with other replies, and
+        //   sent by ntb_poll() when IN endpoint free
+        while ((frame = usb_dev.recv_frame(length)) != 0) {
+            uint8_t     *reply = usb_dev.send_frame_buffer(length);
+
+            if (!reply)
+                break;  // IN NTBs full, drop like any network would
+
+            if ((length = respond(frame, length, reply)) != 0)
+                usb_dev.send_frame_commit(length);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+
+// Echo received data back to host via UsbCdcStream, one small write()
+//   per byte plus a line-count prefix per line -- the chatty pattern
+//   which would otherwise send almost-empty packets.
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <bin_to_hex.hxx>
+
+#include <usb_dev_cdc_acm.hxx>
+#include <usb_cdc_stream.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+UsbDevCdcAcm    usb_dev;
+UsbCdcStream    cdc_stream(usb_dev);
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    uint16_t    line_count = 0   ;
+    bool        line_start = true;
+    char        prefix[7]        ;  // "cccc: "
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        if (usb_dev.device_state() != UsbDev::DeviceState::CONFIGURED)
+            continue;
+
+        cdc_stream.poll();
+
+        uint8_t     byte;
+        while (   cdc_stream.writable() >= sizeof(prefix)
+               && cdc_stream.read(&byte, 1)             ) {
+            if (line_start) {
+                bitops::BinToHex::uint16(line_count++, prefix);
+                prefix[4] = ':';
+                prefix[5] = ' ';
+                prefix[6] = '\0';
+                cdc_stream.write(prefix);
+            }
+
+            cdc_stream.write(&byte, 1);
+
+            line_start = byte == '\n';
+        }
+    }
+}
@@ -0,0 +1,133 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// UsbDevDfu bootloader: downloads application (linked to run at
+//   UsbDevDfu::APP_ADDRESS) into flash, e.g:
+//
+//       dfu-util -a 0 -s 0x08004000:leave -D application.bin
+//
+//   and then starts it. This program must fit in flash below APP_ADDRESS
+//   (16 KB by default).
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_dfu.hxx>
+#include <usb_dfu_flash.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   SRAM_BASE   = 0x20000000,
+                        SRAM_END    = SRAM_BASE + 20 * 1024,
+                        VTOR        = 0xe000ed08;  // SCB vector table offset
+
+static const uint16_t   START_DELAY = 50;  // ms, for final GETSTATUS
+
+UsbDevDfu   usb_dev;
+
+static volatile uint32_t    app_address = 0;
+static          uint16_t    app_frame   = 0;
+
+
+
+static void manifested(
+const uint32_t   address  ,
+      void      *          )
+{
+    app_address = address               ;
+    app_frame   = UsbDev::frame_number();
+}
+
+
+
+static void start_application()
+{
+    const uint32_t  *vectors = reinterpret_cast<const uint32_t*>(app_address);
+
+    // stack pointer must be in RAM, else not valid application
+    if (vectors[0] <= SRAM_BASE || vectors[0] > SRAM_END) {
+        app_address = 0;
+        return;
+    }
+
+    *reinterpret_cast<volatile uint32_t*>(VTOR) = app_address;
+
+#ifdef __ARM_ARCH
+    asm volatile("msr msp, %0" : : "r" (vectors[0]));
+#endif
+
+    reinterpret_cast<void (*)()>(vectors[1])();
+
+}  // start_application()
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    usb_dev.flash(UsbDfuFlash::flash());
+    usb_dev.manifest_callback(manifested, 0);
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        usb_dev.dfu_poll();
+
+        if (   app_address
+            && ((UsbDev::frame_number() - app_frame) & 0x7ff) > START_DELAY)
+            start_application();
+    }
+}
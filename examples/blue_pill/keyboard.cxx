@@ -0,0 +1,175 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// UsbDevHidKeyboard 4x4 key matrix keypad with media keys, scanned by
+//   TIM3 and DMA (UsbKeyMatrix):
+//   PA0-PA3    columns (open-drain)
+//   PB12-PB15  rows (pull-up), diode per key for full N-key rollover
+// User LED shows host's Caps Lock state.
+//
+//      7      8      9      vol+
+//      4      5      6      vol-
+//      1      2      3      mute
+//      shift  0      enter  caps
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_hid_keyboard.hxx>
+#include <usb_key_matrix.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   TIM3_HZ    = 72000000;  // usb_mcu_init(), PPRE1_DIV_1
+
+static const uint8_t    NUM_COLUMNS = 4,
+                        NUM_ROWS    = 4,
+                        FIRST_ROW   = 12;
+
+static const uint8_t    COLUMN_PINS[NUM_COLUMNS] = {0, 1, 2, 3};
+
+static const uint16_t   CONSUMER    = 0x8000,  // keymap flag
+                        KEYMAP[NUM_ROWS][NUM_COLUMNS] = {
+                            {0x24, 0x25, 0x26, CONSUMER | 0xe9},
+                            {0x21, 0x22, 0x23, CONSUMER | 0xea},
+                            {0x1e, 0x1f, 0x20, CONSUMER | 0xe2},
+                            {0xe1, 0x27, 0x28,            0x39},
+                        };
+
+
+UsbDevHidKeyboard               usb_dev;
+
+UsbKeyMatrix<NUM_COLUMNS>       key_matrix(gpioa                  ,
+                                           COLUMN_PINS            ,
+                                           gpiob                  ,
+                                           0xf << FIRST_ROW       ,
+                                           gen_tim_3              ,
+                                           dma1_channel3          ,  // TIM3_UP
+                                           dma1_channel6          ,  // TIM3_CH1
+                                           TIM3_HZ                );
+
+
+
+static void key_changed(
+const uint8_t    column   ,
+const uint8_t    row      ,
+const bool       pressed  ,
+      void      *          )
+{
+    uint16_t    usage = KEYMAP[row - FIRST_ROW][column];
+
+    if (usage & CONSUMER)
+        usb_dev.consumer(pressed ? usage & ~CONSUMER : 0);
+    else if (pressed)
+        usb_dev.key_down(usage);
+    else
+        usb_dev.key_up(usage);
+}
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    rcc->ahbenr  |= Rcc::Ahbenr ::DMA1EN;
+    rcc->apb1enr |= Rcc::Apb1enr::TIM3EN;
+    rcc->apb2enr |= Rcc::Apb2enr::IOPBEN;
+
+    gpioa->crl.ins(  Gpio::Crl::CNF0_OUTPUT_OPEN_DRAIN
+                   | Gpio::Crl::MODE0_OUTPUT_2_MHZ
+                   | Gpio::Crl::CNF1_OUTPUT_OPEN_DRAIN
+                   | Gpio::Crl::MODE1_OUTPUT_2_MHZ
+                   | Gpio::Crl::CNF2_OUTPUT_OPEN_DRAIN
+                   | Gpio::Crl::MODE2_OUTPUT_2_MHZ
+                   | Gpio::Crl::CNF3_OUTPUT_OPEN_DRAIN
+                   | Gpio::Crl::MODE3_OUTPUT_2_MHZ      );
+
+    gpiob->crh.ins(  Gpio::Crh::CNF12_INPUT_PULL_UP_DOWN
+                   | Gpio::Crh::MODE12_INPUT
+                   | Gpio::Crh::CNF13_INPUT_PULL_UP_DOWN
+                   | Gpio::Crh::MODE13_INPUT
+                   | Gpio::Crh::CNF14_INPUT_PULL_UP_DOWN
+                   | Gpio::Crh::MODE14_INPUT
+                   | Gpio::Crh::CNF15_INPUT_PULL_UP_DOWN
+                   | Gpio::Crh::MODE15_INPUT             );
+    gpiob->bsrr = 0xf << FIRST_ROW;  // pull-ups
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+    usb_dev.register_send_callback(UsbDevHidKeyboard::send_callback   ,
+                                   UsbDevHidKeyboard::BOOT_ENDPOINT_IN,
+                                   &usb_dev                           );
+    usb_dev.register_send_callback(UsbDevHidKeyboard::send_callback   ,
+                                   UsbDevHidKeyboard::NKRO_ENDPOINT_IN,
+                                   &usb_dev                           );
+#endif
+
+    key_matrix.key_callback(key_changed, 0);
+    key_matrix.init();
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        // 4 columns * 20 us: new samples every 80 us
+        key_matrix.scan(UsbDev::frame_number());
+
+        usb_dev.hid_poll();  // also for host's SET_IDLE rate
+
+        if (usb_dev.leds() & UsbDevHidKeyboard::LED_CAPS_LOCK)
+            gpioc->bsrr = Gpio::Bsrr::BR13;  // set low  to turn on  user LED
+        else
+            gpioc->bsrr = Gpio::Bsrr::BS13;  // set high to turn off user LED
+    }
+}
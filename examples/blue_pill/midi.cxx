@@ -58,6 +58,44 @@ extern "C" void USB_LP_CAN1_RX0_IRQHandler()
 
 
 
+// Echo events received from host, and send queued ones when due
+static void service()
+{
+    UsbDevMidi::EventPacket     event;
+
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+    usb_dev.poll();
+#endif
+
+    while (usb_dev.recv_event(event))
+        if (!usb_dev.send_event(event))
+            break;  // dropped, queue full
+
+    usb_dev.midi_poll();
+}
+
+
+
+static void send_event(
+const UsbDevMidi::EventPacket   &event)
+{
+    while (!usb_dev.send_event(event))
+        service();
+}
+
+
+
+static void wait(
+const uint64_t  ticks)
+{
+    sys_tick_timer.begin64();
+
+    while (sys_tick_timer.elapsed64() < ticks)
+        service();
+}
+
+
+
 int main()
 {
     usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
@@ -94,50 +132,26 @@ int main()
     static const uint8_t        MIDI_NOTES[] = {60, 62, 64, 65, 67, 69, 71, 72},
                             NUM_MIDI_NOTES   = sizeof(MIDI_NOTES)              ;
 
-    uint8_t                             midi_note_ndx = 0;
-    volatile UsbDevMidi::EventPacket    packet           ;
+    uint8_t     midi_note_ndx = 0;
 
     while (true) {
-        packet.populate(0,
-                        UsbDevMidi::EventPacket::NOTE_ON,
-                        MIDI_NOTE_ON | MIDI_CHANNEL    ,
-                        MIDI_NOTES[midi_note_ndx]      ,
-                        MIDI_VELOCITY                   );
-
-        while (!usb_dev.send(usb_dev.BULK_IN_ENDPOINT           ,
-                             static_cast<const uint8_t*>(packet),
-                             sizeof                     (packet)))
-#ifdef USB_DEV_INTERRUPT_DRIVEN
-            asm("wfi")    ;
-#else
-            usb_dev.poll();
-#endif
-
-        gpioc->bsrr = Gpio::Bsrr::BR13           ;  // low to turn on user LED
-        sys_tick_timer.delay64(MIDI_NOTE_ON_TIME);
-
-        sys_tick_timer.begin64();
-
-        packet.populate(0,
-                        UsbDevMidi::EventPacket::NOTE_OFF,
-                        MIDI_NOTE_OFF | MIDI_CHANNEL     ,
-                        MIDI_NOTES[midi_note_ndx]        ,
-                        MIDI_VELOCITY                    );
-
-        while (!usb_dev.send(usb_dev.BULK_IN_ENDPOINT           ,
-                             static_cast<const uint8_t*>(packet),
-                             sizeof                     (packet))) {
-#ifdef USB_DEV_INTERRUPT_DRIVEN
-            asm("wfi")    ;
-#else
-            usb_dev.poll();
-#endif
-            sys_tick_timer.update64();
-        }
-
-        gpioc->bsrr = Gpio::Bsrr::BS13;   // set high to turn off LED
-        while (sys_tick_timer.elapsed64() < MIDI_NOTE_OFF_TIME)
-            asm("nop");
+        send_event(UsbDevMidi::EventPacket(MIDI_CABLE                     ,
+                                           UsbDevMidi::EventPacket::NOTE_ON,
+                                           MIDI_NOTE_ON | MIDI_CHANNEL    ,
+                                           MIDI_NOTES[midi_note_ndx]      ,
+                                           MIDI_VELOCITY                  ));
+
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // low to turn on user LED
+        wait(MIDI_NOTE_ON_TIME);
+
+        send_event(UsbDevMidi::EventPacket(MIDI_CABLE                      ,
+                                           UsbDevMidi::EventPacket::NOTE_OFF,
+                                           MIDI_NOTE_OFF | MIDI_CHANNEL     ,
+                                           MIDI_NOTES[midi_note_ndx]        ,
+                                           MIDI_VELOCITY                    ));
+
+        gpioc->bsrr = Gpio::Bsrr::BS13;  // set high to turn off LED
+        wait(MIDI_NOTE_OFF_TIME);
 
         if (++midi_note_ndx >= NUM_MIDI_NOTES)
               midi_note_ndx = 0;
@@ -0,0 +1,120 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// USB-MIDI to DIN MIDI interface on USART1, cable 0
+//   PA9  USART1 TX  (to DIN OUT via 220 ohm resistors)
+//   PA10 USART1 RX  (from DIN IN optocoupler)
+// with latency/jitter statistics (read with examples/linux/midi_timing)
+//   and host-to-DIN events released at a fixed delay
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_midi.hxx>
+#include <usb_midi_timing.hxx>
+#include <usb_midi_uart.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   CPU_HZ          = 72000000,
+                        APB2_HZ         = 72000000;  // usb_mcu_init(), PPRE2_DIV_1
+static const uint16_t   OUTPUT_DELAY_US =     2000;  // 0 for unscheduled
+
+
+UsbDevMidi          usb_dev;
+
+UsbMidiTiming       midi_timing   (CPU_HZ     );
+UsbMidiScheduler    midi_scheduler(midi_timing);
+
+UsbMidiUart         midi_uart(usb_dev      ,
+                              usart1       ,
+                              dma1_channel4,   // USART1_TX
+                              dma1_channel5,   // USART1_RX
+                              APB2_HZ      );
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    rcc->ahbenr  |= Rcc::Ahbenr ::DMA1EN  ;
+    rcc->apb2enr |= Rcc::Apb2enr::USART1EN;
+
+    // TX alternate function push-pull, RX floating input
+    gpioa->crh.ins(  Gpio::Crh::CNF9_ALTFUNC_PUSH_PULL
+                   | Gpio::Crh::MODE9_OUTPUT_50_MHZ
+                   | Gpio::Crh::CNF10_INPUT_FLOATING
+                   | Gpio::Crh::MODE10_INPUT          );
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+    UsbMidiTiming::init();
+    midi_timing.output_delay(OUTPUT_DELAY_US);
+    usb_dev.timing(&midi_timing);
+    if (OUTPUT_DELAY_US)
+        usb_dev.scheduler(&midi_scheduler);
+
+    midi_uart.init();
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    // no wfi if interrupt driven: DIN input arrives by DMA, without
+    //   interrupts
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        if (usb_dev.device_state() == UsbDev::DeviceState::CONFIGURED) {
+            midi_uart.poll   ();
+            usb_dev.midi_poll();
+        }
+    }
+}
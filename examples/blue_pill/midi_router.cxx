@@ -0,0 +1,143 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// Two-cable USB-MIDI interface with two DIN MIDI ports and a merge
+//   (build with USB_DEV_MIDI_CABLES=2)
+//   PA9  USART1 TX  DIN OUT 1
+//   PA10 USART1 RX  DIN IN  1
+//   PA2  USART2 TX  DIN OUT 2
+//   PA3  USART2 RX  DIN IN  2
+// Routes:
+//   cable 0  -> DIN OUT 1
+//   cable 1  -> DIN OUT 2
+//   DIN IN 1 -> cable 0, and DIN OUT 2 (merged with cable 1)
+//   DIN IN 2 -> cable 1
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_midi.hxx>
+#include <usb_midi_router.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   APB1_HZ = 72000000,  // usb_mcu_init(), PPRE1_DIV_1
+                        APB2_HZ = 72000000;  // usb_mcu_init(), PPRE2_DIV_1
+
+
+typedef UsbMidiRouter<2>    MidiRouter;
+
+static_assert(MidiRouter::NUM_CABLES == 2, "USB_DEV_MIDI_CABLES != 2");
+
+
+UsbDevMidi      usb_dev;
+
+UsbMidiUart     din_1(usb_dev      ,
+                      usart1       ,
+                      dma1_channel4,   // USART1_TX
+                      dma1_channel5,   // USART1_RX
+                      APB2_HZ      ),
+                din_2(usb_dev      ,
+                      usart2       ,
+                      dma1_channel7,   // USART2_TX
+                      dma1_channel6,   // USART2_RX
+                      APB1_HZ      );
+
+UsbMidiUart* const  dins[] = {&din_1, &din_2};
+
+MidiRouter      router(usb_dev, dins);
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    rcc->ahbenr  |= Rcc::Ahbenr ::DMA1EN  ;
+    rcc->apb2enr |= Rcc::Apb2enr::USART1EN;
+    rcc->apb1enr |= Rcc::Apb1enr::USART2EN;
+
+    // TX alternate function push-pull, RX floating input
+    gpioa->crh.ins(  Gpio::Crh::CNF9_ALTFUNC_PUSH_PULL
+                   | Gpio::Crh::MODE9_OUTPUT_50_MHZ
+                   | Gpio::Crh::CNF10_INPUT_FLOATING
+                   | Gpio::Crh::MODE10_INPUT          );
+    gpioa->crl.ins(  Gpio::Crl::CNF2_ALTFUNC_PUSH_PULL
+                   | Gpio::Crl::MODE2_OUTPUT_50_MHZ
+                   | Gpio::Crl::CNF3_INPUT_FLOATING
+                   | Gpio::Crl::MODE3_INPUT           );
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+    din_1.init();
+    din_2.init();
+
+    router.route(MidiRouter::usb_port (0),
+                 MidiRouter::port_mask(MidiRouter::uart_port(0)));
+    router.route(MidiRouter::usb_port (1),
+                 MidiRouter::port_mask(MidiRouter::uart_port(1)));
+    router.route(MidiRouter::uart_port(0),
+                   MidiRouter::port_mask(MidiRouter::usb_port (0))
+                 | MidiRouter::port_mask(MidiRouter::uart_port(1)));
+    router.route(MidiRouter::uart_port(1),
+                 MidiRouter::port_mask(MidiRouter::usb_port (1)));
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        if (usb_dev.device_state() == UsbDev::DeviceState::CONFIGURED) {
+            router .poll     ();
+            usb_dev.midi_poll();
+        }
+    }
+}
@@ -86,27 +86,25 @@ int main()
     gpioc->bsrr = Gpio::Bsrr::BS13;  // set high to turn off user LED
 
     static const uint8_t    MAX_DIR  = 12,
-                            MAX_STEP =  8,
-                            X_NDX    =  1,
-                            Y_NDX    =  2;
+                            MAX_STEP =  8;
 
     static const int8_t
         X_DIRS    [MAX_DIR] = { 0, -1, -1, -1, -1,  0,  0,  1,  1,  1,  1,  0},
         Y_DIRS    [MAX_DIR] = { 1,  1,  0,  0, -1, -1, -1, -1,  0,  0,  1,  1};
 
-    static uint8_t  hid_report[4] = { 0, 0, 0, 0};
-
     uint8_t     dir  = MAX_DIR  - 1,
                 step = MAX_STEP - 1;
 
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+    usb_dev.register_send_callback(UsbDevHidMouse::send_callback,
+                                   usb_dev.MOUSE_ENDPOINT_IN    ,
+                                   &usb_dev                     );
+#endif
+
     while (true) {
 
         if (++step == MAX_STEP) {
             if (++dir == MAX_DIR) dir = 0;
-
-            hid_report[X_NDX] = X_DIRS[dir];
-            hid_report[Y_NDX] = Y_DIRS[dir];
-
             step = 0;
         }
 
@@ -117,17 +115,15 @@ int main()
 
         sys_tick_timer.begin32();
 
-        while (!usb_dev.send(usb_dev.MOUSE_ENDPOINT_IN,
-                             hid_report               ,
-                             sizeof(hid_report)       ))
-#ifdef USB_DEV_INTERRUPT_DRIVEN
-            asm("wfi")    ;
-#else
+        // accumulated, sent at next host poll without waiting
+        usb_dev.move(X_DIRS[dir], Y_DIRS[dir]);
+
+        while (sys_tick_timer.elapsed32() < TICKS_PER_MOVE) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
             usb_dev.poll();
 #endif
-
-        while (sys_tick_timer.elapsed32() < TICKS_PER_MOVE)
-            asm("nop");
+            usb_dev.hid_poll();  // also for host's SET_IDLE rate
+        }
     }
 
 }  // main()
@@ -0,0 +1,154 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// UsbDevMsc USB drive backed by RAM disk, pre-formatted as tiny FAT12
+//   filesystem containing README.TXT. Host can mount, read, and write it
+//   (contents lost at reset).
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_msc.hxx>
+#include <usb_msc_ram_disk.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   NUM_BLOCKS = 24;  // 12 KB of 20 KB RAM
+
+UsbDevMsc                   usb_dev;
+UsbMscRamDisk<NUM_BLOCKS>   ram_disk;
+
+// FAT12: boot sector, one 1-sector FAT, one 1-sector (16 entry) root
+//   directory, then data clusters of 1 sector each starting at cluster 2
+static const uint32_t   FAT_LBA  = 1,
+                        ROOT_LBA = 2,
+                        DATA_LBA = 3;
+
+static const char       README[] =  "papoon_usb UsbDevMsc RAM disk\r\n";
+
+
+
+static void put16(
+      uint8_t   *bytes,
+const uint16_t   value)
+{
+    bytes[0] = value & 0xff;
+    bytes[1] = value >> 8  ;
+}
+
+static void copy(
+      uint8_t   *dst   ,
+const char      *src   ,
+const uint16_t   length)
+{
+    for (uint16_t ndx = 0 ; ndx < length ; ++ndx)
+        dst[ndx] = src[ndx];
+}
+
+
+
+static void format()
+{
+    uint8_t     *boot = ram_disk.block(0);
+
+    copy(boot, "\xeb\x3c\x90" "MSDOS5.0", 11);  // jump, OEM name
+    put16(boot + 11, UsbDevMsc::BLOCK_SIZE);    // bytes per sector
+    boot[13] = 1;                               // sectors per cluster
+    put16(boot + 14, FAT_LBA);                  // reserved sectors
+    boot[16] = 1;                               // number of FATs
+    put16(boot + 17, 16);                       // root directory entries
+    put16(boot + 19, NUM_BLOCKS);               // total sectors
+    boot[21] = 0xf8;                            // media descriptor: fixed
+    put16(boot + 22, 1);                        // sectors per FAT
+    put16(boot + 24, 1);                        // sectors per track
+    put16(boot + 26, 1);                        // heads
+    boot[36] = 0x80;                            // drive number
+    boot[38] = 0x29;                            // extended boot signature
+    copy(boot + 39, "\x55\x53\x42\x31", 4);     // volume serial number
+    copy(boot + 43, "PAPOON USB FAT12   ", 19); // volume label, FS type
+    boot[510] = 0x55;
+    boot[511] = 0xaa;
+
+    // clusters 0 and 1 reserved, 2 (README.TXT) end-of-chain
+    copy(ram_disk.block(FAT_LBA), "\xf8\xff\xff\xff\x0f", 5);
+
+    uint8_t     *root = ram_disk.block(ROOT_LBA);
+
+    copy(root, "PAPOON USB ", 11);  // volume label entry
+    root[11] = 0x08;
+
+    copy(root + 32, "README  TXT", 11);
+    put16(root + 32 + 26, DATA_LBA - 1);        // first cluster: 2
+    put16(root + 32 + 28, sizeof(README) - 1);  // file size
+
+    copy(ram_disk.block(DATA_LBA), README, sizeof(README) - 1);
+
+}  // format()
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    format();
+    usb_dev.block_device(ram_disk.block_device());
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    while (true) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+        usb_dev.poll();
+#endif
+        usb_dev.msc_poll();
+    }
+}
@@ -0,0 +1,124 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+
+// USB CDC-ACM virtual COM port to USART1 bridge
+//   PA9  USART1 TX
+//   PA10 USART1 RX
+// Baud rate, data bits, parity, and stop bits set by host (e.g. stty)
+
+
+#include <stdint.h>
+
+#include <core_cm3.hxx>
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_cdc_acm.hxx>
+#include <usb_usart_bridge.hxx>
+
+#include <usb_mcu_init.hxx>
+
+
+using namespace stm32f103xb;
+using namespace stm32f10_12357_xx;
+
+
+static const uint32_t   APB2_HZ = 72000000;  // usb_mcu_init(), PPRE2_DIV_1
+
+
+UsbDevCdcAcm    usb_dev;
+
+UsbUsartBridge  usart_bridge(usb_dev      ,
+                             usart1       ,
+                             dma1_channel4,   // USART1_TX
+                             dma1_channel5,   // USART1_RX
+                             APB2_HZ      );
+
+
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+extern "C" void USB_LP_CAN1_RX0_IRQHandler()
+{
+    usb_dev.interrupt_handler();
+}
+#endif
+
+extern "C" void USART1_IRQHandler()
+{
+    usart_bridge.usart_irq();
+}
+
+extern "C" void DMA1_Channel4_IRQHandler()
+{
+    usart_bridge.tx_dma_irq();
+}
+
+extern "C" void DMA1_Channel5_IRQHandler()
+{
+    usart_bridge.rx_dma_irq();
+}
+
+
+
+int main()
+{
+    usb_dev.serial_number_init();  // do before mcu_init() clock speed breaks
+
+    usb_mcu_init ();
+    usb_gpio_init();
+
+    rcc->ahbenr  |= Rcc::Ahbenr ::DMA1EN  ;
+    rcc->apb2enr |= Rcc::Apb2enr::USART1EN;
+
+    // TX alternate function push-pull, RX floating input
+    gpioa->crh.ins(  Gpio::Crh::CNF9_ALTFUNC_PUSH_PULL
+                   | Gpio::Crh::MODE9_OUTPUT_50_MHZ
+                   | Gpio::Crh::CNF10_INPUT_FLOATING
+                   | Gpio::Crh::MODE10_INPUT          );
+
+    gpioc->bsrr = Gpio::Bsrr::BS13;  // turn off user LED by setting high
+
+    if (!usb_dev.init())
+    {
+        gpioc->bsrr = Gpio::Bsrr::BR13;  // turn on user LED by setting low
+        while (true)    // hang
+            asm("nop");
+    }
+
+    usart_bridge.init();
+
+    arm::nvic->iser.set(arm::NvicIrqn::USART1       );
+    arm::nvic->iser.set(arm::NvicIrqn::DMA1_Channel4);
+    arm::nvic->iser.set(arm::NvicIrqn::DMA1_Channel5);
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    arm::nvic->iser.set(arm::NvicIrqn::USB_LP_CAN1_RX0);
+#endif
+
+    while (true) {
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+        asm("wfi");
+#else
+        usb_dev.poll();
+#endif
+        if (usb_dev.device_state() == UsbDev::DeviceState::CONFIGURED)
+            usart_bridge.poll();
+    }
+}
@@ -0,0 +1,188 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// Host-side round-trip latency benchmark for UsbDevHidRaw
+//   (usb/usb_dev_hid_raw.hxx) running examples/blue_pill/hid_raw.cxx
+//   message echo, via Linux hidraw (no libusb or driver needed).
+//
+// Usage: hid_raw_latency [<hidraw device> [<count> [<in flight>]]]
+//
+// Sends <count> (default 10000) messages, each with a request ID (8 bit
+//   sequence number) and payload, keeping up to <in flight> (default 1)
+//   outstanding, and matches echoed responses by ID. Prints round-trip
+//   time percentiles and message throughput.
+
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+
+namespace {
+
+static const char* const    DEFAULT_HIDRAW = "/dev/hidraw0";
+
+static const unsigned       REPORT_SIZE    = 64,  // usb_dev_hid_raw.hxx
+                            HEADER_SIZE    =  2,
+                            PAYLOAD_SIZE   = REPORT_SIZE - HEADER_SIZE,
+                            MAX_IN_FLIGHT  = 255;  // 8 bit request IDs
+
+
+double now_us()
+{
+    struct timespec     time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+
+
+double percentile(
+const std::vector<double>   &sorted ,
+const unsigned               percent)
+{
+    return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+}  // namespace
+
+
+
+int main(
+int      argc  ,
+char    *argv[])
+{
+    const char  *device    = argc > 1 ? argv[1]                  : DEFAULT_HIDRAW;
+    unsigned     count     = argc > 2 ? strtoul(argv[2], 0, 0)   : 10000         ,
+                 in_flight = argc > 3 ? strtoul(argv[3], 0, 0)   :     1         ;
+
+    if (count == 0 || in_flight == 0 || in_flight > MAX_IN_FLIGHT) {
+        std::cerr << "Usage: "
+                  << argv[0]
+                  << " [<hidraw device> (default "
+                  << DEFAULT_HIDRAW
+                  << ") [<count> [<in flight> (1 to "
+                  << MAX_IN_FLIGHT
+                  << ")]]]"
+                  << std::endl;
+        return 1;
+    }
+
+    int     fd = open(device, O_RDWR);
+
+    if (fd == -1) {
+        std::cerr << "Can't open " << device << std::endl;
+        return 1;
+    }
+
+    std::vector<double>     rtts         ;
+    double                  sent_at[256] ;
+    bool                    waiting[256] = {false};
+    uint8_t                 report[1 + REPORT_SIZE];  // report ID 0 prefix
+    unsigned                num_sent     = 0,
+                            num_waiting  = 0,
+                            num_bad      = 0;
+
+    rtts.reserve(count);
+
+    double  start = now_us();
+
+    while (rtts.size() + num_bad < count) {
+        while (num_sent < count && num_waiting < in_flight) {
+            uint8_t     id = num_sent % 256;
+
+            report[0] = 0;  // no report IDs
+            report[1] = id;
+            report[2] = PAYLOAD_SIZE;
+            for (unsigned ndx = 0 ; ndx < PAYLOAD_SIZE ; ++ndx)
+                report[1 + HEADER_SIZE + ndx] = id + ndx;
+
+            sent_at[id] = now_us();
+            if (write(fd, report, sizeof(report)) != sizeof(report)) {
+                std::cerr << "Write to " << device << " failed" << std::endl;
+                return 1;
+            }
+            waiting[id] = true;
+            ++num_sent   ;
+            ++num_waiting;
+        }
+
+        // hidraw reads return report without ID prefix if no report IDs
+        if (read(fd, report, REPORT_SIZE) != REPORT_SIZE) {
+            std::cerr << "Read from " << device << " failed" << std::endl;
+            return 1;
+        }
+
+        double      received = now_us();
+        uint8_t     id       = report[0];
+
+        if (!waiting[id]) {
+            std::cerr << "Unexpected response ID " << +id << std::endl;
+            continue;
+        }
+
+        waiting[id] = false;
+        --num_waiting;
+
+        bool    good = report[1] == PAYLOAD_SIZE;
+        for (unsigned ndx = 0 ; good && ndx < PAYLOAD_SIZE ; ++ndx)
+            good = report[HEADER_SIZE + ndx] == static_cast<uint8_t>(id + ndx);
+
+        if (good)
+            rtts.push_back(received - sent_at[id]);
+        else
+            ++num_bad;
+    }
+
+    double  elapsed = now_us() - start;
+
+    close(fd);
+
+    if (rtts.empty()) {
+        std::cerr << "No good responses" << std::endl;
+        return 1;
+    }
+
+    std::sort(rtts.begin(), rtts.end());
+
+    std::cout << std::fixed << std::setprecision(1)
+              << count      << " messages, "
+              << in_flight  << " in flight, "
+              << num_bad    << " bad"                                << std::endl
+              << "RTT us: p50 " << percentile(rtts, 50)
+              <<        "  p90 " << percentile(rtts, 90)
+              <<        "  p99 " << percentile(rtts, 99)
+              <<        "  max " << rtts.back()                      << std::endl
+              << "throughput: "  << count / (elapsed / 1e6) << " msgs/s, "
+              << count * REPORT_SIZE / elapsed * 1e6 / 1024 << " KB/s each way"
+              << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,262 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// Prints UsbDevMidi latency and jitter histograms (UsbMidiTiming::Report,
+//   see usb_midi_timing.hxx) read with vendor control request. Device
+//   stays bound to the kernel's snd-usb-audio driver, no interface is
+//   claimed.
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <iomanip>
+
+#include <libusb.h>
+
+
+namespace {
+static const uint16_t   VENDOR        = 0x0483,     // usb_dev_midi.cxx
+                        PRODUCT       = 0x5710,     //        "
+                        MAX_REPORT    = 4096  ;
+
+static const uint8_t    REQUEST_TYPE_VENDOR_DEVICE_IN  = 0xc0,
+                        REQUEST_TYPE_VENDOR_DEVICE_OUT = 0x40,
+                        VENDOR_REQ_GET_TIMING          = 0x01,  // usb_dev_midi.hxx
+                        VENDOR_REQ_RESET_TIMING        = 0x02;  //        "
+
+static const unsigned   TIMEOUT = 1000;  // milliseconds
+
+static const char* const    DIRECTION_NAMES[] = {"IN  (device to host)",
+                                                 "OUT (host to device)"};
+
+static const uint8_t    REPORT_HEADER_SIZE = 12;  // through reserved
+
+
+
+uint32_t little_endian(
+const uint8_t   *bytes,
+const uint8_t    size )
+{
+    uint32_t    value = 0;
+
+    for (uint8_t ndx = size ; ndx-- ; )
+        value = (value << 8) | bytes[ndx];
+
+    return value;
+}
+
+
+
+void print_histogram(
+const char          *title  ,
+const uint8_t       *counts ,  // little-endian uint32_t
+const uint8_t        bins   ,
+const uint16_t       bin_us )
+{
+    std::cout << "  " << title << std::endl;
+
+    for (uint8_t bin = 0 ; bin < bins ; ++bin) {
+        uint32_t    count = little_endian(counts + bin * 4, 4);
+
+        std::cout << "    "
+                  << std::setw(6)
+                  << bin * bin_us;
+
+        if (bin == bins - 1)
+            std::cout << " and over";  // last bin counts all longer times
+        else
+            std::cout << " - "
+                      << std::setw(6)
+                      << (bin + 1) * bin_us;
+
+        std::cout << " us: "
+                  << std::setw(10)
+                  << count
+                  << std::endl;
+    }
+}
+
+
+
+int print_report(
+libusb_device_handle    *device_handle)
+{
+    uint8_t     report[MAX_REPORT];
+    int         length = libusb_control_transfer(device_handle                ,
+                                                 REQUEST_TYPE_VENDOR_DEVICE_IN,
+                                                 VENDOR_REQ_GET_TIMING        ,
+                                                 0                            ,
+                                                 0                            ,
+                                                 report                       ,
+                                                 sizeof(report)               ,
+                                                 TIMEOUT                      );
+
+    if (length < 0) {
+        std::cerr << "libusb_control_transfer(VENDOR_REQ_GET_TIMING) failure: "
+                  << libusb_strerror(static_cast<libusb_error>(length))
+                  << '('
+                  << length
+                  << ')'
+                  << std::endl;
+        return length;
+    }
+
+    if (length < REPORT_HEADER_SIZE) {
+        std::cerr << "short timing report: " << length << " bytes" << std::endl;
+        return 1;
+    }
+
+    uint32_t    cycles_per_us   = little_endian(report     , 4);
+    uint16_t    bin_us          = little_endian(report +  4, 2),
+                output_delay_us = little_endian(report +  6, 2);
+    uint8_t     bins            =               report[   8]   ,
+                directions      =               report[   9]   ;
+
+    // events, max_latency, latency histograms, jitter histograms
+    const uint8_t   *events      = report + REPORT_HEADER_SIZE       ,
+                    *max_latency = events      + directions * 4       ,
+                    *latency     = max_latency + directions * 4       ,
+                    *jitter      = latency     + directions * bins * 4;
+
+    if (length < jitter + directions * bins * 4 - report) {
+        std::cerr << "short timing report: " << length << " bytes" << std::endl;
+        return 1;
+    }
+
+    std::cout << "clock "
+              << cycles_per_us
+              << " MHz, output delay "
+              << output_delay_us
+              << " us"
+              << (output_delay_us ? "" : " (unscheduled)")
+              << std::endl;
+
+    for (uint8_t direction = 0 ; direction < directions ; ++direction) {
+        std::cout << (direction < 2 ? DIRECTION_NAMES[direction] : "?")
+                  << ": "
+                  << little_endian(events      + direction * 4, 4)
+                  << " events, max latency "
+                  << little_endian(max_latency + direction * 4, 4)
+                  << " us"
+                  << std::endl;
+
+        print_histogram("latency",
+                        latency + direction * bins * 4,
+                        bins,
+                        bin_us);
+        print_histogram("jitter (latency change between events)",
+                        jitter  + direction * bins * 4,
+                        bins,
+                        bin_us);
+    }
+
+    return 0;
+
+}  // print_report()
+
+}  // namespace
+
+
+
+
+int main(
+int      argc  ,
+char    *argv[])
+{
+    bool        reset   = false  ;
+    uint8_t     vp_ndx  = 1      ;
+    uint16_t    vendor  = VENDOR ,
+                product = PRODUCT;
+
+    if (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-r")) {
+            std::cerr << "Usage: "
+                      << argv[0]
+                      << " [-r] [vid pid]\n"
+                      << "-r        reset histograms after printing\n"
+                      << "vid pid   vendor id, product id"
+                      << std::endl;
+            return 1;
+        }
+        reset  = true;
+        vp_ndx = 2   ;
+    }
+
+    if (argc == vp_ndx + 2) {
+        vendor  = strtol(argv[vp_ndx    ], 0, 16);
+        product = strtol(argv[vp_ndx + 1], 0, 16);
+    }
+
+    int                      error        ;
+    libusb_device_handle    *device_handle;
+
+    if ((error = libusb_init(0)) != static_cast<int>(LIBUSB_SUCCESS)) {
+        std::cerr << "libusb_init() failure: "
+                  << libusb_strerror(static_cast<libusb_error>(error))
+                  << '('
+                  << error
+                  << ')'
+                  << std::endl;
+        return error;
+    }
+
+    if (!(device_handle = libusb_open_device_with_vid_pid(0, vendor, product))){
+        std::cerr << "libusb_open_device_with_vid_pid(0, "
+                  << std::hex
+                  << std::setw(4)
+                  << std::setfill('0')
+                  << vendor
+                  << ", "
+                  << product
+                  << ") failure"
+                  << std::endl;
+        return 1;
+    }
+
+    if (!(error = print_report(device_handle)) && reset) {
+        error = libusb_control_transfer(device_handle                 ,
+                                        REQUEST_TYPE_VENDOR_DEVICE_OUT,
+                                        VENDOR_REQ_RESET_TIMING       ,
+                                        0                             ,
+                                        0                             ,
+                                        0                             ,
+                                        0                             ,
+                                        TIMEOUT                       );
+        if (error < 0)
+            std::cerr << "libusb_control_transfer(VENDOR_REQ_RESET_TIMING) "
+                         "failure: "
+                      << libusb_strerror(static_cast<libusb_error>(error))
+                      << '('
+                      << error
+                      << ')'
+                      << std::endl;
+        else
+            error = 0;
+    }
+
+    libusb_close(device_handle);
+    libusb_exit (0            );
+
+    return error;
+
+}  // main()
@@ -112,8 +112,8 @@ char    *argv[])
 
     if (argv[1][1] == 'm') {
         use_many       = true;
-        max_in_packet  = 16  ;  // see usb_dev_max_endpts.hxx
-        max_out_packet = 16  ;  //  "          "         . "
+        max_in_packet  = 22  ;  // see usb_dev_max_endpts.hxx
+        max_out_packet = 22  ;  //  "          "         . "
         pended         =  9  ;  // prepended "e cccc+ " + appended '\n'
         vp_ndx         =  2  ;
     }
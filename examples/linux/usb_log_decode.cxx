@@ -0,0 +1,259 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+// Host-side decoder for UsbLog (usb/usb_log.hxx) binary log records.
+//
+// Usage: usb_log_decode <device ELF file> [<tty or file>]
+//
+// Reads format strings from the device application's "usb_log_formats"
+//   ELF section, then reads records (little-endian 32-bit words) from the
+//   tty (default /dev/ttyACM0) or file ("-" for stdin) and prints them,
+//   one line per record.
+
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+static const char* const    DEFAULT_DEV_TTY = "/dev/ttyACM0"   ,
+                   * const  SECTION_NAME    = "usb_log_formats";
+
+static const uint32_t       HEADER_VALID    = 0x80,  // usb_log.hxx
+                            NUM_ARGS_MASK   = 0x0f;
+
+
+// Contents of named section, empty if none
+template<typename EHDR, typename SHDR> std::string elf_section(
+const std::vector<char>     &elf ,
+const char* const            name)
+{
+    const EHDR  *ehdr = reinterpret_cast<const EHDR*>(elf.data());
+
+    if (   ehdr->e_shoff + ehdr->e_shnum * sizeof(SHDR) > elf.size()
+        || ehdr->e_shstrndx >= ehdr->e_shnum                        )
+        return std::string();
+
+    const SHDR  *shdrs  = reinterpret_cast<const SHDR*>(  elf.data()
+                                                        + ehdr->e_shoff),
+                *strtab = shdrs + ehdr->e_shstrndx                     ;
+
+    for (unsigned ndx = 0 ; ndx < ehdr->e_shnum ; ++ndx)
+        if (   strcmp(elf.data() + strtab->sh_offset + shdrs[ndx].sh_name,
+                      name                                               )
+               == 0
+            && shdrs[ndx].sh_offset + shdrs[ndx].sh_size <= elf.size())
+            return std::string(elf.data() + shdrs[ndx].sh_offset,
+                               shdrs[ndx].sh_size              );
+
+    return std::string();
+}
+
+
+
+// Expand one printf-style conversion ("spec", e.g. "%-8.3f") of "arg"
+std::string convert(
+const std::string   &spec,
+const uint32_t       arg )
+{
+    char        buffer[128]               ,
+                conversion = spec.back()  ;
+    std::string format                    ;
+
+    // drop length modifiers, args are always 32-bit words
+    for (char chr : spec)
+        if (!strchr("hlLqjzt", chr))
+            format += chr;
+
+    switch (conversion) {
+        case 'd': case 'i': case 'c':
+            snprintf(buffer, sizeof(buffer), format.c_str(),
+                     static_cast<int32_t>(arg));
+            break;
+
+        case 'u': case 'x': case 'X': case 'o':
+            snprintf(buffer, sizeof(buffer), format.c_str(), arg);
+            break;
+
+        case 'p':
+            snprintf(buffer, sizeof(buffer), "0x%08x", arg);
+            break;
+
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A': {
+            float   value;
+            memcpy(&value, &arg, sizeof(value));
+            snprintf(buffer, sizeof(buffer), format.c_str(),
+                     static_cast<double>(value));
+            break;
+        }
+
+        default:
+            return spec;  // unsupported, e.g. %s
+    }
+
+    return buffer;
+}
+
+
+
+std::string expand(
+const char* const    format  ,
+const uint32_t      *args    ,
+const unsigned       num_args)
+{
+    std::string     result    ;
+    unsigned        arg    = 0;
+
+    for (const char *chr = format ; *chr ; ++chr) {
+        if (*chr != '%') {
+            result += *chr;
+            continue;
+        }
+
+        if (*(chr + 1) == '%') {
+            result += '%';
+            ++chr;
+            continue;
+        }
+
+        std::string     spec(1, '%');
+        while (*++chr && !strchr("diucxXopfFeEgGaAs", *chr))
+            spec += *chr;
+        if (!*chr)
+            break;
+        spec += *chr;
+
+        result += arg < num_args ? convert(spec, args[arg++]) : "<?>";
+    }
+
+    return result;
+}
+
+}  // namespace
+
+
+
+int main(
+int      argc  ,
+char    *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: "
+                  << argv[0]
+                  << " <device ELF file> [<tty or file> (default "
+                  << DEFAULT_DEV_TTY
+                  << ")]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::ifstream       elf_file(argv[1], std::ios::binary);
+    std::vector<char>   elf((std::istreambuf_iterator<char>(elf_file)),
+                             std::istreambuf_iterator<char>()         );
+    std::string         strings;
+
+    if (elf.size() >= sizeof(Elf64_Ehdr) && memcmp(elf.data(), ELFMAG, SELFMAG) == 0)
+        strings =    elf[EI_CLASS] == ELFCLASS64
+                  ?  elf_section<Elf64_Ehdr, Elf64_Shdr>(elf, SECTION_NAME)
+                  :  elf_section<Elf32_Ehdr, Elf32_Shdr>(elf, SECTION_NAME);
+
+    if (strings.empty()) {
+        std::cerr << "No \""
+                  << SECTION_NAME
+                  << "\" section in "
+                  << argv[1]
+                  << std::endl;
+        return 1;
+    }
+
+    const char  *input = argc > 2 ? argv[2] : DEFAULT_DEV_TTY;
+    int          fd;
+
+    if (strcmp(input, "-") == 0)
+        fd = 0;
+    else if ((fd = open(input, O_RDONLY | O_NOCTTY)) == -1) {
+        std::cerr << "Can't open " << input << std::endl;
+        return 1;
+    }
+
+    if (isatty(fd)) {
+        struct termios  term_modes;
+        tcgetattr(fd, &term_modes);
+        cfmakeraw(&term_modes);
+        tcsetattr(fd, TCSANOW, &term_modes);
+    }
+
+    uint8_t     bytes[256];
+    uint32_t    record[1 + NUM_ARGS_MASK];
+    unsigned    num_bytes  = 0,  // of current word
+                num_words  = 0,  //  "     "    record
+                record_len = 0;
+    uint32_t    word       = 0;
+    ssize_t     length;
+
+    while ((length = read(fd, bytes, sizeof(bytes))) > 0) {
+        for (ssize_t ndx = 0 ; ndx < length ; ++ndx) {
+            word |= bytes[ndx] << (8 * num_bytes);
+            if (++num_bytes < 4)
+                continue;
+
+            record[num_words++] = word;
+            num_bytes = 0;
+            word      = 0;
+
+            if (num_words == 1) {
+                uint32_t    offset = record[0] >> 8;
+
+                if (!(record[0] & HEADER_VALID) || offset >= strings.size()) {
+                    std::cout << "<bad header 0x"
+                              << std::hex << record[0] << std::dec
+                              << ">" << std::endl;
+                    num_words = 0;
+                    continue;
+                }
+
+                record_len = 1 + (record[0] & NUM_ARGS_MASK);
+            }
+
+            if (num_words == record_len) {
+                std::cout << expand(strings.c_str() + (record[0] >> 8),
+                                    record + 1                      ,
+                                    record_len - 1                  )
+                          << std::endl;
+                num_words = 0;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -35,7 +35,7 @@
 #endif
 
 #define STM32F103XB_MAJOR_VERSION   1
-#define STM32F103XB_MINOR_VERSION   2
+#define STM32F103XB_MINOR_VERSION   3
 #define STM32F103XB_MICRO_VERSION   0
 
 
@@ -2560,6 +2560,176 @@ struct Spi {
 static_assert(sizeof(Spi) == 32, "sizeof(Spi) != 32");
 
 
+struct Usart {
+    struct Sr {
+        using              pos_t = Pos<uint32_t, Sr>;
+        static constexpr   pos_t
+                  PE_POS = pos_t( 0),
+                  FE_POS = pos_t( 1),
+                  NE_POS = pos_t( 2),
+                 ORE_POS = pos_t( 3),
+                IDLE_POS = pos_t( 4),
+                RXNE_POS = pos_t( 5),
+                  TC_POS = pos_t( 6),
+                 TXE_POS = pos_t( 7),
+                 LBD_POS = pos_t( 8),
+                 CTS_POS = pos_t( 9);
+
+        using              bits_t = Bits<uint32_t, Sr>;
+        static constexpr   bits_t
+        PE               = bits_t(1,           PE_POS),
+        FE               = bits_t(1,           FE_POS),
+        NE               = bits_t(1,           NE_POS),
+        ORE              = bits_t(1,          ORE_POS),
+        IDLE             = bits_t(1,         IDLE_POS),
+        RXNE             = bits_t(1,         RXNE_POS),
+        TC               = bits_t(1,           TC_POS),
+        TXE              = bits_t(1,          TXE_POS),
+        LBD              = bits_t(1,          LBD_POS),
+        CTS              = bits_t(1,          CTS_POS);
+    };  // struct Sr
+    using sr_t = Reg<uint32_t, Sr>;
+          sr_t   sr;
+
+
+                uint16_t    dr;
+    private:    uint16_t    _dr_high_bits;   public:
+
+
+                uint16_t    brr;    // mantissa<<4 | fraction == f_PCLK / baud
+    private:    uint16_t    _brr_high_bits;  public:
+
+
+    struct Cr1 {
+        using              pos_t = Pos<uint32_t, Cr1>;
+        static constexpr   pos_t
+                 SBK_POS = pos_t( 0),
+                 RWU_POS = pos_t( 1),
+                  RE_POS = pos_t( 2),
+                  TE_POS = pos_t( 3),
+              IDLEIE_POS = pos_t( 4),
+              RXNEIE_POS = pos_t( 5),
+                TCIE_POS = pos_t( 6),
+               TXEIE_POS = pos_t( 7),
+                PEIE_POS = pos_t( 8),
+                  PS_POS = pos_t( 9),
+                 PCE_POS = pos_t(10),
+                WAKE_POS = pos_t(11),
+                   M_POS = pos_t(12),
+                  UE_POS = pos_t(13);
+
+        using              bits_t = Bits<uint32_t, Cr1>;
+        static constexpr   bits_t
+        SBK              = bits_t(1,          SBK_POS),
+        RWU              = bits_t(1,          RWU_POS),
+        RE               = bits_t(1,           RE_POS),
+        TE               = bits_t(1,           TE_POS),
+        IDLEIE           = bits_t(1,       IDLEIE_POS),
+        RXNEIE           = bits_t(1,       RXNEIE_POS),
+        TCIE             = bits_t(1,         TCIE_POS),
+        TXEIE            = bits_t(1,        TXEIE_POS),
+        PEIE             = bits_t(1,         PEIE_POS),
+        PS               = bits_t(1,           PS_POS),
+        PS_EVEN          = bits_t(0,           PS_POS),
+        PS_ODD           = bits_t(1,           PS_POS),
+        PCE              = bits_t(1,          PCE_POS),
+        WAKE             = bits_t(1,         WAKE_POS),
+        M                = bits_t(1,            M_POS),
+        M_8_BITS         = bits_t(0,            M_POS),
+        M_9_BITS         = bits_t(1,            M_POS),
+        UE               = bits_t(1,           UE_POS);
+    };  // struct Cr1
+    using cr1_t = Reg<uint32_t, Cr1>;
+          cr1_t   cr1;
+
+
+    struct Cr2 {
+        using              pos_t = Pos<uint32_t, Cr2>;
+        static constexpr   pos_t
+                 ADD_POS = pos_t( 0),
+                LBDL_POS = pos_t( 5),
+               LBDIE_POS = pos_t( 6),
+                LBCL_POS = pos_t( 8),
+                CPHA_POS = pos_t( 9),
+                CPOL_POS = pos_t(10),
+               CLKEN_POS = pos_t(11),
+                STOP_POS = pos_t(12),
+               LINEN_POS = pos_t(14);
+
+        using              bits_t = Bits<uint32_t, Cr2>;
+        static constexpr   bits_t
+        LBDL             = bits_t(1,         LBDL_POS),
+        LBDIE            = bits_t(1,        LBDIE_POS),
+        LBCL             = bits_t(1,         LBCL_POS),
+        CPHA             = bits_t(1,         CPHA_POS),
+        CPOL             = bits_t(1,         CPOL_POS),
+        CLKEN            = bits_t(1,        CLKEN_POS),
+        LINEN            = bits_t(1,        LINEN_POS);
+
+        static const uint32_t
+                ADD_MASK =       0xfU,
+               STOP_MASK =       0x3U;
+
+        using              mskd_t = Mskd<uint32_t, Cr2>;
+        using              shft_t = Shft<uint32_t, Cr2>;
+
+        REGBITS_MSKD_RANGE("Usart::Cr2::Add",
+                           ADD,
+                           add,
+                           ADD_MASK,
+                           ADD_POS,
+                           ADD_MASK);
+
+        static constexpr   mskd_t
+        STOP_1_BIT       = mskd_t(       STOP_MASK,  0b00,         STOP_POS),
+        STOP_0_5_BIT     = mskd_t(       STOP_MASK,  0b01,         STOP_POS),
+        STOP_2_BITS      = mskd_t(       STOP_MASK,  0b10,         STOP_POS),
+        STOP_1_5_BITS    = mskd_t(       STOP_MASK,  0b11,         STOP_POS);
+    };  // struct Cr2
+    using cr2_t = Reg<uint32_t, Cr2>;
+          cr2_t   cr2;
+
+
+    struct Cr3 {
+        using              pos_t = Pos<uint32_t, Cr3>;
+        static constexpr   pos_t
+                 EIE_POS = pos_t( 0),
+                IREN_POS = pos_t( 1),
+                IRLP_POS = pos_t( 2),
+               HDSEL_POS = pos_t( 3),
+                NACK_POS = pos_t( 4),
+                SCEN_POS = pos_t( 5),
+                DMAR_POS = pos_t( 6),
+                DMAT_POS = pos_t( 7),
+                RTSE_POS = pos_t( 8),
+                CTSE_POS = pos_t( 9),
+               CTSIE_POS = pos_t(10);
+
+        using              bits_t = Bits<uint32_t, Cr3>;
+        static constexpr   bits_t
+        EIE              = bits_t(1,          EIE_POS),
+        IREN             = bits_t(1,         IREN_POS),
+        IRLP             = bits_t(1,         IRLP_POS),
+        HDSEL            = bits_t(1,        HDSEL_POS),
+        NACK             = bits_t(1,         NACK_POS),
+        SCEN             = bits_t(1,         SCEN_POS),
+        DMAR             = bits_t(1,         DMAR_POS),
+        DMAT             = bits_t(1,         DMAT_POS),
+        RTSE             = bits_t(1,         RTSE_POS),
+        CTSE             = bits_t(1,         CTSE_POS),
+        CTSIE            = bits_t(1,        CTSIE_POS);
+    };  // struct Cr3
+    using cr3_t = Reg<uint32_t, Cr3>;
+          cr3_t   cr3;
+
+
+                uint16_t    gtpr;
+    private:    uint16_t    _gtpr_high_bits; public:
+
+};  // struct Usart
+static_assert(sizeof(Usart) == 28, "sizeof(Usart) != 28");
+
+
 
 struct ElecSig {
                 uint16_t    flash_size;
@@ -2839,6 +3009,10 @@ STM32F103XB_PERIPH( Usb,                usb,            USB_BASE          );
 STM32F103XB_PERIPH( Spi,                spi1,           SPI1_BASE         );
 STM32F103XB_PERIPH( Spi,                spi2,           SPI2_BASE         );
 
+STM32F103XB_PERIPH( Usart,              usart1,         USART1_BASE       );
+STM32F103XB_PERIPH( Usart,              usart2,         USART2_BASE       );
+STM32F103XB_PERIPH( Usart,              usart3,         USART3_BASE       );
+
 STM32F103XB_PERIPH( ElecSig,            elec_sig,       ELEC_SIG_BASE     );
 
 STM32F103XB_PERIPH( Flash,              flash,          FLASH_BASE        );
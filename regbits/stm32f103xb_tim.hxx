@@ -177,14 +177,14 @@
         SMS_TRIGGER      = mskd_t(        SMS_MASK,  0x00006,       SMS_POS),
         SMS_EXT_1        = mskd_t(        SMS_MASK,  0x00007,       SMS_POS),
         SMS_RST_TRIG     = mskd_t(        SMS_MASK,  0x10000,       SMS_POS),
-        TS_INT_0         = mskd_t(         TS_MASK,  0xb000,         TS_POS),
-        TS_INT_1         = mskd_t(         TS_MASK,  0xb001,         TS_POS),
-        TS_INT_2         = mskd_t(         TS_MASK,  0xb010,         TS_POS),
-        TS_INT_3         = mskd_t(         TS_MASK,  0xb011,         TS_POS),
-        TS_TI1_EDGE      = mskd_t(         TS_MASK,  0xb100,         TS_POS),
-        TS_FILT_1        = mskd_t(         TS_MASK,  0xb101,         TS_POS),
-        TS_FILT_2        = mskd_t(         TS_MASK,  0xb110,         TS_POS),
-        TS_EXT           = mskd_t(         TS_MASK,  0xb111,         TS_POS),
+        TS_INT_0         = mskd_t(         TS_MASK,  0b000,          TS_POS),
+        TS_INT_1         = mskd_t(         TS_MASK,  0b001,          TS_POS),
+        TS_INT_2         = mskd_t(         TS_MASK,  0b010,          TS_POS),
+        TS_INT_3         = mskd_t(         TS_MASK,  0b011,          TS_POS),
+        TS_TI1_EDGE      = mskd_t(         TS_MASK,  0b100,          TS_POS),
+        TS_FILT_1        = mskd_t(         TS_MASK,  0b101,          TS_POS),
+        TS_FILT_2        = mskd_t(         TS_MASK,  0b110,          TS_POS),
+        TS_EXT           = mskd_t(         TS_MASK,  0b111,          TS_POS),
         ETF_0_NONE       = mskd_t(        ETF_MASK,  0b0000,        ETF_POS),
         ETF_0_INT_N2     = mskd_t(        ETF_MASK,  0b0001,        ETF_POS),
         ETF_0_INT_N4     = mskd_t(        ETF_MASK,  0b0010,        ETF_POS),
@@ -392,7 +392,8 @@
         OC1M_CH1_INACT   = mskd_t(       OC1M_MASK,  0x0002,          OC1M_POS),
         OC1M_TOGGLE      = mskd_t(       OC1M_MASK,  0x0003,          OC1M_POS),
         OC1M_FORCE_LOW   = mskd_t(       OC1M_MASK,  0x0004,          OC1M_POS),
-        OC1M_FORCE_HIGH  = mskd_t(       OC1M_MASK,  0x0006,          OC1M_POS),
+        OC1M_FORCE_HIGH  = mskd_t(       OC1M_MASK,  0x0005,          OC1M_POS),
+        OC1M_PWM_MODE_1  = mskd_t(       OC1M_MASK,  0x0006,          OC1M_POS),
         OC1M_PWM_MODE_2  = mskd_t(       OC1M_MASK,  0x0007,          OC1M_POS),
         OC1M_RETRIG_1    = mskd_t(       OC1M_MASK,  0x1000,          OC1M_POS),
         OC1M_RETRIG_2    = mskd_t(       OC1M_MASK,  0x1001,          OC1M_POS),
@@ -490,7 +491,8 @@
         OC3M_CH1_INACT   = mskd_t(       OC3M_MASK,  0x0002,          OC3M_POS),
         OC3M_TOGGLE      = mskd_t(       OC3M_MASK,  0x0003,          OC3M_POS),
         OC3M_FORCE_LOW   = mskd_t(       OC3M_MASK,  0x0004,          OC3M_POS),
-        OC3M_FORCE_HIGH  = mskd_t(       OC3M_MASK,  0x0006,          OC3M_POS),
+        OC3M_FORCE_HIGH  = mskd_t(       OC3M_MASK,  0x0005,          OC3M_POS),
+        OC3M_PWM_MODE_1  = mskd_t(       OC3M_MASK,  0x0006,          OC3M_POS),
         OC3M_PWM_MODE_2  = mskd_t(       OC3M_MASK,  0x0007,          OC3M_POS),
         OC3M_RETRIG_1    = mskd_t(       OC3M_MASK,  0x1000,          OC3M_POS),
         OC3M_RETRIG_2    = mskd_t(       OC3M_MASK,  0x1001,          OC3M_POS),
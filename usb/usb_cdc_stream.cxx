@@ -0,0 +1,184 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+
+#include <usb_cdc_stream.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+using namespace stm32f103xb;
+
+
+void UsbCdcStream::arm()
+{
+    if (!_armed) {
+        _deadline_frame = UsbDev::frame_number();
+        _armed          = true                  ;
+    }
+}
+
+
+
+uint16_t UsbCdcStream::write(
+const uint8_t   *data  ,
+const uint16_t   length)
+{
+    uint16_t    written = 0;
+
+    switch (_policy) {
+        case Policy::DROP_OLDEST:
+            if (length > TX_SIZE) {
+                // only newest TX_SIZE bytes can be kept
+                _counters.dropped_oldest += length - TX_SIZE;
+                written                   = length - TX_SIZE;
+            }
+            if (length - written > _tx.space())
+                _counters.dropped_oldest += _tx.skip(  length - written
+                                                     - _tx.space()    );
+            written += _tx.write(data + written, length - written);
+            break;  // counted as written, all now accepted
+
+        case Policy::BLOCK:
+            written = _tx.write(data, length);
+            if (written < length && open()) {
+                ++_counters.blocked;
+                while (written < length && open()) {
+#ifndef USB_DEV_INTERRUPT_DRIVEN
+                    _usb_dev.poll();
+#endif
+                    poll();
+                    written += _tx.write(data + written, length - written);
+                }
+            }
+            break;
+
+        case Policy::SPILL:
+            unspill();
+            if (_spill.empty())  // else must queue behind spilled data
+                written = _tx.write(data, length);
+            if (written < length) {
+                uint16_t    spilled = _spill.write(data   + written,
+                                                   length - written);
+                _counters.spilled += spilled;
+                written           += spilled;
+            }
+            break;
+
+        case Policy::DROP_NEWEST:
+            written = _tx.write(data, length);
+            break;
+    }
+
+    _counters.dropped_newest += length - written;
+
+    if (written)
+        arm();
+
+    return written;
+
+}  // write(const uint8_t*, const uint16_t)
+
+
+
+uint16_t UsbCdcStream::write(
+const char  *string)
+{
+    uint16_t    length = 0;
+
+    while (string[length])
+        ++length;
+
+    return write(reinterpret_cast<const uint8_t*>(string), length);
+}
+
+
+
+void UsbCdcStream::unspill()
+{
+    uint16_t    length;
+
+    while (   !_spill.empty()
+           && (length = _tx.space()) != 0) {
+        if (length > sizeof(_packet))
+            length = sizeof(_packet);
+
+        length = _spill.read(_packet, length);
+        _tx.write(_packet, length);
+    }
+}
+
+
+
+bool UsbCdcStream::deadline_passed()
+const
+{
+    return    _armed
+           &&   ((UsbDev::frame_number() - _deadline_frame) & Usb::Fnr::FN_MASK)
+              >= _flush_ms;
+}
+
+
+
+void UsbCdcStream::poll()
+{
+    // host to device, only if room for full packet
+    if (_rx.space() >= UsbDevCdcAcm::CDC_OUT_DATA_SIZE)
+        _rx.write(_packet, _usb_dev.recv(UsbDevCdcAcm::CDC_ENDPOINT_OUT,
+                                         _packet                       ));
+
+    unspill();
+
+    // device to host, nothing while port closed (data held per _policy)
+    if (   !open()
+        || !(_usb_dev.send_readys() & (1 << UsbDevCdcAcm::CDC_ENDPOINT_IN)))
+        return;
+
+    uint16_t    pending = _tx.size();
+    bool        due     = _flush || deadline_passed();
+
+    if (pending >= UsbDevCdcAcm::CDC_IN_DATA_SIZE || (pending && due)) {
+        uint16_t    length = _tx.read(_packet, UsbDevCdcAcm::CDC_IN_DATA_SIZE);
+
+        _usb_dev.send(UsbDevCdcAcm::CDC_ENDPOINT_IN, _packet, length);
+
+        _zlp = length == UsbDevCdcAcm::CDC_IN_DATA_SIZE;
+
+        if (_tx.empty() && !_zlp) {
+            _armed = false;
+            _flush = false;
+        }
+        // else keep deadline: once due, send rest (or ZLP) without waiting
+    }
+
+    else if (!pending && due) {
+        if (_zlp) {
+            // terminate transfer which ended with full packet
+            _usb_dev.send(UsbDevCdcAcm::CDC_ENDPOINT_IN, _packet, 0);
+            _zlp = false;
+        }
+
+        _armed = false;
+        _flush = false;
+    }
+
+}  // poll()
+
+}  // namespace stm32f10_12357_xx
@@ -0,0 +1,191 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+
+#ifndef USB_CDC_STREAM_HXX
+#define USB_CDC_STREAM_HXX
+
+// RAM ring sizes, bytes, must be powers of 2
+#ifndef USB_CDC_STREAM_TX_SIZE
+#define USB_CDC_STREAM_TX_SIZE  512
+#endif
+#ifndef USB_CDC_STREAM_RX_SIZE
+#define USB_CDC_STREAM_RX_SIZE  256
+#endif
+
+#include <ring_buffer.hxx>
+
+#include <usb_dev_cdc_acm.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Byte-stream API on UsbDevCdcAcm CDC_ENDPOINT_IN/CDC_ENDPOINT_OUT.
+//
+// write() only copies into a RAM ring. poll() sends full bulk packets
+//   whenever the IN endpoint is ready. Partial packets wait for a
+//   deadline, flush_ms USB frames (1 ms each) after the first write()
+//   to an idle stream, or for flush(), so many small writes are coalesced
+//   into few packets. Once due, everything pending is sent as fast as the
+//   host takes it, including a final partial packet written after the
+//   deadline, and the stream is idle again only when the ring is empty.
+//   A transfer ending with a full packet is terminated with a zero-length
+//   packet at the same deadline.
+// Received OUT packets are buffered in a second ring for read(). The
+//   OUT endpoint NAKs the host while that ring has no room for a full
+//   packet.
+//
+// Nothing is sent while the port is closed -- device not configured or
+//   host not asserting DTR (no process has the tty open). Policy() sets
+//   what write() does when the TX ring is full, because the port is
+//   closed or the host is reading slowly:
+//   DROP_NEWEST  accept what fits (default)
+//   DROP_OLDEST  discard oldest unsent data to make room, so host sees
+//                latest data after reconnect
+//   BLOCK        wait, calling poll(), while port open; as DROP_NEWEST
+//                if closed
+//   SPILL        overflow into larger client-supplied RAM ring (see
+//                spill()); as DROP_NEWEST when that is full
+//   Bytes affected are counted per policy, see counters().
+//
+// All methods, including poll(), must be called from the same context
+//   (typically main loop, after UsbDev::poll() if not
+//   USB_DEV_INTERRUPT_DRIVEN).
+//
+class UsbCdcStream {
+  public:
+    static const uint16_t   TX_SIZE = USB_CDC_STREAM_TX_SIZE,
+                            RX_SIZE = USB_CDC_STREAM_RX_SIZE;
+
+    enum class Policy {
+        DROP_NEWEST,
+        DROP_OLDEST,
+        BLOCK      ,
+        SPILL      ,
+    };
+
+    struct Counters {
+        uint32_t    dropped_newest,  // bytes not accepted by write()
+                    dropped_oldest,  // bytes discarded to make room
+                    blocked       ,  // write() calls which had to wait
+                    spilled       ;  // bytes written to spill ring
+    };
+
+    constexpr
+    UsbCdcStream(
+    UsbDevCdcAcm    &usb_dev                       ,
+    const uint8_t    flush_ms  = 2                 ,
+    const Policy     policy    = Policy::DROP_NEWEST)
+    :   _usb_dev       (usb_dev ),
+        _tx            (        ),
+        _spill         (        ),
+        _rx            (        ),
+        _packet        {0       },
+        _deadline_frame(0       ),
+        _flush_ms      (flush_ms),
+        _policy        (policy  ),
+        _counters      {0, 0, 0, 0},
+        _armed         (false   ),
+        _flush         (false   ),
+        _zlp           (false   )
+    {}
+
+    // Return number of bytes accepted/returned, possibly less than length
+    uint16_t    write(const uint8_t     *data  ,
+                      const uint16_t     length);
+    uint16_t    write(const char        *string);  // nul-terminated
+    uint16_t    read (      uint8_t     *data  ,
+                      const uint16_t     length)
+    {
+        return _rx.read(data, length);
+    }
+
+    // bytes write() will accept without dropping or blocking
+    uint16_t    writable() const
+    {
+        return   _policy == Policy::SPILL
+               ? _tx.space() + _spill.space()
+               : _tx.space()                 ;
+    }
+    uint16_t    readable() const { return _rx.size (); }
+
+    // send buffered data as soon as IN endpoint is ready
+    void        flush() { _flush = true; }
+
+    void        flush_ms(const uint8_t   flush_ms) { _flush_ms = flush_ms; }
+
+    void        policy(const Policy  policy) { _policy = policy; }
+    Policy      policy() const { return _policy; }
+
+    // Memory for SPILL policy, size rounded down to power of 2. Discards
+    //   any data already spilled.
+    void        spill(uint8_t   *buffer, const uint16_t  size)
+    {
+        _spill.buffer(buffer, size);
+    }
+
+    const Counters& counters() const { return _counters; }
+    void            clear_counters() { _counters = Counters{0, 0, 0, 0}; }
+
+    // device configured and host has port open (DTR asserted)
+    bool        open() const
+    {
+        return    _usb_dev.device_state() == UsbDev::DeviceState::CONFIGURED
+               && UsbDevCdcAcm::dtr();
+    }
+
+    // Moves data to/from USB endpoints. Call frequently.
+    void        poll();
+
+
+  protected:
+    static const uint16_t   _PACKET_SIZE
+                            =   UsbDevCdcAcm::CDC_IN_DATA_SIZE
+                              > UsbDevCdcAcm::CDC_OUT_DATA_SIZE
+                            ?   UsbDevCdcAcm::CDC_IN_DATA_SIZE
+                            :   UsbDevCdcAcm::CDC_OUT_DATA_SIZE;
+
+    bool    deadline_passed() const;
+
+    void    arm();
+
+    // moves oldest spilled data to TX ring as room allows
+    void    unspill();
+
+
+    UsbDevCdcAcm                &_usb_dev                          ;
+    bitops::RingBuffer<TX_SIZE>  _tx                               ;
+    bitops::RingBufferSpan       _spill                            ;
+    bitops::RingBuffer<RX_SIZE>  _rx                               ;
+    uint8_t                      _packet[(_PACKET_SIZE + 1) & ~0x1];
+    uint16_t                     _deadline_frame                   ;
+    uint8_t                      _flush_ms                         ;
+    Policy                       _policy                           ;
+    Counters                     _counters                         ;
+    bool                         _armed,  // _deadline_frame valid, stream
+                                          //   not idle
+                                 _flush,
+                                 _zlp  ;  // last IN packet was full size
+
+};  // class UsbCdcStream
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_CDC_STREAM_HXX
@@ -33,17 +33,10 @@ using namespace stm32f103xb;
 
 void UsbDev::serial_number_init()  // do before mcu_init() clock speed breaks
 {
-    char    serial_number[_SERIAL_NUMBER_STRING_LEN];
-
-    bitops::BinToHex::uint32(elec_sig->u_id_95_64, &serial_number[ 0]);
-    bitops::BinToHex::uint32(elec_sig->u_id_63_32, &serial_number[ 8]);
-    bitops::BinToHex::uint16(elec_sig->u_id_31_16, &serial_number[16]);
-    bitops::BinToHex::uint16(elec_sig->u_id_15_0,  &serial_number[20]);
-
-    for (uint8_t ndx = 0 ; ndx < _SERIAL_NUMBER_STRING_LEN ; ++ndx)
-        // little-endian uint16_t
-          reinterpret_cast<uint16_t*>(&_SERIAL_NUMBER_STRING_DESC[2])[ndx]
-        = serial_number[ndx];
+    _unique_id[0] =   elec_sig->u_id_95_64                                 ;
+    _unique_id[1] =   elec_sig->u_id_63_32                                 ;
+    _unique_id[2] =  (static_cast<uint32_t>(elec_sig->u_id_31_16) << 16)
+                    | elec_sig->u_id_15_0                                  ;
 }
 
 
@@ -75,47 +68,53 @@ bool UsbDev::init()
     // or modulo 32 values (32, 64, 96, ... 512)
     _pma_descs.EPRN<0>().count_rx.set_num_blocks_0(max_packet_size);
 
-    // retreive adjusted size
-    uint16_t    rx_buffer_size = _pma_descs.EPRN<0>().count_rx.num_bytes_0();
-
-    // keep PMA memory addresses aligned on 32-bit boundaries
-    rx_buffer_size = (rx_buffer_size + 3) & ~0x3;
-
     // CPU vs peripheral memory addressing
-    _pma_descs.EPRN<0>().addr_rx = (pma_addr -= rx_buffer_size);
-    _endpoints[0].recv_pma       = reinterpret_cast<uint32_t*>(
-                                                      USB_PMAADDR
-                                                    + _BTABLE_OFFSET
-                                                    + (pma_addr << 1));
+    pma_addr                    -= pma_recv_size(max_packet_size);
+    _pma_descs.EPRN<0>().addr_rx = pma_addr            ;
+    _endpoints[0].recv_pma       = pma_to_cpu(pma_addr);
     _setup_packet                = reinterpret_cast<SetupPacket*>(
-                                                      USB_PMAADDR
-                                                    + _BTABLE_OFFSET
-                                                    + (pma_addr << 1));
-
-    // use non-adjusted size, and keep PMA memory addresses aligned
-    // on 32-bit boundaries
-    max_packet_size = (max_packet_size + 3) & ~0x3;
+                                   pma_to_cpu(pma_addr));
 
-    // CPU vs peripheral memory addressing
-    _pma_descs.EPRN<0>().addr_tx = (pma_addr -= max_packet_size);
-    _endpoints[0].send_pma       = reinterpret_cast<uint32_t*>(
-                                                      USB_PMAADDR
-                                                    + _BTABLE_OFFSET
-                                                    + (pma_addr << 1));
+    pma_addr                    -= pma_send_size(max_packet_size);
+    _pma_descs.EPRN<0>().addr_tx = pma_addr            ;
+    _endpoints[0].send_pma       = pma_to_cpu(pma_addr);
 
 
     bool    success = true;   // return value
 
+    // Find interfaces with alternate settings. Their endpoints' PMA
+    //   buffers are allocated at runtime from _pma_arena (see
+    //   select_alternate()) instead of statically below.
+    _dynamic_interfaces = 0;
+    for (const uint8_t*     desc_data =   _CONFIG_DESC          ;
+                            desc_data <   _CONFIG_DESC
+                                        + config_desc_total_size();
+                            desc_data += *desc_data               ) {
+        uint8_t     interface = *(desc_data + _INTERFACE_DESC_NUMBER_NDX);
+
+        if (   *(desc_data + 1)
+            == static_cast<uint8_t>(DescriptorType::INTERFACE)
+            && *(desc_data + _INTERFACE_DESC_ALTERNATE_NDX) != 0
+            && interface < USB_DEV_MAX_INTERFACES              )
+            _dynamic_interfaces |= 1 << interface;
+    }
+
+    uint8_t     interface = NO_INTERFACE;  // of following endpoint descriptors
+
     // Parse configuration descriptor to find endpoint descriptors.
     // Assumes descriptor size ("bLength" value, first byte of descrriptor)
     //   is correct.
     // Note  _num_eprns is initialized to 1 in constructor (always have
     // control endpoint)
     //
-    for (const uint8_t*     desc_data =   _CONFIG_DESC                       ;
+    for (const uint8_t*     desc_data =   _CONFIG_DESC          ;
                             desc_data <   _CONFIG_DESC
-                                        + _CONFIG_DESC[CONFIG_DESC_SIZE_NDX] ;
+                                        + config_desc_total_size();
                                                                               ){
+        if (   *(desc_data + 1)
+            == static_cast<uint8_t>(DescriptorType::INTERFACE))
+            interface = *(desc_data + _INTERFACE_DESC_NUMBER_NDX);
+
         if (   *(desc_data + 1)
             != static_cast<uint8_t>(DescriptorType::ENDPOINT)) {
             desc_data += *desc_data;  // is length -- step to next descriptor
@@ -147,7 +146,8 @@ bool UsbDev::init()
         // endpoint_dir (okay, will just add new dir to old) or pathologically
         // (mistake in configuration descriptor, repeated endpoint+dir)
         uint8_t     eprn_ndx = _epaddr2eprn[endpoint_addr];
-        if (eprn_ndx == 0)            // is new, not-seen_before endpoint address
+        bool        new_eprn = eprn_ndx == 0;
+        if (new_eprn)                 // is new, not-seen_before endpoint address
             eprn_ndx = _num_eprns++;  // assign to next empty Usb::Eprn
         // else is either malformed redefinition of a prior endpoint
         // (accept without error) or is defining OUT for already define IN
@@ -162,41 +162,112 @@ bool UsbDev::init()
         _epaddr2eprn[endpoint_addr] = eprn_ndx   ;
         _eprn2epaddr[eprn_ndx     ] = endpoint_addr;
 
-        uint16_t    adjusted_packet_size;
+        bool        dynamic =      interface < USB_DEV_MAX_INTERFACES
+                              && (_dynamic_interfaces & (1 << interface));
+
+        if (dynamic)
+            // not supported, see constructor
+            _double_buffered &= ~(1 << endpoint_addr);
+
+        uint8_t     transfer =   *(desc_data + _ENDPOINT_DESC_ATTRIBUTES_NDX)
+                               & _ENDPOINT_ATTRS_TRANSFER_MASK              ;
+        bool        dbl_buf  = double_buffered(endpoint_addr),
+                    iso      =    transfer
+                               == static_cast<uint8_t>(
+                                  EndpointType::ISYNCHRONOUS);
+
+        // double-buffered endpoint uses both directions' buffer
+        //   descriptors, so can't share EPRN, and must be bulk
+        if (    dbl_buf
+            && (   !new_eprn
+                || transfer != static_cast<uint8_t>(EndpointType::BULK))) {
+            success = false;
+            break;
+        }
 
-        if (endpoint_dir)  // IN / send / tx
-            // keep 32-bit alignment
-            adjusted_packet_size = (max_packet_size + 3) & ~0x3;
-        else { // OUT / recv / rx
-            // converts to allowed modulo 2 or modulo 32 values
-             _pma_descs
-            .eprn(eprn_ndx)
-            .count_rx
-            .set_num_blocks_0(max_packet_size);
+        // as can't isochronous one, except for repeat of same endpoint in
+        //   other alternate setting
+        if (!new_eprn && iso != isochronous(endpoint_addr)) {
+            success = false;
+            break;
+        }
 
-            // retrieve converted value
-            adjusted_packet_size =  _pma_descs.eprn(eprn_ndx)
-                                   .count_rx
-                                   .num_bytes_0();
+        if (iso)
+            _isochronous |= 1 << endpoint_addr;
 
-            // but still ensure 32-bit alignment (might be only modulo-2)
-            adjusted_packet_size = (max_packet_size + 3) & ~0x3;
+        // both directions of an EPRN must belong to same interface if it
+        //   has alternate settings (are allocated and released together)
+        if (   !new_eprn
+            && _endpoints[eprn_ndx].interface != (dynamic ? interface
+                                                          : NO_INTERFACE)) {
+            success = false;
+            break;
         }
 
+        if (dynamic) {
+            // PMA buffers allocated in select_alternate()
+            _endpoints[eprn_ndx].interface = interface;
+            desc_data += *desc_data;
+            continue;
+        }
+
+        _endpoints[eprn_ndx].interface = NO_INTERFACE;
+
+        // tightest legal sizes: 16-bit aligned, and for OUT one of the
+        //   modulo 2 or modulo 32 count_rx values
+        uint16_t    buffer_size =   endpoint_dir
+                                  ? pma_send_size(max_packet_size)
+                                  : pma_recv_size(max_packet_size);
+
         // check for memory collision, up-growing buffer descriptors
         // vs. down-growing packet buffer memory
-        if (   _BTABLE_OFFSET + (eprn_ndx * sizeof(UsbBufDesc))
-            >= (pma_addr -= adjusted_packet_size)                    ) {
+        if (     _BTABLE_OFFSET + (eprn_ndx + 1) * _BTABLE_ENTRY_SIZE
+              +  buffer_size * (dbl_buf || iso ? 2 : 1)
+            >    pma_addr                                            ) {
             // ignore this and any further endpoint descriptors
             success = false;
             break;
         }
 
-        _endpoints[eprn_ndx].type = static_cast<DescriptorType>(
-                                              *(  desc_data
-                                            + _ENDPOINT_DESC_ATTRIBUTES_NDX));
+        pma_addr -= buffer_size;
 
-        if (endpoint_dir) {  // IN / send / tx
+        if (!endpoint_dir)
+            // converts to allowed modulo 2 or modulo 32 values
+             _pma_descs
+            .eprn(eprn_ndx)
+            .count_rx
+            .set_num_blocks_0(max_packet_size);
+
+        _endpoints[eprn_ndx].type = static_cast<DescriptorType>(transfer);
+
+        if (dbl_buf || iso) {
+            // buffer 1, ADDR_RX/COUNT_RX, allocated above
+            _pma_descs.eprn(eprn_ndx).addr_rx = pma_addr            ;
+            _endpoints     [eprn_ndx].recv_pma = pma_to_cpu(pma_addr);
+
+            // buffer 0, ADDR_TX/COUNT_TX
+            pma_addr -= buffer_size;
+            _pma_descs.eprn(eprn_ndx).addr_tx = pma_addr            ;
+            _endpoints     [eprn_ndx].send_pma = pma_to_cpu(pma_addr);
+
+            if (endpoint_dir) {
+                _endpoints[eprn_ndx].max_send_packet = max_packet_size;
+                _pma_descs.eprn(eprn_ndx).count_rx = UsbBufDesc
+                                                     ::CountRx
+                                                     ::count_0(0);
+                _pma_descs.eprn(eprn_ndx).count_tx = UsbBufDesc
+                                                     ::CountTx
+                                                     ::count_0(0);
+            }
+            else {
+                _endpoints[eprn_ndx].max_recv_packet = max_packet_size;
+                // COUNT_TX is buffer 0's receive count, same format
+                  _pma_descs.eprn(eprn_ndx).count_tx
+                = _pma_descs.eprn(eprn_ndx).count_rx.word();
+            }
+        }
+
+        else if (endpoint_dir) {  // IN / send / tx
             // use original value
             _endpoints[eprn_ndx].max_send_packet = max_packet_size;
 
@@ -204,10 +275,7 @@ bool UsbDev::init()
             _pma_descs.eprn(eprn_ndx).addr_tx = pma_addr;
 
             // CPU memory addressing
-              _endpoints[eprn_ndx].send_pma
-            = reinterpret_cast<uint32_t*>(  USB_PMAADDR
-                                          + _BTABLE_OFFSET
-                                          + (pma_addr << 1));
+            _endpoints[eprn_ndx].send_pma = pma_to_cpu(pma_addr);
         }
         else {
             // use original value
@@ -216,19 +284,25 @@ bool UsbDev::init()
             // already decremented above
             _pma_descs.eprn(eprn_ndx).addr_rx = pma_addr;
 
-            // count_rx already set abov
+            // count_rx already set above
 
             // CPU vs peripheral memory addressing
-              _endpoints[eprn_ndx].recv_pma
-            = reinterpret_cast<uint32_t*>(  USB_PMAADDR
-                                          + _BTABLE_OFFSET
-                                          + (pma_addr << 1));
+            _endpoints[eprn_ndx].recv_pma = pma_to_cpu(pma_addr);
         }
 
         // is length -- step to next descriptor
         desc_data += *desc_data;
     }
 
+    // EPRNs of interfaces with alternate settings also need buffer
+    //   descriptor table entries
+    if (_BTABLE_OFFSET + _num_eprns * _BTABLE_ENTRY_SIZE > pma_addr)
+        success = false;
+
+    // remaining PMA between buffer descriptor table and static buffers
+    _pma_arena.init(_BTABLE_OFFSET + _num_eprns * _BTABLE_ENTRY_SIZE,
+                    pma_addr                                        );
+
 
     // clear any pending interrupts (particularly reset)
     usb->istr.clr(  Usb::Istr::PMAOVR
@@ -273,19 +347,15 @@ const uint8_t           endpoint,   // trust caller for OUT endpoint
         return 0;
 
     uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
-    uint16_t    recv_len =  _pma_descs.eprn(eprn_ndx)
-                           .count_rx
-                           .shifted(UsbBufDesc::CountRx::COUNT_0_SHFT);
+    uint16_t    recv_len = recv_lnth(endpoint);
 
     // shouldn't ever happen
     if (recv_len > _endpoints[eprn_ndx].max_recv_packet)
         recv_len = _endpoints[eprn_ndx].max_recv_packet;
 
-    read_pma_data(buffer, _endpoints[eprn_ndx].recv_pma, recv_len);
-
-    _recv_readys &= ~(1 << endpoint);
+    read_pma_data(buffer, recv_pma(endpoint), recv_len);
 
-    usb->eprn(eprn_ndx).stat_rx(Usb::Epr::STAT_RX_VALID);
+    recv_done(endpoint);
 
     return recv_len;
 
@@ -301,19 +371,11 @@ const uint16_t          data_length)  // trust caller <= max_send_packet
     if (!(_send_readys & (1 << endpoint)))
         return false;
 
-    uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
-
-    writ_pma_data(data, _endpoints[eprn_ndx].send_pma, data_length);
-
-    _pma_descs.eprn(eprn_ndx).count_tx =   UsbBufDesc
-                                         ::CountTx
-                                         ::count_0(data_length);
+    uint32_t    *buf = send_pma(endpoint);  // chosen once, if isochronous
 
-    usb->eprn(eprn_ndx).stat_tx(Usb::Epr::STAT_TX_VALID);
+    writ_pma_data(data, buf, data_length);
 
-    _send_readys &= ~(1 << endpoint);
-
-    return true;
+    return send(endpoint, data_length, buf);
 
 }  // send()
 #endif   // ifndef USB_DEV_NO_BUFFER_RECV_SEND
@@ -357,25 +419,13 @@ const uint8_t   UsbDev::_LANGUAGE_ID_STRING_DESC[] = {
                 static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
                 0x09, 0x04},         // language codes
 
-                UsbDev::_VENDOR_STRING_DESC[] = {
-                38,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                'S', 0, 'T', 0, 'M', 0, 'i', 0,
-                'c', 0, 'r', 0, 'o', 0, 'e', 0,
-                'l', 0, 'e', 0, 'c', 0, 't', 0,
-                'r', 0, 'o', 0, 'n', 0, 'i', 0,
-                'c', 0, 's', 0                }; // "STMicroelectronics"
-
-      uint8_t   UsbDev::_SERIAL_NUMBER_STRING_DESC[] = {
-                _SERIAL_NUMBER_STRING_LEN * 2 + 4,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                '0', 0, '0', 0, '0', 0, '0', 0,
-                '0', 0, '0', 0, '0', 0, '0', 0,
-                '0', 0, '0', 0, '0', 0, '0', 0,
-                '0', 0, '0', 0, '0', 0, '0', 0,
-                '0', 0, '0', 0, '0', 0, '0', 0,
-                '0', 0, '0', 0, '0', 0, '0', 0,
-                 0,  0                        };    // terminating null
+                UsbDev::_VENDOR_STRING_DESC[] = "STMicroelectronics",
+
+                // only length used, digits generated from ST "Unique
+                // Device ID" (see serial_number_init()) by
+                // serial_number_char()
+                UsbDev::_SERIAL_NUMBER_STRING_DESC[]
+                = "000000000000000000000000";  // _SERIAL_NUMBER_STRING_LEN
 
 
 
@@ -398,40 +448,14 @@ void UsbDev::reset()
     _recv_readys         = 0x0000;
     _send_readys         = 0x0001;  // control endpoint, not ever used
     _send_readys_pending = 0x0001;  //    "       "    ,  "   "    "
+    _dbl_buf_pending     = 0x0000;
+    _wedged              = 0     ;
 
-    // rest of endpoints
-    for (uint8_t eprn_ndx = 1 ; eprn_ndx < _num_eprns ; ++eprn_ndx) {
-        uint8_t             endpoint_addr = _eprn2epaddr[eprn_ndx        ];
-        Usb::Epr::mskd_t    endpoint_type = _DESC_EP_TYPE_TO_EPR_EP_TYPE[
-                                             static_cast<unsigned>(
-                                             _endpoints[eprn_ndx].type)  ];
-
-        // can just write toggle bits because known to be currently all 0
-        //
-        if (   _endpoints[eprn_ndx].max_send_packet
-            && _endpoints[eprn_ndx].max_recv_packet) {
-            // can't do separately below because toggle-only bits
-            // this is more efficient than epr_t::write() even with extra
-            //   if -- else if -- else
-            usb->eprn(eprn_ndx) =   Usb::Epr::STAT_RX_VALID
-                                  | endpoint_type
-                                  | Usb::Epr::STAT_TX_NAK
-                                  | Usb::Epr::ea(endpoint_addr);
-            _send_readys_pending |= 1 << endpoint_addr;
-        }
-
-        else if (_endpoints[eprn_ndx].max_send_packet) {
-            usb->eprn(eprn_ndx) =   Usb::Epr::STAT_TX_NAK
-                                  | endpoint_type
-                                  | Usb::Epr::ea(endpoint_addr);
-            _send_readys_pending |= 1 << endpoint_addr;
-        }
-
-        else if (_endpoints[eprn_ndx].max_recv_packet)
-            usb->eprn(eprn_ndx) =   Usb::Epr::STAT_RX_VALID
-                                  | endpoint_type
-                                  | Usb::Epr::ea(endpoint_addr);
-    }
+    // rest of endpoints, except those in interfaces with alternate
+    //   settings (below)
+    for (uint8_t eprn_ndx = 1 ; eprn_ndx < _num_eprns ; ++eprn_ndx)
+        if (_endpoints[eprn_ndx].interface == NO_INTERFACE)
+            enable_eprn(eprn_ndx);
 
     if (   _device_state == DeviceState::ADDRESSED
         || _device_state == DeviceState::CONFIGURED)
@@ -446,6 +470,13 @@ void UsbDev::reset()
 
     _device_state = DeviceState::RESET;
 
+    // back to default alternate setting 0
+    for (uint8_t interface = 0                      ;
+                 interface < USB_DEV_MAX_INTERFACES ;
+               ++interface                          )
+        if (_dynamic_interfaces & (1 << interface))
+            select_alternate(interface, 0);
+
 }  // reset()
 
 
@@ -491,6 +522,16 @@ void UsbDev::ctr()  // CTR_LP()
     else {  // normal endpoint
         uint8_t     epaddr = _eprn2epaddr[eprn_ndx];
 
+        if (double_buffered(epaddr)) {
+            dbl_buf_ctr(eprn_ndx, epaddr);
+            return;
+        }
+
+        if (isochronous(epaddr)) {
+            iso_ctr(eprn_ndx, epaddr);
+            return;
+        }
+
         if (usb->eprn(eprn_ndx).any(Usb::Epr::CTR_RX)) {
             _recv_readys |= 1 << epaddr;
 
@@ -526,6 +567,13 @@ void UsbDev::setup()
 {
     bool    standard_handled = false;
 
+    // discard any state left over from previous (possibly aborted) transfer
+    _send_info.reset();
+    _recv_info.reset();
+    _control_out_stream = 0;
+    _string_desc_utf8   = 0;
+    _setup_stall        = false;
+
     if (  _setup_packet
         ->request_type
         .all(SetupPacket::RequestType::TYPE_STANDARD))
@@ -539,8 +587,26 @@ void UsbDev::setup()
         || !standard_handled                         )
         device_class_setup();
 
-    // always call, either to send real data or zero-length status packet
-    data_stage_in();
+    // USB standard: data stage never longer than SETUP packet's wLength
+    _send_info.limit(_setup_packet->length);
+    _recv_info.limit(_setup_packet->length);
+
+    if (_setup_stall)
+        // Request error. Hardware still accepts next SETUP packet.
+        usb->EPRN<0>().stat_tx_rx(  Usb::Epr::STAT_TX_STALL
+                                  | Usb::Epr::STAT_RX_STALL);
+
+    else if (_recv_info.remaining_size()) {
+        // Host-to-device data stage follows. Receive all of it (possibly
+        // multiple packets, see control_out()) before sending zero-length
+        // status stage packet.
+        _last_send_size = 0;
+        usb->EPRN<0>().stat_tx_rx(  Usb::Epr::STAT_TX_NAK
+                                  | Usb::Epr::STAT_RX_VALID);
+    }
+    else
+        // either send real data or zero-length status packet
+        data_stage_in();
 
      _pma_descs
     .EPRN<0>()
@@ -563,12 +629,10 @@ bool UsbDev::standard_request()
              . all(SetupPacket::RequestType::RECIPIENT_INTERFACE))
         return interface_request();
 
-#if 0  // would be implemented in derived class if necessary
     else if (  _setup_packet
              ->request_type
              . all(SetupPacket::RequestType::RECIPIENT_ENDPOINT))
         return endpoint_request();
-#endif
 
     else
         return false;
@@ -599,6 +663,19 @@ bool UsbDev::device_request()
 
         case SetupPacket::Request::SET_CONFIGURATION:
             _current_configuration = _setup_packet->value.bytes.byte0;
+
+            // (re)allocate, or free if deconfigured, endpoints of
+            //   interfaces with alternate settings
+            for (uint8_t interface = 0                      ;
+                         interface < USB_DEV_MAX_INTERFACES ;
+                       ++interface                          )
+                if (_dynamic_interfaces & (1 << interface)) {
+                    if (_current_configuration)
+                        select_alternate (interface, 0);
+                    else
+                        release_interface(interface   );
+                }
+
             _send_readys           = _send_readys_pending            ;
             _device_state          = DeviceState::CONFIGURED         ;
 
@@ -618,15 +695,76 @@ bool UsbDev::device_request()
 bool UsbDev::interface_request()
 {
     switch (static_cast<SetupPacket::Request>(_setup_packet->request)) {
-        case SetupPacket::Request::GET_INTERFACE:
-            _send_info.set(&_current_interface, 1);
+        case SetupPacket::Request::GET_INTERFACE: {
+            uint8_t     interface = _setup_packet->index & 0xff;
+
+            if (interface < USB_DEV_MAX_INTERFACES)
+                _send_info.set(&_alt_settings[interface], 1);
+            else
+                _send_info.set(&_current_interface      , 1);
             return true;
+        }
 
-        case SetupPacket::Request::SET_INTERFACE:
-            _current_interface = _setup_packet->value.bytes.byte0;
+        case SetupPacket::Request::SET_INTERFACE: {
+            uint8_t     interface = _setup_packet->index & 0xff,
+                        alternate = _setup_packet->value.bytes.byte0;
+
+            if (   interface < USB_DEV_MAX_INTERFACES
+                && (_dynamic_interfaces & (1 << interface))) {
+                if (!select_alternate(interface, alternate)) {
+                    // no such alternate setting, or not enough PMA
+                    select_alternate(interface, _alt_settings[interface]);
+                    _setup_stall = true;
+                    return true;
+                }
+            }
+            else if (alternate != 0) {
+                _setup_stall = true;
+                return true;
+            }
+
+            _current_interface = alternate;
             set_interface   ();  // notify derived class if interested
             _send_info.reset();  // just in case
             return true;
+        }
+
+        default:
+            return false;
+    }
+
+    return false;
+}
+
+
+
+bool UsbDev::endpoint_request()
+{
+    static const uint8_t    HALTED    [2] = {1, 0},  // GET_STATUS
+                            NOT_HALTED[2] = {0, 0};
+    static const uint16_t   ENDPOINT_HALT = 0     ;  // feature selector
+
+    uint8_t     endpoint_address = _setup_packet->index & 0xff;
+
+    switch (static_cast<SetupPacket::Request>(_setup_packet->request)) {
+        case SetupPacket::Request::GET_STATUS:
+            _send_info.set(halted(endpoint_address) ? HALTED : NOT_HALTED, 2);
+            return true;
+
+        case SetupPacket::Request::CLR_FEATURE:
+            if (_setup_packet->value.word != ENDPOINT_HALT)
+                return false;
+            // wedged endpoint stays halted, see halt_endpoint()
+            reset_endpoint(endpoint_address                        ,
+                           true                                    ,
+                           _wedged & wedge_bit(endpoint_address)   );
+            return true;
+
+        case SetupPacket::Request::SET_FEATURE:
+            if (_setup_packet->value.word != ENDPOINT_HALT)
+                return false;
+            halt_endpoint(endpoint_address);
+            return true;
 
         default:
             return false;
@@ -647,14 +785,24 @@ bool UsbDev::descriptor_request()
             return true;
 
         case Descriptor::CONFIGURATION:
-            _send_info.set(_CONFIG_DESC, _setup_packet->length);
+            // clamped to SETUP packet wLength in setup()
+            _send_info.set(_CONFIG_DESC, config_desc_total_size());
             return true;
 
-        case Descriptor::STRING:
-            _send_info.set(_STRING_DESCS[_setup_packet->value.bytes.byte0],
-                           _STRING_DESCS[_setup_packet->value.bytes.byte0]
-                                        [_DESCRIPTOR_SIZE_NDX            ]);
+        case Descriptor::STRING: {
+            const uint8_t   *desc
+                           = _STRING_DESCS[_setup_packet->value.bytes.byte0];
+
+            if (desc == _LANGUAGE_ID_STRING_DESC)  // raw, not compact
+                _send_info.set(desc, desc[_DESCRIPTOR_SIZE_NDX]);
+            else {
+                // expanded to UTF-16 in data_stage_in()
+                _string_desc_utf8   = desc                    ;
+                _string_desc_length = string_desc_length(desc);
+                _send_info.set(0, _string_desc_length);
+            }
             return true;
+        }
 
         default:
             usb->EPRN<0>().stat_rx(Usb::Epr::STAT_TX_STALL);
@@ -668,32 +816,56 @@ bool UsbDev::descriptor_request()
 
 void UsbDev::control_out()
 {
-
     if (_recv_info.remaining_size()) {
-        uint16_t    recv_size = _recv_info.transfer_size();
-
-        read_pma_data(_recv_info.remaining_data() ,
-                      _endpoints[0].recv_pma      ,
-                      recv_size                   );
+        // Data stage packet. Use actual received size -- host can end data
+        // stage early with short packet.
+        // Note that packet has overwritten SETUP packet in PMA memory.
+        uint16_t    recv_size =  _pma_descs
+                                .EPRN<0>()
+                                .count_rx
+                                .shifted(UsbBufDesc::CountRx::COUNT_0_SHFT);
+
+        if (recv_size > _recv_info.remaining_size())
+            // malformed, more than SETUP wLength -- ignore excess
+            recv_size = _recv_info.remaining_size();
+
+        uint8_t     *data =   _control_out_stream
+                            ? _control_out_stream(_recv_info.offset()   ,
+                                                  recv_size             ,
+                                                  _control_out_user_data)
+                            : _recv_info.remaining_data()                ;
+
+        if (data)
+            read_pma_data(data, _endpoints[0].recv_pma, recv_size);
 
         _recv_info.update(recv_size);
 
-        // needed to set TX_VALID next transaction after getting CDC/ACM
-        // SET_LINE_CODING request (type: 0x21  rqst: 0x20)
-        // why when no data being sent back?
+        if (   _recv_info.remaining_size()
+            && recv_size == _endpoints[0].max_recv_packet) {
+            // more data stage packets to come
+            usb->EPRN<0>().stat_rx(Usb::Epr::STAT_RX_VALID);
+            return;
+        }
+
+        // data stage complete
+        if (_control_out_stream) {
+            _control_out_stream(_recv_info.offset(), 0, _control_out_user_data);
+            _control_out_stream = 0;
+        }
+
+        _recv_info.reset();
+
+        // status stage: zero-length IN packet
         _pma_descs. EPRN<0>().count_tx = 0                         ;
                usb->EPRN<0>().stat_tx_rx(  Usb::Epr::STAT_TX_VALID
                                          | Usb::Epr::STAT_RX_VALID);
         _last_send_size = 0;
+
+        return;
     }
 
-    if (_recv_info.remaining_size())
-        // Don't see why this should happen (more than control/endpt0 size)
-        // In fact, don't see why getting any endpt0 non-setup OUT at all
-        //   except as "status stage" of multiple data stages.
-        usb->EPRN<0>().stat_rx(Usb::Epr::STAT_RX_STALL);
-    else
-        usb->EPRN<0>().stat_rx(Usb::Epr::STAT_RX_VALID);
+    // zero-length status stage of device-to-host (IN) transfer
+    usb->EPRN<0>().stat_rx(Usb::Epr::STAT_RX_VALID);
 
 }  // control_out()
 
@@ -725,9 +897,12 @@ void UsbDev::data_stage_in()
     _last_send_size = _send_info.transfer_size();
 
     if (_last_send_size) {
-        writ_pma_data(_send_info.remaining_data() ,
-                      _endpoints[0].send_pma      ,
-                      _last_send_size             );
+        if (_string_desc_utf8)
+            writ_pma_string(_endpoints[0].send_pma, _last_send_size);
+        else
+            writ_pma_data(_send_info.remaining_data() ,
+                          _endpoints[0].send_pma      ,
+                          _last_send_size             );
 
         _send_info.update(_last_send_size);
     }
@@ -858,6 +1033,89 @@ const uint16_t          size)
 
 
 
+// Number of bytes in USB string descriptor (2 byte header plus UTF-16
+//   characters) expanded from compact null-terminated UTF-8 string
+//
+uint8_t UsbDev::string_desc_length(
+const uint8_t   *utf8)
+{
+    uint8_t     length = 2;
+
+    for ( ; *utf8 ; ++utf8)
+        if ((*utf8 & 0xc0) != 0x80)  // not UTF-8 continuation byte
+            length += 2;
+
+    return length;
+}
+
+
+
+// Decode one 1, 2, or 3 byte UTF-8 sequence and advance past it.
+// No error checking, and 4 byte sequences (outside Unicode Basic
+//   Multilingual Plane, would require UTF-16 surrogate pairs) not supported.
+//
+uint16_t UsbDev::utf8_to_utf16(
+const uint8_t*  &utf8)
+{
+    uint16_t    utf16 = *utf8++;
+
+    if (utf16 >= 0xe0) {
+        utf16  = (utf16     & 0x0f) << 12;
+        utf16 |= (*utf8++   & 0x3f) <<  6;
+        utf16 |=  *utf8++   & 0x3f       ;
+    }
+    else if (utf16 >= 0xc0) {
+        utf16  = (utf16     & 0x1f) <<  6;
+        utf16 |=  *utf8++   & 0x3f       ;
+    }
+
+    return utf16;
+}
+
+
+
+// Hex digit of ST "Unique Device ID" copied by serial_number_init(), most
+//   significant nibble first
+//
+uint16_t UsbDev::serial_number_char(
+const uint8_t   ndx)
+const
+{
+    char        digit;
+
+    bitops::BinToHex::uint4(  (_unique_id[ndx >> 3] >> (28 - 4 * (ndx & 0x7)))
+                            & 0x0f                                           ,
+                            &digit                                           );
+
+    return digit;
+}
+
+
+
+// Write next "size" bytes of string descriptor, starting at
+//   _send_info.offset(), expanding compact _string_desc_utf8 on the fly.
+// Offsets always even (2 byte header, even control endpoint packet size)
+//   so each UTF-16 character exactly fills one 16-bit PMA memory word.
+//
+void UsbDev::writ_pma_string(
+      uint32_t*         addr,
+const uint16_t          size)
+{
+    uint16_t    ndx = _send_info.offset() >> 1;  // 16-bit word index
+
+    for (uint16_t count = (size + 1) >> 1 ; count ; --count, ++ndx) {
+        if (ndx == 0)  // little-endian bLength, bDescriptorType
+            *addr++ =    _string_desc_length
+                      | (static_cast<uint16_t>(DescriptorType::STRING) << 8);
+        else if (_string_desc_utf8 == _SERIAL_NUMBER_STRING_DESC)
+            *addr++ = serial_number_char(ndx - 1);
+        else
+            *addr++ = utf8_to_utf16(_string_desc_utf8);
+    }
+}
+
+
+
 void UsbDev::set_address(
 const uint8_t   address)
 {
@@ -876,4 +1134,597 @@ const uint8_t   address)
 
 }  // set_address()
 
+
+
+// Endpoints of interfaces with alternate settings
+//
+
+void UsbDev::rewrite_eprn(
+const uint8_t           eprn_ndx,
+const Usb::Epr::mskd_t  bits    )
+{
+    // STAT_xX and DTOG_xX are toggle-only so XOR current values with
+    //   desired ones (DTOG_xX therefore reset to DATA0). Writing 0 to
+    //   CTR_xX clears any stale transfer-complete flags.
+    uint32_t    toggles =   usb->eprn(eprn_ndx).word()
+                          & (  Usb::Epr::STAT_TX_VALID
+                             | Usb::Epr::DTOG_TX_DATA1
+                             | Usb::Epr::STAT_RX_VALID
+                             | Usb::Epr::DTOG_RX_DATA1).bits();
+
+    usb->eprn(eprn_ndx) = toggles ^ bits.bits();
+
+}  // rewrite_eprn()
+
+
+
+void UsbDev::enable_eprn(
+const uint8_t   eprn_ndx)
+{
+    uint8_t             endpoint_addr = _eprn2epaddr[eprn_ndx        ];
+    Usb::Epr::mskd_t    endpoint_type = _DESC_EP_TYPE_TO_EPR_EP_TYPE[
+                                         static_cast<unsigned>(
+                                         _endpoints[eprn_ndx].type)  ];
+    bool                send          = _endpoints[eprn_ndx].max_send_packet,
+                        recv          = _endpoints[eprn_ndx].max_recv_packet;
+
+    if (double_buffered(endpoint_addr))
+        // STAT stays VALID, flow control by DTOG vs SW_BUF. IN starts
+        //   with both 0 (application owns buffer 0, peripheral NAKs), OUT
+        //   with SW_BUF 1 (peripheral receives into buffer 0).
+        rewrite_eprn(eprn_ndx,   (send ? Usb::Epr::STAT_TX_VALID
+                                       : Usb::Epr::STAT_TX_DISABLED
+                                       | Usb::Epr::DTOG_TX_DATA1   )
+                               | (recv ? Usb::Epr::STAT_RX_VALID
+                                       : Usb::Epr::STAT_RX_DISABLED)
+                               | Usb::Epr::mskd_t(Usb::Epr::EP_KIND_MASK,
+                                                  1                     ,
+                                                  Usb::Epr::EP_KIND_POS )
+                               | endpoint_type
+                               | Usb::Epr::ea(endpoint_addr)            );
+    else if (isochronous(endpoint_addr)) {
+        // STAT always VALID, DTOG_xX reset to 0 so peripheral starts with
+        //   buffer 0, application with buffer 1. Nothing to send yet.
+        rewrite_eprn(eprn_ndx,   (send ? Usb::Epr::STAT_TX_VALID
+                                       : Usb::Epr::STAT_TX_DISABLED)
+                               | (recv ? Usb::Epr::STAT_RX_VALID
+                                       : Usb::Epr::STAT_RX_DISABLED)
+                               | endpoint_type
+                               | Usb::Epr::ea(endpoint_addr)        );
+
+        if (send) {
+            _pma_descs.eprn(eprn_ndx).count_tx = UsbBufDesc
+                                                 ::CountTx
+                                                 ::count_0(0);
+            _pma_descs.eprn(eprn_ndx).count_rx = UsbBufDesc
+                                                 ::CountRx
+                                                 ::count_0(0);
+        }
+    }
+    else
+        // can't set IN and OUT separately because toggle-only bits
+        rewrite_eprn(eprn_ndx,   (send ? Usb::Epr::STAT_TX_NAK
+                                       : Usb::Epr::STAT_TX_DISABLED)
+                               | (recv ? Usb::Epr::STAT_RX_VALID
+                                       : Usb::Epr::STAT_RX_DISABLED)
+                               | endpoint_type
+                               | Usb::Epr::ea(endpoint_addr)        );
+
+    if (send)
+        _send_readys_pending |= 1 << endpoint_addr;
+
+}  // enable_eprn()
+
+
+
+void UsbDev::release_interface(
+const uint8_t   interface)
+{
+    for (uint8_t eprn_ndx = 1 ; eprn_ndx < _num_eprns ; ++eprn_ndx) {
+        Endpoint&   endpoint = _endpoints[eprn_ndx];
+
+        if (endpoint.interface != interface)
+            continue;
+
+        uint8_t     endpoint_addr = _eprn2epaddr[eprn_ndx];
+
+        rewrite_eprn(eprn_ndx,   Usb::Epr::STAT_TX_DISABLED
+                               | Usb::Epr::STAT_RX_DISABLED
+                               | Usb::Epr::ea(endpoint_addr));
+
+        // isochronous endpoint's second buffer is in other direction's
+        //   buffer descriptor
+        bool        iso           = isochronous(endpoint_addr);
+
+        if (endpoint.max_send_packet) {
+            _pma_arena.release(_pma_descs.eprn(eprn_ndx).addr_tx,
+                               endpoint.max_send_packet         );
+            if (iso)
+                _pma_arena.release(_pma_descs.eprn(eprn_ndx).addr_rx,
+                                   endpoint.max_send_packet         );
+        }
+
+        if (endpoint.max_recv_packet) {
+            uint16_t    recv_size =  _pma_descs
+                                    .eprn(eprn_ndx)
+                                    .count_rx
+                                    .num_bytes_0();
+
+            _pma_arena.release(_pma_descs.eprn(eprn_ndx).addr_rx, recv_size);
+            if (iso)
+                _pma_arena.release(_pma_descs.eprn(eprn_ndx).addr_tx,
+                                   recv_size                        );
+        }
+
+        endpoint.max_send_packet = 0;
+        endpoint.max_recv_packet = 0;
+
+        _send_readys         &= ~(1 << endpoint_addr);
+        _send_readys_pending &= ~(1 << endpoint_addr);
+        _recv_readys         &= ~(1 << endpoint_addr);
+    }
+
+}  // release_interface()
+
+
+
+bool UsbDev::allocate_endpoint(
+const uint8_t   *desc)
+{
+    uint16_t    max_packet_size =   *(desc + _ENDPOINT_DESC_PACKET_SIZE_NDX    )
+                                  + *(desc + _ENDPOINT_DESC_PACKET_SIZE_NDX + 1)
+                                  * 256;
+    uint8_t     address         = *(desc + _ENDPOINT_DESC_ADDRESS_NDX),
+                eprn_ndx        = _epaddr2eprn[address & ENDPOINT_ADDR_MASK];
+    bool        iso             = isochronous(address & ENDPOINT_ADDR_MASK);
+    uint16_t    pma_addr,
+                iso_addr;   // isochronous buffer 1, in other direction's
+                            //   buffer descriptor
+
+    if (address & ENDPOINT_DIR_IN) {
+        if (!(pma_addr = _pma_arena.alloc(max_packet_size)))
+            return false;
+
+        if (iso) {
+            if (!(iso_addr = _pma_arena.alloc(max_packet_size))) {
+                _pma_arena.release(pma_addr, max_packet_size);
+                return false;
+            }
+            _pma_descs.eprn(eprn_ndx).addr_rx = iso_addr            ;
+            _endpoints     [eprn_ndx].recv_pma = pma_to_cpu(iso_addr);
+        }
+
+        _pma_descs.eprn(eprn_ndx).addr_tx     = pma_addr                 ;
+        _endpoints     [eprn_ndx].send_pma    = pma_to_cpu(pma_addr)     ;
+        _endpoints     [eprn_ndx].max_send_packet = max_packet_size      ;
+    }
+    else {
+        // converts to allowed modulo 2 or modulo 32 values
+        _pma_descs.eprn(eprn_ndx).count_rx.set_num_blocks_0(max_packet_size);
+
+        uint16_t    recv_size =  _pma_descs
+                                .eprn(eprn_ndx)
+                                .count_rx
+                                .num_bytes_0();
+
+        if (!(pma_addr = _pma_arena.alloc(recv_size)))
+            return false;
+
+        if (iso) {
+            if (!(iso_addr = _pma_arena.alloc(recv_size))) {
+                _pma_arena.release(pma_addr, recv_size);
+                return false;
+            }
+            // COUNT_TX is buffer 0's receive count, same format
+              _pma_descs.eprn(eprn_ndx).count_tx
+            = _pma_descs.eprn(eprn_ndx).count_rx.word();
+            _pma_descs.eprn(eprn_ndx).addr_tx  = iso_addr            ;
+            _endpoints     [eprn_ndx].send_pma = pma_to_cpu(iso_addr);
+        }
+
+        _pma_descs.eprn(eprn_ndx).addr_rx     = pma_addr                 ;
+        _endpoints     [eprn_ndx].recv_pma    = pma_to_cpu(pma_addr)     ;
+        _endpoints     [eprn_ndx].max_recv_packet = max_packet_size      ;
+    }
+
+    _endpoints[eprn_ndx].type = static_cast<DescriptorType>(
+                                  *(desc + _ENDPOINT_DESC_ATTRIBUTES_NDX)
+                                & _ENDPOINT_ATTRS_TRANSFER_MASK          );
+
+    // again if second direction of same EPRN
+    enable_eprn(eprn_ndx);
+
+    if (   (address & ENDPOINT_DIR_IN)
+        && _device_state == DeviceState::CONFIGURED)
+        _send_readys |= 1 << (address & ENDPOINT_ADDR_MASK);
+
+    return true;
+
+}  // allocate_endpoint()
+
+
+
+bool UsbDev::select_alternate(
+const uint8_t   interface,
+const uint8_t   alternate)
+{
+    bool    found    = false,
+            selected = false,   // parsing endpoints of requested alternate
+            success  = true ;
+
+    release_interface(interface);
+
+    for (const uint8_t*     desc_data =   _CONFIG_DESC          ;
+                            desc_data <   _CONFIG_DESC
+                                        + config_desc_total_size();
+                            desc_data += *desc_data               ) {
+        if (   *(desc_data + 1)
+            == static_cast<uint8_t>(DescriptorType::INTERFACE)) {
+            selected =    *(desc_data + _INTERFACE_DESC_NUMBER_NDX   )
+                       == interface
+                       && *(desc_data + _INTERFACE_DESC_ALTERNATE_NDX)
+                       == alternate;
+            found    |= selected;
+        }
+        else if (   selected
+                 &&    *(desc_data + 1)
+                    == static_cast<uint8_t>(DescriptorType::ENDPOINT)
+                 && !allocate_endpoint(desc_data)                     ) {
+            success = false;
+            break;
+        }
+    }
+
+    if (found && success) {
+        _alt_settings[interface] = alternate;
+        return true;
+    }
+
+    // leave nothing half-allocated
+    release_interface(interface);
+    return false;
+
+}  // select_alternate()
+
+
+
+// Double-buffered endpoints (see usb_dev.hxx)
+//
+
+void UsbDev::dbl_buf_toggle(
+const uint8_t   eprn_ndx,
+const bool      in      )
+{
+    // write 0 to other toggle-only bits, 1 to clear-only CTR_xX bits
+    uint32_t    word =   usb->eprn(eprn_ndx).word()
+                       & ~(  Usb::Epr::STAT_TX_VALID
+                           | Usb::Epr::DTOG_TX_DATA1
+                           | Usb::Epr::STAT_RX_VALID
+                           | Usb::Epr::DTOG_RX_DATA1).bits();
+
+    word |=   Usb::Epr::CTR_TX.bits()
+            | Usb::Epr::CTR_RX.bits()
+            | (  in
+               ? Usb::Epr::DTOG_RX_DATA1     // SW_BUF
+               : Usb::Epr::DTOG_TX_DATA1).bits();
+
+    usb->eprn(eprn_ndx) = word;
+
+}  // dbl_buf_toggle()
+
+
+
+// Application is done with its OUT buffer (_recv_readys bit already
+//   cleared). If the peripheral has filled the other one meanwhile
+//   (and is NAKing), take it.
+//
+void UsbDev::dbl_buf_recv_done(
+const uint8_t   endpoint)
+{
+    if (!(_dbl_buf_pending & (1 << endpoint)))
+        return;  // dbl_buf_ctr() will toggle when next packet received
+
+    _dbl_buf_pending &= ~(1 << endpoint);
+    dbl_buf_toggle(_epaddr2eprn[endpoint], false);
+    _recv_readys     |=   1 << endpoint ;
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+    if (_recv_callbacks[endpoint]._callback)
+        _recv_callbacks[endpoint]._callback(endpoint                   ,
+                                            _recv_callbacks[endpoint]
+                                            ._user_data                );
+#endif
+
+}  // dbl_buf_recv_done()
+
+
+
+// Application has written its IN buffer. Pass it to the peripheral now
+//   if idle, else when the packet in flight completes (dbl_buf_ctr()).
+//
+void UsbDev::dbl_buf_send(
+const uint8_t   endpoint,
+const uint16_t  length  )
+{
+    uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
+    bool        sw_buf   = dbl_buf_sw_buf(eprn_ndx, true);
+
+    if (sw_buf)
+        _pma_descs.eprn(eprn_ndx).count_rx = UsbBufDesc
+                                             ::CountRx
+                                             ::count_0(length);
+    else
+        _pma_descs.eprn(eprn_ndx).count_tx = UsbBufDesc
+                                             ::CountTx
+                                             ::count_0(length);
+
+    // Mask CTR interrupt so dbl_buf_ctr() can't run (and toggle SW_BUF
+    //   for a pending buffer) between checking DTOG_TX and toggling SW_BUF
+    //   or marking buffer pending below. A transfer completing meanwhile
+    //   is handled when unmasked.
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    usb->cntr -= Usb::Cntr::CTRM;
+#endif
+
+    _send_readys &= ~(1 << endpoint);
+
+    // DTOG_TX == SW_BUF: peripheral has no buffer, no transfer in flight
+    if (sw_buf == dbl_buf_dtog(eprn_ndx, true)) {
+        dbl_buf_toggle(eprn_ndx, true);
+        _send_readys     |= 1 << endpoint;
+    }
+    else
+        _dbl_buf_pending |= 1 << endpoint;  // see dbl_buf_ctr()
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    usb->cntr |= Usb::Cntr::CTRM;
+#endif
+
+}  // dbl_buf_send()
+
+
+
+void UsbDev::dbl_buf_ctr(
+const uint8_t   eprn_ndx,
+const uint8_t   endpoint)
+{
+    // Clear CTR_xX before examining DTOG/SW_BUF so a transfer completing
+    //   meanwhile sets it again (is handled by next ctr()) instead of
+    //   being lost. Endpoint is either IN or OUT, never both.
+    if (usb->eprn(eprn_ndx).any(Usb::Epr::CTR_RX)) {
+        usb->eprn(eprn_ndx).clear(Usb::Epr::CTR_RX);
+
+        if (_recv_readys & (1 << endpoint)) {
+            // application still has previous packet, peripheral NAKs
+            //   until dbl_buf_recv_done()
+            _dbl_buf_pending |= 1 << endpoint;
+            return;
+        }
+
+        dbl_buf_toggle(eprn_ndx, false);
+        _recv_readys |= 1 << endpoint;
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+        if (_recv_callbacks[endpoint]._callback)
+            _recv_callbacks[endpoint]._callback(endpoint                   ,
+                                                _recv_callbacks[endpoint]
+                                                ._user_data                );
+#endif
+    }
+
+    if (usb->eprn(eprn_ndx).any(Usb::Epr::CTR_TX)) {
+        usb->eprn(eprn_ndx).clear(Usb::Epr::CTR_TX);
+
+        if (_dbl_buf_pending & (1 << endpoint)) {
+            // Only if peripheral now idle (DTOG_TX == SW_BUF) -- this may
+            //   be a stale completion already handled by dbl_buf_send()
+            //   with the newly pending buffer's predecessor still in
+            //   flight.
+            if (dbl_buf_sw_buf(eprn_ndx, true) != dbl_buf_dtog(eprn_ndx, true))
+                return;
+
+            _dbl_buf_pending &= ~(1 << endpoint);
+            dbl_buf_toggle(eprn_ndx, true);
+        }
+
+        _send_readys |= 1 << endpoint;
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+        if (_send_callbacks[endpoint]._callback)
+            _send_callbacks[endpoint]._callback(endpoint                   ,
+                                                _send_callbacks[endpoint]
+                                                ._user_data                );
+#endif
+    }
+
+}  // dbl_buf_ctr()
+
+
+
+// Endpoint halt (see usb_dev.hxx)
+//
+
+bool UsbDev::halted(
+const uint8_t   endpoint_address)
+const
+{
+    uint8_t     eprn_ndx = _epaddr2eprn[endpoint_address & ENDPOINT_ADDR_MASK];
+
+    if (!eprn_ndx)
+        return false;
+
+    if (endpoint_address & ENDPOINT_DIR_IN)
+        return    (  usb->eprn(eprn_ndx).word()
+                   & Usb::Epr::STAT_TX_VALID.bits())
+               == Usb::Epr::STAT_TX_STALL.bits()   ;
+    else
+        return    (  usb->eprn(eprn_ndx).word()
+                   & Usb::Epr::STAT_RX_VALID.bits())
+               == Usb::Epr::STAT_RX_STALL.bits()   ;
+
+}  // halted()
+
+
+
+void UsbDev::reset_endpoint(
+const uint8_t   endpoint_address,
+const bool      toggle          ,
+const bool      halt            )
+{
+    uint8_t     endpoint = endpoint_address & ENDPOINT_ADDR_MASK,
+                eprn_ndx = _epaddr2eprn[endpoint]               ;
+    bool        in       = endpoint_address & ENDPOINT_DIR_IN   ,
+                dbl_buf  = double_buffered(endpoint)            ;
+
+    if (!eprn_ndx || isochronous(endpoint))
+        return;  // control endpoint (see _setup_stall), unused, or no halt
+
+    uint32_t    stat   = (  in
+                          ? Usb::Epr::STAT_TX_VALID
+                          : Usb::Epr::STAT_RX_VALID).bits(),
+                dtog   = (  in
+                          ? Usb::Epr::DTOG_TX_DATA1
+                          : Usb::Epr::DTOG_RX_DATA1).bits(),
+                sw_buf = (  in
+                          ? Usb::Epr::DTOG_RX_DATA1
+                          : Usb::Epr::DTOG_TX_DATA1).bits(),
+                mask   = stat | dtog                      ,
+                bits;
+
+    if (halt)
+        bits = (in ? Usb::Epr::STAT_TX_STALL : Usb::Epr::STAT_RX_STALL).bits();
+    else if (in && !dbl_buf)
+        bits = Usb::Epr::STAT_TX_NAK.bits();  // until send()
+    else
+        bits = stat;  // VALID
+
+    bool        data1 = !toggle && (usb->eprn(eprn_ndx).word() & dtog);
+
+    if (data1)
+        bits |= dtog;
+
+    // Double-buffered: no buffer for peripheral (SW_BUF == DTOG) if IN,
+    //   peripheral receives into buffer selected by DTOG if OUT (see
+    //   enable_eprn())
+    if (dbl_buf) {
+        mask |= sw_buf;
+        if (in ? data1 : !data1)
+            bits |= sw_buf;
+    }
+
+    // keep interrupt handler's send/recv bookkeeping out until EPR written
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    usb->cntr -= Usb::Cntr::CTRM;
+#endif
+
+    _dbl_buf_pending &= ~(1 << endpoint);
+
+    if (in && !halt)
+        _send_readys |=   1 << endpoint ;
+    else if (in)
+        _send_readys &= ~(1 << endpoint);
+    else
+        _recv_readys &= ~(1 << endpoint);
+
+    // Write 0 to other toggle-only bits, 1 to clear-only CTR_xX bits
+    //   except this direction's, whose stale transfer is discarded
+    uint32_t    word =   usb->eprn(eprn_ndx).word()
+                       & ~(  Usb::Epr::STAT_TX_VALID
+                           | Usb::Epr::DTOG_TX_DATA1
+                           | Usb::Epr::STAT_RX_VALID
+                           | Usb::Epr::DTOG_RX_DATA1).bits();
+
+    word |= (in ? Usb::Epr::CTR_RX : Usb::Epr::CTR_TX).bits();
+    word &= ~(in ? Usb::Epr::CTR_TX : Usb::Epr::CTR_RX).bits();
+    word |= (usb->eprn(eprn_ndx).word() ^ bits) & mask;
+
+    usb->eprn(eprn_ndx) = word;
+
+#ifdef USB_DEV_INTERRUPT_DRIVEN
+    usb->cntr |= Usb::Cntr::CTRM;
+#endif
+
+}  // reset_endpoint()
+
+
+
+// Isochronous endpoints (see usb_dev.hxx)
+//
+
+// Application has written its IN buffer, which the peripheral will send
+//   after the one it currently holds. Count goes with buffer the data
+//   was written to, even if DTOG has toggled since, else with
+//   application's buffer now.
+//
+void UsbDev::iso_send(
+const uint8_t                   endpoint,
+const uint16_t                  length  ,
+const volatile uint32_t* const  buf     )
+{
+    uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
+    bool        buffer_0 =   buf
+                           ? buf == _endpoints[eprn_ndx].send_pma
+                           : dbl_buf_dtog(eprn_ndx, true)        ;
+
+    if (buffer_0)
+        _pma_descs.eprn(eprn_ndx).count_tx = UsbBufDesc
+                                             ::CountTx
+                                             ::count_0(length);
+    else
+        _pma_descs.eprn(eprn_ndx).count_rx = UsbBufDesc
+                                             ::CountRx
+                                             ::count_0(length);
+
+    _send_readys &= ~(1 << endpoint);
+
+}  // iso_send()
+
+
+
+void UsbDev::iso_ctr(
+const uint8_t   eprn_ndx,
+const uint8_t   endpoint)
+{
+    // DTOG already toggled, so buffer just received or sent is now the
+    //   application's. Endpoint is either IN or OUT, never both.
+    if (usb->eprn(eprn_ndx).any(Usb::Epr::CTR_RX)) {
+        usb->eprn(eprn_ndx).clear(Usb::Epr::CTR_RX);
+
+        // replaces previous packet if not read
+        _recv_readys |= 1 << endpoint;
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+        if (_recv_callbacks[endpoint]._callback)
+            _recv_callbacks[endpoint]._callback(endpoint                   ,
+                                                _recv_callbacks[endpoint]
+                                                ._user_data                );
+#endif
+    }
+
+    if (usb->eprn(eprn_ndx).any(Usb::Epr::CTR_TX)) {
+        usb->eprn(eprn_ndx).clear(Usb::Epr::CTR_TX);
+
+        // zero-length packet, not stale data, if send() not called
+        //   before peripheral gets to this buffer
+        if (dbl_buf_dtog(eprn_ndx, true))
+            _pma_descs.eprn(eprn_ndx).count_tx = UsbBufDesc
+                                                 ::CountTx
+                                                 ::count_0(0);
+        else
+            _pma_descs.eprn(eprn_ndx).count_rx = UsbBufDesc
+                                                 ::CountRx
+                                                 ::count_0(0);
+
+        _send_readys |= 1 << endpoint;
+
+#ifdef USB_DEV_ENDPOINT_CALLBACKS
+        if (_send_callbacks[endpoint]._callback)
+            _send_callbacks[endpoint]._callback(endpoint                   ,
+                                                _send_callbacks[endpoint]
+                                                ._user_data                );
+#endif
+    }
+
+}  // iso_ctr()
+
 } // namespace stm32f10_12357_xx
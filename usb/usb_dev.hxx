@@ -22,11 +22,20 @@
 #define USB_DEV_HXX
 
 #define USB_DEV_MAJOR_VERSION   1
-#define USB_DEV_MINOR_VERSION   2
-#define USB_DEV_MICRO_VERSION   1
+#define USB_DEV_MINOR_VERSION   3
+#define USB_DEV_MICRO_VERSION   0
 
 #include <stm32f103xb.hxx>
 
+// Max number of interfaces (bInterfaceNumber values) with alternate
+//   settings. Interfaces with higher numbers can only have one setting.
+#ifndef USB_DEV_MAX_INTERFACES
+#define USB_DEV_MAX_INTERFACES  8
+#endif
+#if USB_DEV_MAX_INTERFACES > 32
+#error USB_DEV_MAX_INTERFACES must be <= 32
+#endif
+
 #if STM32F103XB_MAJOR_VERSION == 1
 #if STM32F103XB_MINOR_VERSION  < 2
 #warning STM32F103XB_MINOR_VERSION >= 2 with required STM32F103XB_MAJOR_VERSION == 1
@@ -86,8 +95,14 @@ class UsbDev {
         INTERRUPT    = 3,
     };
 
+    // Packet buffering of bulk endpoints (see UsbDev constructor)
+    enum class Buffering {
+        SINGLE = 0,
+        DOUBLE
+    };
+
     // USB standard: offset into configuration descriptor to length field
-    static const uint8_t    CONFIG_DESC_SIZE_NDX = 2;
+    static const uint8_t    CONFIG_DESC_SIZE_NDX = 2;  // wTotalLength
 
     // USB standard: Bit in endpoint descriptor address byte. If set, endpoint
     //   is IN; if clear is OUT (host-centric nomenclature)
@@ -96,10 +111,36 @@ class UsbDev {
     static const uint8_t    ENDPOINT_DIR_IN      = 0x80,
                             ENDPOINT_ADDR_MASK   = 0x0F;
 
-
-
+    // Streaming destination for multi-packet control OUT data stages (see
+    //   control_out_stream(), below).
+    // Called once per received packet with the packet's byte offset within
+    //   the data stage and its length. Must return address to copy packet
+    //   data into (room for length rounded up to even number of bytes), or
+    //   0 to discard it. Called a final time with length == 0 and offset ==
+    //   total bytes received after the data stage has completed, just
+    //   before the status stage handshake is sent to the host.
+    // Executes in interrupt context if USB_DEV_INTERRUPT_DRIVEN
+    typedef uint8_t* (*ControlOutStream)(const uint16_t     offset   ,
+                                         const uint16_t     length   ,
+                                               void        *user_data);
+
+
+
+    // Bit N of double_buffered set makes bulk endpoint with address N
+    //   (USB endpoint descriptor bEndpointAddress without direction bit)
+    //   double-buffered: two PMA buffers, so the peripheral can transfer
+    //   one packet while the application copies the next to or from the
+    //   other. Such endpoints must have only one direction (IN or OUT,
+    //   not both, since both ST buffer descriptors are used) and not be in
+    //   an interface with alternate settings (are not double-buffered if
+    //   so). Transparent to application: send(), recv(), and the direct
+    //   buffer access methods below work the same, except that send()
+    //   can queue a second packet while the first is in flight and the
+    //   host can send a second OUT packet before the first is recv()'d.
     constexpr
-    UsbDev()
+    explicit
+    UsbDev(
+    const uint16_t  double_buffered = 0)
     :   _endpoints            {                         },
 #ifdef USB_DEV_ENDPOINT_CALLBACKS
         _recv_callbacks       {{0, 0}                   },
@@ -107,15 +148,28 @@ class UsbDev {
 #endif
         _epaddr2eprn          {0                        },
         _eprn2epaddr          {0                        },
+        _alt_settings         {0                        },
+        _pma_arena            (                         ),
+        _dynamic_interfaces   (0                        ),
         _send_info            (                         ),
         _recv_info            (                         ),
+        _control_out_stream   (0                        ),
+        _control_out_user_data(0                        ),
+        _string_desc_utf8     (0                        ),
+        _unique_id            {0                        },
+        _setup_stall          (false                    ),
         _setup_packet         (0                        ),
         _device_state         (DeviceState ::CONSTRUCTED),
     //  _status               (0                        ),
         _recv_readys          (0x0000                   ),
         _send_readys          (0x0000                   ),
         _send_readys_pending  (0x0000                   ),
+        _double_buffered      (double_buffered          ),
+        _dbl_buf_pending      (0x0000                   ),
+        _isochronous          (0x0000                   ),
+        _wedged               (0                        ),
         _last_send_size       (0                        ),
+        _string_desc_length   (0                        ),
         _num_eprns            (1                        ), // parse descriptor,
                                                            // always endpoint 0
         _current_configuration(0                        ),
@@ -141,8 +195,9 @@ class UsbDev {
 
 
     // Optional use by client application.
-    // Will copy/format ST "Unique Device ID" value into USB descriptor,
-    // Otherwise value will be  default string "000..."
+    // Will copy ST "Unique Device ID" value for serial number string
+    //   descriptor (generated on demand, 12 bytes of RAM). Otherwise value
+    //   will be default string "000..."
     // Hardware bug: must be done while main CPU clock at default 8 MHz
     //   before mandatory increase to 48 or 72 MHz for USB peripheral.
     void    serial_number_init();
@@ -161,6 +216,13 @@ class UsbDev {
     // see "enum class DeviceState", above
     DeviceState     device_state() const { return _device_state ; }
 
+    // USB start-of-frame number, 11 bits, increments every 1 ms while bus
+    //   is active (no interrupts needed)
+    static uint16_t frame_number()
+    {
+        return stm32f103xb::usb->fnr.shifted(stm32f103xb::Usb::Fnr::FN);
+    }
+
     void interrupt_handler();
 
 
@@ -229,6 +291,15 @@ class UsbDev {
 #endif
 
 
+    // Currently selected bAlternateSetting of interface (always 0 for
+    //   interfaces without alternate settings)
+    uint8_t alternate_setting(
+    const uint8_t   interface)
+    const {
+        return interface < USB_DEV_MAX_INTERFACES ? _alt_settings[interface]
+                                                  : 0                      ;
+    }
+
     // accessor for information parsed from USB endpoint descriptor
     uint16_t endpoint_recv_bufsize(
     const uint8_t   endpoint)
@@ -243,6 +314,125 @@ class UsbDev {
         return _endpoints[_epaddr2eprn[endpoint]].max_send_packet;
     }
 
+    // PMA bytes used by endpoint's buffers (see pma_recv_size() and
+    //   pma_send_size())
+    uint16_t endpoint_recv_pma_size(
+    const uint8_t   endpoint)
+    const {
+        return pma_recv_size(endpoint_recv_bufsize(endpoint));
+    }
+
+    uint16_t endpoint_send_pma_size(
+    const uint8_t   endpoint)
+    const {
+        return pma_send_size(endpoint_send_bufsize(endpoint));
+    }
+
+    // PMA bytes not currently used by buffer descriptor table or any
+    //   endpoint buffers
+    uint16_t pma_free_size()
+    const {
+        return _pma_arena.free_bytes();
+    }
+
+
+    // PMA bytes needed for endpoint buffer of given max packet size.
+    // Addresses must be 16-bit aligned, and receive buffers must be one
+    //   of the count_rx BL_SIZE/NUM_BLOCK sizes: 2, 4, ... 62 or 64, 96,
+    //   ... 512 bytes.
+    static constexpr uint16_t pma_send_size(
+    const uint16_t  max_packet)
+    {
+        return (max_packet + 1) & ~0x1;
+    }
+
+    static constexpr uint16_t pma_recv_size(
+    const uint16_t  max_packet)
+    {
+        return   max_packet <= 62
+               ? (max_packet +  1) & ~0x01
+               : (max_packet + 31) & ~0x1f;
+    }
+
+    // PMA bytes taken by buffer of "size" (pma_send_size() or
+    //   pma_recv_size()) if endpoint is in interface with alternate
+    //   settings (see PmaArena, below)
+    static constexpr uint16_t pma_slab_size(
+    const uint16_t  size)
+    {
+        return size <= 8 ? 8 : 2 * pma_slab_size((size + 1) / 2);
+    }
+
+    // Largest max packet size (up to "limit") for num_send IN and num_recv
+    //   OUT endpoints to fit in PMA memory along with control endpoint 0
+    //   and num_eprns (including control's) buffer descriptor table
+    //   entries. For "as large as fits" endpoint descriptors. 0 if none.
+    // "reserved" is PMA bytes used by other, fixed size, endpoints (see
+    //   pma_send_size() and pma_recv_size()).
+    static constexpr uint16_t pma_fit_packet_size(
+    const uint8_t   num_eprns,
+    const uint8_t   num_send,
+    const uint8_t   num_recv,
+    const uint16_t  control_max_packet = 64,
+    const uint16_t  limit              = 64,
+    const uint16_t  reserved           =  0)
+    {
+        uint16_t    size = limit & ~0x1;
+
+        while (   size
+               && pma_used_size(num_eprns                        ,
+                                  num_send * pma_send_size(size)
+                                + num_recv * pma_recv_size(size)
+                                + reserved                       ,
+                                control_max_packet               )
+                  > stm32f103xb::USB_PMASIZE                      )
+            size -= 2;
+
+        return size;
+    }
+
+    // As pma_fit_packet_size(), but full-speed bulk sizes only (8, 16,
+    //   32, or 64, "limit" one of them). 0 if none.
+    static constexpr uint16_t pma_fit_bulk_packet_size(
+    const uint8_t   num_eprns,
+    const uint8_t   num_send,
+    const uint8_t   num_recv,
+    const uint16_t  control_max_packet = 64,
+    const uint16_t  limit              = 64,
+    const uint16_t  reserved           =  0)
+    {
+        uint16_t    size = limit;
+
+        while (   size >= 8
+               && pma_used_size(num_eprns                        ,
+                                  num_send * pma_send_size(size)
+                                + num_recv * pma_recv_size(size)
+                                + reserved                       ,
+                                control_max_packet               )
+                  > stm32f103xb::USB_PMASIZE                      )
+            size >>= 1;
+
+        return size >= 8 ? size : 0;
+    }
+
+    // Total PMA bytes used by buffer descriptor table entries for
+    //   num_eprns endpoint registers (including control's), control
+    //   endpoint buffers, and "buffers" bytes of other endpoints' buffers
+    //   (sum of pma_send_size() and pma_recv_size() values, twice for
+    //   double-buffered and isochronous endpoints). For compile-time
+    //   checks against stm32f103xb::USB_PMASIZE.
+    static constexpr uint16_t pma_used_size(
+    const uint8_t   num_eprns               ,
+    const uint16_t  buffers                 ,
+    const uint16_t  control_max_packet = 64)
+    {
+        return   _BTABLE_OFFSET
+               + num_eprns * _BTABLE_ENTRY_SIZE
+               + pma_send_size(control_max_packet)
+               + pma_recv_size(control_max_packet)
+               + buffers                         ;
+    }
+
 
     // Accessors for endpoint states
     //
@@ -307,6 +497,18 @@ class UsbDev {
     // the USB_DEV_NO_BUFFER_RECV_SEND pre-processor macro can be defined
     // to eliminate their compilation and reduce binary code size.
     //
+    // Isochronous endpoints (bmAttributes transfer type 1 in endpoint
+    // descriptor) use the same methods, but are never NAKed or flow
+    // controlled: the host sends or takes one packet per (micro)frame
+    // regardless. OUT packets are recv_ready() until the next one arrives,
+    // one frame later, so must be read (recv()/read()/recv_buf()) before
+    // then; recv_done() only clears the ready state. An IN packet given to
+    // send() goes to the host in the frame after the packet currently
+    // waiting, and send_ready() comes back when each frame's packet has
+    // been taken. A frame with nothing sent is a zero-length packet (which
+    // the host treats as a dropped one). Each isochronous endpoint needs
+    // its own endpoint number (can't have both IN and OUT).
+    //
 
 #ifndef USB_DEV_NO_BUFFER_RECV_SEND
     // no checking of params -- caller must guarantee valid
@@ -329,8 +531,21 @@ class UsbDev {
         if (!(_recv_readys & (1 << endpoint)))
             return 0;
 
+        uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
+
+        // buffer 0 of double-buffered or isochronous endpoint is described
+        //   by COUNT_TX
+        if (   (double_buffered(endpoint) && !dbl_buf_sw_buf(eprn_ndx, false))
+            || (isochronous    (endpoint) &&  dbl_buf_dtog  (eprn_ndx, false)))
+            return  _pma_descs
+                   .eprn(eprn_ndx)
+                   .count_tx.shifted(  stm32f103xb
+                                     ::UsbBufDesc
+                                     ::CountTx
+                                     ::COUNT_0_SHFT);
+
         return  _pma_descs
-               .eprn(_epaddr2eprn[endpoint])
+               .eprn(eprn_ndx)
                .count_rx.shifted(  stm32f103xb
                                  ::UsbBufDesc
                                  ::CountRx
@@ -345,21 +560,38 @@ class UsbDev {
 
         _recv_readys &= ~(1 << endpoint);
 
-          stm32f103xb
-        ::usb
-        ->eprn(_epaddr2eprn[endpoint])
-         .stat_rx(stm32f103xb::Usb::Epr::STAT_RX_VALID);
+        if (double_buffered(endpoint))
+            dbl_buf_recv_done(endpoint);
+        else if (!isochronous(endpoint))  // always VALID
+              stm32f103xb
+            ::usb
+            ->eprn(_epaddr2eprn[endpoint])
+             .stat_rx(stm32f103xb::Usb::Epr::STAT_RX_VALID);
 
         return true;
     }
 
+    // Isochronous IN: "buf" is the send_buf() the data was written to.
+    //   Else (0) the peripheral's buffer swap at each frame start must
+    //   not fall between the writes and send(), as buffer is re-chosen.
     bool send(  // no check for valid endpoint or length
-    const uint8_t   endpoint,
-    const uint16_t  length  )
+    const uint8_t                   endpoint   ,
+    const uint16_t                  length     ,
+    const volatile uint32_t* const  buf     = 0)
     {
         if (!(_send_readys & (1 << endpoint)))
             return false;
 
+        if (double_buffered(endpoint)) {
+            dbl_buf_send(endpoint, length);
+            return true;
+        }
+
+        if (isochronous(endpoint)) {
+            iso_send(endpoint, length, buf);
+            return true;
+        }
+
           _pma_descs.eprn(_epaddr2eprn[endpoint]).count_tx
         = stm32f103xb::UsbBufDesc::CountTx::count_0(length);
 
@@ -373,13 +605,14 @@ class UsbDev {
         return true;
     }
 
-    // direct access to hardware USB buffers
+    // direct access to hardware USB buffers (application's buffer if
+    //   double-buffered, valid until recv_done() or send())
     //
     uint16_t read(              // no checking of parameters
     const uint8_t   endpoint,
     const uint8_t   data_ndx)   // uint16_t index, i.e. byte index divided by 2
     {
-        return *(_endpoints[_epaddr2eprn[endpoint]].recv_pma + data_ndx);
+        return *(recv_pma(endpoint) + data_ndx);
     }
 
     void writ(                  // no checking of parameters
@@ -387,7 +620,7 @@ class UsbDev {
     const uint16_t  data    ,
     const uint8_t   data_ndx)   // uint16_t index, i.e. byte index divided by 2
     {
-        *(_endpoints[_epaddr2eprn[endpoint]].send_pma + data_ndx) = data;
+        *(send_pma(endpoint) + data_ndx) = data;
     }
 
     // e.g. for DMA from/to peripheral
@@ -395,15 +628,56 @@ class UsbDev {
     volatile uint32_t* recv_buf(
     const uint8_t   endpoint)
     {
-        return _endpoints[_epaddr2eprn[endpoint]].recv_pma;
+        return recv_pma(endpoint);
     }
 
     volatile uint32_t* send_buf(
     const uint8_t   endpoint)
     {
-        return _endpoints[_epaddr2eprn[endpoint]].send_pma;
+        return send_pma(endpoint);
+    }
+
+
+    // Endpoint halt (USB 2.0 9.4.5), e.g. for class-specific error
+    //   handling. "endpoint_address" is bEndpointAddress: endpoint number,
+    //   plus ENDPOINT_DIR_IN if IN. Not for control or isochronous
+    //   endpoints.
+    //
+    // Halted endpoint answers host with STALL handshakes, and discards
+    //   any packets waiting in its buffers. Host's CLEAR_FEATURE
+    //   (ENDPOINT_HALT) resumes it with data toggle reset to DATA0, except
+    //   if "wedge": then it stays halted (data toggle still reset) until
+    //   unwedge() or clear_halt().
+    void    halt_endpoint (const uint8_t    endpoint_address,
+                           const bool       wedge = false   )
+    {
+        if (wedge)
+            _wedged |= wedge_bit(endpoint_address);
+
+        reset_endpoint(endpoint_address, false, true);
+    }
+
+    void    clear_halt    (const uint8_t    endpoint_address)
+    {
+        _wedged &= ~wedge_bit(endpoint_address);
+
+        reset_endpoint(endpoint_address, true, false);
+    }
+
+    void    unwedge       (const uint8_t    endpoint_address)
+    {
+        _wedged &= ~wedge_bit(endpoint_address);
     }
 
+    bool    halted        (const uint8_t    endpoint_address) const;
+
+    // Discard packets waiting in endpoint's buffers (send_ready() if IN),
+    //   and reset data toggle to DATA0 if "toggle". Endpoint left halted
+    //   if "halt", else resumed.
+    void    reset_endpoint(const uint8_t    endpoint_address,
+                           const bool       toggle          ,
+                           const bool       halt            );
+
 
   protected:
 
@@ -417,8 +691,107 @@ class UsbDev {
                          max_send_packet; //    "     "     "      "
         DescriptorType   type          ;  // convert to Usb::Epr::mskd_t with
                                           // _DESC_EP_TYPE_TO_EPR_EP_TYPE[]
+        uint8_t          interface     ;  // with alternate settings, else
+                                          // NO_INTERFACE
     };
 
+    static const uint8_t    NO_INTERFACE = 0xff;
+
+
+    // Allocator for packet buffers of endpoints in interfaces with
+    //   alternate settings, which are (re)allocated on each SET_INTERFACE
+    //   and SET_CONFIGURATION request (see select_alternate()). Manages PMA
+    //   memory between end of buffer descriptor table and statically
+    //   allocated buffers as 8-byte granules (max 64, bit N of _used).
+    //   Requests are rounded up to power-of-two slab sizes (8 ... 256
+    //   bytes) placed at naturally aligned offsets, so freed slabs always
+    //   coalesce and the arena never needs compaction.
+    class PmaArena {
+      public:
+        constexpr
+        PmaArena()
+        :   _used       (0),
+            _base       (0),
+            _num_granules(0)
+        {}
+
+        void init(
+        const uint16_t  base ,    // PMA (USB peripheral) byte addresses
+        const uint16_t  limit)
+        {
+            _base         = (base + GRANULE - 1) & ~(GRANULE - 1);
+            _num_granules = limit > _base ? (limit - _base) / GRANULE : 0;
+            if (_num_granules > 64)
+                _num_granules = 64;
+            _used         = 0;
+        }
+
+        // returns PMA address, or 0 (never valid, is BTABLE) if no room
+        uint16_t alloc(
+        const uint16_t  size)
+        {
+            const uint8_t   granules = slab_granules(size);
+            const uint64_t  mask     = slab_mask    (granules);
+
+            for (uint8_t ndx = 0                       ;
+                         ndx + granules <= _num_granules;
+                         ndx += granules                )
+                if (!(_used & (mask << ndx))) {
+                    _used |= mask << ndx;
+                    return _base + ndx * GRANULE;
+                }
+
+            return 0;
+        }
+
+        void release(
+        const uint16_t  addr,   // as returned by alloc()
+        const uint16_t  size)   // as passed to alloc()
+        {
+            _used &= ~(  slab_mask(slab_granules(size))
+                       << ((addr - _base) / GRANULE)   );
+        }
+
+        // bytes never allocated by arena
+        uint16_t free_bytes()
+        const
+        {
+            uint16_t    free = 0;
+
+            for (uint8_t ndx = 0 ; ndx < _num_granules ; ++ndx)
+                if (!(_used & (static_cast<uint64_t>(1) << ndx)))
+                    free += GRANULE;
+
+            return free;
+        }
+
+        static const uint16_t   GRANULE = 8;
+
+      protected:
+        static uint8_t slab_granules(
+        const uint16_t  size)
+        {
+            uint8_t     granules = 1;
+
+            while (granules * GRANULE < size)
+                granules <<= 1;
+
+            return granules;
+        }
+
+        static uint64_t slab_mask(
+        const uint8_t   granules)
+        {
+            return   granules >= 64
+                   ? ~static_cast<uint64_t>(0)
+                   : (static_cast<uint64_t>(1) << granules) - 1;
+        }
+
+        uint64_t    _used        ;
+        uint16_t    _base        ;
+        uint8_t     _num_granules;
+    };  // class PmaArena
+
 
     // for handling multiple transfers to host via USB control endpoint pipe
     template <typename CONST_OR_NON> class DataInfo {
@@ -456,6 +829,16 @@ class UsbDev {
 
         void reset() { _offset = _length = 0; }
 
+        // USB standard: never transfer more than SETUP packet wLength
+        void limit(
+        const uint16_t      max_length)
+        {
+            if (_length > max_length)
+                _length = max_length;
+        }
+
+        uint16_t offset() const { return _offset; }
+
       protected:
         CONST_OR_NON    _buffer;
         uint16_t        _length,
@@ -558,18 +941,22 @@ class UsbDev {
 #endif
 
 
-    static const uint32_t   _BTABLE_OFFSET = 0;
+    static const uint32_t   _BTABLE_OFFSET     = 0,
+                            _BTABLE_ENTRY_SIZE = 8;  // PMA (not CPU) bytes
 
     static const uint8_t    _DESCRIPTOR_SIZE_NDX             =  0,
                             _DEVICE_DESC_MAX_PACKET_SIZE_NDX =  7,
                             _DEVICE_DESC_NUM_CONFIGS_NDX     = 17,
                             _SERIAL_NUMBER_STRING_NDX        =  3,
                             _SERIAL_NUMBER_STRING_LEN        = 24,
+                            _INTERFACE_DESC_NUMBER_NDX       =  2,
+                            _INTERFACE_DESC_ALTERNATE_NDX    =  3,
                             _ENDPOINT_DESC_ADDRESS_NDX       =  2,
                             _ENDPOINT_DESC_ATTRIBUTES_NDX    =  3,
                             _ENDPOINT_DESC_PACKET_SIZE_NDX   =  4;
 
-    static const uint8_t    _ENDPOINT_ATTRS_TYPE_MASK = 0x0f;
+    static const uint8_t    _ENDPOINT_ATTRS_TYPE_MASK     = 0x0f,
+                            _ENDPOINT_ATTRS_TRANSFER_MASK = 0x03;
 
     static const uint8_t    IMPOSSIBLE_DEV_ADDR = 0xff;
 
@@ -579,17 +966,24 @@ class UsbDev {
     static const stm32f103xb::Usb::Epr::mskd_t  _DESC_EP_TYPE_TO_EPR_EP_TYPE[];
 
     // derived class implements _DEVICE_DESC, _CONFIG_DESC, and _STRING_DESCS
+    // _STRING_DESCS[0] is raw USB language ID descriptor, all others are
+    //   compact: null-terminated UTF-8 strings (Unicode Basic Multilingual
+    //   Plane only, max 126 characters) expanded to UTF-16 USB string
+    //   descriptors on the fly when written to PMA memory (see
+    //   writ_pma_string())
     // _CONFIG_DESC parsed in init() -- minimal checking done, malformed
     //   descriptor (bad bLength fields, duplicate or 0==control
     //   bEndpointAddress values, etc) will cause HardFault exception or
     //   inoperative USB peripheral. (Note *can* have bEndpointAddress of
     //   0x8n and 0x0n -- IN and OUT endpoints with same numeric address.)
+    // _CONFIG_DESC normally points to constexpr object built with
+    //   usb_dev_descriptors.hxx, which computes wTotalLength etc.
     static const uint8_t    _DEVICE_DESC              [],
                             _LANGUAGE_ID_STRING_DESC  [],
-                            _VENDOR_STRING_DESC       [];
-                            // must be non-const because runtime setting of ...
-    static       uint8_t    _CONFIG_DESC              [],  // ... bLength field
-                            _SERIAL_NUMBER_STRING_DESC[];  // ... all bytes
+                            _VENDOR_STRING_DESC       [],
+                            _SERIAL_NUMBER_STRING_DESC[];  // placeholder
+    static const uint8_t* const
+                            _CONFIG_DESC                  ;
     static const uint8_t*   _STRING_DESCS[];
 
     void    reset(),
@@ -606,12 +1000,144 @@ class UsbDev {
             endpoint_request  (),
             descriptor_request();
 
+    // bit of _wedged: OUT endpoints 0 to 15, IN 16 to 31
+    static uint32_t wedge_bit(
+    const uint8_t   endpoint_address)
+    {
+        return   1UL
+              << (  (endpoint_address & ENDPOINT_ADDR_MASK)
+                  + (endpoint_address & ENDPOINT_DIR_IN ? 16 : 0));
+    }
+
+    // For use by derived class device_class_setup() instead of
+    //   _recv_info.set() when host-to-device data stage (up to SETUP
+    //   packet wLength bytes, any number of packets) is to be passed
+    //   piecewise to callback instead of into a single buffer
+    void    control_out_stream(ControlOutStream     callback ,
+                               void                *user_data,
+                               const uint16_t       length   )
+    {
+        _recv_info.set(0, length);
+        _control_out_stream    = callback ;
+        _control_out_user_data = user_data;
+    }
+
     bool    device_class_setup();  // derived class must provide
     void    set_configuration ();  //    "      "    "      "
     void    set_interface     ();  //    "      "    "      "
 
     void    set_address(const uint8_t   address);
 
+    // endpoint (re)configuration for interfaces with alternate settings
+    bool    select_alternate (const uint8_t     interface,
+                              const uint8_t     alternate),
+            allocate_endpoint(const uint8_t    *desc     );
+    void    release_interface(const uint8_t     interface),
+            enable_eprn      (const uint8_t     eprn_ndx ),
+            rewrite_eprn     (const uint8_t     eprn_ndx ,
+                              const stm32f103xb::Usb::Epr::mskd_t
+                                                bits     );
+
+    // Double-buffered endpoints (see constructor). Buffer 0 is described
+    //   by the buffer descriptor table ADDR_TX/COUNT_TX entry and
+    //   Endpoint::send_pma, buffer 1 by ADDR_RX/COUNT_RX and
+    //   Endpoint::recv_pma, for both IN and OUT endpoints. The application
+    //   owns the buffer selected by the endpoint register's SW_BUF bit
+    //   (DTOG_RX bit for IN, DTOG_TX for OUT) and the peripheral the one
+    //   selected by DTOG (DTOG_TX for IN, DTOG_RX for OUT), NAKing the
+    //   host when both are the same. Toggling SW_BUF passes the
+    //   application's buffer to the peripheral and takes the other.
+    //
+    bool double_buffered(const uint8_t  endpoint) const
+    {
+        return _double_buffered & (1 << endpoint);
+    }
+
+    static bool dbl_buf_sw_buf(
+    const uint8_t   eprn_ndx,
+    const bool      in      )
+    {
+        return    stm32f103xb::usb->eprn(eprn_ndx).word()
+               & (  in
+                  ? stm32f103xb::Usb::Epr::DTOG_RX_DATA1
+                  : stm32f103xb::Usb::Epr::DTOG_TX_DATA1).bits();
+    }
+
+    static bool dbl_buf_dtog(
+    const uint8_t   eprn_ndx,
+    const bool      in      )
+    {
+        return    stm32f103xb::usb->eprn(eprn_ndx).word()
+               & (  in
+                  ? stm32f103xb::Usb::Epr::DTOG_TX_DATA1
+                  : stm32f103xb::Usb::Epr::DTOG_RX_DATA1).bits();
+    }
+
+    uint32_t* recv_pma(
+    const uint8_t   endpoint)
+    {
+        uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
+
+        bool        buffer_0 =    (   double_buffered(endpoint)
+                                   && !dbl_buf_sw_buf(eprn_ndx, false))
+                               || (   isochronous    (endpoint)
+                                   &&  dbl_buf_dtog  (eprn_ndx, false));
+
+        return   buffer_0
+               ? _endpoints[eprn_ndx].send_pma
+               : _endpoints[eprn_ndx].recv_pma;
+    }
+
+    uint32_t* send_pma(
+    const uint8_t   endpoint)
+    {
+        uint8_t     eprn_ndx = _epaddr2eprn[endpoint];
+
+        bool        buffer_1 =    (   double_buffered(endpoint)
+                                   &&  dbl_buf_sw_buf(eprn_ndx, true))
+                               || (   isochronous    (endpoint)
+                                   && !dbl_buf_dtog  (eprn_ndx, true));
+
+        return   buffer_1
+               ? _endpoints[eprn_ndx].recv_pma
+               : _endpoints[eprn_ndx].send_pma;
+    }
+
+    static void dbl_buf_toggle(const uint8_t    eprn_ndx,
+                               const bool       in      );
+           void dbl_buf_recv_done(const uint8_t     endpoint),
+                dbl_buf_send     (const uint8_t     endpoint,
+                                  const uint16_t    length  ),
+                dbl_buf_ctr      (const uint8_t     eprn_ndx,
+                                  const uint8_t     endpoint);
+
+    // Isochronous endpoints (EP_TYPE_ISO) are always double-buffered by
+    //   the peripheral, with the same two buffers as above, but with no
+    //   SW_BUF handshake: STAT is always VALID, the peripheral uses the
+    //   buffer selected by DTOG (DTOG_TX for IN, DTOG_RX for OUT) and
+    //   toggles DTOG after every frame's transaction, completed or not.
+    //   The application owns the other buffer (buffer 0 when DTOG set).
+    //
+    bool isochronous(const uint8_t  endpoint) const
+    {
+        return _isochronous & (1 << endpoint);
+    }
+
+    void iso_send(const uint8_t                     endpoint,
+                  const uint16_t                    length  ,
+                  const volatile uint32_t* const    buf     ),
+         iso_ctr (const uint8_t                     eprn_ndx,
+                  const uint8_t                     endpoint);
+
+    // PMA buffer address to CPU address
+    static uint32_t* pma_to_cpu(
+    const uint16_t  pma_addr)
+    {
+        return reinterpret_cast<uint32_t*>(  stm32f103xb::USB_PMAADDR
+                                           + _BTABLE_OFFSET
+                                           + (pma_addr << 1)         );
+    }
+
     void    writ_pma_data(const uint8_t*  const     data,
                                 uint32_t* const     addr,
                           const uint16_t            size),
@@ -619,6 +1145,20 @@ class UsbDev {
                           const uint32_t* const     addr,
                           const uint16_t            size);
 
+    // wTotalLength field of _CONFIG_DESC
+    static uint16_t config_desc_total_size()
+    {
+        return    _CONFIG_DESC[CONFIG_DESC_SIZE_NDX    ]
+               | (_CONFIG_DESC[CONFIG_DESC_SIZE_NDX + 1] << 8);
+    }
+
+    // compact string descriptor support
+    static uint8_t  string_desc_length(const uint8_t     *utf8);
+    static uint16_t utf8_to_utf16     (const uint8_t*    &utf8);
+           uint16_t serial_number_char(const uint8_t      ndx ) const;
+           void     writ_pma_string   (      uint32_t*    addr,
+                                       const uint16_t     size);
+
 
     // fake endpoint count of 1 okay, only using  statically-checked EPRN<0>()
     stm32f103xb ::UsbPmaDescs<1, _BTABLE_OFFSET>    _pma_descs;
@@ -652,8 +1192,22 @@ class UsbDev {
                                                 ::Usb
                                                 ::NUM_ENDPOINT_REGS   ];
 
+                                // current bAlternateSetting, per interface
+      uint8_t                   _alt_settings  [USB_DEV_MAX_INTERFACES];
+
+      PmaArena                  _pma_arena            ;
+      uint32_t                  _dynamic_interfaces   ;  // bit N: interface N
+                                                         // has alt settings
+
       DataInfo<const uint8_t*>  _send_info            ;
       DataInfo<      uint8_t*>  _recv_info            ;
+      ControlOutStream          _control_out_stream   ;
+      void                     *_control_out_user_data;
+      const uint8_t            *_string_desc_utf8     ;  // 0 if not sending
+      uint32_t                  _unique_id[3]         ;  // most significant
+                                                         //   word first
+      bool                      _setup_stall          ;  // request error,
+                                                         // set by handlers
       SetupPacket*              _setup_packet         ;
       DeviceState               _device_state         ;
       Status                    _status               ;
@@ -661,10 +1215,17 @@ class UsbDev {
                                 // bit N indicates USB endpoint descriptor addr
       uint16_t                  _recv_readys          ,
                                 _send_readys          ,
-                                _send_readys_pending  ;
+                                _send_readys_pending  ,
+                                _double_buffered      ,  // fixed at init()
+                                _dbl_buf_pending      ,  // app buffer waiting
+                                                         //   for toggle
+                                _isochronous          ;  // fixed at init()
+
+      uint32_t                  _wedged               ;  // see wedge_bit()
 
       uint16_t                  _last_send_size       ;
-      uint8_t                   _num_eprns            ,
+      uint8_t                   _string_desc_length   ,
+                                _num_eprns            ,
                                 _current_configuration,
                                 _current_interface    ,
                                 _pending_set_addr     ;
@@ -0,0 +1,880 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_audio.hxx>
+#include <usb_dev_descriptors.hxx>
+
+namespace stm32f10_12357_xx {
+
+using namespace stm32f103xb;
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),   // bDescriptorType
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0x00,   // bDeviceClass: defined by interfaces
+    0x00,   // bDeviceSubClass
+    0x00,   // bDeviceProtocol
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x30,   // idProduct = 0x5730 "Audio in FS Mode"
+    0x57,   //     "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+// Input Terminal, Feature Unit (master channel mute and volume), Output
+//   Terminal chain for one direction. Mono, so no channel cluster
+//   spatial locations.
+static constexpr auto terminal_descs(
+const uint8_t   input_terminal,
+const uint16_t  input_type    ,
+const uint16_t  output_type   )
+{
+    return usb_desc::concat(
+        // Input Terminal
+        usb_desc::class_specific(
+            usb_desc::CS_INTERFACE,
+            0x02,                       // bDescriptorSubtype: INPUT_TERMINAL
+            input_terminal,             // bTerminalID
+            usb_desc::lsb(input_type),  // wTerminalType
+            usb_desc::msb(input_type),  //       "
+            0x00,                       // bAssocTerminal: none
+            0x01,                       // bNrChannels: mono
+            0x00,                       // wChannelConfig: none
+            0x00,                       //       "
+            0x00,                       // iChannelNames: unused
+            0x00),                      // iTerminal: unused
+
+        // Feature Unit
+        usb_desc::class_specific(
+            usb_desc::CS_INTERFACE,
+            0x06,                       // bDescriptorSubtype: FEATURE_UNIT
+            input_terminal + 1,         // bUnitID
+            input_terminal,             // bSourceID
+            0x01,                       // bControlSize
+            0x03,                       // bmaControls(0): mute, volume
+            0x00,                       // bmaControls(1): none
+            0x00),                      // iFeature: unused
+
+        // Output Terminal
+        usb_desc::class_specific(
+            usb_desc::CS_INTERFACE,
+            0x03,                       // bDescriptorSubtype: OUTPUT_TERMINAL
+            input_terminal + 2,         // bTerminalID
+            usb_desc::lsb(output_type), // wTerminalType
+            usb_desc::msb(output_type), //       "
+            0x00,                       // bAssocTerminal: none
+            input_terminal + 1,         // bSourceID: feature unit
+            0x00));                     // iTerminal: unused
+}
+
+// AudioStreaming interface: alternate setting 0 (no bandwidth) and 1
+//   (16-bit mono PCM, continuous sampling frequency MIN_HZ to MAX_HZ)
+template<typename... ENDPOINTS>
+static constexpr auto streaming_descs(
+const uint8_t           interface,
+const uint8_t           terminal ,
+const ENDPOINTS&...     endpoints)
+{
+    return usb_desc::concat(
+        usb_desc::interface(
+            interface,  // bInterfaceNumber
+            0,          // bAlternateSetting: zero bandwidth
+            0x01,       // bInterfaceClass: Audio
+            0x02,       // bInterfaceSubClass: AudioStreaming
+            0x00,       // bInterfaceProtocol: unused
+            0),         // iInterface
+
+        usb_desc::interface(
+            interface,  // bInterfaceNumber
+            1,          // bAlternateSetting: streaming
+            0x01,       // bInterfaceClass: Audio
+            0x02,       // bInterfaceSubClass: AudioStreaming
+            0x00,       // bInterfaceProtocol: unused
+            0,          // iInterface
+
+            // AS_GENERAL
+            usb_desc::class_specific(
+                usb_desc::CS_INTERFACE,
+                0x01,       // bDescriptorSubtype: AS_GENERAL
+                terminal,   // bTerminalLink
+                0x01,       // bDelay: frames
+                0x01,       // wFormatTag: PCM
+                0x00),      //      "
+
+            // Type I format
+            usb_desc::class_specific(
+                usb_desc::CS_INTERFACE,
+                0x02,       // bDescriptorSubtype: FORMAT_TYPE
+                0x01,       // bFormatType: FORMAT_TYPE_I
+                0x01,       // bNrChannels: mono
+                0x02,       // bSubFrameSize: bytes
+                16,         // bBitResolution
+                0x00,       // bSamFreqType: continuous
+                UsbDevAudio::MIN_HZ        & 0xff,  // tLowerSamFreq
+               (UsbDevAudio::MIN_HZ >>  8) & 0xff,  //       "
+               (UsbDevAudio::MIN_HZ >> 16) & 0xff,  //       "
+                UsbDevAudio::MAX_HZ        & 0xff,  // tUpperSamFreq
+               (UsbDevAudio::MAX_HZ >>  8) & 0xff,  //       "
+               (UsbDevAudio::MAX_HZ >> 16) & 0xff), //       "
+
+            endpoints...));
+}
+
+// Class-specific isochronous audio data endpoint descriptor
+static constexpr auto   as_endpoint = usb_desc::class_specific(
+    usb_desc::CS_ENDPOINT,
+    0x01,           // bDescriptorSubtype: EP_GENERAL
+    0x01,           // bmAttributes: sampling frequency control
+    0x00,           // bLockDelayUnits: unused
+    0x00,           // wLockDelay: unused
+    0x00);          //     "
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0x80,           // bmAttributes: bus powered
+    100,            // MaxPower: mA
+
+    // Audio Control
+    usb_desc::interface(
+        UsbDevAudio::AUDIO_CONTROL_INTERFACE,
+        0,          // bAlternateSetting
+        0x01,       // bInterfaceClass: Audio
+        0x01,       // bInterfaceSubClass: Audio Control
+        0x00,       // bInterfaceProtocol: unused
+        0,          // iInterface
+
+#if USB_DEV_AUDIO_SPEAKER && USB_DEV_AUDIO_MIC
+        usb_desc::audio_control_header(
+            0x0100,                                     // bcdADC: 1.0
+            usb_desc::raw(UsbDevAudio::SPEAKER_INTERFACE,
+                          UsbDevAudio::MIC_INTERFACE    ),
+            terminal_descs(UsbDevAudio::SPEAKER_INPUT_TERMINAL,
+                           0x0101,  // USB streaming
+                           0x0301), // speaker
+            terminal_descs(UsbDevAudio::MIC_INPUT_TERMINAL,
+                           0x0201,  // microphone
+                           0x0101)))
+#elif USB_DEV_AUDIO_SPEAKER
+        usb_desc::audio_control_header(
+            0x0100,                                     // bcdADC: 1.0
+            usb_desc::raw(UsbDevAudio::SPEAKER_INTERFACE),
+            terminal_descs(UsbDevAudio::SPEAKER_INPUT_TERMINAL,
+                           0x0101,  // USB streaming
+                           0x0301)))
+#else
+        usb_desc::audio_control_header(
+            0x0100,                                     // bcdADC: 1.0
+            usb_desc::raw(UsbDevAudio::MIC_INTERFACE),
+            terminal_descs(UsbDevAudio::MIC_INPUT_TERMINAL,
+                           0x0201,  // microphone
+                           0x0101)))
+#endif
+
+#if USB_DEV_AUDIO_SPEAKER
+    // asynchronous data OUT endpoint, explicit feedback IN endpoint
+    , streaming_descs(
+        UsbDevAudio::SPEAKER_INTERFACE,
+        UsbDevAudio::SPEAKER_INPUT_TERMINAL,
+
+        usb_desc::audio_endpoint(UsbDevAudio::SPEAKER_ENDPOINT,
+                                 UsbDev::EndpointType::ISYNCHRONOUS,
+                                 UsbDevAudio::MAX_PACKET,
+                                 1,     // bInterval: every frame
+                                 0x04,  // asynchronous
+                                 0,     // bRefresh: unused
+                                   UsbDevAudio::FEEDBACK_ENDPOINT
+                                 | UsbDev::ENDPOINT_DIR_IN     ),
+        as_endpoint,
+
+        usb_desc::audio_endpoint(  UsbDevAudio::FEEDBACK_ENDPOINT
+                                 | UsbDev::ENDPOINT_DIR_IN,
+                                 UsbDev::EndpointType::ISYNCHRONOUS,
+                                 UsbDevAudio::FEEDBACK_SIZE,
+                                 1,     // bInterval: must be 1
+                                 0x00,  // no synchronization
+                                 UsbDevAudio::FEEDBACK_REFRESH,
+                                 0))    // bSynchAddress: unused
+#endif
+
+#if USB_DEV_AUDIO_MIC
+    // asynchronous data IN endpoint, implicit feedback (sample count)
+    , streaming_descs(
+        UsbDevAudio::MIC_INTERFACE,
+        UsbDevAudio::MIC_OUTPUT_TERMINAL,
+
+        usb_desc::audio_endpoint(  UsbDevAudio::MIC_ENDPOINT
+                                 | UsbDev::ENDPOINT_DIR_IN,
+                                 UsbDev::EndpointType::ISYNCHRONOUS,
+                                 UsbDevAudio::MAX_PACKET,
+                                 1,     // bInterval: every frame
+                                 0x04,  // asynchronous
+                                 0,     // bRefresh: unused
+                                 0),    // bSynchAddress: unused
+        as_endpoint)
+#endif
+    );
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t UsbDevAudio::_QUALIFIER_DESC[] = {
+    10,     // bLength: qualifier size
+    static_cast<uint8_t>(UsbDev::Descriptor::DEVICE_QUALIFIER),
+    0x00,   // undocumented configuration values
+    0x02,   //      "             "         "
+    0x00,   //      "             "         "
+    0x00,   //      "             "         "
+    0x00,   //      "             "         "
+    0x40,   //      "             "         "
+    0x01,   //      "             "         "
+    0x00,   //      "             "         "
+};
+
+const uint8_t   UsbDevAudio::_device_string_desc[] = "STM32 Audio";
+
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev     ::  language_id_string_desc(),
+    UsbDev     ::       vendor_string_desc(),
+    UsbDevAudio::       device_string_desc(),
+    UsbDev     ::serial_number_string_desc(),
+};
+
+
+// 10^(-dB/20) * 32768, rounded
+const uint16_t  UsbDevAudio::_VOLUME_GAINS[] = {
+    32768, 29205, 26029, 23198, 20675, 18427, 16423, 14637, 13045, 11627,
+    10362,  9235,  8231,  7336,  6538,  5827,  5193,  4629,  4125,  3677,
+     3277,  2920,  2603,  2320,  2068,  1843,  1642,  1464,  1305,  1163,
+     1036,   924,   823,   734,   654,   583,   519,   463,   413,   368,
+      328,   292,   260,   232,   207,   184,   164,   146,   130,   116,
+      104,    92,    82,    73,    65,    58,    52,    46,    41,    37,
+       33,
+};
+
+
+
+void UsbDevAudio::speaker_init(
+volatile DmaChannel*     const  dma    ,
+volatile void*           const  output ,
+const volatile uint16_t* const  counter)
+{
+    _speaker_dma    = dma     ;
+    _sample_counter = counter ;
+    _speaker_base   = *counter;
+
+    speaker_silence();
+
+#if USB_DEV_AUDIO_SPEAKER
+    dma->ccr = 0;
+    dma->pa  = reinterpret_cast<uintptr_t>(output       );
+    dma->ma  = reinterpret_cast<uintptr_t>(_speaker_ring);
+    dma->ndt = RING_SIZE                                 ;
+    dma->ccr =   DmaChannel::Ccr::DIR_MEM2PERIPH
+               | DmaChannel::Ccr::PL_VERY_HIGH
+               | DmaChannel::Ccr::MSIZE_16_BITS
+               | DmaChannel::Ccr::PSIZE_16_BITS
+               | DmaChannel::Ccr::MINC
+               | DmaChannel::Ccr::CIRC
+               | DmaChannel::Ccr::EN          ;
+#else
+    (void)output;
+#endif
+
+}  // speaker_init()
+
+
+
+void UsbDevAudio::pwm_range(
+const uint16_t  range)
+{
+    _pwm_range = range;
+
+    // else ring refilled by next packets
+    if (!_streaming[SPEAKER])
+        speaker_silence();
+
+}  // pwm_range()
+
+
+
+void UsbDevAudio::mic_init(
+volatile DmaChannel* const  dma     ,
+const volatile void* const  input   ,
+const uint8_t               adc_bits)
+{
+    _mic_dma  = dma     ;
+    _adc_bits = adc_bits;
+
+#if USB_DEV_AUDIO_MIC
+    dma->ccr = 0;
+    dma->pa  = reinterpret_cast<uintptr_t>(input    );
+    dma->ma  = reinterpret_cast<uintptr_t>(_mic_ring);
+    dma->ndt = RING_SIZE                             ;
+    dma->ccr =   DmaChannel::Ccr::DIR_PERIPH2MEM
+               | DmaChannel::Ccr::PL_VERY_HIGH
+               | DmaChannel::Ccr::MSIZE_16_BITS
+               | DmaChannel::Ccr::PSIZE_16_BITS
+               | DmaChannel::Ccr::MINC
+               | DmaChannel::Ccr::CIRC
+               | DmaChannel::Ccr::EN          ;
+#else
+    (void)input;
+#endif
+
+}  // mic_init()
+
+
+
+void UsbDevAudio::audio_poll()
+{
+    // no SET_CONFIGURATION or SET_INTERFACE after bus reset
+    if (device_state() != DeviceState::CONFIGURED)
+        streaming_changed();
+
+#ifndef USB_DEV_ENDPOINT_CALLBACKS
+    speaker_recv ();
+    send_feedback();
+    mic_send     ();
+#endif
+
+    if (_streaming[SPEAKER])
+        measure_feedback();
+
+}  // audio_poll()
+
+
+
+void UsbDevAudio::streaming_changed()
+{
+    bool    configured = device_state() == DeviceState::CONFIGURED;
+
+#if USB_DEV_AUDIO_SPEAKER
+    bool    speaker =    configured
+                      && _sample_counter
+                      && alternate_setting(SPEAKER_INTERFACE) == 1;
+
+    if (speaker != _streaming[SPEAKER]) {
+        _streaming[SPEAKER] = speaker;
+
+        if (speaker)
+            speaker_start  ();
+        else
+            speaker_silence();
+    }
+#endif
+
+#if USB_DEV_AUDIO_MIC
+    bool    mic =    configured
+                  && _mic_dma
+                  && alternate_setting(MIC_INTERFACE) == 1;
+
+    if (mic != _streaming[MIC]) {
+        _streaming[MIC] = mic;
+
+        if (mic)
+            mic_start();
+    }
+#endif
+
+}  // streaming_changed()
+
+
+
+void UsbDevAudio::speaker_silence()
+{
+#if USB_DEV_AUDIO_SPEAKER
+    uint16_t    silence = _pwm_range >> 1;
+
+    for (uint16_t ndx = 0 ; ndx < RING_SIZE ; ++ndx)
+        _speaker_ring[ndx] = silence;
+#endif
+
+}  // speaker_silence()
+
+
+
+// Ring half full of silence, so host's first packets have half a ring
+//   of time to arrive before underrun
+//
+void UsbDevAudio::speaker_start()
+{
+    speaker_silence();
+
+    _speaker_written  = *_sample_counter + _RING_TARGET;
+    _feedback         = nominal_feedback(_hz[SPEAKER]) ;
+    _feedback_restart = true                           ;
+
+}  // speaker_start()
+
+
+
+void UsbDevAudio::speaker_pad(
+const uint16_t  samples)
+{
+#if USB_DEV_AUDIO_SPEAKER
+    uint16_t    silence = _pwm_range >> 1;
+
+    for (uint16_t count = 0 ; count < samples ; ++count)
+        _speaker_ring[speaker_ndx(_speaker_written++)] = silence;
+#else
+    (void)samples;
+#endif
+
+}  // speaker_pad()
+
+
+
+void UsbDevAudio::speaker_recv()
+{
+#if USB_DEV_AUDIO_SPEAKER
+    if (!_streaming[SPEAKER] || !(_recv_readys & (1 << SPEAKER_ENDPOINT)))
+        return;
+
+    uint16_t    samples = recv_lnth(SPEAKER_ENDPOINT) >> 1,
+                played  = *_sample_counter                ;
+    int16_t     fill    = _speaker_written - played       ;
+
+    if (fill < 0) {
+        // DMA ran past newest sample (into guard silence), restart at
+        //   half full
+        ++_underruns[SPEAKER];
+        _speaker_written = played;
+        speaker_pad(_RING_TARGET);
+        fill = _RING_TARGET;
+    }
+
+    // never overwrite samples not yet played, nor guard
+    uint16_t    room = RING_SIZE - 1 - _GUARD - fill;
+
+    if (samples > room) {
+        ++_overruns[SPEAKER];
+        samples = room;
+    }
+
+    for (uint8_t ndx = 0 ; ndx < samples ; ++ndx)
+          _speaker_ring[speaker_ndx(_speaker_written++)]
+        = speaker_sample(static_cast<int16_t>(read(SPEAKER_ENDPOINT, ndx)));
+
+    // so late packet plays silence, not samples from one ring ago
+    uint16_t    silence = _pwm_range >> 1;
+
+    for (uint16_t ndx = 0 ; ndx < _GUARD ; ++ndx)
+        _speaker_ring[speaker_ndx(_speaker_written + ndx)] = silence;
+
+    recv_done(SPEAKER_ENDPOINT);
+#endif
+
+}  // speaker_recv()
+
+
+
+void UsbDevAudio::send_feedback()
+{
+#if USB_DEV_AUDIO_SPEAKER
+    if (!_streaming[SPEAKER] || !(_send_readys & (1 << FEEDBACK_ENDPOINT)))
+        return;
+
+    uint32_t             feedback = _feedback                    ;  // 10.14,
+    volatile uint32_t   *buf      = send_buf(FEEDBACK_ENDPOINT);  //   3 bytes
+
+    // same buffer throughout, see UsbDev::send(endpoint, length, buf)
+    buf[0] =  feedback        & 0xffff;
+    buf[1] = (feedback >> 16) & 0x00ff;
+    send(FEEDBACK_ENDPOINT, FEEDBACK_SIZE, buf);
+#endif
+
+}  // send_feedback()
+
+
+
+// Samples played per frame, averaged over FEEDBACK_FRAMES frames, minus
+//   ring's distance from half full spread over the next FEEDBACK_FRAMES
+//   frames. Frame boundaries found by polling frame number (no SOF
+//   interrupt or timer capture), so each end of the interval is late by
+//   up to the audio_poll() call interval, averaged out over the interval.
+//
+void UsbDevAudio::measure_feedback()
+{
+    uint16_t    frame = frame_number();
+
+    if (frame == _feedback_frame)
+        return;
+
+    uint16_t    count = *_sample_counter;
+
+    _feedback_frame = frame;
+
+    if (_feedback_restart) {
+        _feedback_restart = false;
+        _feedback_start   = frame;
+        _feedback_samples = count;
+        return;
+    }
+
+    uint16_t    frames = (frame - _feedback_start) & 0x07ff;  // 11 bits
+
+    if (frames < FEEDBACK_FRAMES)
+        return;
+
+    // main loop stalled, 16-bit sample count may have wrapped
+    if (frames >= 2 * FEEDBACK_FRAMES) {
+        _feedback_start   = frame;
+        _feedback_samples = count;
+        return;
+    }
+
+    uint32_t    samples  = static_cast<uint16_t>(count - _feedback_samples),
+                nominal  = nominal_feedback(_hz[SPEAKER])                  ;
+    int16_t     fill     = _speaker_written - count                        ;
+    int32_t     feedback =   static_cast<int32_t>((samples << 14) / frames)
+                           -   (fill - static_cast<int32_t>(_RING_TARGET))
+                             * (1 << 14) / FEEDBACK_FRAMES                 ;
+
+    // +/- 1 sample per frame
+    if (feedback < static_cast<int32_t>(nominal - (1 << 14)))
+        feedback = nominal - (1 << 14);
+    else if (feedback > static_cast<int32_t>(nominal + (1 << 14)))
+        feedback = nominal + (1 << 14);
+
+    _feedback         = feedback;
+    _feedback_start   = frame   ;
+    _feedback_samples = count   ;
+
+}  // measure_feedback()
+
+
+
+void UsbDevAudio::mic_start()
+{
+#if USB_DEV_AUDIO_MIC
+    _mic_read  = (RING_SIZE - _mic_dma->ndt - _RING_TARGET) & _RING_MASK;
+    _mic_accum = 0;
+#endif
+
+}  // mic_start()
+
+
+
+// Sends sampling frequency / 1000 samples (fraction carried to later
+//   frames), one more or fewer if ring is more than a packet away from
+//   half full, so host follows device's sample clock.
+//
+void UsbDevAudio::mic_send()
+{
+#if USB_DEV_AUDIO_MIC
+    if (!_streaming[MIC] || !(_send_readys & (1 << MIC_ENDPOINT)))
+        return;
+
+    uint16_t    write   = (RING_SIZE - _mic_dma->ndt) & _RING_MASK,
+                avail   = (write - _mic_read)         & _RING_MASK,
+                samples;
+
+    _mic_accum += _hz[MIC]           ;
+    samples     = _mic_accum / 1000  ;
+    _mic_accum -= samples    * 1000  ;
+
+    if (avail > RING_SIZE - _GUARD) {
+        // DMA about to overwrite unsent samples, restart at half full
+        ++_overruns[MIC];
+        _mic_read = (write - _RING_TARGET) & _RING_MASK;
+        avail     = _RING_TARGET                       ;
+    }
+
+    if (avail > _RING_TARGET + _GUARD)
+        ++samples;
+    else if (avail + _GUARD < _RING_TARGET)
+        --samples;
+
+    if (samples > _GUARD)
+        samples = _GUARD;
+
+    if (samples > avail) {
+        ++_underruns[MIC];
+        samples = avail;
+    }
+
+    // same buffer throughout, see UsbDev::send(endpoint, length, buf)
+    volatile uint32_t   *buf = send_buf(MIC_ENDPOINT);
+
+    for (uint8_t ndx = 0 ; ndx < samples ; ++ndx) {
+        buf[ndx]  = static_cast<uint16_t>(mic_sample(_mic_ring[_mic_read]));
+        _mic_read = (_mic_read + 1) & _RING_MASK;
+    }
+
+    send(MIC_ENDPOINT, samples << 1, buf);
+#endif
+
+}  // mic_send()
+
+
+
+void UsbDevAudio::set_cur(
+const uint16_t  length)
+{
+    uint8_t     direction = _set_cur_direction;
+
+    if (_set_cur_endpoint) {
+        if (_set_cur_selector != _SAMPLING_FREQ_CONTROL || length < 3)
+            return;
+
+        uint32_t    hz =            _control_data[0]
+                         | (        _control_data[1] <<  8)
+                         | (static_cast<uint32_t>(
+                                    _control_data[2]) << 16);
+
+        if (hz < MIN_HZ)
+            hz = MIN_HZ;
+        else if (hz > MAX_HZ)
+            hz = MAX_HZ;
+
+        _hz[direction] = hz;
+
+        if (direction == SPEAKER) {
+            _feedback         = nominal_feedback(hz);
+            _feedback_restart = true                ;
+        }
+        else
+            _mic_accum = 0;
+
+        if (_rate_callback)
+            _rate_callback(direction, hz, _rate_user_data);
+
+        return;
+    }
+
+    if (_set_cur_selector == _MUTE_CONTROL && length >= 1)
+        _mutes[direction] = _control_data[0] != 0;
+    else if (_set_cur_selector == _VOLUME_CONTROL && length >= 2) {
+        int16_t     volume = static_cast<int16_t>(  _control_data[0]
+                                                  | (_control_data[1] << 8));
+
+        if (volume < MIN_VOLUME)
+            volume = MIN_VOLUME;
+        else if (volume > MAX_VOLUME)
+            volume = MAX_VOLUME;
+
+        // whole dB, rounded
+        _volumes[direction] = (  (volume - VOLUME_RES / 2)
+                               / VOLUME_RES               ) * VOLUME_RES;
+    }
+    else
+        return;
+
+      _gains[direction]
+    =   _mutes[direction]
+      ? 0
+      : _VOLUME_GAINS[-_volumes[direction] / VOLUME_RES];
+
+}  // set_cur()
+
+
+
+uint8_t* UsbDevAudio::set_cur_stream(
+const uint16_t   offset   ,
+const uint16_t   length   ,
+      void      *user_data)
+{
+    UsbDevAudio     *self = static_cast<UsbDevAudio*>(user_data);
+
+    if (length)
+        return   offset + length <= sizeof(self->_control_data)
+               ? self->_control_data + offset
+               : 0                                             ;
+
+    // data stage complete
+    self->set_cur(offset);
+
+    return 0;
+
+}  // set_cur_stream()
+
+
+
+// Feature unit mute and volume, master channel
+//
+bool UsbDevAudio::feature_request(
+const uint8_t   direction)
+{
+    uint8_t     selector = _setup_packet->value.bytes.byte1;
+    int16_t     value;
+
+    if (   _setup_packet->value.bytes.byte0 != 0  // channel
+        || (   selector != _MUTE_CONTROL
+            && selector != _VOLUME_CONTROL)      ) {
+        _setup_stall = true;
+        return true;
+    }
+
+    switch (_setup_packet->request) {
+        case _REQ_SET_CUR:
+            _set_cur_direction = direction;
+            _set_cur_selector  = selector ;
+            _set_cur_endpoint  = false    ;
+            control_out_stream(set_cur_stream       ,
+                               this                 ,
+                               _setup_packet->length);
+            return true;
+
+        case _REQ_GET_CUR:
+            if (selector == _MUTE_CONTROL) {
+                _control_data[0] = _mutes[direction];
+                _send_info.set(_control_data, 1);
+                return true;
+            }
+            value = _volumes[direction];
+            break;
+
+        case _REQ_GET_MIN: value = MIN_VOLUME; break;
+        case _REQ_GET_MAX: value = MAX_VOLUME; break;
+        case _REQ_GET_RES: value = VOLUME_RES; break;
+
+        default:
+            _setup_stall = true;
+            return true;
+    }
+
+    if (selector != _VOLUME_CONTROL) {  // mute only has CUR
+        _setup_stall = true;
+        return true;
+    }
+
+    _control_data[0] = value & 0xff;
+    _control_data[1] = value >> 8  ;
+    _send_info.set(_control_data, 2);
+
+    return true;
+
+}  // feature_request()
+
+
+
+// Isochronous data endpoint sampling frequency
+//
+bool UsbDevAudio::sampling_request(
+const uint8_t   direction)
+{
+    if (_setup_packet->value.bytes.byte1 != _SAMPLING_FREQ_CONTROL) {
+        _setup_stall = true;
+        return true;
+    }
+
+    switch (_setup_packet->request) {
+        case _REQ_SET_CUR:
+            _set_cur_direction = direction             ;
+            _set_cur_selector  = _SAMPLING_FREQ_CONTROL;
+            _set_cur_endpoint  = true                  ;
+            control_out_stream(set_cur_stream       ,
+                               this                 ,
+                               _setup_packet->length);
+            return true;
+
+        case _REQ_GET_CUR:
+            _control_data[0] =  _hz[direction]        & 0xff;
+            _control_data[1] = (_hz[direction] >>  8) & 0xff;
+            _control_data[2] = (_hz[direction] >> 16) & 0xff;
+            _send_info.set(_control_data, 3);
+            return true;
+
+        default:
+            _setup_stall = true;
+            return true;
+    }
+
+}  // sampling_request()
+
+
+
+bool UsbDevAudio::class_setup()
+{
+    if (   _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_INTERFACE)) {
+        if ((_setup_packet->index & 0xff) != AUDIO_CONTROL_INTERFACE)
+            return false;
+
+        switch (_setup_packet->index >> 8) {  // entity ID
+#if USB_DEV_AUDIO_SPEAKER
+            case SPEAKER_FEATURE_UNIT:
+                return feature_request(SPEAKER);
+#endif
+#if USB_DEV_AUDIO_MIC
+            case MIC_FEATURE_UNIT:
+                return feature_request(MIC);
+#endif
+            default:
+                return false;
+        }
+    }
+
+    if (   _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_ENDPOINT)) {
+        switch (_setup_packet->index & 0xff) {  // bEndpointAddress
+#if USB_DEV_AUDIO_SPEAKER
+            case SPEAKER_ENDPOINT:
+                return sampling_request(SPEAKER);
+#endif
+#if USB_DEV_AUDIO_MIC
+            case MIC_ENDPOINT | ENDPOINT_DIR_IN:
+                return sampling_request(MIC);
+#endif
+            default:
+                return false;
+        }
+    }
+
+    return false;
+
+}  // class_setup()
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevAudio*>(this)->class_setup();
+}
+
+
+
+// Alternate setting 1 starts streaming, 0 stops it
+//
+void UsbDev::set_configuration()
+{
+    static_cast<UsbDevAudio*>(this)->streaming_changed();
+}
+
+void UsbDev::set_interface()
+{
+    static_cast<UsbDevAudio*>(this)->streaming_changed();
+}
+
+
+}  // namespace stm32f10_12357_xx {
@@ -0,0 +1,403 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_AUDIO_HXX
+#define USB_DEV_AUDIO_HXX
+
+// Speaker (host-to-device, isochronous OUT) streaming interface, 0 or 1
+#ifndef USB_DEV_AUDIO_SPEAKER
+#define USB_DEV_AUDIO_SPEAKER       1
+#endif
+
+// Microphone (device-to-host, isochronous IN) streaming interface, 0 or 1
+#ifndef USB_DEV_AUDIO_MIC
+#define USB_DEV_AUDIO_MIC           0
+#endif
+
+// Highest sampling frequency in descriptors. Sets isochronous packet
+//   sizes, so PMA use: up to 48000 for one direction, 31000 if both.
+#ifndef USB_DEV_AUDIO_MAX_HZ
+#define USB_DEV_AUDIO_MAX_HZ        48000
+#endif
+
+// Samples in each direction's RAM ring, power of 2
+#ifndef USB_DEV_AUDIO_RING
+#define USB_DEV_AUDIO_RING          512
+#endif
+
+#include <usb_dev.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+
+namespace stm32f10_12357_xx {
+
+// USB Audio Class 1.0 device: speaker and/or microphone, 16-bit mono PCM
+//   at any sampling frequency from MIN_HZ to MAX_HZ (set by host with
+//   endpoint SET_CUR request), with mute and volume (-60 to 0 dB, 1 dB
+//   steps) feature unit controls. Streaming interfaces have an alternate
+//   setting 0 with no endpoints, selected by the host when not playing
+//   or recording, and setting 1 with the isochronous endpoint(s).
+//
+// Each direction has a RAM ring of RING_SIZE samples between its
+//   isochronous endpoint and a circular DMA stream to or from the audio
+//   peripheral, paced by the peripheral's (or a timer's) sample clock,
+//   set up by speaker_init() or mic_init(). The ring is kept half full,
+//   so the main loop can be late by up to half its length.
+//
+// Speaker: asynchronous isochronous OUT endpoint, with feedback IN
+//   endpoint telling the host how many samples per frame to send, so the
+//   device's sample clock sets the rate. The feedback value (10.14
+//   samples per frame) is measured from a 16-bit counter of samples
+//   output (e.g. a timer clocked by the sample timer's update event) over
+//   FEEDBACK_FRAMES USB frames, timed by polling the frame number in
+//   audio_poll(), and corrected by the ring's distance from half full.
+//   Samples are scaled by mute/volume gain and written to the ring as
+//   signed PCM (e.g. I2S or SPI DAC) or, if pwm_range() set, as
+//   unsigned 0 to range - 1 compare values for timer PWM output. A
+//   frame's worth of silence is kept ahead of the newest sample, so a
+//   late packet plays silence, not stale ring contents.
+//
+// Microphone: asynchronous isochronous IN endpoint. Each frame's packet
+//   has sampling frequency / 1000 samples (fraction accumulated), one
+//   more or less when the ring is more or less than half full, so the
+//   host follows the device's sample clock. Ring samples are unsigned
+//   ADC conversions (mic_init() "adc_bits") or signed PCM.
+//
+// Isochronous packets must be handled every USB frame (1 ms): register
+//   recv_callback() and send_callback() (#ifdef USB_DEV_ENDPOINT_CALLBACKS,
+//   best with USB_DEV_INTERRUPT_DRIVEN), else call audio_poll() more
+//   often than that. audio_poll() must be called in any case, frequently
+//   for accurate feedback. Ring underruns and overruns are counted.
+//
+class UsbDevAudio : public UsbDev
+{
+  public:
+    static const uint8_t    // have to be public for clients, static descriptors
+                            SPEAKER                 = 0,  // direction index
+                            MIC                     = 1,  //     "       "
+                            DIRECTIONS              = 2,
+                            NUM_STREAMING           =   USB_DEV_AUDIO_SPEAKER
+                                                      + USB_DEV_AUDIO_MIC    ,
+                            AUDIO_CONTROL_INTERFACE = 0,
+                            SPEAKER_INTERFACE       = 1,
+                            MIC_INTERFACE           = 1 + USB_DEV_AUDIO_SPEAKER,
+                            SPEAKER_ENDPOINT        = 1,  // OUT
+                            FEEDBACK_ENDPOINT       = 2,  // or'd with 0x80
+                            MIC_ENDPOINT            = 3,  // or'd with 0x80
+                            FEEDBACK_SIZE           = 3,  // 10.14 format
+                            FEEDBACK_REFRESH        = 5,  // host polls every
+                                                          //   2^5 frames
+                            SPEAKER_INPUT_TERMINAL  = 1,  // USB streaming
+                            SPEAKER_FEATURE_UNIT    = 2,
+                            SPEAKER_OUTPUT_TERMINAL = 3,  // speaker
+                            MIC_INPUT_TERMINAL      = 4,  // microphone
+                            MIC_FEATURE_UNIT        = 5,
+                            MIC_OUTPUT_TERMINAL     = 6;  // USB streaming
+
+    static const uint32_t   MIN_HZ          = 8000                ,
+                            MAX_HZ          = USB_DEV_AUDIO_MAX_HZ;
+
+    static const uint16_t   MAX_PACKET      = (MAX_HZ / 1000 + 1) * 2,  // bytes
+                            RING_SIZE       = USB_DEV_AUDIO_RING     ,
+                            FEEDBACK_FRAMES = 256                    ;
+
+    static const int16_t    MIN_VOLUME      = -60 * 256,  // 1/256 dB units
+                            MAX_VOLUME      =   0      ,
+                            VOLUME_RES      = 256      ;
+
+    static_assert(NUM_STREAMING >= 1, "no USB_DEV_AUDIO_SPEAKER or _MIC");
+
+    static_assert(MAX_HZ >= MIN_HZ && MAX_HZ <= 48000,
+                  "USB_DEV_AUDIO_MAX_HZ must be 8000 to 48000");
+
+    static_assert(   (RING_SIZE & (RING_SIZE - 1)) == 0
+                  && RING_SIZE >= 4 * (MAX_PACKET / 2)
+                  && RING_SIZE <= 16384                  ,
+                  "USB_DEV_AUDIO_RING must be power of 2, 4 frames or more");
+
+    // isochronous endpoints have two buffers each, allocated from
+    //   PmaArena (streaming interfaces have alternate settings)
+    static_assert(   pma_used_size(  1
+                                   + USB_DEV_AUDIO_SPEAKER * 2
+                                   + USB_DEV_AUDIO_MIC          ,
+                                     2 * USB_DEV_AUDIO_SPEAKER
+                                   * (  pma_slab_size(pma_recv_size(
+                                                        MAX_PACKET   ))
+                                      + pma_slab_size(pma_send_size(
+                                                        FEEDBACK_SIZE)))
+                                   + 2 * USB_DEV_AUDIO_MIC
+                                   * pma_slab_size(pma_send_size(
+                                                        MAX_PACKET   )))
+                  <= stm32f103xb::USB_PMASIZE,
+                  "audio endpoint buffers don't fit in PMA memory, "
+                  "lower USB_DEV_AUDIO_MAX_HZ");
+
+    // Called when host sets sampling frequency, e.g. to reprogram sample
+    //   clock. Executes in interrupt context if USB_DEV_INTERRUPT_DRIVEN.
+    typedef void (*RateCallback)(const uint8_t      direction,  // SPEAKER/MIC
+                                 const uint32_t     hz       ,
+                                       void        *user_data);
+
+    constexpr UsbDevAudio()
+    :   UsbDev              (                       ),
+#if USB_DEV_AUDIO_SPEAKER
+        _speaker_ring       {0                      },
+#endif
+#if USB_DEV_AUDIO_MIC
+        _mic_ring           {0                      },
+#endif
+        _speaker_dma        (0                      ),
+        _mic_dma            (0                      ),
+        _sample_counter     (0                      ),
+        _rate_callback      (0                      ),
+        _rate_user_data     (0                      ),
+        _hz                 {MAX_HZ, MAX_HZ         },
+        _feedback           (nominal_feedback(MAX_HZ)),
+        _underruns          {0                      },
+        _overruns           {0                      },
+        _mic_accum          (0                      ),
+        _gains              {32768, 32768           },
+        _volumes            {MAX_VOLUME, MAX_VOLUME },
+        _pwm_range          (0                      ),
+        _speaker_base       (0                      ),
+        _speaker_written    (0                      ),
+        _feedback_frame     (0                      ),
+        _feedback_start     (0                      ),
+        _feedback_samples   (0                      ),
+        _mic_read           (0                      ),
+        _control_data       {0                      },
+        _mutes              {false, false           },
+        _streaming          {false, false           },
+        _set_cur_direction  (0                      ),
+        _set_cur_selector   (0                      ),
+        _set_cur_endpoint   (false                  ),
+        _feedback_restart   (true                   ),
+        _adc_bits           (0                      )
+    {}
+
+
+    // Speaker ring DMA to "output" (16-bit writes, e.g. timer CCR or SPI
+    //   DR), one sample per request, and "counter" incremented with each
+    //   (e.g. timer clocked by sample timer's update). Call with sample
+    //   clock stopped, start it after.
+    void    speaker_init(volatile stm32f103xb::DmaChannel* const  dma    ,
+                         volatile void*                    const  output ,
+                         const volatile uint16_t*          const  counter);
+
+    // Ring samples as unsigned PWM compare values 0 to range - 1 (0 for
+    //   signed PCM). Call again when sample clock period changes.
+    void    pwm_range(const uint16_t    range);
+
+    // Microphone ring DMA from "input" (16-bit reads, e.g. ADC DR), one
+    //   sample per request. "adc_bits": unsigned right-aligned samples of
+    //   that many bits, 0 for signed PCM.
+    void    mic_init(volatile stm32f103xb::DmaChannel* const  dma     ,
+                     const volatile void*              const  input   ,
+                     const uint8_t                            adc_bits);
+
+    void    rate_callback(RateCallback  callback ,
+                          void         *user_data)
+    {
+        _rate_callback  = callback ;
+        _rate_user_data = user_data;
+    }
+
+    // Handles endpoints if no callbacks registered, measures feedback,
+    //   stops streams after bus reset. Call from main loop, frequently.
+    void    audio_poll();
+
+
+    uint32_t    sampling_hz(const uint8_t   direction) const
+                { return _hz     [direction]; }
+    bool        muted      (const uint8_t   direction) const
+                { return _mutes  [direction]; }
+    int16_t     volume     (const uint8_t   direction) const  // 1/256 dB
+                { return _volumes[direction]; }
+    bool        streaming  (const uint8_t   direction) const
+                { return _streaming[direction]; }
+
+    // Speaker feedback sent to host, 10.14 samples per frame
+    uint32_t    feedback() const { return _feedback; }
+
+    // Speaker: ring empty (silence played), or samples dropped when full.
+    //   Mic: fewer samples than due sent, or ring overwritten by DMA.
+    uint32_t    underruns(const uint8_t direction) const
+                { return _underruns[direction]; }
+    uint32_t    overruns (const uint8_t direction) const
+                { return _overruns [direction]; }
+
+
+    // usb_dev.register_recv_callback(UsbDevAudio::recv_callback,
+    //                                UsbDevAudio::SPEAKER_ENDPOINT,
+    //                                &usb_dev                     );
+    // and send_callback() for FEEDBACK_ENDPOINT and MIC_ENDPOINT
+    static void recv_callback(const uint8_t              ,  // endpoint
+                                    void       *user_data)
+    {
+        static_cast<UsbDevAudio*>(user_data)->speaker_recv();
+    }
+
+    static void send_callback(const uint8_t     endpoint ,
+                                    void       *user_data)
+    {
+        if (endpoint == FEEDBACK_ENDPOINT)
+            static_cast<UsbDevAudio*>(user_data)->send_feedback();
+        else
+            static_cast<UsbDevAudio*>(user_data)->mic_send();
+    }
+
+
+    // need public accessor for static initialization of _NEW_STRING_DESCS
+    //
+    static constexpr const uint8_t* device_string_desc()
+    {
+        return _device_string_desc;
+    }
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    // Audio 1.0 class-specific requests and control selectors
+    static const uint8_t    _REQ_SET_CUR            = 0x01,
+                            _REQ_GET_CUR            = 0x81,
+                            _REQ_GET_MIN            = 0x82,
+                            _REQ_GET_MAX            = 0x83,
+                            _REQ_GET_RES            = 0x84,
+                            _MUTE_CONTROL           = 0x01,
+                            _VOLUME_CONTROL         = 0x02,
+                            _SAMPLING_FREQ_CONTROL  = 0x01;
+
+    static const uint16_t   _RING_MASK   = RING_SIZE - 1        ,
+                            _RING_TARGET = RING_SIZE / 2        ,
+                            _GUARD       = MAX_PACKET / 2       ;  // samples
+
+    // Q15 gains (32768 == unity), index -dB
+    static const uint16_t   _VOLUME_GAINS[-MIN_VOLUME / VOLUME_RES + 1];
+
+    static const uint8_t    _device_string_desc[],
+                            _QUALIFIER_DESC    [];
+
+    static constexpr uint32_t nominal_feedback(
+    const uint32_t  hz)
+    {
+        return (hz << 14) / 1000;
+    }
+
+    bool    class_setup      ();    // UsbDev::device_class_setup()
+    bool    feature_request  (const uint8_t     direction);
+    bool    sampling_request (const uint8_t     direction);
+    void    set_cur          (const uint16_t    length   );
+    void    streaming_changed();    // UsbDev::set_interface(), etc.
+
+    static uint8_t* set_cur_stream(const uint16_t   offset   ,
+                                   const uint16_t   length   ,
+                                         void      *user_data);
+
+    void    speaker_start   (),
+            speaker_silence (),
+            speaker_pad     (const uint16_t     samples),
+            speaker_recv    (),
+            send_feedback   (),
+            measure_feedback(),
+            mic_start       (),
+            mic_send        ();
+
+    uint16_t speaker_sample(
+    const int16_t   pcm)
+    const
+    {
+        int32_t     scaled =    (pcm * static_cast<int32_t>(_gains[SPEAKER]))
+                             >> 15                                       ;
+
+        return   _pwm_range
+               ? ((scaled + 32768) * static_cast<uint32_t>(_pwm_range)) >> 16
+               : static_cast<uint16_t>(scaled)                               ;
+    }
+
+    int16_t mic_sample(
+    const uint16_t  raw)
+    const
+    {
+        int32_t     pcm =   _adc_bits
+                          ? (static_cast<int32_t>(raw) << (16 - _adc_bits))
+                            - 32768
+                          : static_cast<int16_t>(raw)                      ;
+
+        return (pcm * static_cast<int32_t>(_gains[MIC])) >> 15;
+    }
+
+    // speaker ring slot of sample counter value
+    uint16_t speaker_ndx(
+    const uint16_t  count)
+    const
+    {
+        return (count - _speaker_base) & _RING_MASK;
+    }
+
+
+#if USB_DEV_AUDIO_SPEAKER
+    uint16_t                            _speaker_ring[RING_SIZE];
+#endif
+#if USB_DEV_AUDIO_MIC
+    uint16_t                            _mic_ring    [RING_SIZE];
+#endif
+    volatile stm32f103xb::DmaChannel   *_speaker_dma            ,
+                                       *_mic_dma                ;
+    const volatile uint16_t            *_sample_counter         ;
+    RateCallback                        _rate_callback          ;
+    void                               *_rate_user_data         ;
+    uint32_t                            _hz         [DIRECTIONS];
+    volatile uint32_t                   _feedback               ;
+    uint32_t                            _underruns  [DIRECTIONS],
+                                        _overruns   [DIRECTIONS],
+                                        _mic_accum              ;  // Hz * ms
+    uint16_t                            _gains      [DIRECTIONS];
+    int16_t                             _volumes    [DIRECTIONS];
+    uint16_t                            _pwm_range              ,
+                                        _speaker_base           ,  // counter
+                                        _speaker_written        ,  //   "
+                                        _feedback_frame         ,
+                                        _feedback_start         ,  // frame
+                                        _feedback_samples       ,  // counter
+                                        _mic_read               ;  // ring ndx
+    uint8_t                             _control_data[4]        ;
+    bool                                _mutes      [DIRECTIONS],
+                                        _streaming  [DIRECTIONS];
+    uint8_t                             _set_cur_direction      ,
+                                        _set_cur_selector       ;
+    bool                                _set_cur_endpoint       ;
+    volatile bool                       _feedback_restart       ;
+    uint8_t                             _adc_bits               ;
+
+};  // class UsbDevAudio
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_AUDIO_HXX
@@ -19,6 +19,7 @@
 
 
 #include <usb_dev_cdc_acm.hxx>
+#include <usb_dev_descriptors.hxx>
 
 namespace stm32f10_12357_xx {
 
@@ -43,106 +44,56 @@ const uint8_t UsbDev::_DEVICE_DESC[] = {
     0x01    // bNumConfigurations
 };
 
-uint8_t UsbDev::_CONFIG_DESC[] = {  // not const because set total size entry
-    // Configuration Descriptor
-    0x09,   // bLength: Configuration Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::CONFIGURATION),
-    0,      // wTotalLength: including sub-descriptors; will be set a runtime
-    0x00,   //      "      : MSB of uint16_t
-    0x02,   // bNumInterfaces: 2 interface
-    0x01,   // bConfigurationValue: Configuration value
-    0x00,   // iConfiguration: Index of string descriptor for configuration
-    0xC0,   // bmAttributes: self powered
-    0x32,   // MaxPower 0 mA
-
-    // Interface Descriptor
-    0x09,   // bLength: Interface Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE),
-    // Interface descriptor type
-    0x00,   // bInterfaceNumber: Number of Interface
-    0x00,   // bAlternateSetting: Alternate setting
-    0x01,   // bNumEndpoints: One endpoints used
-    0x02,   // bInterfaceClass: Communication Interface Class
-    0x02,   // bInterfaceSubClass: Abstract Control Model
-    0x01,   // bInterfaceProtocol: Common AT commands
-    0x00,   // iInterface:
-
-    // Header Functional Descriptor
-    0x05,   // bFunctionLength
-    0x24,   // bDescriptorType: CS_INTERFACE
-    0x00,   // bDescriptorSubtype: Header Func Desc
-    0x10,   // bcdCDC: spec release number
-    0x01,
-
-    // Call Management Functional Descriptor
-    0x05,   // bFunctionLength
-    0x24,   // bDescriptorType: CS_INTERFACE
-    0x01,   // bDescriptorSubtype: Call Management Func Desc
-    0x00,   // bmCapabilities: D0+D1
-    0x01,   // bDataInterface: 1
-
-    // ACM Functional Descriptor
-    0x04,   // bFunctionLength
-    0x24,   // bDescriptorType: CS_INTERFACE
-    0x02,   // bDescriptorSubtype: Abstract Control Management desc
-    0x02,   // bmCapabilities
-
-    // Union Functional Descriptor
-    0x05,   // bFunctionLength
-    0x24,   // bDescriptorType: CS_INTERFACE
-    0x06,   // bDescriptorSubtype: Union func desc
-    0x00,   // bMasterInterface: Communication class interface
-    0x01,   // bSlaveInterface0: Data Class Interface
-
-    // Endpoint 2 Descriptor
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT),
-    UsbDevCdcAcm::ACM_ENDPOINT | UsbDev::ENDPOINT_DIR_IN,   // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevCdcAcm::ACM_DATA_SIZE,                            // wMaxPacketSize:
-    0x00,
-    0xFF,   // bInterval:
-
-
-    // Data class interface descriptor
-    0x09,   // bLength: Interface Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE),
-    0x01,   // bInterfaceNumber: Number of Interface
-    0x00,   // bAlternateSetting: Alternate setting
-    0x02,   // bNumEndpoints: Two endpoints used
-    0x0A,   // bInterfaceClass: CDC
-    0x00,   // bInterfaceSubClass:
-    0x00,   // bInterfaceProtocol:
-    0x00,   // iInterface:
-
-    // Endpoint 3 Descriptor
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT),
-    UsbDevCdcAcm::CDC_ENDPOINT_OUT, // bEndpointAddress: (OUT3)
-    static_cast<uint8_t>(UsbDev::EndpointType::BULK),   // bmAttributes: Bulk
-    UsbDevCdcAcm::CDC_OUT_DATA_SIZE,                    // wMaxPacketSize: 64
-    0x00,                                               //    MSB of uint16_t
-    0x00,   // bInterval: ignore for Bulk transfer
-
-    // Endpoint 1 Descriptor
-    0x07,                               // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT),
-    UsbDevCdcAcm::CDC_ENDPOINT_IN | UsbDev::ENDPOINT_DIR_IN,//bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::BULK),  // bmAttributes: Bulk
-    UsbDevCdcAcm::CDC_IN_DATA_SIZE,     // wMaxPacketSize:
-    0x00,
-    0x00                                // bInterval
-};
-
-const uint8_t   UsbDevCdcAcm::_device_string_desc[] = {
-                46,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                'S', 0, 'T', 0, 'M', 0, '3', 0,
-                '2', 0, ' ', 0, 'V', 0, 'i', 0,
-                'r', 0, 't', 0, 'u', 0, 'a', 0,
-                'l', 0, ' ', 0, 'C', 0, 'O', 0,
-                'M', 0, ' ', 0, 'P', 0, 'o', 0,
-                'r', 0, 't', 0                };     // "STM32 Virtual COM Port"
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x02,       // bInterfaceClass: Communication Interface Class
+        0x02,       // bInterfaceSubClass: Abstract Control Model
+        0x01,       // bInterfaceProtocol: Common AT commands
+        0,          // iInterface
+
+        usb_desc::cdc_header         (0x0110),  // bcdCDC: 1.10
+        usb_desc::cdc_call_management(0x00,     // bmCapabilities
+                                      1   ),    // bDataInterface
+        usb_desc::cdc_acm            (0x02),    // bmCapabilities: line coding
+        usb_desc::cdc_union          (0,        // bControlInterface
+                                      1   ),    // bSubordinateInterface0
+
+        usb_desc::endpoint(  UsbDevCdcAcm::ACM_ENDPOINT
+                           | UsbDev::ENDPOINT_DIR_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevCdcAcm::ACM_DATA_SIZE,
+                           0xff)),              // bInterval: ms
+
+    usb_desc::interface(
+        1,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x0a,       // bInterfaceClass: CDC Data
+        0x00,       // bInterfaceSubClass
+        0x00,       // bInterfaceProtocol
+        0,          // iInterface
+
+        usb_desc::endpoint(UsbDevCdcAcm::CDC_ENDPOINT_OUT,
+                           UsbDev::EndpointType::BULK,
+                           UsbDevCdcAcm::CDC_OUT_DATA_SIZE,
+                           0),                  // bInterval: ignored for bulk
+
+        usb_desc::endpoint(  UsbDevCdcAcm::CDC_ENDPOINT_IN
+                           | UsbDev::ENDPOINT_DIR_IN,
+                           UsbDev::EndpointType::BULK,
+                           UsbDevCdcAcm::CDC_IN_DATA_SIZE,
+                           0)));                // bInterval: ignored for bulk
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t   UsbDevCdcAcmBase::_device_string_desc[]
+                = "STM32 Virtual COM Port";
 
 const uint8_t   *UsbDev::_STRING_DESCS[] = {
     UsbDev      ::  language_id_string_desc(),
@@ -151,15 +102,31 @@ const uint8_t   *UsbDev::_STRING_DESCS[] = {
     UsbDev      ::serial_number_string_desc(),
 };
 
-UsbDevCdcAcm::LineCoding UsbDevCdcAcm::_line_coding = {9600, 0, 0, 8} ;
+UsbDevCdcAcmBase::LineCoding UsbDevCdcAcmBase::_line_coding = {9600, 0, 0, 8};
+
+UsbDevCdcAcmBase::LineCodingCallback
+                    UsbDevCdcAcmBase::_line_coding_callback  = 0;
+void               *UsbDevCdcAcmBase::_line_coding_user_data = 0;
+
+volatile uint16_t   UsbDevCdcAcmBase::_control_lines         = 0;
 
 
 
-bool UsbDevCdcAcm::init()
+uint8_t* UsbDevCdcAcmBase::line_coding_stream(
+const uint16_t   offset   ,
+const uint16_t   length   ,
+      void      *user_data)
 {
-    _CONFIG_DESC[UsbDev::CONFIG_DESC_SIZE_NDX]  = sizeof(_CONFIG_DESC);
+    (void)user_data;
 
-    return UsbDev::init();
+    if (length)
+        return reinterpret_cast<uint8_t*>(&_line_coding) + offset;
+
+    // data stage complete
+    if (_line_coding_callback)
+        _line_coding_callback(_line_coding, _line_coding_user_data);
+
+    return 0;
 }
 
 
@@ -177,12 +144,21 @@ bool UsbDev::device_class_setup()
 
     switch (_setup_packet->request) {
         case UsbDevCdcAcm::_SET_LINE_CODING:
+            // notify client, if registered, after data stage received
+            control_out_stream(UsbDevCdcAcm::line_coding_stream  ,
+                               0                                 ,
+                               sizeof(UsbDevCdcAcm::_line_coding));
+            return true;
+
         case UsbDevCdcAcm::_GET_LINE_CODING:
             data =  reinterpret_cast<uint8_t*>(&UsbDevCdcAcm::_line_coding);
             size =                      sizeof( UsbDevCdcAcm::_line_coding);
             break;
 
         case UsbDevCdcAcm::_SET_CONTROL_LINE_STATE:
+            UsbDevCdcAcm::_control_lines =   _setup_packet->value.word
+                                           & (  UsbDevCdcAcm::CONTROL_LINE_DTR
+                                              | UsbDevCdcAcm::CONTROL_LINE_RTS);
             data = 0;
             size = 0;
             break;
@@ -202,7 +178,14 @@ bool UsbDev::device_class_setup()
 }
 
 
-void UsbDev::set_configuration() {}
+void UsbDev::set_configuration()
+{
+    // (re)report current DCD/DSR to newly configured host, which will
+    //   (re)assert DTR/RTS when port opened
+    static_cast<UsbDevCdcAcm*>(this)->_serial_state.resend();
+    UsbDevCdcAcm::_control_lines = 0;
+}
+
 void UsbDev::set_interface    () {}
 
 
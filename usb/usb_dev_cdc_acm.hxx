@@ -22,12 +22,22 @@
 #define USB_DEV_CDC_ACM_HXX
 
 
+// Bulk data endpoint max packet sizes and buffering of UsbDevCdcAcm (see
+//   bottom of file), the instantiation whose descriptors are in
+//   usb_dev_cdc_acm.cxx. Sizes must be 8, 16, 32, or 64 (USB full speed
+//   bulk), buffering SINGLE or DOUBLE (UsbDev::Buffering).
+#ifndef CDC_IN_EP_SIZE
+#define CDC_IN_EP_SIZE      64
+#endif
 #ifndef CDC_OUT_EP_SIZE
-#define CDC_OUT_EP_SIZE 64  // must be modulo 4, max 64)
+#define CDC_OUT_EP_SIZE     64
+#endif
+#ifndef CDC_EP_BUFFERING
+#define CDC_EP_BUFFERING    SINGLE
 #endif
 
 
-#include <usb_dev.hxx>
+#include <usb_dev_cdc_acm_serial.hxx>
 
 #if USB_DEV_MAJOR_VERSION == 1
 #if USB_DEV_MINOR_VERSION  < 0
@@ -40,23 +50,83 @@
 
 namespace stm32f10_12357_xx {
 
-class UsbDevCdcAcm : public UsbDev
+// Control (line coding, DTR/RTS) and notification (SERIAL_STATE) parts
+//   of CDC-ACM, independent of data endpoint sizes and buffering. Use
+//   UsbDevCdcAcm, below. SERIAL_STATE_* and CONTROL_LINE_* constants and
+//   LineCoding are in UsbDevCdcAcmSerial.
+//
+class UsbDevCdcAcmBase : public UsbDevCdcAcmSerial
 {
   public:
     static const uint8_t    // have to be public for clients, static descriptors
                             ACM_ENDPOINT             =  2,
                             CDC_ENDPOINT_IN          =  1,
-                            CDC_ENDPOINT_OUT         =  3,
-                            // have to be public for extern static definition
-                            CDC_IN_DATA_SIZE         = 64,
-                            CDC_OUT_DATA_SIZE        = CDC_OUT_EP_SIZE,
-                            ACM_DATA_SIZE            =  8;
-
-    constexpr UsbDevCdcAcm()
-    :   UsbDev()
+                            CDC_ENDPOINT_OUT         =  3;
+
+    // Called after host has changed line coding (SET_LINE_CODING).
+    // Executes in interrupt context if USB_DEV_INTERRUPT_DRIVEN
+    typedef void (*LineCodingCallback)(const LineCoding     &line_coding,
+                                             void           *user_data  );
+
+    constexpr explicit UsbDevCdcAcmBase(
+    const uint16_t  double_buffered)
+    :   UsbDevCdcAcmSerial(double_buffered),
+        _serial_state     (               )
     {}
 
-    bool init();
+
+    // Line status to be reported to host via SERIAL_STATE notifications on
+    //   ACM_ENDPOINT. Can be called from (one) interrupt handler -- only
+    //   record changes, which are merged into at most one notification in
+    //   flight and sent by serial_state_poll().
+    //
+    void serial_state_lines(       // set DCD and/or DSR levels
+    const uint16_t  lines)
+    {
+        _serial_state.lines(lines);
+    }
+
+    void serial_state_event(       // post BREAK, RING, or error(s)
+    const uint16_t  events)
+    {
+        _serial_state.event(events);
+    }
+
+    uint16_t serial_state() const { return _serial_state.lines(); }
+
+    // Sends notification if any changes pending and previous notification
+    //   has been delivered. Call from main loop.
+    void serial_state_poll()
+    {
+        UsbDevCdcAcmSerial::serial_state_poll(_serial_state, ACM_ENDPOINT, 0);
+    }
+
+
+    static const LineCoding& line_coding() { return _line_coding; }
+
+    // Replace host's requested baud rate with one actually achieved, as
+    //   subsequently reported in GET_LINE_CODING responses
+    static void line_coding_baud(
+    const uint32_t  baud)
+    {
+        _line_coding.baud = baud;
+    }
+
+    // DTR/RTS from host's last SET_CONTROL_LINE_STATE, zero until then and
+    //   after SET_CONFIGURATION. Host drivers typically assert DTR while
+    //   a process has the tty open.
+    static uint16_t control_lines() { return _control_lines; }
+
+    static bool dtr() { return _control_lines & CONTROL_LINE_DTR; }
+    static bool rts() { return _control_lines & CONTROL_LINE_RTS; }
+
+    static void line_coding_callback(
+    LineCodingCallback   callback ,
+    void                *user_data)
+    {
+        _line_coding_callback  = callback ;
+        _line_coding_user_data = user_data;
+    }
 
 
     // need public accessor for static initialization of _NEW_STRING_DESCS
@@ -72,22 +142,80 @@ class UsbDevCdcAcm : public UsbDev
   protected:
     friend class UsbDev;
 
-    struct LineCoding {
-        uint32_t    baud       ;
-        uint8_t     stop_bits  ,
-                    parity_code,
-                    bits       ;
-    };
+    static uint8_t* line_coding_stream(const uint16_t     offset   ,
+                                       const uint16_t     length   ,
+                                             void        *user_data);
 
-    static const uint8_t    _NUM_ENDPOINTS          = 4   ,
-                            _SET_LINE_CODING        = 0x20,
-                            _GET_LINE_CODING        = 0x21,
-                            _SET_CONTROL_LINE_STATE = 0x22;
+    static const uint8_t    _NUM_ENDPOINTS          = 4   ;
 
     static const uint8_t        _device_string_desc[];
     static       LineCoding     _line_coding         ;
+    static LineCodingCallback   _line_coding_callback ;
+    static void                *_line_coding_user_data;
+    static volatile uint16_t    _control_lines        ;
+
+    SerialState                 _serial_state         ;
+
+};  // class UsbDevCdcAcmBase
+
+
+
+// CDC-ACM with bulk data endpoints CDC_ENDPOINT_IN and CDC_ENDPOINT_OUT of
+//   IN_SIZE and OUT_SIZE max packet sizes, single- or double-buffered
+//   (see UsbDev constructor). Double buffering lets the peripheral
+//   transfer one packet while the next is being copied, so consecutive
+//   packets of a bulk transfer aren't separated by NAKs while waiting
+//   for the application (full speed bulk can carry up to 19 64-byte
+//   packets per 1 ms frame).
+//
+// Sizes and buffering are checked at compile time against PMA memory,
+//   including control and ACM_ENDPOINT buffers and the buffer descriptor
+//   table.
+//
+template<uint16_t           IN_SIZE  ,
+         uint16_t           OUT_SIZE ,
+         UsbDev::Buffering  BUFFERING>
+class UsbDevCdcAcmBulk : public UsbDevCdcAcmBase
+{
+  public:
+    static const uint16_t   // have to be public for extern static definition
+                            CDC_IN_DATA_SIZE  = IN_SIZE ,
+                            CDC_OUT_DATA_SIZE = OUT_SIZE;
+
+    static const Buffering  CDC_BUFFERING     = BUFFERING;
+
+    static const uint8_t    NUM_BUFFERS       =   BUFFERING == Buffering::DOUBLE
+                                                ? 2 : 1                       ;
+
+    // powers of 2 from 8 to 64
+    static_assert(   IN_SIZE  >= 8 && IN_SIZE  <= 64
+                  && OUT_SIZE >= 8 && OUT_SIZE <= 64
+                  && (IN_SIZE  & (IN_SIZE  - 1)) == 0
+                  && (OUT_SIZE & (OUT_SIZE - 1)) == 0,
+                  "CDC bulk packet sizes must be 8, 16, 32, or 64");
+
+    static_assert(   pma_used_size(_NUM_ENDPOINTS,
+                                     pma_send_size(ACM_DATA_SIZE)
+                                   + NUM_BUFFERS * pma_send_size(IN_SIZE )
+                                   + NUM_BUFFERS * pma_recv_size(OUT_SIZE))
+                  <= stm32f103xb::USB_PMASIZE,
+                  "CDC endpoint buffers don't fit in PMA memory");
+
+    constexpr UsbDevCdcAcmBulk()
+    :   UsbDevCdcAcmBase(  BUFFERING == Buffering::DOUBLE
+                         ? (1 << CDC_ENDPOINT_IN) | (1 << CDC_ENDPOINT_OUT)
+                         : 0                                               )
+    {}
+
+};  // template<...> class UsbDevCdcAcmBulk
+
+
 
-};  // class UsbDevCdcAcm
+// Instantiation with descriptors and UsbDev hooks defined in
+//   usb_dev_cdc_acm.cxx
+typedef UsbDevCdcAcmBulk<CDC_IN_EP_SIZE            ,
+                         CDC_OUT_EP_SIZE           ,
+                         UsbDev::Buffering::CDC_EP_BUFFERING>   UsbDevCdcAcm;
 
 }  // namespace stm32f10_12357_xx
 
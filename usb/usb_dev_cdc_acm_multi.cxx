@@ -0,0 +1,155 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_cdc_acm_multi.hxx>
+#include <usb_dev_descriptors.hxx>
+
+namespace stm32f10_12357_xx {
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0xef,   // bDeviceClass: Miscellaneous
+    0x02,   // bDeviceSubClass: Common Class
+    0x01,   // bDeviceProtocol: Interface Association Descriptor
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x40,   // idProduct = 0x5740
+    0x57,   //     "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+
+
+// IAD, communications and data interfaces for one port
+static constexpr auto port_descs(
+const uint8_t   port)
+{
+    return usb_desc::concat(
+        usb_desc::interface_association(
+            2 * port,       // bFirstInterface
+            2,              // bInterfaceCount
+            0x02,           // bFunctionClass: Communication Interface Class
+            0x02,           // bFunctionSubClass: Abstract Control Model
+            0x01,           // bFunctionProtocol: Common AT commands
+            0),             // iFunction
+
+        usb_desc::interface(
+            2 * port,       // bInterfaceNumber
+            0,              // bAlternateSetting
+            0x02,           // bInterfaceClass: Communication Interface Class
+            0x02,           // bInterfaceSubClass: Abstract Control Model
+            0x01,           // bInterfaceProtocol: Common AT commands
+            0,              // iInterface
+
+            usb_desc::cdc_header         (0x0110),      // bcdCDC: 1.10
+            usb_desc::cdc_call_management(0x00,         // bmCapabilities
+                                          2 * port + 1),// bDataInterface
+            usb_desc::cdc_acm            (0x02),        // bmCapabilities
+            usb_desc::cdc_union          (2 * port,     // bControlInterface
+                                          2 * port + 1),// bSubordinate...0
+
+            usb_desc::endpoint(  UsbDevCdcAcmPorts::notify_endpoint(port)
+                               | UsbDev::ENDPOINT_DIR_IN,
+                               UsbDev::EndpointType::INTERRUPT,
+                               UsbDevCdcAcmPorts::ACM_DATA_SIZE,
+                               0xff)),          // bInterval: ms
+
+        usb_desc::interface(
+            2 * port + 1,   // bInterfaceNumber
+            0,              // bAlternateSetting
+            0x0a,           // bInterfaceClass: CDC Data
+            0x00,           // bInterfaceSubClass
+            0x00,           // bInterfaceProtocol
+            0,              // iInterface
+
+            usb_desc::endpoint(UsbDevCdcAcmPorts::data_endpoint(port),
+                               UsbDev::EndpointType::BULK,
+                               UsbDevCdcAcmPorts::DATA_SIZE,
+                               0),              // bInterval: ignored for bulk
+
+            usb_desc::endpoint(  UsbDevCdcAcmPorts::data_endpoint(port)
+                               | UsbDev::ENDPOINT_DIR_IN,
+                               UsbDev::EndpointType::BULK,
+                               UsbDevCdcAcmPorts::DATA_SIZE,
+                               0)));            // bInterval: ignored for bulk
+}
+
+// Ports 0 through NUM - 1, recursively
+template<unsigned NUM> struct AllPortDescs {
+    static constexpr auto bytes()
+    {
+        return usb_desc::concat(AllPortDescs<NUM - 1>::bytes(),
+                                port_descs  (NUM - 1)        );
+    }
+};
+
+template<> struct AllPortDescs<1> {
+    static constexpr auto bytes()
+    {
+        return port_descs(0);
+    }
+};
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    AllPortDescs<UsbDevCdcAcmPorts::PORTS>::bytes());
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+template<> const uint8_t    UsbDevCdcAcmPorts::_device_string_desc[]
+                            = "STM32 Virtual COM Ports";
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev           ::  language_id_string_desc(),
+    UsbDev           ::       vendor_string_desc(),
+    UsbDevCdcAcmPorts::       device_string_desc(),
+    UsbDev           ::serial_number_string_desc(),
+};
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevCdcAcmPorts*>(this)->class_setup();
+}
+
+
+void UsbDev::set_configuration()
+{
+    static_cast<UsbDevCdcAcmPorts*>(this)->configured();
+}
+
+void UsbDev::set_interface    () {}
+
+
+}  // namespace stm32f10_12357_xx {
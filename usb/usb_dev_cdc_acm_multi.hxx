@@ -0,0 +1,287 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_CDC_ACM_MULTI_HXX
+#define USB_DEV_CDC_ACM_MULTI_HXX
+
+
+// Number of ports in UsbDevCdcAcmPorts (see bottom of file), the
+//   instantiation whose descriptors are in usb_dev_cdc_acm_multi.cxx
+#ifndef USB_DEV_CDC_ACM_PORTS
+#define USB_DEV_CDC_ACM_PORTS   2
+#endif
+
+
+#include <usb_dev_cdc_acm_serial.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+
+
+namespace stm32f10_12357_xx {
+
+// Composite device with NUM_PORTS independent CDC-ACM virtual COM ports,
+//   each a communications/data interface pair grouped by an interface
+//   association descriptor (IAD).
+//
+// Port "p" (from 0) has:
+//   interfaces       2p (communications) and 2p + 1 (data)
+//   endpoint         data_endpoint(p)   bulk IN and bulk OUT
+//   endpoint         notify_endpoint(p) interrupt IN (SERIAL_STATE)
+//   and its own line coding, DTR/RTS, and serial state.
+// SERIAL_STATE_* and CONTROL_LINE_* constants and LineCoding are in
+//   UsbDevCdcAcmSerial, shared with UsbDevCdcAcm.
+//
+// Bulk packet size DATA_SIZE is largest legal one (8, 16, 32, or 64)
+//   that fits in PMA with the others: 64 bytes for 1 or 2 ports, 32 for
+//   3. NUM_PORTS limited to 3 by the hardware's 8 endpoint registers.
+//
+template<unsigned NUM_PORTS> class UsbDevCdcAcmMulti
+:   public UsbDevCdcAcmSerial
+{
+  public:
+    static_assert(NUM_PORTS >= 1 && NUM_PORTS <= 3,
+                  "UsbDevCdcAcmMulti NUM_PORTS must be 1, 2, or 3");
+
+    static const uint8_t    PORTS         = NUM_PORTS;
+
+    // have to be public for extern static definition
+    static const uint16_t   DATA_SIZE
+                            = UsbDev::pma_fit_bulk_packet_size(
+                                          2 * NUM_PORTS + 1,
+                                              NUM_PORTS    ,
+                                              NUM_PORTS    ,
+                                          64               ,
+                                          64               ,
+                                            NUM_PORTS
+                                          * pma_send_size(ACM_DATA_SIZE));
+
+    static_assert(   DATA_SIZE >= 8 && DATA_SIZE <= 64
+                  && (DATA_SIZE & (DATA_SIZE - 1)) == 0,
+                  "UsbDevCdcAcmMulti bulk DATA_SIZE must be 8, 16, 32, or 64");
+
+    // Called after host has changed port's line coding.
+    // Executes in interrupt context if USB_DEV_INTERRUPT_DRIVEN
+    typedef void (*LineCodingCallback)(const uint8_t         port       ,
+                                       const LineCoding     &line_coding,
+                                             void           *user_data  );
+
+    constexpr UsbDevCdcAcmMulti()
+    :   UsbDevCdcAcmSerial(),
+        _ports                {},
+        _line_coding_callback (0),
+        _line_coding_user_data(0),
+        _line_coding_port     (0)
+    {}
+
+
+    static constexpr uint8_t   data_endpoint(const uint8_t   port)
+    {
+        return 2 * port + 1;
+    }
+
+    static constexpr uint8_t notify_endpoint(const uint8_t   port)
+    {
+        return 2 * port + 2;
+    }
+
+
+    const LineCoding& line_coding(const uint8_t     port) const
+    {
+        return _ports[port].line_coding;
+    }
+
+    void line_coding_callback(
+    LineCodingCallback   callback ,
+    void                *user_data)
+    {
+        _line_coding_callback  = callback ;
+        _line_coding_user_data = user_data;
+    }
+
+    // see UsbDevCdcAcm::control_lines()
+    uint16_t control_lines(const uint8_t    port) const
+    {
+        return _ports[port].control_lines;
+    }
+
+    bool dtr(const uint8_t  port) const
+    {
+        return _ports[port].control_lines & CONTROL_LINE_DTR;
+    }
+
+    bool rts(const uint8_t  port) const
+    {
+        return _ports[port].control_lines & CONTROL_LINE_RTS;
+    }
+
+
+    // see UsbDevCdcAcm::serial_state_lines() et al
+    void serial_state_lines(
+    const uint8_t   port ,
+    const uint16_t  lines)
+    {
+        _ports[port].serial_state.lines(lines);
+    }
+
+    void serial_state_event(
+    const uint8_t   port  ,
+    const uint16_t  events)
+    {
+        _ports[port].serial_state.event(events);
+    }
+
+    // Sends pending notification for each port whose previous one has
+    //   been delivered. Call from main loop.
+    void serial_state_poll()
+    {
+        for (uint8_t port = 0 ; port < NUM_PORTS ; ++port)
+            UsbDevCdcAcmSerial::serial_state_poll(_ports[port].serial_state,
+                                                  notify_endpoint(port)    ,
+                                                  2 * port                 );
+    }
+
+
+    // need public accessor for static initialization of _NEW_STRING_DESCS
+    //
+    static constexpr const uint8_t* device_string_desc()
+    {
+        return _device_string_desc;
+    }
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    struct Port {
+        LineCoding          line_coding  ;
+        volatile uint16_t   control_lines;
+        SerialState         serial_state ;
+    };
+
+    static uint8_t* line_coding_stream(const uint16_t   offset   ,
+                                       const uint16_t   length   ,
+                                             void      *user_data)
+    {
+        UsbDevCdcAcmMulti   *self = static_cast<UsbDevCdcAcmMulti*>(user_data);
+        Port                &port = self->_ports[self->_line_coding_port]     ;
+
+        if (length)
+            return reinterpret_cast<uint8_t*>(&port.line_coding) + offset;
+
+        // data stage complete
+        if (self->_line_coding_callback)
+            self->_line_coding_callback(self->_line_coding_port ,
+                                        port.line_coding        ,
+                                        self->_line_coding_user_data);
+
+        return 0;
+    }
+
+    // UsbDev::device_class_setup() for communications interface requests
+    bool class_setup()
+    {
+        if (!  _setup_packet
+             ->request_type
+             . all(  SetupPacket::RequestType::TYPE_CLASS
+                   | SetupPacket::RequestType::RECIPIENT_INTERFACE))
+            return false;
+
+        uint8_t      port = (_setup_packet->index & 0xff) / 2;
+        uint8_t     *data;
+        uint16_t     size;
+
+        if (port >= NUM_PORTS)
+            return false;
+
+        switch (_setup_packet->request) {
+            case _SET_LINE_CODING:
+                _line_coding_port = port;
+                control_out_stream(line_coding_stream                   ,
+                                   this                                 ,
+                                   sizeof(_ports[port].line_coding));
+                return true;
+
+            case _GET_LINE_CODING:
+                data = reinterpret_cast<uint8_t*>(&_ports[port].line_coding);
+                size =                     sizeof( _ports[port].line_coding);
+                break;
+
+            case _SET_CONTROL_LINE_STATE:
+                _ports[port].control_lines =   _setup_packet->value.word
+                                             & (  CONTROL_LINE_DTR
+                                                | CONTROL_LINE_RTS);
+                data = 0;
+                size = 0;
+                break;
+
+            default:
+                return false;
+        }
+
+        if (_setup_packet->request_type.any(   SetupPacket
+                                            ::RequestType
+                                            ::DIR_DEV_TO_HOST))
+            _send_info.set(data, size);
+        else
+            _recv_info.set(data, size);
+
+        return true;
+
+    }  // class_setup()
+
+    // UsbDev::set_configuration()
+    void configured()
+    {
+        for (uint8_t port = 0 ; port < NUM_PORTS ; ++port) {
+            if (!_ports[port].line_coding.baud)
+                _ports[port].line_coding = LineCoding{9600, 0, 0, 8};
+            _ports[port].control_lines = 0;
+            _ports[port].serial_state.resend();  // (re)report DCD/DSR
+        }
+    }
+
+
+    static const uint8_t    _device_string_desc[];
+
+    Port                _ports[NUM_PORTS]     ;
+    LineCodingCallback  _line_coding_callback ;
+    void               *_line_coding_user_data;
+    uint8_t             _line_coding_port     ;  // of SET_LINE_CODING
+
+};  // template<unsigned NUM_PORTS> class UsbDevCdcAcmMulti
+
+
+
+// Instantiation with descriptors and UsbDev hooks defined in
+//   usb_dev_cdc_acm_multi.cxx
+typedef UsbDevCdcAcmMulti<USB_DEV_CDC_ACM_PORTS>    UsbDevCdcAcmPorts;
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_CDC_ACM_MULTI_HXX
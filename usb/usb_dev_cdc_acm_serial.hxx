@@ -0,0 +1,163 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_CDC_ACM_SERIAL_HXX
+#define USB_DEV_CDC_ACM_SERIAL_HXX
+
+#include <usb_dev.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// CDC-ACM (USB CDC PSTN subclass 1.2) definitions and SERIAL_STATE
+//   notification logic common to single-port UsbDevCdcAcm
+//   (usb_dev_cdc_acm.hxx) and multi-port UsbDevCdcAcmMulti
+//   (usb_dev_cdc_acm_multi.hxx). Not used directly.
+//
+class UsbDevCdcAcmSerial : public UsbDev
+{
+  public:
+    static const uint8_t    ACM_DATA_SIZE            = 10;  // SERIAL_STATE
+
+    // 6.5.4, SERIAL_STATE notification UART state bitmap. DCD and DSR are
+    //   levels, others are events reported once.
+    static const uint16_t   SERIAL_STATE_DCD         = 0x0001,  // bRxCarrier
+                            SERIAL_STATE_DSR         = 0x0002,  // bTxCarrier
+                            SERIAL_STATE_BREAK       = 0x0004,
+                            SERIAL_STATE_RING        = 0x0008,
+                            SERIAL_STATE_FRAMING     = 0x0010,
+                            SERIAL_STATE_PARITY      = 0x0020,
+                            SERIAL_STATE_OVERRUN     = 0x0040,
+                            SERIAL_STATE_LINES       =   SERIAL_STATE_DCD
+                                                       | SERIAL_STATE_DSR;
+
+    // 6.3.12, SET_CONTROL_LINE_STATE wValue
+    static const uint16_t   CONTROL_LINE_DTR         = 0x0001,
+                            CONTROL_LINE_RTS         = 0x0002;
+
+    // 6.3.11
+    struct LineCoding {
+        uint32_t    baud       ;  // dwDTERate
+        uint8_t     stop_bits  ,  // bCharFormat: 0 == 1, 1 == 1.5, 2 == 2
+                    parity_code,  // bParityType: 0 none, 1 odd, 2 even, ...
+                    bits       ;  // bDataBits
+    };
+
+
+    // Line status of one port to be reported to host via SERIAL_STATE
+    //   notifications. lines() and event() can be called from (one)
+    //   interrupt handler -- only record changes, which are merged into
+    //   at most one notification in flight, see serial_state_poll().
+    //
+    class SerialState {
+      public:
+        constexpr SerialState()
+        :   _lines (0),
+            _sent  (0),
+            _posted(0),
+            _acked (0)
+        {}
+
+        void lines(                 // set DCD and/or DSR levels
+        const uint16_t  lines)
+        {
+            _lines = lines & SERIAL_STATE_LINES;
+        }
+
+        uint16_t lines() const { return _lines; }
+
+        void event(                 // post BREAK, RING, or error(s)
+        const uint16_t  events)
+        {
+            // toggle bits not already pending; lock-free because only this
+            //   writes _posted and only serial_state_poll() writes _acked
+            uint16_t    pending = _posted ^ _acked;
+
+            _posted ^= events & ~SERIAL_STATE_LINES & ~pending;
+        }
+
+        // (re)report current DCD/DSR, e.g. to newly configured host
+        void resend() { _sent = ~0; }
+
+
+      protected:
+        friend class UsbDevCdcAcmSerial;
+
+        volatile uint16_t   _lines ,
+                            _sent  ,  // lines last sent
+                            _posted,  // events, toggled
+                            _acked ;  //   and sent
+    };  // class SerialState
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    constexpr explicit UsbDevCdcAcmSerial(
+    const uint16_t  double_buffered = 0)
+    :   UsbDev(double_buffered)
+    {}
+
+    static const uint8_t    _SERIAL_STATE           = 0x20,  // notification
+                            _SET_LINE_CODING        = 0x20,
+                            _GET_LINE_CODING        = 0x21,
+                            _SET_CONTROL_LINE_STATE = 0x22;
+
+    // Sends state's pending changes as notification from communications
+    //   interface on endpoint, if previous one has been delivered
+    //
+    void serial_state_poll(
+          SerialState   &state    ,
+    const uint8_t        endpoint ,
+    const uint8_t        interface)
+    {
+        if (!(send_readys() & (1 << endpoint)))
+            return;  // previous notification in flight
+
+        uint16_t    lines  = state._lines                ,
+                    events = state._posted ^ state._acked;
+
+        if (lines == state._sent && !events)
+            return;
+
+        const uint8_t   notification[ACM_DATA_SIZE] = {
+            0xa1,                   // bmRequestType: class, interface, to host
+            _SERIAL_STATE,          // bNotification
+            0x00, 0x00,             // wValue
+            interface, 0x00,        // wIndex: communications interface
+            0x02, 0x00,             // wLength
+            static_cast<uint8_t>(lines | events),
+            0x00                    // UART state bitmap, MSB
+        };
+
+        if (send(endpoint, notification, sizeof(notification))) {
+            state._sent   = lines ;
+            state._acked ^= events;  // any posted since remain pending
+        }
+
+    }  // serial_state_poll(SerialState&, const uint8_t, const uint8_t)
+
+};  // class UsbDevCdcAcmSerial
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_CDC_ACM_SERIAL_HXX
@@ -0,0 +1,597 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_cdc_ncm.hxx>
+#include <usb_dev_descriptors.hxx>
+
+namespace stm32f10_12357_xx {
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0x02,   // bDeviceClass: CDC
+    0x00,   // bDeviceSubClass
+    0x00,   // bDeviceProtocol
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x40,   // idProduct = 0x5740
+    0x57,   //     "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        UsbDevCdcNcm::COMM_INTERFACE,   // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x02,       // bInterfaceClass: Communication Interface Class
+        0x0d,       // bInterfaceSubClass: Network Control Model
+        0x00,       // bInterfaceProtocol: none
+        0,          // iInterface
+
+        usb_desc::cdc_header  (0x0110),             // bcdCDC: 1.10
+        usb_desc::cdc_union   (UsbDevCdcNcm::COMM_INTERFACE,
+                               UsbDevCdcNcm::DATA_INTERFACE),
+        usb_desc::cdc_ethernet(UsbDevCdcNcm::MAC_STRING_NDX,
+                               0,                   // bmEthernetStatistics
+                               UsbDevCdcNcm::MAX_SEGMENT_SIZE,
+                               0,                   // wNumberMCFilters
+                               0),                  // bNumberPowerFilters
+        usb_desc::cdc_ncm     (0x0100,              // bcdNcmVersion: 1.00
+                               0x00),               // bmNetworkCapabilities
+
+        usb_desc::endpoint(  UsbDevCdcNcm::NOTIFY_ENDPOINT
+                           | UsbDev::ENDPOINT_DIR_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevCdcNcm::NOTIFY_DATA_SIZE,
+                           0x10)),              // bInterval: ms
+
+    // alternate 0: no endpoints, link down
+    usb_desc::interface(
+        UsbDevCdcNcm::DATA_INTERFACE,   // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x0a,       // bInterfaceClass: CDC Data
+        0x00,       // bInterfaceSubClass
+        0x01,       // bInterfaceProtocol: NCM data
+        0),         // iInterface
+
+    // alternate 1: data endpoints (PMA allocated at SET_INTERFACE)
+    usb_desc::interface(
+        UsbDevCdcNcm::DATA_INTERFACE,   // bInterfaceNumber
+        1,          // bAlternateSetting
+        0x0a,       // bInterfaceClass: CDC Data
+        0x00,       // bInterfaceSubClass
+        0x01,       // bInterfaceProtocol: NCM data
+        0,          // iInterface
+
+        usb_desc::endpoint(UsbDevCdcNcm::DATA_ENDPOINT,
+                           UsbDev::EndpointType::BULK,
+                           UsbDevCdcNcm::DATA_SIZE,
+                           0),                  // bInterval: ignored for bulk
+
+        usb_desc::endpoint(  UsbDevCdcNcm::DATA_ENDPOINT
+                           | UsbDev::ENDPOINT_DIR_IN,
+                           UsbDev::EndpointType::BULK,
+                           UsbDevCdcNcm::DATA_SIZE,
+                           0)));                // bInterval: ignored for bulk
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t   UsbDevCdcNcm::_device_string_desc[] = "STM32 NCM Ethernet"  ,
+                UsbDevCdcNcm::_mac_string_desc   [] = USB_DEV_NCM_HOST_MAC  ;
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev      ::  language_id_string_desc(),
+    UsbDev      ::       vendor_string_desc(),
+    UsbDevCdcNcm::       device_string_desc(),
+    UsbDev      ::serial_number_string_desc(),
+    UsbDevCdcNcm::          mac_string_desc(),  // MAC_STRING_NDX
+};
+
+const UsbDevCdcNcm::NtbParameters   UsbDevCdcNcm::_NTB_PARAMETERS = {
+    sizeof(NtbParameters),  // wLength
+    0x0001,                 // bmNtbFormatsSupported: NTB16
+    NTB_IN_SIZE,            // dwNtbInMaxSize
+    _NDP_ALIGN,             // wNdpInDivisor
+    0,                      // wNdpInPayloadRemainder
+    _NDP_ALIGN,             // wNdpInAlignment
+    0,                      // wReserved
+    NTB_OUT_SIZE,           // dwNtbOutMaxSize
+    _NDP_ALIGN,             // wNdpOutDivisor
+    0,                      // wNdpOutPayloadRemainder
+    _NDP_ALIGN,             // wNdpOutAlignment
+    0,                      // wNtbOutMaxDatagrams: no limit
+};
+
+
+
+bool UsbDevCdcNcm::class_setup()
+{
+    static const uint16_t   NTB16_FORMAT = 0;
+
+    if (!  _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_INTERFACE))
+        return false;
+
+    const uint8_t   *data;
+    uint16_t         size;
+
+    switch (_setup_packet->request) {
+        case _GET_NTB_PARAMETERS:
+            data = reinterpret_cast<const uint8_t*>(&_NTB_PARAMETERS);
+            size =                           sizeof( _NTB_PARAMETERS);
+            break;
+
+        case _GET_NTB_FORMAT:
+            data = reinterpret_cast<const uint8_t*>(&NTB16_FORMAT);
+            size =                           sizeof( NTB16_FORMAT);
+            break;
+
+        case _SET_NTB_FORMAT:
+            if (_setup_packet->value.word != NTB16_FORMAT)
+                _setup_stall = true;  // NTB32 not supported
+            data = 0;
+            size = 0;
+            break;
+
+        case _GET_NTB_INPUT_SIZE:
+            data = reinterpret_cast<const uint8_t*>(&_ntb_input_size[0]);
+            size =                           sizeof( _ntb_input_size[0]);
+            break;
+
+        case _SET_NTB_INPUT_SIZE:
+            // dwNtbInMaxSize, optionally followed by wNtbInMaxDatagrams
+            //   (see in_limit() and in_max_datagrams()), checked after
+            //   data stage by ntb_input_size_stream()
+            if (_setup_packet->length != 4 && _setup_packet->length != 8)
+                return false;
+            _ntb_input_request[0] = 0;
+            _ntb_input_request[1] = 0;  // no wNtbInMaxDatagrams limit
+            control_out_stream(ntb_input_size_stream, this,
+                               _setup_packet->length     );
+            return true;
+
+        case _SET_ETHERNET_PACKET_FILTER:
+            // accepted but not applied: device only sends frames the
+            //   application addresses to host
+            data = 0;
+            size = 0;
+            break;
+
+        default:
+            return false;
+    }
+
+    if (_setup_packet->request_type.any(   SetupPacket
+                                        ::RequestType
+                                        ::DIR_DEV_TO_HOST))
+        _send_info.set(data, size);
+    else
+        _recv_info.set(const_cast<uint8_t*>(data), size);
+
+    return true;
+
+}  // class_setup()
+
+
+
+uint8_t* UsbDevCdcNcm::ntb_input_size_stream(
+const uint16_t   offset   ,
+const uint16_t   length   ,
+      void      *user_data)
+{
+    UsbDevCdcNcm    *self = static_cast<UsbDevCdcNcm*>(user_data);
+
+    if (length)
+        return reinterpret_cast<uint8_t*>(self->_ntb_input_request) + offset;
+
+    // data stage complete: ignore if too short or if dwNtbInMaxSize can't
+    //   hold maximum size frame (too late to stall), keeping previous
+    if (offset >= 4 && self->_ntb_input_request[0] >= _NTB_IN_MIN_SIZE) {
+        self->_ntb_input_size[0] = self->_ntb_input_request[0];
+        self->_ntb_input_size[1] = self->_ntb_input_request[1];
+    }
+
+    return 0;
+
+}  // ntb_input_size_stream()
+
+
+
+void UsbDevCdcNcm::restart()
+{
+    // clear first so no SET_CONFIGURATION/SET_INTERFACE is missed
+    _restart = false;
+
+    bool    up =    device_state() == DeviceState::CONFIGURED
+                 && alternate_setting(DATA_INTERFACE) == 1;
+
+    _out_head         = _out_tail = 0;
+    _out_offset       = 0            ;
+    _out_ndp          = 0            ;
+    _out_entry        = 0            ;
+    _in_head          = _in_tail  = 0;
+    _in_offset        = _NTH16_SIZE  ;
+    _in_sent          = 0            ;
+    _in_num_datagrams = 0            ;
+
+    if (up)
+        _notify_pending = _NOTIFY_SPEED | _NOTIFY_CONNECT;
+    else if (_link_up)
+        _notify_pending = _NOTIFY_DISCONNECT;
+
+    _link_up = up;
+
+}  // restart()
+
+
+
+// Check NTH16 and NDP16 chain of complete OUT NTB so recv_frame() can
+//   trust it
+bool UsbDevCdcNcm::out_valid(
+const uint8_t   *ntb   ,
+const uint16_t   length)
+{
+    if (   length                  <  _NTH16_SIZE
+        || ntb[0] != 'N' || ntb[1] != 'C' || ntb[2] != 'M' || ntb[3] != 'H'
+        || get16(ntb + 4)          != _NTH16_SIZE)
+        return false;
+
+    uint16_t    block_length = get16(ntb +  8),
+                ndp          = get16(ntb + 10);
+
+    if (block_length > length)
+        return false;
+
+    // bounded, in case of NDP loop
+    for (uint8_t count = 0 ; count < 8 ; ++count) {
+        if (   ndp                   <  _NTH16_SIZE
+            || ndp % _NDP_ALIGN
+            || ndp + ndp_size(0)     >  block_length)
+            return false;
+
+        const uint8_t   *ndp_bytes  = ntb + ndp;
+        uint16_t         ndp_length = get16(ndp_bytes + 4);
+
+        if (   ndp_bytes[0] != 'N' || ndp_bytes[1] != 'C'
+            || ndp_bytes[2] != 'M' || ndp_bytes[3] != '0'   // no CRC
+            || ndp_length    < ndp_size(1)
+            || ndp + ndp_length > block_length             )
+            return false;
+
+        for (uint16_t entry  = _NDP16_BASE_SIZE ;
+                      entry + 4 <= ndp_length   ;
+                      entry += 4                ) {
+            uint16_t    index = get16(ndp_bytes + entry    ),
+                        size  = get16(ndp_bytes + entry + 2);
+
+            if (!index || !size)
+                break;
+
+            if (index + size > block_length)
+                return false;
+        }
+
+        if ((ndp = get16(ndp_bytes + 6)) == 0)
+            return true;
+    }
+
+    return false;
+
+}  // out_valid()
+
+
+
+const uint8_t* UsbDevCdcNcm::recv_frame(
+uint16_t    &length)
+{
+    while (_out_tail != _out_head) {
+        uint8_t     *ntb = out_ntb(_out_tail);
+
+        if (!_out_ndp) {    // start of NTB
+            _out_ndp   = get16(ntb + 10);
+            _out_entry = _NDP16_BASE_SIZE;
+        }
+
+        while (_out_ndp) {
+            const uint8_t   *ndp = ntb + _out_ndp;
+
+            if (_out_entry + 4 <= get16(ndp + 4)) {
+                uint16_t    index = get16(ndp + _out_entry    ),
+                            size  = get16(ndp + _out_entry + 2);
+
+                _out_entry += 4;
+
+                if (index && size) {
+                    length = size;
+                    return ntb + index;
+                }
+            }
+
+            // end of this NDP, next one if any
+            _out_ndp   = get16(ndp + 6);
+            _out_entry = _NDP16_BASE_SIZE;
+        }
+
+        // all datagrams returned, free for next OUT transfer
+        ++_out_tail;
+    }
+
+    length = 0;
+    return 0;
+
+}  // recv_frame()
+
+
+
+void UsbDevCdcNcm::close_in_ntb()
+{
+    uint8_t     *ntb = in_ntb(_in_head)  ,
+                *ndp                     ;
+    uint16_t     ndp_offset = align(_in_offset),
+                 block_length;
+
+    ndp = ntb + ndp_offset;
+
+    ndp[0] = 'N';
+    ndp[1] = 'C';
+    ndp[2] = 'M';
+    ndp[3] = '0';
+    put16(ndp + 4, ndp_size(_in_num_datagrams));
+    put16(ndp + 6, 0                          );  // wNextNdpIndex
+
+    for (uint8_t datagram = 0 ; datagram < _in_num_datagrams ; ++datagram) {
+        put16(ndp + _NDP16_BASE_SIZE + 4 * datagram    ,
+              _in_datagrams[datagram][0]                );
+        put16(ndp + _NDP16_BASE_SIZE + 4 * datagram + 2,
+              _in_datagrams[datagram][1]                );
+    }
+    put16(ndp + _NDP16_BASE_SIZE + 4 * _in_num_datagrams    , 0);
+    put16(ndp + _NDP16_BASE_SIZE + 4 * _in_num_datagrams + 2, 0);
+
+    block_length = ndp_offset + ndp_size(_in_num_datagrams);
+
+    ntb[0] = 'N';
+    ntb[1] = 'C';
+    ntb[2] = 'M';
+    ntb[3] = 'H';
+    put16(ntb +  4, _NTH16_SIZE   );
+    put16(ntb +  6, _in_sequence++);
+    put16(ntb +  8, block_length  );
+    put16(ntb + 10, ndp_offset    );
+
+    _in_lengths[_in_head & (NTB_IN_COUNT - 1)] = block_length;
+
+    ++_in_head;
+    _in_offset        = _NTH16_SIZE;
+    _in_num_datagrams = 0          ;
+
+}  // close_in_ntb()
+
+
+
+uint8_t* UsbDevCdcNcm::send_frame_buffer(
+const uint16_t  length)
+{
+    if (!_link_up || !length)
+        return 0;
+
+    while (static_cast<uint8_t>(_in_head - _in_tail) < NTB_IN_COUNT) {
+        uint16_t    start = align(_in_offset);
+
+        if (   _in_num_datagrams < in_max_datagrams()
+            &&   align(start + length) + ndp_size(_in_num_datagrams + 1)
+              <= in_limit()                                          )
+            return in_ntb(_in_head) + start;
+
+        if (!_in_num_datagrams)
+            return 0;   // too large for any NTB
+
+        close_in_ntb();  // full, continue in next one if free
+    }
+
+    return 0;
+
+}  // send_frame_buffer()
+
+
+
+void UsbDevCdcNcm::send_frame_commit(
+const uint16_t  length)  // trust caller, after successful send_frame_buffer()
+{
+    uint16_t    start = align(_in_offset);
+
+    _in_datagrams[_in_num_datagrams][0] = start ;
+    _in_datagrams[_in_num_datagrams][1] = length;
+
+    ++_in_num_datagrams;
+    _in_offset = start + length;
+}
+
+
+
+bool UsbDevCdcNcm::send_frame(
+const uint8_t   *frame ,
+const uint16_t   length)
+{
+    uint8_t     *buffer = send_frame_buffer(length);
+
+    if (!buffer)
+        return false;
+
+    for (uint16_t ndx = 0 ; ndx < length ; ++ndx)
+        buffer[ndx] = frame[ndx];
+
+    send_frame_commit(length);
+
+    return true;
+}
+
+
+
+void UsbDevCdcNcm::recv_packets()
+{
+    while (   static_cast<uint8_t>(_out_head - _out_tail) < NTB_OUT_COUNT
+           && recv_ready(1 << DATA_ENDPOINT)                           ) {
+        uint8_t     *ntb    = out_ntb(_out_head);
+        uint16_t     length = recv(DATA_ENDPOINT, ntb + _out_offset);
+
+        _out_offset += length;
+
+        // more packets in this transfer unless short, zero-length, or full
+        if (length == DATA_SIZE && _out_offset < NTB_OUT_SIZE)
+            continue;
+
+        if (_out_offset && out_valid(ntb, _out_offset)) {
+            _out_lengths[_out_head & (NTB_OUT_COUNT - 1)] = _out_offset;
+            ++_out_head;
+        }
+        // else discard malformed NTB
+
+        _out_offset = 0;
+    }
+
+}  // recv_packets()
+
+
+
+void UsbDevCdcNcm::send_packets()
+{
+    if (!(send_readys() & (1 << DATA_ENDPOINT)))
+        return;
+
+    if (_in_tail == _in_head) {
+        if (!_in_num_datagrams)
+            return;
+
+        // send everything queued while previous NTB was in flight
+        close_in_ntb();
+    }
+
+    uint8_t     *ntb    = in_ntb(_in_tail)                          ;
+    uint16_t     length = _in_lengths[_in_tail & (NTB_IN_COUNT - 1)],
+                 packet = length - _in_sent                          ;
+
+    if (packet > DATA_SIZE)
+        packet = DATA_SIZE;
+
+    send(DATA_ENDPOINT, ntb + _in_sent, packet);
+
+    _in_sent += packet;
+
+    // short packet ends transfer, or full packet if NTB is host's max
+    //   size, else zero-length packet will follow
+    if (packet < DATA_SIZE || (_in_sent == length && length >= in_limit())) {
+        ++_in_tail;
+        _in_sent = 0;
+    }
+
+}  // send_packets()
+
+
+
+void UsbDevCdcNcm::notify()
+{
+    if (!_notify_pending || !(send_readys() & (1 << NOTIFY_ENDPOINT)))
+        return;
+
+    uint8_t     notification[NOTIFY_DATA_SIZE] = {
+                    0xa1,               // bmRequestType: class, to host
+                    _NETWORK_CONNECTION,// bNotificationCode
+                    0x00, 0x00,         // wValue
+                    COMM_INTERFACE,     // wIndex
+                    0x00,
+                    0x00, 0x00};        // wLength
+    uint16_t    size = 8;
+    uint8_t     sent;
+
+    if (_notify_pending & _NOTIFY_SPEED) {
+        notification[1] = _CONNECTION_SPEED_CHANGE;
+        notification[6] = 8                       ;  // wLength
+        put16(notification +  8, _LINK_BITS_PER_SEC & 0xffff);  // downlink
+        put16(notification + 10, _LINK_BITS_PER_SEC >> 16   );
+        put16(notification + 12, _LINK_BITS_PER_SEC & 0xffff);  // uplink
+        put16(notification + 14, _LINK_BITS_PER_SEC >> 16   );
+        size            = 16                      ;
+        sent            = _NOTIFY_SPEED           ;
+    }
+    else if (_notify_pending & _NOTIFY_CONNECT) {
+        notification[2] = 1                       ;  // connected
+        sent            = _NOTIFY_CONNECT         ;
+    }
+    else
+        sent            = _NOTIFY_DISCONNECT      ;
+
+    if (send(NOTIFY_ENDPOINT, notification, size))
+        _notify_pending &= ~sent;
+
+}  // notify()
+
+
+
+void UsbDevCdcNcm::ntb_poll()
+{
+    if (_restart)
+        restart();
+
+    notify();
+
+    if (!_link_up)
+        return;
+
+    recv_packets();
+    send_packets();
+
+}  // ntb_poll()
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevCdcNcm*>(this)->class_setup();
+}
+
+
+void UsbDev::set_configuration()
+{
+    static_cast<UsbDevCdcNcm*>(this)->_restart = true;
+}
+
+void UsbDev::set_interface()
+{
+    static_cast<UsbDevCdcNcm*>(this)->_restart = true;
+}
+
+
+}  // namespace stm32f10_12357_xx {
@@ -0,0 +1,315 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_CDC_NCM_HXX
+#define USB_DEV_CDC_NCM_HXX
+
+
+// NTB (NCM transfer block) buffer sizes and counts. Sizes must be
+//   multiples of 64 and hold at least one 1514 byte Ethernet frame plus
+//   headers; counts must be powers of 2. Linux cdc_ncm requests IN
+//   blocks of at least 2048 bytes but accepts smaller ones.
+#ifndef USB_DEV_NCM_NTB_IN_SIZE
+#define USB_DEV_NCM_NTB_IN_SIZE         2048
+#endif
+#ifndef USB_DEV_NCM_NTB_OUT_SIZE
+#define USB_DEV_NCM_NTB_OUT_SIZE        2048
+#endif
+#ifndef USB_DEV_NCM_NTB_IN_COUNT
+#define USB_DEV_NCM_NTB_IN_COUNT        2
+#endif
+#ifndef USB_DEV_NCM_NTB_OUT_COUNT
+#define USB_DEV_NCM_NTB_OUT_COUNT       2
+#endif
+
+// Max datagrams aggregated per IN NTB
+#ifndef USB_DEV_NCM_MAX_IN_DATAGRAMS
+#define USB_DEV_NCM_MAX_IN_DATAGRAMS    16
+#endif
+
+// MAC address of host's end of link, 12 hex digits, string descriptor
+#ifndef USB_DEV_NCM_HOST_MAC
+#define USB_DEV_NCM_HOST_MAC            "0200005C4E01"
+#endif
+
+
+#include <usb_dev.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+
+
+namespace stm32f10_12357_xx {
+
+// USB CDC NCM 1.0 (Network Control Model) Ethernet device, NTB16 only.
+//
+// Host-to-device NTBs are received packet by packet (multi-packet bulk
+//   transfers) into a ring of RAM buffers, and their datagrams returned
+//   in place, without copying, by recv_frame(). Device-to-host
+//   datagrams are built in place in a ring of IN NTB buffers via
+//   send_frame_buffer()/send_frame_commit() (or copied by send_frame())
+//   and as many as fit are aggregated into each NTB, which is closed
+//   and sent when the IN endpoint becomes free.
+//
+// Frame queue interface for an IP stack:
+//   recv_frame()           next received Ethernet frame, or 0
+//   send_frame_buffer()    room for frame in current IN NTB, or 0 if
+//                          none (all IN NTBs full/in flight)
+//   send_frame_commit()    queue frame written into above
+//   send_frame()           copy and queue frame
+//   link_up()              host has selected data interface alternate 1
+//
+// ntb_poll() moves NTBs to/from USB and sends connection notifications. It
+//   and all frame queue methods must be called from the same context
+//   (typically main loop, after UsbDev::poll() if not
+//   USB_DEV_INTERRUPT_DRIVEN).
+//
+class UsbDevCdcNcm : public UsbDev
+{
+  public:
+    static const uint8_t    // have to be public for clients, static descriptors
+                            NOTIFY_ENDPOINT   =  1,
+                            DATA_ENDPOINT     =  2,
+                            COMM_INTERFACE    =  0,
+                            DATA_INTERFACE    =  1,
+                            MAC_STRING_NDX    =  4,
+                            NOTIFY_DATA_SIZE  = 16,
+                            DATA_SIZE         = 64;
+
+    static const uint16_t   NTB_IN_SIZE       = USB_DEV_NCM_NTB_IN_SIZE  ,
+                            NTB_OUT_SIZE      = USB_DEV_NCM_NTB_OUT_SIZE ,
+                            NTB_IN_COUNT      = USB_DEV_NCM_NTB_IN_COUNT ,
+                            NTB_OUT_COUNT     = USB_DEV_NCM_NTB_OUT_COUNT,
+                            MAX_IN_DATAGRAMS  = USB_DEV_NCM_MAX_IN_DATAGRAMS,
+                            MAX_SEGMENT_SIZE  = 1514;  // Ethernet frame
+
+    static_assert(   NTB_IN_SIZE  % DATA_SIZE == 0
+                  && NTB_OUT_SIZE % DATA_SIZE == 0,
+                  "NTB sizes must be multiples of DATA_SIZE");
+    static_assert(   (NTB_IN_COUNT  & (NTB_IN_COUNT  - 1)) == 0
+                  && (NTB_OUT_COUNT & (NTB_OUT_COUNT - 1)) == 0,
+                  "NTB counts must be powers of 2");
+
+    constexpr UsbDevCdcNcm()
+    :   UsbDev            (          ),
+        _ntb_input_size   {NTB_IN_SIZE, 0},
+        _ntb_input_request{0, 0      },
+        _notify_pending   (0         ),
+        _restart          (true      ),
+        _link_up          (false     ),
+        _out_ntbs         {{0}       },
+        _out_lengths      {0         },
+        _out_head         (0         ),
+        _out_tail         (0         ),
+        _out_offset       (0         ),
+        _out_ndp          (0         ),
+        _out_entry        (0         ),
+        _in_ntbs          {{0}       },
+        _in_lengths       {0         },
+        _in_head          (0         ),
+        _in_tail          (0         ),
+        _in_offset        (0         ),
+        _in_sent          (0         ),
+        _in_sequence      (0         ),
+        _in_datagrams     {{0}       },
+        _in_num_datagrams (0         )
+    {}
+
+
+    // Frame queue interface, see above
+    //
+    const uint8_t*  recv_frame(uint16_t     &length);  // valid until next call
+
+          uint8_t*  send_frame_buffer(const uint16_t     length);
+          void      send_frame_commit(const uint16_t     length);
+          bool      send_frame       (const uint8_t     *frame ,
+                                      const uint16_t     length);
+
+          bool      link_up() const { return _link_up; }
+
+    // Moves NTBs to/from USB endpoints. Call frequently.
+    void    ntb_poll();
+
+
+    // need public accessors for static initialization of _STRING_DESCS
+    //
+    static constexpr const uint8_t* device_string_desc()
+    {
+        return _device_string_desc;
+    }
+
+    static constexpr const uint8_t* mac_string_desc()
+    {
+        return _mac_string_desc;
+    }
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    // USB CDC NCM 1.0, 6.2.1
+    struct NtbParameters {
+        uint16_t    length                 ,
+                    ntb_formats_supported  ;
+        uint32_t    ntb_in_max_size        ;
+        uint16_t    ndp_in_divisor         ,
+                    ndp_in_payload_remainder,
+                    ndp_in_alignment       ,
+                    reserved               ;
+        uint32_t    ntb_out_max_size       ;
+        uint16_t    ndp_out_divisor        ,
+                    ndp_out_payload_remainder,
+                    ndp_out_alignment      ,
+                    ntb_out_max_datagrams  ;
+    };
+    static_assert(sizeof(NtbParameters) == 28, "NtbParameters not packed");
+
+    static const uint8_t    _SET_ETHERNET_PACKET_FILTER = 0x43,
+                            _GET_NTB_PARAMETERS         = 0x80,
+                            _GET_NTB_FORMAT             = 0x83,
+                            _SET_NTB_FORMAT             = 0x84,
+                            _GET_NTB_INPUT_SIZE         = 0x85,
+                            _SET_NTB_INPUT_SIZE         = 0x86,
+                            _NETWORK_CONNECTION         = 0x00,  // notifs
+                            _CONNECTION_SPEED_CHANGE    = 0x2a,
+                            _NOTIFY_SPEED               = 0x01,  // pending
+                            _NOTIFY_CONNECT             = 0x02,
+                            _NOTIFY_DISCONNECT          = 0x04;
+
+    static const uint16_t   _NTH16_SIZE      = 12,
+                            _NDP16_BASE_SIZE =  8,  // plus entries
+                            _NDP_ALIGN       =  4;
+
+    static const uint32_t   _LINK_BITS_PER_SEC = 12000000;  // full speed
+
+    static uint16_t get16(const uint8_t    *bytes)
+    {
+        return bytes[0] | (bytes[1] << 8);
+    }
+
+    static void put16(uint8_t   *bytes, const uint16_t    value)
+    {
+        bytes[0] = value & 0xff;
+        bytes[1] = value >> 8  ;
+    }
+
+    static constexpr uint16_t align(const uint16_t   offset)
+    {
+        return (offset + _NDP_ALIGN - 1) & ~(_NDP_ALIGN - 1);
+    }
+
+    static constexpr uint16_t ndp_size(const uint16_t    num_datagrams)
+    {
+        // entries plus zero terminator
+        return _NDP16_BASE_SIZE + 4 * (num_datagrams + 1);
+    }
+
+    // smallest SET_NTB_INPUT_SIZE dwNtbInMaxSize accepted: NTH16, one
+    //   maximum size datagram, and NDP16 with its entry and terminator,
+    //   as laid out by close_in_ntb() (_NTH16_SIZE already aligned)
+    static const uint16_t   _NTB_IN_MIN_SIZE
+                            =   (  (  _NTH16_SIZE + MAX_SEGMENT_SIZE
+                                    + _NDP_ALIGN  - 1               )
+                                 & ~(_NDP_ALIGN - 1)                 )
+                              + _NDP16_BASE_SIZE + 4 * 2              ;
+
+    static_assert(NTB_IN_SIZE >= _NTB_IN_MIN_SIZE,
+                  "NTB_IN_SIZE too small for maximum size Ethernet frame");
+
+    uint8_t* out_ntb(const uint8_t   ndx)
+    {
+        return reinterpret_cast<uint8_t*>(_out_ntbs[ndx & (NTB_OUT_COUNT - 1)]);
+    }
+
+    uint8_t*  in_ntb(const uint8_t   ndx)
+    {
+        return reinterpret_cast<uint8_t*>( _in_ntbs[ndx & (NTB_IN_COUNT  - 1)]);
+    }
+
+    // host's dwNtbInMaxSize and wNtbInMaxDatagrams (0 == no limit)
+    uint16_t in_limit() const
+    {
+        return    _ntb_input_size[0] < NTB_IN_SIZE
+               ?  _ntb_input_size[0] : NTB_IN_SIZE;
+    }
+
+    uint8_t in_max_datagrams() const
+    {
+        uint16_t    host = _ntb_input_size[1] & 0xffff;
+
+        return host && host < MAX_IN_DATAGRAMS ? host : MAX_IN_DATAGRAMS;
+    }
+
+    static uint8_t* ntb_input_size_stream(const uint16_t     offset   ,
+                                          const uint16_t     length   ,
+                                                void        *user_data);
+
+    bool    class_setup  ();  // UsbDev::device_class_setup()
+    void    restart      ();
+    bool    out_valid    (const uint8_t   *ntb, const uint16_t   length);
+    void    close_in_ntb ();
+    void    recv_packets ();
+    void    send_packets ();
+    void    notify       ();
+
+
+    static const uint8_t        _device_string_desc[],
+                                _mac_string_desc   [];
+    static const NtbParameters  _NTB_PARAMETERS      ;
+
+    uint32_t            _ntb_input_size   [2];  // SET_NTB_INPUT_SIZE,
+    uint32_t            _ntb_input_request[2];  //   accepted and received
+    volatile uint8_t    _notify_pending  ;
+    volatile bool       _restart         ,   // set by interrupt
+                        _link_up         ;
+
+    // OUT (host-to-device) NTB ring, uint32_t for 16-bit PMA copy alignment
+    uint32_t            _out_ntbs   [NTB_OUT_COUNT][NTB_OUT_SIZE / 4];
+    uint16_t            _out_lengths[NTB_OUT_COUNT]                  ;
+    uint8_t             _out_head   ,   // receiving into, free-running
+                        _out_tail   ;   // parsing
+    uint16_t            _out_offset ,   // of next packet in _out_head
+                        _out_ndp    ,   // current NDP16 in _out_tail
+                        _out_entry  ;   //    "    datagram in above
+
+    // IN (device-to-host) NTB ring
+    uint32_t            _in_ntbs    [NTB_IN_COUNT][NTB_IN_SIZE / 4];
+    uint16_t            _in_lengths [NTB_IN_COUNT]                 ;
+    uint8_t             _in_head    ,   // building, free-running
+                        _in_tail    ;   // sending
+    uint16_t            _in_offset  ,   // next free byte in _in_head
+                        _in_sent    ,   // bytes of _in_tail sent
+                        _in_sequence;
+    uint16_t            _in_datagrams[MAX_IN_DATAGRAMS][2];  // index, length
+    uint8_t             _in_num_datagrams                 ;
+
+};  // class UsbDevCdcNcm
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_CDC_NCM_HXX
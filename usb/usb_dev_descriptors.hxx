@@ -0,0 +1,510 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_DESCRIPTORS_HXX
+#define USB_DEV_DESCRIPTORS_HXX
+
+#include <usb_dev.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Compile-time builders for USB configuration descriptors.
+//
+// Each builder returns a DescBytes<N> block with its own bLength filled
+//   in. Container builders (configuration(), interface(),
+//   class_specific_header(), etc) take their sub-descriptors as trailing
+//   arguments, concatenate them, and compute wTotalLength, bNumInterfaces,
+//   bNumEndpoints, etc. from the result. Use to initialize a "static
+//   constexpr auto" object whose bytes then live in flash, e.g.:
+//
+//      static constexpr auto   config_desc = usb_desc::configuration(
+//          1, 0, 0x80, 100,
+//          usb_desc::interface(0, 0, 0xff, 0, 0xff, 0,
+//              usb_desc::endpoint(1 | UsbDev::ENDPOINT_DIR_IN,
+//                                 UsbDev::EndpointType::BULK, 64, 0),
+//              usb_desc::endpoint(1, UsbDev::EndpointType::BULK, 64, 0)));
+//
+//      const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+//
+// configuration() checks the bLength chain of the complete descriptor.
+//   A malformed one (e.g. a raw() block with a bad length byte) fails
+//   compilation with an error referencing malformed_descriptor().
+//
+// Requires C++14 (constexpr loops).
+//
+namespace usb_desc {
+
+static const uint8_t    CS_INTERFACE          = 0x24,  // class-specific
+                        CS_ENDPOINT           = 0x25,  //   "      "
+                        INTERFACE_ASSOCIATION = 0x0b,
+                        HID                   = 0x21,
+                        HID_REPORT            = 0x22,
+                        DFU_FUNCTIONAL        = 0x21;
+
+
+template<unsigned SIZE> struct DescBytes {
+    static const unsigned   LENGTH = SIZE;
+
+    constexpr uint8_t operator[](const unsigned ndx) const
+    {
+        return bytes[ndx];
+    }
+
+    uint8_t     bytes[SIZE];
+};
+
+
+
+// never defined -- reaching it in constexpr evaluation is compile error
+void malformed_descriptor();
+
+
+
+constexpr uint8_t lsb(
+const uint16_t  value)
+{
+    return value & 0xff;
+}
+
+constexpr uint8_t msb(
+const uint16_t  value)
+{
+    return value >> 8;
+}
+
+
+
+template<unsigned SIZE_1, unsigned SIZE_2>
+constexpr DescBytes<SIZE_1 + SIZE_2> operator+(
+const DescBytes<SIZE_1>     &first ,
+const DescBytes<SIZE_2>     &second)
+{
+    DescBytes<SIZE_1 + SIZE_2>  result{};
+
+    for (unsigned ndx = 0 ; ndx < SIZE_1 ; ++ndx)
+        result.bytes[ndx         ] = first .bytes[ndx];
+    for (unsigned ndx = 0 ; ndx < SIZE_2 ; ++ndx)
+        result.bytes[ndx + SIZE_1] = second.bytes[ndx];
+
+    return result;
+}
+
+template<unsigned SIZE>
+constexpr DescBytes<SIZE> concat(
+const DescBytes<SIZE>       &only)
+{
+    return only;
+}
+
+template<unsigned SIZE, typename... REST>
+constexpr auto concat(
+const DescBytes<SIZE>       &first,
+const REST&...               rest )
+{
+    return first + concat(rest...);
+}
+
+
+
+// true if chain of bLength fields exactly spans descriptor
+template<unsigned SIZE>
+constexpr bool well_formed(
+const DescBytes<SIZE>       &desc)
+{
+    unsigned    ndx = 0;
+
+    while (ndx < SIZE) {
+        if (desc.bytes[ndx] < 2)
+            return false;
+        ndx += desc.bytes[ndx];
+    }
+
+    return ndx == SIZE;
+}
+
+
+
+// Number of descriptors of bDescriptorType "type" from offset "start" on.
+// If "alternate_0_only", skip interface descriptors with non-zero
+//   bAlternateSetting.
+template<unsigned SIZE>
+constexpr uint8_t count(
+const DescBytes<SIZE>       &desc            ,
+const unsigned               start           ,
+const uint8_t                type            ,
+const bool                   alternate_0_only)
+{
+    uint8_t     result = 0;
+
+    for (unsigned ndx = start ; ndx < SIZE ; ndx += desc.bytes[ndx]) {
+        if (desc.bytes[ndx] < 2)
+            break;  // malformed, caught by well_formed()
+        if (   desc.bytes[ndx + 1] == type
+            && (!alternate_0_only || desc.bytes[ndx + 3] == 0))
+            ++result;
+    }
+
+    return result;
+}
+
+
+
+// Offset of "nth" (from 0) descriptor of bDescriptorType "type", or
+//   SIZE if none.
+template<unsigned SIZE>
+constexpr unsigned find(
+const DescBytes<SIZE>       &desc,
+const uint8_t                type,
+      unsigned               nth = 0)
+{
+    for (unsigned ndx = 0 ; ndx < SIZE ; ndx += desc.bytes[ndx]) {
+        if (desc.bytes[ndx] < 2)
+            break;
+        if (desc.bytes[ndx + 1] == type && nth-- == 0)
+            return ndx;
+    }
+
+    return SIZE;
+}
+
+
+
+// Raw bytes, no bLength/bDescriptorType header (e.g. for variable-length
+//   lists inside other descriptors).
+template<typename... BYTES>
+constexpr DescBytes<sizeof...(BYTES)> raw(
+const BYTES...      bytes)
+{
+    return DescBytes<sizeof...(BYTES)>{{static_cast<uint8_t>(bytes)...}};
+}
+
+
+
+template<typename... CHILDREN>
+constexpr auto configuration(
+const uint8_t           value     ,  // bConfigurationValue
+const uint8_t           string    ,  // iConfiguration
+const uint8_t           attributes,  // bmAttributes
+const uint16_t          max_power ,  // mA
+const CHILDREN&...      children  )
+{
+    auto    result = concat(DescBytes<9>{{
+                                9,
+                                static_cast<uint8_t>(  UsbDev
+                                                     ::DescriptorType
+                                                     ::CONFIGURATION),
+                                0, 0,       // wTotalLength, set below
+                                0,          // bNumInterfaces, set below
+                                value,
+                                string,
+                                attributes,
+                                static_cast<uint8_t>(max_power / 2)}},
+                            children...);
+
+    if (!well_formed(result))
+        malformed_descriptor();
+
+    result.bytes[2] = lsb(result.LENGTH);
+    result.bytes[3] = msb(result.LENGTH);
+    result.bytes[4] = count(result,
+                            9,
+                            static_cast<uint8_t>(  UsbDev
+                                                 ::DescriptorType
+                                                 ::INTERFACE),
+                            true);
+
+    return result;
+}
+
+
+
+template<typename... CHILDREN>
+constexpr auto interface(
+const uint8_t           number   ,  // bInterfaceNumber
+const uint8_t           alternate,  // bAlternateSetting
+const uint8_t           klass    ,  // bInterfaceClass
+const uint8_t           subclass ,  // bInterfaceSubClass
+const uint8_t           protocol ,  // bInterfaceProtocol
+const uint8_t           string   ,  // iInterface
+const CHILDREN&...      children )
+{
+    auto    result = concat(DescBytes<9>{{
+                                9,
+                                static_cast<uint8_t>(  UsbDev
+                                                     ::DescriptorType
+                                                     ::INTERFACE),
+                                number,
+                                alternate,
+                                0,          // bNumEndpoints, set below
+                                klass,
+                                subclass,
+                                protocol,
+                                string}},
+                            children...);
+
+    result.bytes[4] = count(result,
+                            9,
+                            static_cast<uint8_t>(  UsbDev
+                                                 ::DescriptorType
+                                                 ::ENDPOINT),
+                            false);
+
+    return result;
+}
+
+
+
+constexpr DescBytes<8> interface_association(
+const uint8_t           first_interface,
+const uint8_t           interface_count,
+const uint8_t           klass          ,
+const uint8_t           subclass       ,
+const uint8_t           protocol       ,
+const uint8_t           string         )
+{
+    return DescBytes<8>{{8,
+                         INTERFACE_ASSOCIATION,
+                         first_interface,
+                         interface_count,
+                         klass,
+                         subclass,
+                         protocol,
+                         string}};
+}
+
+
+
+// "sync_usage" is isochronous bmAttributes bits 2..5
+constexpr DescBytes<7> endpoint(
+const uint8_t               address   ,  // incl. UsbDev::ENDPOINT_DIR_IN
+const UsbDev::EndpointType  type      ,
+const uint16_t              max_packet,
+const uint8_t               interval  ,
+const uint8_t               sync_usage = 0)
+{
+    return DescBytes<7>{{7,
+                         static_cast<uint8_t>(  UsbDev
+                                              ::DescriptorType
+                                              ::ENDPOINT),
+                         address,
+                         static_cast<uint8_t>(  static_cast<uint8_t>(type)
+                                              | sync_usage               ),
+                         lsb(max_packet),
+                         msb(max_packet),
+                         interval}};
+}
+
+
+
+// USB Audio 1.0 9-byte form, also used by MIDI 1.0
+constexpr DescBytes<9> audio_endpoint(
+const uint8_t               address      ,
+const UsbDev::EndpointType  type         ,
+const uint16_t              max_packet   ,
+const uint8_t               interval     ,
+const uint8_t               sync_usage   = 0,
+const uint8_t               refresh      = 0,
+const uint8_t               sync_address = 0)
+{
+    return DescBytes<9>{{9,
+                         static_cast<uint8_t>(  UsbDev
+                                              ::DescriptorType
+                                              ::ENDPOINT),
+                         address,
+                         static_cast<uint8_t>(  static_cast<uint8_t>(type)
+                                              | sync_usage               ),
+                         lsb(max_packet),
+                         msb(max_packet),
+                         interval,
+                         refresh,
+                         sync_address}};
+}
+
+
+
+// Generic class-specific (or any other) descriptor: bLength, "type", and
+//   "data" bytes (typically bDescriptorSubtype first).
+template<typename... DATA>
+constexpr DescBytes<2 + sizeof...(DATA)> class_specific(
+const uint8_t       type,
+const DATA...       data)
+{
+    return DescBytes<2 + sizeof...(DATA)>{{2 + sizeof...(DATA),
+                                           type,
+                                           static_cast<uint8_t>(data)...}};
+}
+
+
+
+// Class-specific interface header whose wTotalLength covers itself and
+//   all "children" (e.g. MIDI 1.0 MS_HEADER).
+template<typename... CHILDREN>
+constexpr auto class_specific_header(
+const uint8_t           subtype ,
+const uint16_t          bcd     ,
+const CHILDREN&...      children)
+{
+    auto    result = concat(DescBytes<7>{{7,
+                                          CS_INTERFACE,
+                                          subtype,
+                                          lsb(bcd),
+                                          msb(bcd),
+                                          0, 0}},   // wTotalLength
+                            children...);
+
+    result.bytes[5] = lsb(result.LENGTH);
+    result.bytes[6] = msb(result.LENGTH);
+
+    return result;
+}
+
+
+
+// USB Audio 1.0 class-specific AudioControl interface header.
+// bInCollection and wTotalLength computed from "streaming_interfaces" (see
+//   raw()) and "children" (terminal and unit descriptors).
+template<unsigned NUM_STREAMING, typename... CHILDREN>
+constexpr auto audio_control_header(
+const uint16_t                      bcd                 ,
+const DescBytes<NUM_STREAMING>     &streaming_interfaces,
+const CHILDREN&...                  children            )
+{
+    auto    result = concat(  DescBytes<8>{{8 + NUM_STREAMING,
+                                            CS_INTERFACE,
+                                            0x01,   // HEADER
+                                            lsb(bcd),
+                                            msb(bcd),
+                                            0, 0,   // wTotalLength
+                                            NUM_STREAMING}}
+                            + streaming_interfaces,
+                            children...);
+
+    result.bytes[5] = lsb(result.LENGTH);
+    result.bytes[6] = msb(result.LENGTH);
+
+    return result;
+}
+
+
+
+// CDC 1.2 functional descriptors
+//
+constexpr DescBytes<5> cdc_header(
+const uint16_t      bcd)
+{
+    return class_specific(CS_INTERFACE, 0x00, lsb(bcd), msb(bcd));
+}
+
+constexpr DescBytes<5> cdc_call_management(
+const uint8_t       capabilities  ,
+const uint8_t       data_interface)
+{
+    return class_specific(CS_INTERFACE, 0x01, capabilities, data_interface);
+}
+
+constexpr DescBytes<4> cdc_acm(
+const uint8_t       capabilities)
+{
+    return class_specific(CS_INTERFACE, 0x02, capabilities);
+}
+
+constexpr DescBytes<5> cdc_union(
+const uint8_t       control_interface   ,
+const uint8_t       subordinate_interface)
+{
+    return class_specific(CS_INTERFACE,
+                          0x06,
+                          control_interface,
+                          subordinate_interface);
+}
+
+// CDC ECM 1.2, 5.4
+constexpr DescBytes<13> cdc_ethernet(
+const uint8_t       mac_string       ,  // iMACAddress
+const uint32_t      statistics       ,  // bmEthernetStatistics
+const uint16_t      max_segment_size ,
+const uint16_t      num_mc_filters   ,
+const uint8_t       num_power_filters)
+{
+    return class_specific(CS_INTERFACE,
+                          0x0f,
+                          mac_string,
+                          lsb(statistics      ),
+                          msb(statistics      ),
+                          lsb(statistics >> 16),
+                          msb(statistics >> 16),
+                          lsb(max_segment_size),
+                          msb(max_segment_size),
+                          lsb(num_mc_filters  ),
+                          msb(num_mc_filters  ),
+                          num_power_filters);
+}
+
+// CDC NCM 1.0, 5.2.1
+constexpr DescBytes<6> cdc_ncm(
+const uint16_t      bcd         ,
+const uint8_t       capabilities)
+{
+    return class_specific(CS_INTERFACE, 0x1a, lsb(bcd), msb(bcd), capabilities);
+}
+
+
+
+// HID 1.11, single report descriptor
+constexpr DescBytes<9> hid(
+const uint16_t      bcd          ,
+const uint8_t       country_code ,
+const uint16_t      report_length)
+{
+    return class_specific(HID,
+                          lsb(bcd),
+                          msb(bcd),
+                          country_code,
+                          1,            // bNumDescriptors
+                          HID_REPORT,
+                          lsb(report_length),
+                          msb(report_length));
+}
+
+
+
+// DFU 1.1, 4.1.3 (bcd 0x011a for ST DfuSe extensions)
+constexpr DescBytes<9> dfu_functional(
+const uint8_t       attributes    ,  // bmAttributes
+const uint16_t      detach_timeout,  // wDetachTimeOut: ms
+const uint16_t      transfer_size ,  // wTransferSize
+const uint16_t      bcd           )  // bcdDFUVersion
+{
+    return class_specific(DFU_FUNCTIONAL,
+                          attributes,
+                          lsb(detach_timeout),
+                          msb(detach_timeout),
+                          lsb(transfer_size),
+                          msb(transfer_size),
+                          lsb(bcd),
+                          msb(bcd));
+}
+
+}  // namespace usb_desc
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_DESCRIPTORS_HXX
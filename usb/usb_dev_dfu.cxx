@@ -0,0 +1,681 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_dfu.hxx>
+#include <usb_dev_descriptors.hxx>
+
+namespace stm32f10_12357_xx {
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0x00,   // bDeviceClass: defined by interface
+    0x00,   // bDeviceSubClass
+    0x00,   // bDeviceProtocol
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x11,   // idProduct = 0xdf11
+    0xdf,   //     "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        UsbDevDfu::INTERFACE,           // bInterfaceNumber
+        0,          // bAlternateSetting
+        0xfe,       // bInterfaceClass: Application Specific
+        0x01,       // bInterfaceSubClass: Device Firmware Upgrade
+        0x02,       // bInterfaceProtocol: DFU mode
+        UsbDevDfu::LAYOUT_STRING_NDX,   // iInterface: DfuSe memory layout
+
+        usb_desc::dfu_functional(
+            0x07,   // bmAttributes: manifestation tolerant, upload, download
+            255,    // wDetachTimeOut: ms
+            UsbDevDfu::TRANSFER_SIZE,
+            0x011a)));  // bcdDFUVersion: 1.1a, DfuSe
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t   UsbDevDfu::_device_string_desc[] = "STM32 DFU"              ,
+                UsbDevDfu::_layout_string_desc[] = USB_DEV_DFU_MEMORY_LAYOUT;
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev   ::  language_id_string_desc(),
+    UsbDev   ::       vendor_string_desc(),
+    UsbDevDfu::       device_string_desc(),
+    UsbDev   ::serial_number_string_desc(),
+    UsbDevDfu::       layout_string_desc(),  // LAYOUT_STRING_NDX
+};
+
+// DfuSe UPLOAD block 0
+const uint8_t   UsbDevDfu::_COMMANDS[] = {_GET_COMMANDS        ,
+                                          _SET_ADDRESS_POINTER ,
+                                          _ERASE               };
+
+
+
+
+bool UsbDevDfu::class_setup()
+{
+    if (!  _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_INTERFACE))
+        return false;
+
+    switch (_setup_packet->request) {
+        case _DETACH:
+            break;  // already in DFU mode
+
+        case _DNLOAD:
+            dnload();
+            break;
+
+        case _UPLOAD:
+            upload();
+            break;
+
+        case _GETSTATUS:
+            get_status();
+            break;
+
+        case _CLRSTATUS:
+            if (_dfu_state == DfuState::ERROR) {
+                _dfu_status = DfuStatus::OK  ;
+                _dfu_state  = DfuState ::IDLE;
+            }
+            else
+                request_error();
+            break;
+
+        case _GETSTATE:
+            _status_response[4] = static_cast<uint8_t>(_dfu_state);
+            _send_info.set(&_status_response[4], 1);
+            break;
+
+        case _ABORT:
+            // queued flash work is completed, not abandoned
+            if (   _dfu_state == DfuState::IDLE
+                || _dfu_state == DfuState::DNLOAD_SYNC
+                || _dfu_state == DfuState::DNLOAD_IDLE
+                || _dfu_state == DfuState::MANIFEST_SYNC
+                || _dfu_state == DfuState::UPLOAD_IDLE  )
+                _dfu_state = DfuState::IDLE;
+            else
+                request_error();
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+
+}  // class_setup()
+
+
+
+uint8_t* UsbDevDfu::dnload_stream(
+const uint16_t   offset   ,
+const uint16_t   length   ,
+      void      *user_data)
+{
+    UsbDevDfu   *self = static_cast<UsbDevDfu*>(user_data);
+
+    if (!length) {
+        // data stage complete
+        self->_dnload_received = offset == self->_dnload_length;
+        return 0;
+    }
+
+    if (self->_dnload_block)
+        return self->block(self->_dnload_buffer) + offset;
+    else
+        return self->_command + offset;
+
+}  // dnload_stream()
+
+
+
+void UsbDevDfu::dnload()
+{
+    uint16_t    block  = _setup_packet->value.word,
+                length = _setup_packet->length    ;
+
+    if (   _dfu_state != DfuState::IDLE
+        && _dfu_state != DfuState::DNLOAD_IDLE) {
+        request_error();
+        return;
+    }
+
+    if (!length) {
+        // end of download, manifestation follows GETSTATUS
+        if (_dfu_state == DfuState::DNLOAD_IDLE) {
+            _manifest_done = false                  ;
+            _dfu_state     = DfuState::MANIFEST_SYNC;
+        }
+        else
+            request_error();
+        return;
+    }
+
+    if (   !_flash.erase
+        || block  == 1                                // DfuSe reserved
+        || length >  (block ? TRANSFER_SIZE : _COMMAND_SIZE)
+        || !accepting()                             ) {  // ignored DNBUSY
+        request_error();
+        return;
+    }
+
+    _dnload_block    = block                ;
+    _dnload_length   = length               ;
+    _dnload_received = false                ;
+    _dfu_state       = DfuState::DNLOAD_SYNC;
+
+    control_out_stream(dnload_stream, this, length);
+
+}  // dnload()
+
+
+
+void UsbDevDfu::upload()
+{
+    uint16_t         block  = _setup_packet->value.word,
+                     length = _setup_packet->length    ,
+                     size                              ;
+    const uint8_t   *data                              ;
+
+    if (   (   _dfu_state != DfuState::IDLE
+            && _dfu_state != DfuState::UPLOAD_IDLE)
+        || block == 1
+        || !_flash.memory
+        || _ops_tail != __atomic_load_n(&_ops_head, __ATOMIC_ACQUIRE)) {
+        // last download still being programmed
+        request_error();
+        return;
+    }
+
+    if (!block) {
+        data = _COMMANDS        ;
+        size = sizeof(_COMMANDS);
+    }
+    else {
+        uint32_t    address = _address + (block - 2) * TRANSFER_SIZE;
+
+        size = length < TRANSFER_SIZE ? length : TRANSFER_SIZE;
+
+        if (address >= FLASH_END || address < FLASH_BASE)
+            size = 0;
+        else if (size > FLASH_END - address)
+            size = FLASH_END - address;
+
+        data = size ? _flash.memory(address, _flash.user_data) : 0;
+    }
+
+    if (size > length)
+        size = length;
+
+    // short or zero-length block ends upload
+    _dfu_state = size < length ? DfuState::IDLE : DfuState::UPLOAD_IDLE;
+
+    _send_info.set(data, size);
+
+}  // upload()
+
+
+
+void UsbDevDfu::get_status()
+{
+    uint32_t    timeout = 0;  // bwPollTimeout, ms
+
+    switch (_dfu_state) {
+        case DfuState::DNLOAD_SYNC:
+            if (!_dnload_received)
+                error(DfuStatus::ERR_NOTDONE);
+            else if (_dnload_block)
+                queue_program();
+            else
+                command();
+
+            if (_dfu_state == DfuState::DNBUSY)
+                timeout = busy_ms(false);
+            break;
+
+        case DfuState::DNBUSY:
+            if (accepting())
+                _dfu_state = DfuState::DNLOAD_IDLE;
+            else
+                timeout = busy_ms(false);
+            break;
+
+        case DfuState::MANIFEST_SYNC:
+            if (_manifest_done)
+                _dfu_state = DfuState::IDLE;  // manifestation tolerant
+            else {
+                _dfu_state = DfuState::MANIFEST;
+                timeout    = busy_ms(true)     ;
+            }
+            break;
+
+        case DfuState::MANIFEST:
+            timeout = busy_ms(true);
+            break;
+
+        default:
+            break;
+    }
+
+    _status_response[0] = static_cast<uint8_t>(_dfu_status);
+    _status_response[1] =  timeout        & 0xff;
+    _status_response[2] = (timeout >>  8) & 0xff;
+    _status_response[3] = (timeout >> 16) & 0xff;
+    _status_response[4] = static_cast<uint8_t>(_dfu_state );
+    _status_response[5] = 0;  // iString
+
+    _send_info.set(_status_response, _STATUS_SIZE);
+
+}  // get_status()
+
+
+
+// DfuSe command in DNLOAD block 0, executed by GETSTATUS
+void UsbDevDfu::command()
+{
+    uint32_t    address = 0;
+
+    if (_dnload_length == _COMMAND_SIZE)
+        address =            _command[1]
+                  | (        _command[2]         <<  8)
+                  | (        _command[3]         << 16)
+                  | (static_cast<uint32_t>(_command[4]) << 24);
+
+    switch (_command[0]) {
+        case _SET_ADDRESS_POINTER:
+            if (   _dnload_length != _COMMAND_SIZE
+                || address        <  FLASH_BASE
+                || address        >= FLASH_END    ) {
+                error(DfuStatus::ERR_TARGET);
+                return;
+            }
+            _address = address;
+            break;
+
+        case _ERASE:
+            if (_dnload_length == 1)
+                queue(OpType::ERASE, APP_ADDRESS, APP_SIZE, 0);
+            else if (   _dnload_length == _COMMAND_SIZE
+                     && downloadable(address)         )
+                queue(OpType::ERASE, page_start(address), PAGE_SIZE, 0);
+            else {
+                error(DfuStatus::ERR_TARGET);
+                return;
+            }
+            break;
+
+        default:
+            error(DfuStatus::ERR_UNKNOWN);
+            return;
+    }
+
+    // DfuSe hosts require dfuDNBUSY after commands
+    _dfu_state = DfuState::DNBUSY;
+
+}  // command()
+
+
+
+void UsbDevDfu::queue_program()
+{
+    uint32_t    address = _address + (_dnload_block - 2) * TRANSFER_SIZE;
+
+    if (   (address & 1)
+        || !downloadable(address)
+        || _dnload_length > FLASH_END - address) {
+        error(DfuStatus::ERR_ADDRESS);
+        return;
+    }
+
+    if (_dnload_length & 1)
+        block(_dnload_buffer)[_dnload_length] = 0xff;  // complete halfword
+
+    queue(OpType::PROGRAM, address, _dnload_length, _dnload_buffer);
+
+    _dnload_buffer ^= 1;
+
+    // pipelined: host sends next block while this one is programmed
+    _dfu_state = accepting() ? DfuState::DNLOAD_IDLE : DfuState::DNBUSY;
+
+}  // queue_program()
+
+
+
+void UsbDevDfu::queue(
+const OpType    type   ,
+const uint32_t  address,
+const uint32_t  length ,
+const uint8_t   buffer )
+{
+    uint8_t     head = _ops_head                     ;
+    Op         &op   = _ops[head & (_OPS_SIZE - 1)] ;
+
+    op.type    = type   ;
+    op.address = address;
+    op.length  = length ;
+    op.buffer  = buffer ;
+
+    __atomic_store_n(&_ops_head, head + 1, __ATOMIC_RELEASE);
+
+}  // queue()
+
+
+
+uint8_t UsbDevDfu::programs_queued()
+const
+{
+    uint8_t     head  = __atomic_load_n(&_ops_head, __ATOMIC_ACQUIRE),
+                count = 0                                           ;
+
+    for (uint8_t ndx = _ops_tail ; ndx != head ; ++ndx)
+        if (_ops[ndx & (_OPS_SIZE - 1)].type == OpType::PROGRAM)
+            ++count;
+
+    return count;
+
+}  // programs_queued()
+
+
+
+bool UsbDevDfu::erase_queued(
+const uint32_t  address)
+const
+{
+    uint8_t     head = __atomic_load_n(&_ops_head, __ATOMIC_ACQUIRE);
+
+    for (uint8_t ndx = _ops_tail ; ndx != head ; ++ndx) {
+        const Op    &op = _ops[ndx & (_OPS_SIZE - 1)];
+
+        if (   op.type == OpType::ERASE
+            && address >= op.address
+            && address <  op.address + op.length)
+            return true;
+    }
+
+    return false;
+
+}  // erase_queued()
+
+
+
+// Room for another DNLOAD: free block buffer and queue entry
+bool UsbDevDfu::accepting()
+const
+{
+    return    static_cast<uint8_t>(_ops_head - _ops_tail) < _OPS_SIZE
+           && programs_queued()                           < 2        ;
+
+}  // accepting()
+
+
+
+// Estimated time to finish op, from "offset" bytes into it
+uint32_t UsbDevDfu::op_ms(
+const Op        &op    ,
+const uint16_t   offset)
+const
+{
+    if (op.type == OpType::ERASE)
+        return (op.length / PAGE_SIZE) * _erase_ms;
+
+    uint32_t    ms =   ((op.length - offset) * _program_ms + TRANSFER_SIZE - 1)
+                     / TRANSFER_SIZE;
+
+    // pages that will be erased before programming
+    for (uint32_t address  = op.address + offset             ;
+                  address  < op.address + op.length          ;
+                  address  = page_start(address) + PAGE_SIZE )
+        if (!erased(address) && !erase_queued(address))
+            ms += _erase_ms;
+
+    return ms;
+
+}  // op_ms()
+
+
+
+// Estimated time until accepting() (or if "all", until queue empty)
+uint32_t UsbDevDfu::busy_ms(
+const bool  all)
+const
+{
+    uint8_t     head     = __atomic_load_n(&_ops_head, __ATOMIC_ACQUIRE),
+                programs = programs_queued()                            ;
+    uint32_t    ms       = 0                                            ;
+
+    // remainder of erase in progress
+    if (_flash_busy && _flash_erasing) {
+        uint16_t    elapsed = frames_since(_flash_frame);
+
+        if (elapsed < _erase_ms)
+            ms = _erase_ms - elapsed;
+    }
+
+    for (uint8_t ndx = _ops_tail ; ndx != head ; ++ndx) {
+        if (   !all
+            && static_cast<uint8_t>(head - ndx) < _OPS_SIZE
+            && programs                         < 2        )
+            break;
+
+        const Op    &op = _ops[ndx & (_OPS_SIZE - 1)];
+
+        ms += op_ms(op, ndx == _ops_tail ? _op_offset : 0);
+
+        if (op.type == OpType::PROGRAM)
+            --programs;
+    }
+
+    return ms;
+
+}  // busy_ms()
+
+
+
+void UsbDevDfu::request_error()
+{
+    _setup_stall = true;
+    error(DfuStatus::ERR_STALLEDPKT);
+
+}  // request_error()
+
+
+
+void UsbDevDfu::error(
+const DfuStatus     status)
+{
+    _dfu_status = status         ;
+    _dfu_state  = DfuState::ERROR;
+
+}  // error()
+
+
+
+void UsbDevDfu::flash_failed(
+const DfuStatus     status)
+{
+    // abandon rest of download
+    _op_offset = 0;
+    __atomic_store_n(&_ops_tail                                       ,
+                     __atomic_load_n(&_ops_head, __ATOMIC_ACQUIRE)   ,
+                     __ATOMIC_RELEASE                                 );
+
+    error(status);
+
+}  // flash_failed()
+
+
+
+void UsbDevDfu::start_erase(
+const uint32_t  address)
+{
+    uint16_t    page = page_ndx(address);
+
+    _erased[page / 32] |= 1 << (page % 32);
+
+    _flash_frame   = frame_number();
+    _flash_erasing = true          ;
+    _flash_busy    = true          ;
+
+    _flash.erase(address, _flash.user_data);
+
+}  // start_erase()
+
+
+
+void UsbDevDfu::dfu_poll()
+{
+    if (!_flash.status)
+        return;
+
+    if (_flash_busy) {
+        FlashStatus     status = _flash.status(_flash.user_data);
+
+        if (status == FlashStatus::BUSY)
+            return;
+
+        _flash_busy = false;
+
+        if (status == FlashStatus::ERROR) {
+            flash_failed(  _flash_erasing
+                         ? DfuStatus::ERR_ERASE
+                         : DfuStatus::ERR_PROG );
+            return;
+        }
+
+        if (_flash_erasing)
+            _erase_ms = frames_since(_flash_frame) + 1;  // round up
+        else {
+            const uint8_t   *memory = _flash.memory(_flash_address   ,
+                                                    _flash.user_data);
+
+            if ((memory[0] | (memory[1] << 8)) != _flash_halfword) {
+                flash_failed(DfuStatus::ERR_VERIFY);
+                return;
+            }
+        }
+    }
+
+    uint8_t     tail = _ops_tail;
+
+    if (tail == __atomic_load_n(&_ops_head, __ATOMIC_ACQUIRE)) {
+        if (_dfu_state == DfuState::MANIFEST) {
+            _erased_stale  = true                   ;  // download over
+            _manifest_done = true                   ;
+            _dfu_state     = DfuState::MANIFEST_SYNC;
+
+            if (_manifest_callback)
+                _manifest_callback(_address, _manifest_user_data);
+        }
+
+        if (_erased_stale) {
+            // pages must be erased again before next download programs them
+            _erased_stale = false;
+            for (uint8_t ndx = 0 ; ndx < (NUM_PAGES + 31) / 32 ; ++ndx)
+                _erased[ndx] = 0;
+        }
+        return;
+    }
+
+    Op          &op = _ops[tail & (_OPS_SIZE - 1)];
+
+    if (op.type == OpType::ERASE) {
+        start_erase(op.address);
+
+        op.address += PAGE_SIZE;
+        op.length  -= PAGE_SIZE;
+
+        if (!op.length)
+            __atomic_store_n(&_ops_tail, tail + 1, __ATOMIC_RELEASE);
+
+        return;
+    }
+
+    uint32_t     address = op.address + _op_offset;
+
+    if (!erased(address)) {
+        start_erase(address);
+        return;
+    }
+
+    const uint8_t   *data = block(op.buffer) + _op_offset;
+
+    if (!_op_offset)
+        _block_frame = frame_number();
+
+    _flash_address  = address                  ;
+    _flash_halfword = data[0] | (data[1] << 8) ;
+    _flash_erasing  = false                    ;
+    _flash_busy     = true                     ;
+
+    _flash.program(address, _flash_halfword, _flash.user_data);
+
+    if ((_op_offset += 2) >= op.length) {
+        // block buffer free once last halfword latched by flash
+        if (op.length == TRANSFER_SIZE)
+            _program_ms = frames_since(_block_frame) + 1;
+
+        _op_offset = 0;
+        __atomic_store_n(&_ops_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+}  // dfu_poll()
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevDfu*>(this)->class_setup();
+}
+
+
+// new host session, previous one's erased pages forgotten by dfu_poll()
+void UsbDev::set_configuration()
+{
+    static_cast<UsbDevDfu*>(this)->_erased_stale = true;
+}
+
+void UsbDev::set_interface()
+{
+    static_cast<UsbDevDfu*>(this)->_erased_stale = true;
+}
+
+
+}  // namespace stm32f10_12357_xx {
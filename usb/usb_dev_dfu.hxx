@@ -0,0 +1,399 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_DFU_HXX
+#define USB_DEV_DFU_HXX
+
+
+// Flash memory map. Pages from USB_DEV_DFU_APP_ADDRESS to end of flash
+//   can be downloaded (erased and programmed); everything else (e.g. the
+//   DFU program itself) only uploaded (read).
+#ifndef USB_DEV_DFU_FLASH_BASE
+#define USB_DEV_DFU_FLASH_BASE      0x08000000
+#endif
+#ifndef USB_DEV_DFU_FLASH_SIZE
+#define USB_DEV_DFU_FLASH_SIZE      (64 * 1024)
+#endif
+#ifndef USB_DEV_DFU_PAGE_SIZE
+#define USB_DEV_DFU_PAGE_SIZE       1024
+#endif
+#ifndef USB_DEV_DFU_APP_ADDRESS
+#define USB_DEV_DFU_APP_ADDRESS     0x08004000
+#endif
+
+// DNLOAD/UPLOAD wTransferSize, multiple of 64
+#ifndef USB_DEV_DFU_TRANSFER_SIZE
+#define USB_DEV_DFU_TRANSFER_SIZE   1024
+#endif
+
+// DfuSe memory layout interface string, must match above
+#ifndef USB_DEV_DFU_MEMORY_LAYOUT
+#define USB_DEV_DFU_MEMORY_LAYOUT   "@Internal Flash  /0x08000000/16*001Ka,48*001Kg"
+#endif
+
+
+#include <usb_dev.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+
+
+namespace stm32f10_12357_xx {
+
+// USB DFU 1.1 (Device Firmware Upgrade) DFU-mode device with ST DfuSe
+//   (bcdDFUVersion 0x011a) addressing, as used by dfu-util, e.g.:
+//
+//       dfu-util -a 0 -s 0x08004000:leave -D application.bin
+//
+// DfuSe DNLOAD block 0 commands: SET ADDRESS POINTER (0x21), ERASE page
+//   (0x41 + address) or all downloadable pages (0x41 alone). Data block N
+//   >= 2 goes to address pointer + (N - 2) * TRANSFER_SIZE, and is
+//   received (multi-packet control OUT) into one of two RAM block
+//   buffers. UPLOAD block 0 returns the command list, N >= 2 as above.
+//   Pages not explicitly erased are erased before being programmed.
+//
+// Flash work is pipelined: each erase and received block is queued and
+//   carried out by dfu_poll() a page or halfword at a time, and GETSTATUS
+//   reports dfuDNLOAD-IDLE as soon as there is room for another block, so
+//   the host sends the next block (and erase commands) while the previous
+//   one is being erased and programmed. When there isn't room, or for
+//   DfuSe commands (which must report dfuDNBUSY), bwPollTimeout is the
+//   time until there will be, computed from measured page erase and
+//   block program times (initially datasheet maximums). Flash errors and
+//   read-back verify failures are reported by the next GETSTATUS.
+//
+// Flash is accessed through client's Flash functions (see below), e.g.
+//   UsbDfuFlash in usb_dfu_flash.hxx for the STM32F103's own flash.
+//
+// Pages erased during a download are remembered until manifestation or
+//   the host's next SET_CONFIGURATION or SET_INTERFACE (a new dfu-util
+//   session), so DfuSe hosts which ABORT to dfuIDLE between commands
+//   don't have them erased again.
+//
+// After a zero-length DNLOAD (dfu-util ":leave") the manifest callback is
+//   called once all queued work is done, typically to start application.
+//
+// dfu_poll() must be called frequently from main loop (after
+//   UsbDev::poll() if not USB_DEV_INTERRUPT_DRIVEN).
+//
+class UsbDevDfu : public UsbDev
+{
+  public:
+    static const uint8_t    // have to be public for clients, static descriptors
+                            INTERFACE          = 0,
+                            LAYOUT_STRING_NDX  = 4;
+
+    static const uint32_t   FLASH_BASE         = USB_DEV_DFU_FLASH_BASE    ,
+                            FLASH_SIZE         = USB_DEV_DFU_FLASH_SIZE    ,
+                            FLASH_END          = FLASH_BASE + FLASH_SIZE   ,
+                            APP_ADDRESS        = USB_DEV_DFU_APP_ADDRESS   ,
+                            APP_SIZE           = FLASH_END - APP_ADDRESS   ;
+
+    static const uint16_t   PAGE_SIZE          = USB_DEV_DFU_PAGE_SIZE     ,
+                            TRANSFER_SIZE      = USB_DEV_DFU_TRANSFER_SIZE ,
+                            NUM_PAGES          = FLASH_SIZE / PAGE_SIZE    ;
+
+    static_assert(   APP_ADDRESS >= FLASH_BASE && APP_ADDRESS < FLASH_END
+                  && (APP_ADDRESS - FLASH_BASE) % PAGE_SIZE == 0
+                  && FLASH_SIZE                 % PAGE_SIZE == 0,
+                  "USB_DEV_DFU_APP_ADDRESS not page in flash");
+    static_assert(TRANSFER_SIZE % 64 == 0,
+                  "USB_DEV_DFU_TRANSFER_SIZE must be multiple of 64");
+
+    // DFU 1.1, 6.1.2
+    enum class DfuState : uint8_t {
+        APP_IDLE            =  0,
+        APP_DETACH          =  1,
+        IDLE                =  2,
+        DNLOAD_SYNC         =  3,
+        DNBUSY              =  4,
+        DNLOAD_IDLE         =  5,
+        MANIFEST_SYNC       =  6,
+        MANIFEST            =  7,
+        MANIFEST_WAIT_RESET =  8,
+        UPLOAD_IDLE         =  9,
+        ERROR               = 10,
+    };
+
+    enum class DfuStatus : uint8_t {
+        OK                  =  0,
+        ERR_TARGET          =  1,
+        ERR_FILE            =  2,
+        ERR_WRITE           =  3,
+        ERR_ERASE           =  4,
+        ERR_CHECK_ERASED    =  5,
+        ERR_PROG            =  6,
+        ERR_VERIFY          =  7,
+        ERR_ADDRESS         =  8,
+        ERR_NOTDONE         =  9,
+        ERR_FIRMWARE        = 10,
+        ERR_VENDOR          = 11,
+        ERR_USBR            = 12,
+        ERR_POR             = 13,
+        ERR_UNKNOWN         = 14,
+        ERR_STALLEDPKT      = 15,
+    };
+
+    enum class FlashStatus : uint8_t {
+        OK   ,
+        BUSY ,
+        ERROR,
+    };
+
+    // erase() and program() start operation on page containing address or
+    //   halfword at address, status() returns BUSY until it completes.
+    //   memory() returns address for reading (UPLOAD and verify). Called
+    //   from dfu_poll() except memory().
+    struct Flash {
+        void            (*erase  )(const uint32_t    address  ,
+                                         void       *user_data);
+        void            (*program)(const uint32_t    address  ,
+                                   const uint16_t    halfword ,
+                                         void       *user_data);
+        FlashStatus     (*status )(      void       *user_data);
+        const uint8_t*  (*memory )(const uint32_t    address  ,
+                                         void       *user_data);
+        void             *user_data;
+    };
+
+    // "address" is DfuSe address pointer, e.g. application start from
+    //   dfu-util "-s 0x08004000:leave". Called from dfu_poll().
+    typedef void (*ManifestCallback)(const uint32_t      address  ,
+                                           void         *user_data);
+
+    constexpr UsbDevDfu()
+    :   UsbDev                  (                       ),
+        _flash                  {0, 0, 0, 0, 0          },
+        _manifest_callback      (0                      ),
+        _manifest_user_data     (0                      ),
+        _blocks                 {{0}                    },
+        _ops                    {                       },
+        _erased                 {0                      },
+        _status_response        {0                      },
+        _command                {0                      },
+        _address                (APP_ADDRESS            ),
+        _ops_head               (0                      ),
+        _ops_tail               (0                      ),
+        _op_offset              (0                      ),
+        _dnload_block           (0                      ),
+        _dnload_length          (0                      ),
+        _erase_ms               (_ERASE_MAX_MS          ),
+        _program_ms             (_PROGRAM_MAX_MS        ),
+        _flash_frame            (0                      ),
+        _block_frame            (0                      ),
+        _flash_address          (0                      ),
+        _flash_halfword         (0                      ),
+        _dfu_state              (DfuState::IDLE         ),
+        _dfu_status             (DfuStatus::OK          ),
+        _dnload_buffer          (0                      ),
+        _dnload_received        (false                  ),
+        _manifest_done          (false                  ),
+        _erased_stale           (false                  ),
+        _flash_busy             (false                  ),
+        _flash_erasing          (false                  )
+    {}
+
+
+    // Set before init()
+    void flash(
+    const Flash     &flash)
+    {
+        _flash = flash;
+    }
+
+    void manifest_callback(
+    ManifestCallback     callback ,
+    void                *user_data)
+    {
+        _manifest_callback  = callback ;
+        _manifest_user_data = user_data;
+    }
+
+    DfuState    dfu_state () const { return _dfu_state ; }
+    DfuStatus   dfu_status() const { return _dfu_status; }
+
+    // Current estimates, ms
+    uint16_t    erase_ms  () const { return _erase_ms  ; }  // per page
+    uint16_t    program_ms() const { return _program_ms; }  // per block
+
+    // Erases and programs flash. Call frequently.
+    void    dfu_poll();
+
+
+    // need public accessors for static initialization of _STRING_DESCS
+    //
+    static constexpr const uint8_t* device_string_desc()
+    {
+        return _device_string_desc;
+    }
+
+    static constexpr const uint8_t* layout_string_desc()
+    {
+        return _layout_string_desc;
+    }
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    enum class OpType : uint8_t {
+        ERASE  ,
+        PROGRAM,
+    };
+
+    // queued flash work
+    struct Op {
+        uint32_t    address;
+        uint32_t    length ;  // bytes, ERASE multiple of PAGE_SIZE
+        OpType      type   ;
+        uint8_t     buffer ;  // PROGRAM block buffer
+    };
+
+    // DFU 1.1, 3
+    static const uint8_t    _DETACH             = 0,
+                            _DNLOAD             = 1,
+                            _UPLOAD             = 2,
+                            _GETSTATUS          = 3,
+                            _CLRSTATUS          = 4,
+                            _GETSTATE           = 5,
+                            _ABORT              = 6;
+
+    // ST AN3156 DfuSe commands
+    static const uint8_t    _GET_COMMANDS       = 0x00,
+                            _SET_ADDRESS_POINTER= 0x21,
+                            _ERASE              = 0x41;
+
+    static const uint8_t    _OPS_SIZE           = 8,  // power of 2
+                            _STATUS_SIZE        = 6,
+                            _COMMAND_SIZE       = 5;
+
+    // STM32F103 datasheet tERASE and tPROG maximums
+    static const uint16_t   _ERASE_MAX_MS       = 40,
+                            _PROGRAM_MAX_MS     = (  (TRANSFER_SIZE / 2) * 70
+                                                   + 999                  )
+                                                  / 1000;
+
+    static bool downloadable(const uint32_t  address)
+    {
+        return address >= APP_ADDRESS && address < FLASH_END;
+    }
+
+    static uint16_t page_ndx(const uint32_t  address)
+    {
+        return (address - FLASH_BASE) / PAGE_SIZE;
+    }
+
+    static uint32_t page_start(const uint32_t    address)
+    {
+        return FLASH_BASE + page_ndx(address) * PAGE_SIZE;
+    }
+
+    static uint16_t frames_since(const uint16_t  frame)  // ms
+    {
+        return (frame_number() - frame) & 0x7ff;
+    }
+
+    uint8_t* block(const uint8_t    ndx)
+    {
+        return reinterpret_cast<uint8_t*>(_blocks[ndx]);
+    }
+
+    bool erased(const uint32_t  address) const
+    {
+        uint16_t    page = page_ndx(address);
+
+        return _erased[page / 32] & (1 << (page % 32));
+    }
+
+    static uint8_t* dnload_stream(const uint16_t     offset   ,
+                                  const uint16_t     length   ,
+                                        void        *user_data);
+
+    bool        class_setup     ();  // UsbDev::device_class_setup()
+    void        dnload          ();
+    void        upload          ();
+    void        get_status      ();
+    void        command         ();
+    void        queue_program   ();
+    void        queue           (const OpType       type   ,
+                                 const uint32_t     address,
+                                 const uint32_t     length ,
+                                 const uint8_t      buffer );
+    uint8_t     programs_queued () const;
+    bool        erase_queued    (const uint32_t     address) const;
+    bool        accepting       () const;
+    uint32_t    op_ms           (const Op          &op     ,
+                                 const uint16_t     offset ) const;
+    uint32_t    busy_ms         (const bool         all    ) const;
+    void        request_error   ();
+    void        error           (const DfuStatus    status );
+    void        flash_failed    (const DfuStatus    status );
+    void        start_erase     (const uint32_t     address);
+
+
+    static const uint8_t    _device_string_desc[],
+                            _layout_string_desc[],
+                            _COMMANDS          [];
+
+    Flash                   _flash             ;
+    ManifestCallback        _manifest_callback ;
+    void                   *_manifest_user_data;
+
+    // DNLOAD blocks, uint32_t for 16-bit PMA copy alignment
+    uint32_t                _blocks         [2][TRANSFER_SIZE / 4]  ;
+    Op                      _ops            [_OPS_SIZE]             ;
+    uint32_t                _erased         [(NUM_PAGES + 31) / 32] ;  // bits
+    uint8_t                 _status_response[_STATUS_SIZE]          ,
+                            _command        [_COMMAND_SIZE + 1]     ;  // even
+
+    uint32_t                _address        ;  // DfuSe address pointer
+    uint8_t                 _ops_head       ,  // queued by setup, atomic
+                            _ops_tail       ;  // done by dfu_poll(),  "
+    uint16_t                _op_offset      ,  // in PROGRAM op at _ops_tail
+                            _dnload_block   ,  // wBlockNum
+                            _dnload_length  ;  // wLength
+    uint16_t                _erase_ms       ,  // measured, per page
+                            _program_ms     ,  //    "    , per TRANSFER_SIZE
+                            _flash_frame    ,  // USB frame at erase start
+                            _block_frame    ;  //  "    "   "  block start
+    uint32_t                _flash_address  ;  // programmed, to verify
+    uint16_t                _flash_halfword ;  //     "     ,  "    "
+    volatile DfuState       _dfu_state      ;
+    volatile DfuStatus      _dfu_status     ;
+    uint8_t                 _dnload_buffer  ;  // next block buffer
+    volatile bool           _dnload_received,  // data stage complete
+                            _manifest_done  ,
+                            _erased_stale   ;  // new session, see dfu_poll()
+    bool                    _flash_busy     ,
+                            _flash_erasing  ;
+
+};  // class UsbDevDfu
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_DFU_HXX
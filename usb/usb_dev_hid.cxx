@@ -73,13 +73,25 @@ bool UsbDevHid::usb_dev_hid_device_class_setup()
                 size = 1         ;
                 break;
 
+            // wValue high byte duration (SET_IDLE only), low byte report
+            //   ID, 0 for all reports
             case UsbDevHid::_REQ_SET_IDLE:
-                usb_dev->_idle_state = _setup_packet->value.bytes.byte0;
+                if (_setup_packet->value.bytes.byte0 > MAX_REPORT_ID)
+                    return false;
+                if (_setup_packet->value.bytes.byte0)
+                      usb_dev->_idle_rates[_setup_packet->value.bytes.byte0]
+                    = _setup_packet->value.bytes.byte1;
+                else
+                    for (uint8_t id = 0 ; id <= MAX_REPORT_ID ; ++id)
+                        usb_dev->_idle_rates[id]
+                        = _setup_packet->value.bytes.byte1;
                 break;
 
             case UsbDevHid::_REQ_GET_IDLE:
-                data = &usb_dev->_idle_state;
-                size = 1           ;
+                if (_setup_packet->value.bytes.byte0 > MAX_REPORT_ID)
+                    return false;
+                data = &usb_dev->_idle_rates[_setup_packet->value.bytes.byte0];
+                size = 1;
                 break;
 
             default:
@@ -104,13 +116,13 @@ bool UsbDevHid::usb_dev_hid_device_class_setup()
 
 #if 0  // handled by derived class
         case UsbDevHid::HID_REPORT_DESC_TYPE:
-            data =        UsbDevHid::_REPORT_DESC ;
-            size = sizeof(UsbDevHid::_REPORT_DESC);
+            data = UsbDevHid::_REPORT_DESC     ;
+            size = UsbDevHid::_REPORT_DESC_SIZE;
             break;
 
         case UsbDevHid::HID_DESCRIPTOR_TYPE:
-            data =        UsbDevHid::_HID_DESC ;
-            size = sizeof(UsbDevHid::_HID_DESC);
+            data = UsbDevHid::_HID_DESC                       ;
+            size = UsbDevHid::_HID_DESC[_DESCRIPTOR_SIZE_NDX];
             break;
 #endif
 
@@ -130,6 +142,7 @@ bool UsbDevHid::usb_dev_hid_device_class_setup()
 }
 
 
+
 void UsbDev::set_configuration() {}
 void UsbDev::set_interface    () {}
 
@@ -21,7 +21,14 @@
 #ifndef USB_DEV_HID_HXX
 #define USB_DEV_HID_HXX
 
+// Highest report ID used by derived class, 0 if reports have no ID
+#ifndef USB_DEV_HID_MAX_REPORT_ID
+#define USB_DEV_HID_MAX_REPORT_ID   0
+#endif
+
+
 #include <usb_dev.hxx>
+#include <usb_hid_report.hxx>
 
 #if USB_DEV_MAJOR_VERSION == 1
 #if USB_DEV_MINOR_VERSION  < 0
@@ -34,6 +41,15 @@
 
 namespace stm32f10_12357_xx {
 
+// Base for HID classes: HID class requests (SET_PROTOCOL, SET_IDLE,
+//   etc), and descriptor and report ID definitions shared by derived
+//   classes (UsbDevHidMouse, UsbDevHidKeyboard, UsbDevHidRaw).
+//
+// Host SET_IDLE requests set a per-report-ID idle rate (HID 1.11,
+//   7.2.4), 0 (indefinite) by default. Derived classes repeat an
+//   unchanged report when idle_expired() for its ID, and call
+//   report_sent() after each report, timed by USB frame number.
+//
 class UsbDevHid : public UsbDev
 {
   public:
@@ -41,17 +57,26 @@ class UsbDevHid : public UsbDev
                             HID_DESCRIPTOR_TYPE      = 0x21,
                             HID_REPORT_DESC_TYPE     = 0x22,
                             MOUSE_ENDPOINT_IN        =    1,
-                            MOUSE_REPORT_DESC_SIZE   =   74,
-                            MOUSE_REPORT_SIZE        =    4,
-                            IN_FS_POLLING_INTERVAL   =   10;
+                            IN_FS_POLLING_INTERVAL   =   10,
+                            MAX_REPORT_ID            = USB_DEV_HID_MAX_REPORT_ID;
 
     constexpr UsbDevHid()
-    :   UsbDev      ( ),
-        _protocol   (0),
-        _idle_state (0)
+    :   UsbDev              ( ),
+        _idle_rates         {0},
+        _report_frames      {0},
+        _protocol           (0)
     {}
 
 
+    // Host-requested idle rate, 4 ms units, 0 == send only on change
+    uint8_t idle_rate(
+    const uint8_t   report_id = 0)  // no check for valid report_id
+    const
+    {
+        return _idle_rates[report_id];
+    }
+
+
     // need public accessor for static initialization of _NEW_STRING_DESCS
     //
     static constexpr const uint8_t* device_string_desc()
@@ -69,20 +94,49 @@ class UsbDevHid : public UsbDev
                             _REQ_SET_PROTOCOL       = 0x0b,
                             _REQ_GET_PROTOCOL       = 0x03,
                             _REQ_SET_IDLE           = 0x0a,
-                            _REQ_GET_IDLE           = 0x02;
+                            _REQ_GET_IDLE           = 0x02,
+                            _REQ_GET_REPORT         = 0x01,
+                            _REQ_SET_REPORT         = 0x09;
+
+    // GET_REPORT/SET_REPORT wValue high byte
+    static const uint8_t    _REPORT_TYPE_INPUT      = 1,
+                            _REPORT_TYPE_OUTPUT     = 2,
+                            _REPORT_TYPE_FEATURE    = 3;
 
     static const uint8_t    _device_string_desc[],
-                            _QUALIFIER_DESC    [],
-                            _HID_DESC          [],
-                            _REPORT_DESC       [];
+                            _QUALIFIER_DESC    [];
+    static const uint8_t* const
+                            _HID_DESC             ;  // within _CONFIG_DESC
+    static const uint8_t* const
+                            _REPORT_DESC          ;  // generated by derived
+    static const uint16_t   _REPORT_DESC_SIZE     ;  //   class
 
 
     // called by derived class UsbDev::device_class_setup()
     bool    usb_dev_hid_device_class_setup();
 
+    // For derived classes' reports: true if report_id's idle rate is
+    //   non-zero and has elapsed since report_sent(report_id)
+    bool    idle_expired(
+    const uint8_t   report_id)
+    const
+    {
+        return    _idle_rates[report_id]
+               &&   ((frame_number() - _report_frames[report_id]) & 0x7ff)
+                  >= _idle_rates[report_id] * 4u                          ;
+    }
+
+    void    report_sent(
+    const uint8_t   report_id)
+    {
+        _report_frames[report_id] = frame_number();
+    }
+
+
+    uint8_t     _idle_rates      [MAX_REPORT_ID + 1];  // 4 ms units
+    uint16_t    _report_frames   [MAX_REPORT_ID + 1];  // last sent
 
-    uint8_t     _protocol  ,
-                _idle_state;
+    uint8_t     _protocol        ;
 
 
 };  // class UsbDevHid
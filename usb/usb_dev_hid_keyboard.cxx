@@ -0,0 +1,515 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_hid_keyboard.hxx>
+#include <usb_dev_descriptors.hxx>
+#include <usb_hid_report.hxx>
+
+namespace stm32f10_12357_xx {
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),   // bDescriptorType
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0x00,   // bDeviceClass: defined by interface
+    0x00,   // bDeviceSubClass
+    0x00,   // bDeviceProtocol
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x51,   // idProduct = 0x5751
+    0x57,   //      "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+// Boot interface: HID 1.11 appendix B.1 keyboard and LEDs, no report IDs
+static constexpr auto   boot_report_desc = usb_desc::concat(
+    hid_report::usage_page<hid_report::GENERIC_DESKTOP_PAGE>(),
+    hid_report::usage     <hid_report::KEYBOARD            >(),
+
+    hid_report::collection<hid_report::APPLICATION>(
+        UsbDevHidKeyboard::BootReport::items(
+            UsbDevHidKeyboard::Modifiers::items(
+                hid_report::usage_page   <hid_report::KEYBOARD_PAGE    >(),
+                hid_report::usage_minimum<UsbDevHidKeyboard
+                                          ::MODIFIER_FIRST             >(),
+                hid_report::usage_maximum<UsbDevHidKeyboard
+                                          ::MODIFIER_LAST              >()),
+
+            hid_report::Padding<8>::items(),
+
+            UsbDevHidKeyboard::BootKeys::items(
+                hid_report::usage_minimum<0                            >(),
+                hid_report::usage_maximum<0xff                         >())),
+
+        UsbDevHidKeyboard::BootLedReport::items(
+            UsbDevHidKeyboard::Leds::items(
+                hid_report::usage_page   <hid_report::LED_PAGE         >(),
+                hid_report::usage_minimum<1                            >(),
+                hid_report::usage_maximum<5                            >()),
+
+            UsbDevHidKeyboard::LedPadding::items())));
+
+// NKRO interface: NKRO keyboard and LEDs, and consumer control
+static constexpr auto   report_desc = usb_desc::concat(
+    hid_report::usage_page<hid_report::GENERIC_DESKTOP_PAGE>(),
+    hid_report::usage     <hid_report::KEYBOARD            >(),
+
+    hid_report::collection<hid_report::APPLICATION>(
+        UsbDevHidKeyboard::NkroReport::items(
+            UsbDevHidKeyboard::Modifiers::items(
+                hid_report::usage_page   <hid_report::KEYBOARD_PAGE    >(),
+                hid_report::usage_minimum<UsbDevHidKeyboard
+                                          ::MODIFIER_FIRST             >(),
+                hid_report::usage_maximum<UsbDevHidKeyboard
+                                          ::MODIFIER_LAST              >()),
+
+            UsbDevHidKeyboard::KeyBitmap::items(
+                hid_report::usage_minimum<0                            >(),
+                hid_report::usage_maximum<UsbDevHidKeyboard
+                                          ::NKRO_USAGES - 1            >())),
+
+        UsbDevHidKeyboard::LedReport::items(
+            UsbDevHidKeyboard::Leds::items(
+                hid_report::usage_page   <hid_report::LED_PAGE         >(),
+                hid_report::usage_minimum<1                            >(),
+                hid_report::usage_maximum<5                            >()),
+
+            UsbDevHidKeyboard::LedPadding::items())),
+
+    hid_report::usage_page<hid_report::CONSUMER_PAGE   >(),
+    hid_report::usage     <hid_report::CONSUMER_CONTROL>(),
+
+    hid_report::collection<hid_report::APPLICATION>(
+        UsbDevHidKeyboard::ConsumerReport::items(
+            UsbDevHidKeyboard::Consumer::items(
+                hid_report::usage_minimum<0                            >(),
+                hid_report::usage_maximum<UsbDevHidKeyboard
+                                          ::MAX_CONSUMER_USAGE         >()))));
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0x80,           // bmAttributes: bus powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        UsbDevHidKeyboard::BOOT_INTERFACE,  // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x03,       // bInterfaceClass: HID (Human Interface Device)
+        0x01,       // bInterfaceSubClass: Boot Interface SubClass
+        0x01,       // bInterfaceProtocol: Keyboard Protocol
+        0,          // iInterface
+
+        usb_desc::hid(0x0111,                            // bcdHID: 1.11
+                      0x00,                              // bCountryCode: none
+                      boot_report_desc.LENGTH),
+
+        usb_desc::endpoint(  UsbDev::ENDPOINT_DIR_IN
+                           | UsbDevHidKeyboard::BOOT_ENDPOINT_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevHidKeyboard::BOOT_PACKET_SIZE,
+                           UsbDevHidKeyboard::KEYBOARD_POLLING_INTERVAL)),
+
+    usb_desc::interface(
+        UsbDevHidKeyboard::NKRO_INTERFACE,  // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x03,       // bInterfaceClass: HID (Human Interface Device)
+        0x00,       // bInterfaceSubClass: none
+        0x00,       // bInterfaceProtocol: none
+        0,          // iInterface
+
+        usb_desc::hid(0x0111,                            // bcdHID: 1.11
+                      0x00,                              // bCountryCode: none
+                      report_desc.LENGTH),
+
+        usb_desc::endpoint(  UsbDev::ENDPOINT_DIR_IN
+                           | UsbDevHidKeyboard::NKRO_ENDPOINT_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevHidKeyboard::NKRO_PACKET_SIZE,
+                           UsbDevHidKeyboard::KEYBOARD_POLLING_INTERVAL)));
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+// HID descriptors are also requested separately, share copies in
+//   _CONFIG_DESC. UsbDevHid ones are NKRO interface's.
+static const uint8_t* const     boot_hid_desc
+                                =   config_desc.bytes
+                                  + usb_desc::find(config_desc,
+                                                   usb_desc::HID,
+                                                   UsbDevHidKeyboard
+                                                   ::BOOT_INTERFACE);
+
+const uint8_t* const    UsbDevHid::_HID_DESC
+                        =   config_desc.bytes
+                          + usb_desc::find(config_desc,
+                                           usb_desc::HID,
+                                           UsbDevHidKeyboard::NKRO_INTERFACE);
+
+const uint8_t* const    UsbDevHid::_REPORT_DESC      = report_desc.bytes ;
+const uint16_t          UsbDevHid::_REPORT_DESC_SIZE = report_desc.LENGTH;
+
+const uint8_t   UsbDevHid::_device_string_desc[] = "STM32 HID keyboard";
+
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev           ::  language_id_string_desc(),
+    UsbDev           ::       vendor_string_desc(),
+    UsbDevHidKeyboard::       device_string_desc(),
+    UsbDev           ::serial_number_string_desc(),
+};
+
+
+
+
+void UsbDevHidKeyboard::update_key(
+const uint8_t   usage,
+const bool      down )
+{
+    uint8_t     *byte,
+                 bit ;
+
+    if (usage >= MODIFIER_FIRST && usage <= MODIFIER_LAST) {
+        byte = &_nkro.bytes()[_NKRO_MODIFIERS_NDX];
+        bit  = 1 << (usage - MODIFIER_FIRST)      ;
+    }
+    else if (usage >= FIRST_KEY && usage < NKRO_USAGES) {
+        byte = &_nkro.bytes()[_NKRO_KEYS_NDX + usage / 8];
+        bit  = 1 << (usage % 8)                          ;
+    }
+    else
+        return;
+
+    if (static_cast<bool>(*byte & bit) == down)
+        return;
+
+    begin_update();
+
+    if (down) *byte |=  bit;
+    else      *byte &= ~bit;
+
+    if (byte == &_nkro.bytes()[_NKRO_MODIFIERS_NDX])
+        _boot.bytes()[_BOOT_MODIFIERS_NDX] = *byte;
+    else if (down)
+        boot_insert(usage);
+    else
+        boot_remove(usage);
+
+    _changed |= _KEYBOARD_CHANGED;
+
+    end_update();
+
+    load_report();
+
+}  // update_key()
+
+
+
+void UsbDevHidKeyboard::boot_insert(
+const uint8_t   usage)
+{
+    if (_boot_count < BOOT_KEYS)
+        _boot.bytes()[_BOOT_KEYS_NDX + _boot_count++] = usage;
+    else
+        ++_boot_overflow;
+
+}  // boot_insert()
+
+
+
+void UsbDevHidKeyboard::boot_remove(
+const uint8_t   usage)
+{
+    uint8_t     *keys = &_boot.bytes()[_BOOT_KEYS_NDX],
+                 ndx                                  ;
+
+    for (ndx = 0 ; ndx < _boot_count && keys[ndx] != usage ; ++ndx)
+        ;
+
+    if (ndx == _boot_count) {  // was one of overflow keys
+        if (_boot_overflow)
+            --_boot_overflow;
+        return;
+    }
+
+    for ( ; ndx < _boot_count - 1 ; ++ndx)
+        keys[ndx] = keys[ndx + 1];
+    keys[--_boot_count] = 0;
+
+    if (!_boot_overflow)
+        return;
+
+    // Rare (more than BOOT_KEYS down): refill freed slot with a down key
+    //   not in array. Released key already cleared in bitmap.
+    for (uint8_t key = FIRST_KEY ; key < NKRO_USAGES ; ++key) {
+        if (!(_nkro.bytes()[_NKRO_KEYS_NDX + key / 8] & (1 << (key % 8))))
+            continue;
+
+        for (ndx = 0 ; ndx < _boot_count && keys[ndx] != key ; ++ndx)
+            ;
+
+        if (ndx == _boot_count) {
+            keys[_boot_count++] = key;
+            --_boot_overflow;
+            return;
+        }
+    }
+
+}  // boot_remove()
+
+
+
+void UsbDevHidKeyboard::consumer(
+const uint16_t  usage)
+{
+    begin_update();
+
+    _consumer_now = usage;
+    if (usage)
+        _consumer_latched = usage;
+
+    end_update();
+
+    load_report();
+
+}  // consumer()
+
+
+
+// Boot protocol reports go to BOOT_ENDPOINT_IN, report protocol ones
+//   to NKRO_ENDPOINT_IN, so keys are never reported twice. Endpoint can
+//   only become ready by sending, so calls from main loop and from
+//   CTR_TX interrupt never overlap once past send_ready(). Call from
+//   CTR_TX during key_down(), etc, returns at _updating: they call
+//   again when done.
+bool UsbDevHidKeyboard::load_report()
+{
+    uint8_t     *buffer = reinterpret_cast<uint8_t*>(_send_buffer);
+
+    if (__atomic_load_n(&_updating, __ATOMIC_SEQ_CST))
+        return false;
+
+    if (_protocol == PROTOCOL_BOOT) {  // no consumer control
+        if (!send_ready(1 << BOOT_ENDPOINT_IN))
+            return false;
+
+        if (_protocol != _protocol_sent) {  // resend state in new format
+            _protocol_sent  = _protocol        ;
+            _changed       |= _KEYBOARD_CHANGED;
+        }
+
+        if (!(_changed & _KEYBOARD_CHANGED) && !idle_expired(0))
+            return false;
+
+        _changed &= ~_KEYBOARD_CHANGED;
+        report_sent(0);
+
+        for (uint8_t ndx = 0 ; ndx < BootReport::SIZE ; ++ndx)
+            buffer[ndx] = _boot.bytes()[ndx];
+
+        if (_boot_overflow)
+            for (uint8_t ndx = 0 ; ndx < BOOT_KEYS ; ++ndx)
+                buffer[_BOOT_KEYS_NDX + ndx] = ERROR_ROLL_OVER;
+
+        return send_report(BOOT_ENDPOINT_IN, BootReport::SIZE);
+    }
+
+    if (!send_ready(1 << NKRO_ENDPOINT_IN))
+        return false;
+
+    if (_protocol != _protocol_sent) {  // resend state in new format
+        _protocol_sent  = _protocol                            ;
+        _changed       |= _KEYBOARD_CHANGED | _CONSUMER_CHANGED;
+    }
+
+    uint16_t    usage    =   _consumer_latched
+                           ? _consumer_latched
+                           : _consumer_now    ;
+    bool        keyboard =    (_changed & _KEYBOARD_CHANGED)
+                           || idle_expired(KEYBOARD_REPORT_ID),
+                consumer =    (_changed & _CONSUMER_CHANGED)
+                           || usage != _consumer_sent
+                           || idle_expired(CONSUMER_REPORT_ID);
+
+    if (keyboard && consumer)  // alternate, so neither starves
+        keyboard = _report_id_sent != KEYBOARD_REPORT_ID;
+
+    if (keyboard) {
+        _changed        &= ~_KEYBOARD_CHANGED;
+        _report_id_sent  = KEYBOARD_REPORT_ID;
+        report_sent(KEYBOARD_REPORT_ID);
+
+        for (uint8_t ndx = 0 ; ndx < NkroReport::SIZE ; ++ndx)
+            buffer[ndx] = _nkro.bytes()[ndx];
+
+        return send_report(NKRO_ENDPOINT_IN, NkroReport::SIZE);
+    }
+
+    if (!consumer)
+        return false;
+
+    _changed          &= ~_CONSUMER_CHANGED;
+    _consumer_latched  = 0                 ;
+    _consumer_sent     = usage             ;
+    _report_id_sent    = CONSUMER_REPORT_ID;
+    _consumer_report.set<0>(usage);
+    report_sent(CONSUMER_REPORT_ID);
+
+    for (uint8_t ndx = 0 ; ndx < ConsumerReport::SIZE ; ++ndx)
+        buffer[ndx] = _consumer_report.bytes()[ndx];
+
+    return send_report(NKRO_ENDPOINT_IN, ConsumerReport::SIZE);
+
+}  // load_report()
+
+
+
+// Whole report in one packet: BOOT_PACKET_SIZE and NKRO_PACKET_SIZE
+//   checked against report sizes at compile time
+bool UsbDevHidKeyboard::send_report(
+const uint8_t   endpoint,
+const uint8_t   length  )
+{
+    return send(endpoint                                  ,
+                reinterpret_cast<uint8_t*>(_send_buffer),
+                length                                    );
+
+}  // send_report()
+
+
+
+uint8_t* UsbDevHidKeyboard::led_stream(
+const uint16_t   offset   ,
+const uint16_t   length   ,
+      void      *user_data)
+{
+    UsbDevHidKeyboard   *self = static_cast<UsbDevHidKeyboard*>(user_data);
+
+    if (length)
+        return self->_led_buffer + offset;
+
+    // NKRO interface: ID and LEDs, boot interface: LEDs only
+    if (offset == LedReport::SIZE && self->_led_buffer[0] == KEYBOARD_REPORT_ID)
+        self->_leds = self->_led_buffer[1];
+    else if (offset == 1)
+        self->_leds = self->_led_buffer[0];
+
+    return 0;
+
+}  // led_stream()
+
+
+
+bool UsbDevHidKeyboard::class_setup()
+{
+    if (   _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_INTERFACE)) {
+        uint8_t     report_type = _setup_packet->value.bytes.byte1,
+                    report_id   = _setup_packet->value.bytes.byte0,
+                    interface   = _setup_packet->index & 0xff     ;
+
+        switch (_setup_packet->request) {
+            case UsbDevHid::_REQ_GET_REPORT:
+                if (report_type != _REPORT_TYPE_INPUT)
+                    return false;
+                if (interface == BOOT_INTERFACE)
+                    _send_info.set(_boot.bytes(), BootReport::SIZE);
+                else if (report_id == KEYBOARD_REPORT_ID)
+                    _send_info.set(_nkro.bytes(), NkroReport::SIZE);
+                else if (report_id == CONSUMER_REPORT_ID)
+                    _send_info.set(_consumer_report.bytes(),
+                                   ConsumerReport::SIZE    );
+                else
+                    return false;
+                return true;
+
+            case UsbDevHid::_REQ_SET_REPORT:
+                if (   report_type           != _REPORT_TYPE_OUTPUT
+                    || _setup_packet->length >  LedReport::SIZE    )
+                    return false;
+                control_out_stream(led_stream           ,
+                                   this                 ,
+                                   _setup_packet->length);
+                return true;
+
+            case UsbDevHid::_REQ_SET_PROTOCOL:  // boot interface only
+            case UsbDevHid::_REQ_GET_PROTOCOL:
+                if (interface != BOOT_INTERFACE)
+                    return false;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (usb_dev_hid_device_class_setup())
+        return true;
+
+    if (  !  _setup_packet
+           ->request_type
+           . all(SetupPacket::RequestType::TYPE_STANDARD)
+        ||    (static_cast<SetupPacket::Request>(_setup_packet->request)
+           != SetupPacket::Request::GET_DESCRIPTOR))
+        return false;
+
+    bool    boot = (_setup_packet->index & 0xff) == BOOT_INTERFACE;
+
+    switch (_setup_packet->value.bytes.byte1) {
+        case UsbDevHid::HID_REPORT_DESC_TYPE:
+            if (boot)
+                _send_info.set(boot_report_desc.bytes ,
+                               boot_report_desc.LENGTH);
+            else
+                _send_info.set(UsbDevHid::_REPORT_DESC     ,
+                               UsbDevHid::_REPORT_DESC_SIZE);
+            return true;
+
+        case UsbDevHid::HID_DESCRIPTOR_TYPE:
+            if (boot)
+                _send_info.set(boot_hid_desc                       ,
+                               boot_hid_desc[_DESCRIPTOR_SIZE_NDX]);
+            else
+                _send_info.set(UsbDevHid::_HID_DESC                       ,
+                               UsbDevHid::_HID_DESC[_DESCRIPTOR_SIZE_NDX]);
+            return true;
+
+        default:
+            return false;
+    }
+
+}  // class_setup()
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevHidKeyboard*>(this)->class_setup();
+}
+
+}  // namespace stm32f10_12357_xx {
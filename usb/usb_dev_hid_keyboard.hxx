@@ -0,0 +1,255 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_HID_KEYBOARD_HXX
+#define USB_DEV_HID_KEYBOARD_HXX
+
+#include <usb_dev_hid.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+#if USB_DEV_HID_MAX_REPORT_ID < 2
+#error UsbDevHidKeyboard requires USB_DEV_HID_MAX_REPORT_ID >= 2
+#endif
+
+
+namespace stm32f10_12357_xx {
+
+// Boot-compatible keyboard with N-key rollover, plus consumer control
+//   (media keys), as two HID interfaces with interrupt IN endpoints
+//   polled every 1 ms:
+//
+// BOOT_INTERFACE (Boot subclass, BOOT_ENDPOINT_IN, 8 byte packets as
+//   HID 1.11 appendix B requires): standard 8 byte boot report, up to 6
+//   keys, all ErrorRollOver if more are down. Used in boot protocol,
+//   which host (e.g. BIOS) selects with SET_PROTOCOL(0).
+// NKRO_INTERFACE (no subclass, NKRO_ENDPOINT_IN): report ID
+//   KEYBOARD_REPORT_ID is modifiers byte followed by bitmap of key usages
+//   0 to NKRO_USAGES-1, so any number of keys can be down at once, and
+//   report ID CONSUMER_REPORT_ID is one 16 bit consumer page usage. Used
+//   in report protocol (default, and after SET_PROTOCOL(1)), when boot
+//   interface sends nothing, so keys are not reported twice.
+// Either way each report is a single packet, so reaches host at next
+//   poll.
+//
+// key_down()/key_up() update both report layouts in place, one bit and
+//   at most one array slot per call, so report building is just a copy
+//   to the endpoint regardless of number of keys. Changed report is
+//   loaded into the endpoint immediately if it is idle, else as soon as
+//   the host takes the previous one (send_callback() from CTR_TX, if
+//   registered, or hid_poll()). Keyboard and consumer reports alternate
+//   when both are pending, so neither starves the other. Key state, not
+//   edges, is reported (a matrix debounce time longer than the 1 ms
+//   polling interval ensures none are lost); a consumer() usage is
+//   reported even if released before host poll.
+//
+// key_down(), key_up(), consumer(), and hid_poll() must be called from a
+//   single context; send_callback() may interrupt them.
+//
+// Host Output report (SET_REPORT to either interface, no OUT endpoint)
+//   LED state is available from leds().
+//
+class UsbDevHidKeyboard : public UsbDevHid
+{
+  public:
+    static const uint8_t    // have to be public for clients, static descriptors
+                            BOOT_INTERFACE           =    0,
+                            NKRO_INTERFACE           =    1,
+                            BOOT_ENDPOINT_IN         =    1,
+                            NKRO_ENDPOINT_IN         =    2,
+                            BOOT_PACKET_SIZE         =    8,
+                            NKRO_PACKET_SIZE         =   32,
+                            KEYBOARD_POLLING_INTERVAL=    1,  // ms
+                            KEYBOARD_REPORT_ID       =    1,
+                            CONSUMER_REPORT_ID       =    2,
+                            PROTOCOL_BOOT            =    0,
+                            PROTOCOL_REPORT          =    1,
+                            NKRO_USAGES              =  128,  // 0x00 - 0x7f
+                            BOOT_KEYS                =    6,
+                            MODIFIER_FIRST           = 0xe0,  // left control
+                            MODIFIER_LAST            = 0xe7,  // right GUI
+                            ERROR_ROLL_OVER          = 0x01,
+                            FIRST_KEY                = 0x04;  // "a", lower
+                                                              //   are errors
+
+    // leds() bits
+    static const uint8_t    LED_NUM_LOCK             = 0x01,
+                            LED_CAPS_LOCK            = 0x02,
+                            LED_SCROLL_LOCK          = 0x04,
+                            LED_COMPOSE              = 0x08,
+                            LED_KANA                 = 0x10;
+
+    static const uint16_t   MAX_CONSUMER_USAGE       = 0x3ff;
+
+    typedef hid_report::Field<1, 8          , 0, 1>     Modifiers  ;
+    typedef hid_report::Field<1, NKRO_USAGES, 0, 1>     KeyBitmap  ;
+    typedef hid_report::Field<8, BOOT_KEYS  , 0, 0xff,
+                              hid_report::ARRAY>        BootKeys   ;
+    typedef hid_report::Field<16, 1, 0, MAX_CONSUMER_USAGE,
+                              hid_report::ARRAY>        Consumer   ;
+    typedef hid_report::Field<1, 5, 0, 1,
+                              hid_report::VARIABLE,
+                              hid_report::OUTPUT  >     Leds       ;
+    typedef hid_report::Padding<3, hid_report::OUTPUT>  LedPadding ;
+
+    typedef hid_report::Report<KEYBOARD_REPORT_ID,
+                               Modifiers         ,
+                               KeyBitmap         >      NkroReport    ;
+    typedef hid_report::Report<CONSUMER_REPORT_ID,
+                               Consumer          >      ConsumerReport;
+    typedef hid_report::Report<KEYBOARD_REPORT_ID,
+                               Leds              ,
+                               LedPadding        >      LedReport     ;
+    typedef hid_report::Report<0                    ,
+                               Modifiers            ,
+                               hid_report::Padding<8>,
+                               BootKeys             >   BootReport    ;
+    typedef hid_report::Report<0                 ,
+                               Leds              ,
+                               LedPadding        >      BootLedReport ;
+
+    static_assert(BootReport::SIZE == BOOT_PACKET_SIZE, "bad BootReport");
+    static_assert(   NkroReport    ::SIZE <= NKRO_PACKET_SIZE
+                  && ConsumerReport::SIZE <= NKRO_PACKET_SIZE,
+                  "report protocol report must fit in one packet");
+
+    constexpr UsbDevHidKeyboard()
+    :   UsbDevHid           (     ),
+        _nkro               (     ),
+        _boot               (     ),
+        _consumer_report    (     ),
+        _led_buffer         {0    },
+        _send_buffer        {0    },
+        _consumer_now       (0    ),
+        _consumer_latched   (0    ),
+        _consumer_sent      (0    ),
+        _changed            (0    ),
+        _boot_count         (0    ),
+        _boot_overflow      (0    ),
+        _protocol_sent      (PROTOCOL_REPORT),
+        _report_id_sent     (0    ),
+        _leds               (0    ),
+        _updating           (false)
+    {
+        _protocol = PROTOCOL_REPORT;  // HID 1.11, 7.2.6
+    }
+
+
+    // Keyboard page usage (e.g. 0x04 == 'a', 0xe1 == left shift).
+    //   Usages below FIRST_KEY (error codes) or >= NKRO_USAGES other than
+    //   modifiers are ignored. Repeated key_down() or key_up() for same
+    //   usage is harmless.
+    void    key_down(const uint8_t   usage) { update_key(usage, true ); }
+    void    key_up  (const uint8_t   usage) { update_key(usage, false); }
+
+    // Consumer page usage currently down (e.g. 0xe9 == volume up), 0 if
+    //   none
+    void    consumer(const uint16_t  usage);
+
+    // Host LED state, LED_NUM_LOCK, etc
+    uint8_t leds() const { return _leds; }
+
+    // Loads pending or idle-rate repeat report if endpoint free. Call
+    //   frequently.
+    bool    hid_poll() { return load_report(); }
+
+    // usb_dev.register_send_callback(UsbDevHidKeyboard::send_callback,
+    //                                UsbDevHidKeyboard::BOOT_ENDPOINT_IN,
+    //                                &usb_dev                         );
+    //   and same for NKRO_ENDPOINT_IN
+    static void send_callback(const uint8_t              ,  // endpoint
+                                    void       *user_data)
+    {
+        static_cast<UsbDevHidKeyboard*>(user_data)->load_report();
+    }
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    static const uint8_t    _KEYBOARD_CHANGED        = 0x1,
+                            _CONSUMER_CHANGED        = 0x2;
+
+    // byte offsets in report layouts
+    static const uint8_t    _NKRO_MODIFIERS_NDX      = NkroReport::ID_BYTES,
+                            _NKRO_KEYS_NDX           = NkroReport::ID_BYTES
+                                                       + 1                 ,
+                            _BOOT_MODIFIERS_NDX      = 0                   ,
+                            _BOOT_KEYS_NDX           = 2                   ;
+
+    static uint8_t* led_stream(const uint16_t    offset   ,
+                               const uint16_t    length   ,
+                                     void       *user_data);
+
+    bool    class_setup();  // UsbDev::device_class_setup()
+
+    bool    load_report(),
+            send_report(const uint8_t    endpoint,  // from _send_buffer
+                        const uint8_t    length  );
+
+    void    update_key(const uint8_t    usage,
+                       const bool       down );
+
+    void    boot_insert(const uint8_t   usage),
+            boot_remove(const uint8_t   usage);
+
+    void    begin_update()
+    {
+        __atomic_store_n(&_updating, true , __ATOMIC_SEQ_CST);
+    }
+    void    end_update  ()
+    {
+        __atomic_store_n(&_updating, false, __ATOMIC_SEQ_CST);
+    }
+
+
+    NkroReport      _nkro              ;  // current state, both layouts
+    BootReport      _boot              ;
+    ConsumerReport  _consumer_report   ;  // last sent
+
+    uint8_t         _led_buffer[LedReport::SIZE];
+    uint32_t        _send_buffer[(NkroReport::SIZE + 3) / 4];  // PMA alignment
+
+    uint16_t        _consumer_now      ,
+                    _consumer_latched  ,  // down, not yet reported
+                    _consumer_sent     ;
+
+    uint8_t         _changed           ,  // _KEYBOARD_CHANGED, etc
+                    _boot_count        ,  // keys in _boot array
+                    _boot_overflow     ,  // down but not in _boot array
+                    _protocol_sent     ,
+                    _report_id_sent    ;  // last report protocol report
+    volatile uint8_t
+                    _leds              ;
+    bool            _updating          ;  // atomic access
+
+};  // class UsbDevHidKeyboard
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_HID_KEYBOARD_HXX
@@ -19,6 +19,8 @@
 
 
 #include <usb_dev_hid_mouse.hxx>
+#include <usb_dev_descriptors.hxx>
+#include <usb_hid_report.hxx>
 
 namespace stm32f10_12357_xx {
 
@@ -43,119 +45,65 @@ const uint8_t UsbDev::_DEVICE_DESC[] = {
     0x01    // bNumConfigurations
 };
 
-uint8_t UsbDev::_CONFIG_DESC[] = {  // not const because set total size entry
-    // Configuration Descriptor
-    0x09,   // bLength: Configuration Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::CONFIGURATION),
-    0,      // wTotalLength: including sub-descriptors; will be set at runtime
-    0x00,   //      "      : MSB of uint16_t
-    0x01,   // bNumInterfaces: 1 interface
-    0x01,   // bConfigurationValue: Configuration value
-    0x00,   // iConfiguration: Index of string descriptor for configuration
-    0x80,   // bmAttributes: self powered
-    0x32,   // MaxPower 0 mA
-
-    // Interface Descriptor
-    0x09,   // bLength: Interface Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE), // bDescriptorType
-    0x00,   // bInterfaceNumber: Number of Interface
-    0x00,   // bAlternateSetting: Alternate setting
-    0x01,   // bNumEndpoints: One endpoints used
-    0x03,   // bInterfaceClass: HID (Human Interface Device)
-    0x01,   // bInterfaceSubClass: Boot Interface SubClass
-    0x02,   // bInterfaceProtocol: Mouse Protocol
-    0x00,   // iInterface: index of string descriptor?
-
-    // HID Mouse Descriptor
-    0x09,   // bLength: HID Descriptor size
-    static_cast<uint8_t>(UsbDevHidMouse::HID_DESCRIPTOR_TYPE),// bDescriptorType
-    0x11,   // bcdHID: HID Class Spec release number 0x0111==1.11
-    0x01,   //   "   : MSB of uint16_t
-    0x00,   // bCountryCode: Hardware target country (0==none)
-    0x01,   // bNumDescriptors: Number of HID class descriptors to follow
-    UsbDevHidMouse::HID_REPORT_DESC_TYPE,   // bDescriptorType
-    UsbDevHidMouse::MOUSE_REPORT_DESC_SIZE, // wItemLength: of report descriptor
-    0x00,   // high byte of _MOUSE_REPORT_DESC_SIZE
-
-    // Endpoint Descriptor
-    0x07,          // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType:
-    UsbDev::ENDPOINT_DIR_IN | UsbDevHidMouse::MOUSE_ENDPOINT_IN,// endpt 1, IN
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevHidMouse::MOUSE_REPORT_SIZE,  // wMaxPacketSize: 4 Byte max
-    0x00,                               //       "       : MSB of uint16_t
-    UsbDevHidMouse::IN_FS_POLLING_INTERVAL, // bInterval: 10 ms
-};
+// Boot protocol compatible mouse: UsbDevHidMouse::PointerReport
+static constexpr auto   report_desc = usb_desc::concat(
+    hid_report::usage_page<hid_report::GENERIC_DESKTOP_PAGE>(),
+    hid_report::usage     <hid_report::MOUSE               >(),
 
-const uint8_t UsbDevHid::_HID_DESC[] = {
-    0x09,   // bLength: HID Descriptor size
-    HID_DESCRIPTOR_TYPE, // bDescriptorType: HID
-    0x11,   // bcdHID: HID Class Spec release number (0x0111==1.11)
-    0x01,   //   "   : MSB of uint16_t
-    0x00,   // bCountryCode: Hardware target country (0==none)
-    0x01,   // bNumDescriptors: Number of HID class descriptors to follow
-    UsbDevHidMouse::HID_REPORT_DESC_TYPE,       // bDescriptorType
-    UsbDevHidMouse::MOUSE_REPORT_DESC_SIZE,// wItemLength: Total length of Report descriptor
-    0x00,       // high byte of _MOUSE_REPORT_DESC_SIZE
-};
+    hid_report::collection<hid_report::APPLICATION>(
+        hid_report::usage<hid_report::POINTER>(),
 
-const uint8_t UsbDevHid::_REPORT_DESC[] = {
-    0x05, 0x01, // Usage Page (Generic Desktop)
-    0x09, 0x02, // Usage (Mouse)
-    0xa1, 0x01, // Collection (Application)
-    0x09, 0x01, // Usage (Pointer)
-
-    0xa1, 0x00, // Collection (Physical)
-    0x05, 0x09, // Usage Page (Buttons)
-    0x19, 0x01, // Usage Minimum (01)
-    0x29, 0x01, // Usage Maximum (01)
-
-    0x15, 0x00, // Logical Minimum (0)
-    0x25, 0x01, // Logical Maximum (1)
-    0x95, 0x03, // Report Count (3)
-    0x75, 0x01, // Report Size (1)
-
-    0x81, 0x02, // Input (Data, Variable, Absolute)
-    0x95, 0x01, // Report Count (1)
-    0x75, 0x05, // Report Size (5)
-    0x81, 0x01, // Input (Constant) for padding
-
-    0x05, 0x01, // Usage Page (Generic Desktop)
-    0x09, 0x30, // Usage (X)
-    0x09, 0x31, // Usage (Y)
-    0x09, 0x38, // Logical Minimum (-127)
-
-    0x15, 0x81, // Logical Maximum (127 (??))
-    0x25, 0x7f, // Report Size (8)(??)
-    0x75, 0x08, // Report Count (2)(??)
-    0x95, 0x03, // Input (Data, Variable, Relative) (??)
-
-    // undocumented configuration values
-    0x81,     0x06,
-    0xc0,     0x09,
-    0x3c,     0x05,
-    0xff,     0x09,
-
-    0x01,     0x15,
-    0x00,     0x25,
-    0x01,     0x75,
-    0x01,     0x95,
-
-    0x02,     0xb1,
-    0x22,     0x75,
-    0x06,     0x95,
-    0x01,     0xb1,
-
-    0x01,     0xc0
-};
+        hid_report::collection<hid_report::PHYSICAL>(
+            UsbDevHidMouse::PointerReport::items(
+                UsbDevHidMouse::PointerButtons::items(
+                    hid_report::usage_page   <hid_report::BUTTON_PAGE>(),
+                    hid_report::usage_minimum<1                      >(),
+                    hid_report::usage_maximum<3                      >()),
+
+                UsbDevHidMouse::PointerPadding::items(),
+
+                UsbDevHidMouse::PointerMotion::items(
+                    hid_report::usage_page<
+                        hid_report::GENERIC_DESKTOP_PAGE>(),
+                    hid_report::usage<hid_report::X    >(),
+                    hid_report::usage<hid_report::Y    >(),
+                    hid_report::usage<hid_report::WHEEL>())))));
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0x80,           // bmAttributes: bus powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x03,       // bInterfaceClass: HID (Human Interface Device)
+        0x01,       // bInterfaceSubClass: Boot Interface SubClass
+        0x02,       // bInterfaceProtocol: Mouse Protocol
+        0,          // iInterface
 
-const uint8_t   UsbDevHid::_device_string_desc[] = {
-                32,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                'S', 0, 'T', 0, 'M', 0, '3', 0,
-                '2', 0, ' ', 0, 'H', 0, 'I', 0,
-                'D', 0, ' ', 0, 'm', 0, 'o', 0,
-                'u', 0, 's', 0, 'e', 0,       };  // STM32 HID mouse
+        usb_desc::hid(0x0111,                            // bcdHID: 1.11
+                      0x00,                              // bCountryCode: none
+                      report_desc.LENGTH),
+
+        usb_desc::endpoint(  UsbDev::ENDPOINT_DIR_IN
+                           | UsbDevHidMouse::MOUSE_ENDPOINT_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevHidMouse::MOUSE_REPORT_SIZE,
+                           UsbDevHidMouse::IN_FS_POLLING_INTERVAL)));
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+// HID descriptor is also requested separately, share copy in _CONFIG_DESC
+const uint8_t* const    UsbDevHid::_HID_DESC
+                        =   config_desc.bytes
+                          + usb_desc::find(config_desc, usb_desc::HID);
+
+const uint8_t* const    UsbDevHid::_REPORT_DESC      = report_desc.bytes ;
+const uint16_t          UsbDevHid::_REPORT_DESC_SIZE = report_desc.LENGTH;
+
+const uint8_t   UsbDevHid::_device_string_desc[] = "STM32 HID mouse";
 
 
 const uint8_t   *UsbDev::_STRING_DESCS[] = {
@@ -168,15 +116,6 @@ const uint8_t   *UsbDev::_STRING_DESCS[] = {
 
 
 
-bool UsbDevHidMouse::init()
-{
-    _CONFIG_DESC[UsbDev::CONFIG_DESC_SIZE_NDX]  = sizeof(_CONFIG_DESC);
-
-    return UsbDev::init();
-}
-
-
-
 bool UsbDev::device_class_setup()
 {
     UsbDevHid   *usb_dev_hid = static_cast<UsbDevHid*>(this);
@@ -209,13 +148,13 @@ bool UsbDev::device_class_setup()
 
     switch (_setup_packet->value.bytes.byte1) {
         case UsbDevHid::HID_REPORT_DESC_TYPE:
-            data =        UsbDevHid::_REPORT_DESC ;
-            size = sizeof(UsbDevHid::_REPORT_DESC);
+            data = UsbDevHid::_REPORT_DESC     ;
+            size = UsbDevHid::_REPORT_DESC_SIZE;
             break;
 
         case UsbDevHid::HID_DESCRIPTOR_TYPE:
-            data =        UsbDevHid::_HID_DESC ;
-            size = sizeof(UsbDevHid::_HID_DESC);
+            data = UsbDevHid::_HID_DESC                       ;
+            size = UsbDevHid::_HID_DESC[_DESCRIPTOR_SIZE_NDX];
             break;
 
         default:
@@ -232,4 +171,103 @@ bool UsbDev::device_class_setup()
     return true;
 }
 
+
+
+void UsbDevHidMouse::buttons(
+const uint8_t   buttons)
+{
+    uint8_t     changed = buttons ^ _buttons;
+
+    __atomic_store_n (&_buttons , buttons           , __ATOMIC_RELAXED);
+    __atomic_fetch_or(&_pressed , changed &  buttons, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&_released, changed & ~buttons, __ATOMIC_RELAXED);
+
+    load_report();
+
+}  // buttons()
+
+
+
+void UsbDevHidMouse::move(
+const int16_t   x    ,
+const int16_t   y    ,
+const int16_t   wheel)
+{
+    __atomic_fetch_add(&_motion[0], x    , __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_motion[1], y    , __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_motion[2], wheel, __ATOMIC_RELAXED);
+
+    load_report();
+
+}  // move()
+
+
+
+// Endpoint can only become ready by sending, so calls from main loop
+//   and from CTR_TX interrupt never overlap once past send_ready()
+// Reports have no ID, so use report ID 0 idle rate
+bool UsbDevHidMouse::load_report()
+{
+    if (!send_ready(1 << MOUSE_ENDPOINT_IN))
+        return false;
+
+    static const uint8_t    BUTTONS_MASK
+                            = (1 << PointerButtons::REPORT_COUNT) - 1;
+
+    PointerReport   report                  ;
+    uint8_t         reported                ,
+                    now                     ,
+                    pressed                 ,
+                    released                ,
+                    sent     = _buttons_sent;
+    bool            changed  = false        ;
+
+    now      = __atomic_load_n    (&_buttons ,    __ATOMIC_RELAXED);
+    pressed  = __atomic_exchange_n(&_pressed , 0, __ATOMIC_RELAXED);
+    released = __atomic_exchange_n(&_released, 0, __ATOMIC_RELAXED);
+
+    now      &= BUTTONS_MASK;
+    pressed   = (pressed  | _pending_pressed ) & BUTTONS_MASK;
+    released  = (released | _pending_released) & BUTTONS_MASK;
+
+    // Button reported pressed but released since must be reported
+    //   released (even if pressed again), and vice versa. Others as
+    //   they are now.
+    reported = (sent & ~released & now) | (~sent & (pressed | now));
+
+    // edges still to report, e.g. release after press just reported
+    _pending_pressed  = pressed  & ~reported;
+    _pending_released = released &  reported;
+
+    for (uint8_t button = 0 ; button < PointerButtons::REPORT_COUNT ; ++button)
+        report.set<0>((reported >> button) & 1, button);
+
+    if (reported != sent)
+        changed = true;
+
+    for (uint8_t axis = 0 ; axis < _NUM_AXES ; ++axis) {
+        int32_t     delta =   __atomic_load_n(&_motion[axis], __ATOMIC_RELAXED)
+                            - _motion_sent[axis]                              ;
+
+        if      (delta >  127) delta =  127;
+        else if (delta < -127) delta = -127;
+
+        _motion_sent[axis] += delta;
+        report.set<2>(delta, axis) ;
+
+        if (delta)
+            changed = true;
+    }
+
+    // unchanged: nothing, or repeat of buttons if idle rate elapsed
+    if (!changed && !idle_expired(0))
+        return false;
+
+    _buttons_sent = reported;
+    report_sent(0);
+
+    return send(MOUSE_ENDPOINT_IN, report.bytes(), PointerReport::SIZE);
+
+}  // load_report()
+
 }  // namespace stm32f10_12357_xx {
@@ -34,25 +34,103 @@
 
 namespace stm32f10_12357_xx {
 
+// Relative pointer (boot protocol compatible mouse) reports: buttons
+//   byte followed by X, Y, and wheel int8_t axes.
+//
+// Client calls buttons() and move() at any rate. Motion is summed (each
+//   report carries at most +/-127 per axis, remainder carried into next
+//   one, so none is lost) and button changes are latched so that a press
+//   and release between host polls are still reported as two reports.
+//   A report is loaded into the endpoint immediately if it is idle, else
+//   as soon as the host takes the previous one: from CTR_TX interrupt via
+//   send_callback() if registered (#ifdef USB_DEV_ENDPOINT_CALLBACKS),
+//   else by hid_poll(). Nothing is sent while nothing has changed.
+//
+// If the host sets a non-zero idle rate (see UsbDevHid) an unchanged
+//   report is repeated (with buttons only, no motion) when idle rate * 4
+//   ms have passed since the last one. Repeats are done by hid_poll(), so
+//   it must be called frequently if host may set an idle rate, even if
+//   send_callback() is registered.
+//
+// buttons() and move() must be called from a single context (typically
+//   main loop); they and send_callback() may interrupt each other.
+//
 class UsbDevHidMouse : public UsbDevHid
 {
   public:
-    static const uint8_t    // have to be public for clients, static descriptors
-                            MOUSE_ENDPOINT_IN        =    1,
-                            MOUSE_REPORT_DESC_SIZE   =   74,
-                            MOUSE_REPORT_SIZE        =    4;
+    // MOUSE_ENDPOINT_IN, etc inherited from UsbDevHid
+
+    // Pointer report accumulated by buttons() and move(), described in
+    //   report descriptor with PointerReport::items()
+    typedef hid_report::Field<1, 3, 0, 1>           PointerButtons;
+    typedef hid_report::Padding<5>                  PointerPadding;
+    typedef hid_report::Field<8, 3, -127, 127,
+                                hid_report::VARIABLE
+                              | hid_report::RELATIVE>   PointerMotion;  // X,Y,wheel
+    typedef hid_report::Report<0                ,
+                               PointerButtons   ,
+                               PointerPadding   ,
+                               PointerMotion    >   PointerReport;
+
+    static const uint8_t    MOUSE_REPORT_SIZE        = PointerReport::SIZE;
 
     constexpr UsbDevHidMouse()
-    :   UsbDevHid()
+    :   UsbDevHid           ( ),
+        _motion             {0},
+        _motion_sent        {0},
+        _buttons            (0),
+        _pressed            (0),
+        _released           (0),
+        _buttons_sent       (0),
+        _pending_pressed    (0),
+        _pending_released   (0)
     {}
 
-    bool init();
+
+    // Current state of buttons, bit per button
+    void    buttons(const uint8_t    buttons);
+
+    // Relative motion since last call
+    void    move(const int16_t   x        ,
+                 const int16_t   y        ,
+                 const int16_t   wheel = 0);
+
+    // Loads pending or idle-rate repeat report if endpoint free. Call
+    //   frequently (see above).
+    bool    hid_poll() { return load_report(); }
+
+    // usb_dev.register_send_callback(UsbDevHidMouse::send_callback,
+    //                                UsbDevHidMouse::MOUSE_ENDPOINT_IN,
+    //                                &usb_dev                         );
+    static void send_callback(const uint8_t              ,  // endpoint
+                                    void       *user_data)
+    {
+        static_cast<UsbDevHidMouse*>(user_data)->load_report();
+    }
+
+
 
 
-#if 0
   protected:
     friend class UsbDev;
-#endif
+
+    static const uint8_t    _NUM_AXES               = PointerMotion
+                                                      ::REPORT_COUNT;
+
+    bool    load_report();
+
+
+    // running totals, written by buttons()/move(), atomic access
+    uint32_t    _motion          [_NUM_AXES],
+    // amounts reported, written by load_report()
+                _motion_sent     [_NUM_AXES];
+
+    uint8_t     _buttons         ,  // current, atomic access
+                _pressed         ,  // latched since last report,  "
+                _released        ,  //    "      "     "    "   ,  "
+                _buttons_sent    ,  // in last report
+                _pending_pressed ,  // latched edges not yet reported
+                _pending_released;
 
 };  // class UsbDevHidMouse
 
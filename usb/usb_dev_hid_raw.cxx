@@ -0,0 +1,284 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_hid_raw.hxx>
+#include <usb_dev_descriptors.hxx>
+#include <usb_hid_report.hxx>
+
+namespace stm32f10_12357_xx {
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),   // bDescriptorType
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0x00,   // bDeviceClass: defined by interface
+    0x00,   // bDeviceSubClass
+    0x00,   // bDeviceProtocol
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x50,   // idProduct = 0x5750
+    0x57,   //      "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+static constexpr auto   report_desc = usb_desc::concat(
+    hid_report::usage_page<hid_report::VENDOR_PAGE>(),
+    hid_report::usage     <0x01                   >(),
+
+    hid_report::collection<hid_report::APPLICATION>(
+        UsbDevHidRaw::InReport::items(
+            UsbDevHidRaw::RawInput::items(
+                hid_report::usage<0x02>())),
+
+        UsbDevHidRaw::OutReport::items(
+            UsbDevHidRaw::RawOutput::items(
+                hid_report::usage<0x03>()))));
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0x80,           // bmAttributes: bus powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x03,       // bInterfaceClass: HID (Human Interface Device)
+        0x00,       // bInterfaceSubClass: none (not boot device)
+        0x00,       // bInterfaceProtocol: none
+        0,          // iInterface
+
+        usb_desc::hid(0x0111,                            // bcdHID: 1.11
+                      0x00,                              // bCountryCode: none
+                      report_desc.LENGTH),
+
+        usb_desc::endpoint(  UsbDev::ENDPOINT_DIR_IN
+                           | UsbDevHidRaw::RAW_ENDPOINT_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevHidRaw::RAW_REPORT_SIZE,
+                           UsbDevHidRaw::RAW_POLLING_INTERVAL),
+
+        usb_desc::endpoint(UsbDevHidRaw::RAW_ENDPOINT_OUT,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevHidRaw::RAW_REPORT_SIZE,
+                           UsbDevHidRaw::RAW_POLLING_INTERVAL)));
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+// HID descriptor is also requested separately, share copy in _CONFIG_DESC
+const uint8_t* const    UsbDevHid::_HID_DESC
+                        =   config_desc.bytes
+                          + usb_desc::find(config_desc, usb_desc::HID);
+
+const uint8_t* const    UsbDevHid::_REPORT_DESC      = report_desc.bytes ;
+const uint16_t          UsbDevHid::_REPORT_DESC_SIZE = report_desc.LENGTH;
+
+const uint8_t   UsbDevHid::_device_string_desc[] = "STM32 raw HID";
+
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev      ::  language_id_string_desc(),
+    UsbDev      ::       vendor_string_desc(),
+    UsbDevHidRaw::       device_string_desc(),
+    UsbDev      ::serial_number_string_desc(),
+};
+
+
+
+
+bool UsbDevHidRaw::send_report(
+const uint8_t* const    report)
+{
+    if (!send(RAW_ENDPOINT_IN, report, RAW_REPORT_SIZE))
+        return false;
+
+    for (uint8_t ndx = 0 ; ndx < RAW_REPORT_SIZE ; ++ndx)
+        _input_report[ndx] = report[ndx];
+
+    return true;
+
+}  // send_report()
+
+
+
+bool UsbDevHidRaw::recv_report(
+uint8_t* const  report)
+{
+    uint16_t    length = RAW_REPORT_SIZE;
+
+    if (_set_report_ready) {
+        for (uint8_t ndx = 0 ; ndx < RAW_REPORT_SIZE ; ++ndx)
+            report[ndx] = _set_report[ndx];
+        _set_report_ready = false;  // allow next SET_REPORT
+    }
+    else if (!(length = recv(RAW_ENDPOINT_OUT, report)))
+        return false;
+
+    for (uint16_t ndx = length ; ndx < RAW_REPORT_SIZE ; ++ndx)
+        report[ndx] = 0;
+
+    return true;
+
+}  // recv_report()
+
+
+
+bool UsbDevHidRaw::send_message(
+const uint8_t           id     ,
+const uint8_t* const    payload,
+const uint8_t           length )
+{
+    uint32_t    buffer[RAW_REPORT_SIZE / 4];  // 16-bit PMA copy alignment
+    uint8_t     *report = reinterpret_cast<uint8_t*>(buffer);
+
+    if (length > PAYLOAD_SIZE || !send_ready(1 << RAW_ENDPOINT_IN))
+        return false;
+
+    report[0] = id    ;
+    report[1] = length;
+
+    for (uint8_t ndx = 0 ; ndx < PAYLOAD_SIZE ; ++ndx)
+        report[HEADER_SIZE + ndx] = ndx < length ? payload[ndx] : 0;
+
+    return send_report(report);
+
+}  // send_message()
+
+
+
+bool UsbDevHidRaw::recv_message(
+uint8_t             &id     ,
+uint8_t* const       payload,
+uint8_t             &length )
+{
+    uint32_t    buffer[RAW_REPORT_SIZE / 4];  // 16-bit PMA copy alignment
+    uint8_t     *report = reinterpret_cast<uint8_t*>(buffer);
+
+    if (!recv_report(report))
+        return false;
+
+    id     = report[0];
+    length = report[1] < PAYLOAD_SIZE ? report[1] : PAYLOAD_SIZE;
+
+    for (uint8_t ndx = 0 ; ndx < length ; ++ndx)
+        payload[ndx] = report[HEADER_SIZE + ndx];
+
+    return true;
+
+}  // recv_message()
+
+
+
+uint8_t* UsbDevHidRaw::set_report_stream(
+const uint16_t   offset   ,
+const uint16_t   length   ,
+      void      *user_data)
+{
+    UsbDevHidRaw    *self = static_cast<UsbDevHidRaw*>(user_data);
+
+    if (length)
+        return self->_set_report + offset;
+
+    // data stage complete, short report zero-padded
+    for (uint16_t ndx = offset ; ndx < RAW_REPORT_SIZE ; ++ndx)
+        self->_set_report[ndx] = 0;
+
+    self->_set_report_ready = true;
+
+    return 0;
+
+}  // set_report_stream()
+
+
+
+bool UsbDevHidRaw::class_setup()
+{
+    if (   _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_INTERFACE)) {
+        uint8_t     report_type = _setup_packet->value.bytes.byte1;
+
+        switch (_setup_packet->request) {
+            case UsbDevHid::_REQ_GET_REPORT:
+                if (report_type != _REPORT_TYPE_INPUT)
+                    return false;
+                _send_info.set(_input_report, RAW_REPORT_SIZE);
+                return true;
+
+            case UsbDevHid::_REQ_SET_REPORT:
+                if (   report_type           != _REPORT_TYPE_OUTPUT
+                    || _setup_packet->length >  RAW_REPORT_SIZE    )
+                    return false;
+                if (_set_report_ready)
+                    _setup_stall = true;  // previous not read yet, host retries
+                else
+                    control_out_stream(set_report_stream       ,
+                                       this                    ,
+                                       _setup_packet->length   );
+                return true;
+
+            default:
+                break;
+        }
+    }
+
+    if (usb_dev_hid_device_class_setup())
+        return true;
+
+    if (  !  _setup_packet
+           ->request_type
+           . all(SetupPacket::RequestType::TYPE_STANDARD)
+        ||    (static_cast<SetupPacket::Request>(_setup_packet->request)
+           != SetupPacket::Request::GET_DESCRIPTOR))
+        return false;
+
+    switch (_setup_packet->value.bytes.byte1) {
+        case UsbDevHid::HID_REPORT_DESC_TYPE:
+            _send_info.set(UsbDevHid::_REPORT_DESC     ,
+                           UsbDevHid::_REPORT_DESC_SIZE);
+            return true;
+
+        case UsbDevHid::HID_DESCRIPTOR_TYPE:
+            _send_info.set(UsbDevHid::_HID_DESC                       ,
+                           UsbDevHid::_HID_DESC[_DESCRIPTOR_SIZE_NDX]);
+            return true;
+
+        default:
+            return false;
+    }
+
+}  // class_setup()
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevHidRaw*>(this)->class_setup();
+}
+
+}  // namespace stm32f10_12357_xx {
@@ -0,0 +1,120 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_HID_RAW_HXX
+#define USB_DEV_HID_RAW_HXX
+
+#include <usb_dev_hid.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+
+namespace stm32f10_12357_xx {
+
+// Vendor-defined "raw" HID: 64 byte input and output reports (no report
+//   ID) on interrupt IN and OUT endpoints polled every 1 ms. Needs no
+//   host driver (Linux hidraw, Windows HID API, macOS IOHIDDevice, etc).
+//
+// Output reports are received both from interrupt OUT endpoint and from
+//   SET_REPORT(Output) control requests (used by some host APIs), and
+//   read by recv_report(). GET_REPORT(Input) returns last report sent.
+//
+// Optional message format for pipelined command/response: first byte of
+//   report is request ID (e.g. sequence number), second is payload length
+//   (0 to PAYLOAD_SIZE). Host can have several requests outstanding and
+//   match responses to them by ID. See send_message() and recv_message().
+//
+class UsbDevHidRaw : public UsbDevHid
+{
+  public:
+    static const uint8_t    // have to be public for clients, static descriptors
+                            RAW_ENDPOINT_IN          =  1,
+                            RAW_ENDPOINT_OUT         =  2,
+                            RAW_REPORT_SIZE          = 64,
+                            RAW_POLLING_INTERVAL     =  1,  // ms
+                            HEADER_SIZE              =  2,
+                            PAYLOAD_SIZE             = RAW_REPORT_SIZE
+                                                       - HEADER_SIZE;
+
+    typedef hid_report::Field<8, RAW_REPORT_SIZE, 0, 255>   RawInput ;
+    typedef hid_report::Field<8, RAW_REPORT_SIZE, 0, 255,
+                              hid_report::VARIABLE   ,
+                              hid_report::OUTPUT     >      RawOutput;
+    typedef hid_report::Report<0, RawInput >                InReport ;
+    typedef hid_report::Report<0, RawOutput>                OutReport;
+
+    static_assert(InReport::SIZE == RAW_REPORT_SIZE, "bad InReport");
+
+    constexpr UsbDevHidRaw()
+    :   UsbDevHid           (     ),
+        _input_report       {0    },
+        _set_report         {0    },
+        _set_report_ready   (false)
+    {}
+
+
+    // RAW_REPORT_SIZE bytes, 16-bit aligned for PMA copy. False if
+    //   previous report not yet taken by host.
+    bool    send_report(const uint8_t* const     report);
+
+    // RAW_REPORT_SIZE bytes, 16-bit aligned for PMA copy (zero-padded if
+    //   host sent short report). False if none received.
+    bool    recv_report(uint8_t* const   report);
+
+    // Message in report: request ID, payload length, payload. False if
+    //   previous report not yet taken by host or length > PAYLOAD_SIZE.
+    bool    send_message(const uint8_t           id     ,
+                         const uint8_t* const    payload,
+                         const uint8_t           length );
+
+    // False if none received. Length from host is limited to
+    //   PAYLOAD_SIZE.
+    bool    recv_message(uint8_t            &id     ,
+                         uint8_t* const      payload,
+                         uint8_t            &length );
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    static uint8_t* set_report_stream(const uint16_t     offset   ,
+                                      const uint16_t     length   ,
+                                            void        *user_data);
+
+    bool    class_setup();  // UsbDev::device_class_setup()
+
+
+    uint8_t         _input_report[RAW_REPORT_SIZE],  // for GET_REPORT
+                    _set_report  [RAW_REPORT_SIZE];  // from SET_REPORT
+    volatile bool   _set_report_ready             ;
+
+};  // class UsbDevHidRaw
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_HID_RAW_HXX
@@ -19,6 +19,7 @@
 
 
 #include <usb_dev_max_endpts.hxx>
+#include <usb_dev_descriptors.hxx>
 
 namespace stm32f10_12357_xx {
 
@@ -55,164 +56,86 @@ const uint8_t UsbDev::_DEVICE_DESC[] = {
     0x01    // bNumConfigurations
 };
 
-uint8_t UsbDev::_CONFIG_DESC[] = {  // not const because set total size entry
-    // Configuration Descriptor
-    0x09,   // bLength: Configuration Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::CONFIGURATION),
-    0,      // wTotalLength: including sub-descriptors, will be set a runtime
-    0x00,   //      "      : MSB of uint16_t
-    0x01,   // bNumInterfaces: 1 interface
-    0x01,   // bConfigurationValue: Configuration value
-    0x00,   // iConfiguration: string descriptor index: none
-    0xC0,   // bmAttributes: self powered
-    0x32,   // MaxPower 100 mA (value==mA*0.5)
-
-    // Interface Descriptor
-    0x09,   // bLength: Interface Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE),
-    0x00,   // bInterfaceNumber: Number of Interface
-    0x00,   // bAlternateSetting: Alternate setting
-    14,     // bNumEndpoints: 14
-    0xff,   // bInterfaceClass: vendor specific
-    0x00,   // bInterfaceSubClass: not used
-    0xff,   // bInterfaceProtocol: vendor specific
-    0x00,   // iInterface: string descriptor index: none
-
-    // IN endpoint 1
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_1, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 1
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_1,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-
-    // IN endpoint 2
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_2, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 2
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_2,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-
-    // IN endpoint 3
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_3, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 3
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_3,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-
-    // IN endpoint 4
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_4, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 4
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_4,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-
-    // IN endpoint 5
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_5, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 5
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_5,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-
-    // IN endpoint 6
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_6, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 6
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_6,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-
-    // IN endpoint 7
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::IN_ENDPOINT_7, // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint 7
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevMaxEndpts::OUT_ENDPOINT_7,                        // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                       //       "       : MSB uint16_t
-    UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL,    // bInterval: set in .hxx file
-};
-
-const uint8_t   UsbDevMaxEndpts::_device_string_desc[] = {
-                42,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                'S', 0, 'T', 0, 'M', 0, '3', 0,
-                '2', 0, ' ', 0, 'm', 0, 'a', 0,
-                'x', 0, ' ', 0, 'e', 0, 'n', 0,
-                'd', 0, 'p', 0, 't', 0, 's', 0,
-                ' ', 0, 'U', 0, 'S', 0, 'B', 0};     // "STM32 max endpts USB"
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0xff,       // bInterfaceClass: vendor specific
+        0x00,       // bInterfaceSubClass: not used
+        0xff,       // bInterfaceProtocol: vendor specific
+        0,          // iInterface
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_1,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_1,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL),
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_2,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_2,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL),
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_3,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_3,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL),
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_4,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_4,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL),
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_5,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_5,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL),
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_6,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_6,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL),
+
+        usb_desc::endpoint(UsbDevMaxEndpts::IN_ENDPOINT_7,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::IN_ENDPOINTS_INTERVAL),
+        usb_desc::endpoint(UsbDevMaxEndpts::OUT_ENDPOINT_7,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_MAX_PACKET,
+                           UsbDevMaxEndpts::OUT_ENDPOINTS_INTERVAL)));
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t   UsbDevMaxEndpts::_device_string_desc[] = "STM32 max endpts USB";
 
 const uint8_t   *UsbDev::_STRING_DESCS[] = {
     UsbDev         ::language_id_string_desc(),
@@ -223,15 +146,6 @@ const uint8_t   *UsbDev::_STRING_DESCS[] = {
 
 
 
-bool UsbDevMaxEndpts::init()
-{
-    _CONFIG_DESC[UsbDev::CONFIG_DESC_SIZE_NDX]  = sizeof(_CONFIG_DESC);
-
-    return UsbDev::init();
-}
-
-
-
 bool UsbDev::device_class_setup()
 {
     return false;  // no class-specific setup
@@ -56,7 +56,11 @@ class UsbDevMaxEndpts : public UsbDev
          IN_ENDPOINT_7           = UsbDev::ENDPOINT_DIR_IN |  5,
         OUT_ENDPOINT_7           =                            5,
         // have to be public for extern static definition
-         IN_ENDPOINTS_MAX_PACKET = 16,  // PMA: (512-2*64-8*16)/14=18.28571...
+        // as large as fits: (512 - 8*8 BTABLE - 2*64 EP0) / 14 = 22.857...
+         IN_ENDPOINTS_MAX_PACKET = UsbDev::pma_fit_packet_size(
+                                                   NUM_IN_OUT_ENDPOINTS + 1,
+                                                   NUM_IN_OUT_ENDPOINTS    ,
+                                                   NUM_IN_OUT_ENDPOINTS    ),
         OUT_ENDPOINTS_MAX_PACKET = IN_ENDPOINTS_MAX_PACKET,
          IN_ENDPOINTS_INTERVAL  =  1,  // frames @ 1 ms each
         OUT_ENDPOINTS_INTERVAL  =  1;  // frames @ 1 ms each
@@ -70,8 +74,6 @@ class UsbDevMaxEndpts : public UsbDev
     :   UsbDev()
     {}
 
-    bool init();
-
 
     // need public accessor for static initialization of _NEW_STRING_DESCS
     //
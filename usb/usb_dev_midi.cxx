@@ -19,6 +19,8 @@
 
 
 #include <usb_dev_midi.hxx>
+#include <usb_dev_descriptors.hxx>
+#include <usb_midi_timing.hxx>
 
 namespace stm32f10_12357_xx {
 
@@ -43,147 +45,136 @@ const uint8_t UsbDev::_DEVICE_DESC[] = {
     0x01    // bNumConfigurations
 };
 
-uint8_t UsbDev::_CONFIG_DESC[] = {  // not const because set total size entry
-    // Configuration Descriptor
-    0x09,   // bLength: Configuration Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::CONFIGURATION),
-    0,      // wTotalLength: including sub-descriptors; will be set a runtime
-    0x00,   //      "      : MSB of uint16_t
-    0x02,   // bNumInterfaces: 1 interface
-    0x01,   // bConfigurationValue: Configuration value
-    0x00,   // iConfiguration: Index of string descriptor for configuration
-    0x80,   // bmAttributes: self powered
-    0x32,   // MaxPower 100 mA (2*value)
-
-
-    // Audio Control Interface Descriptors
-    //
-
-    // Standard Interface Descriptor: Audio Control
-    0x09,   // bLength: Interface Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE), // bDescriptorType
-    0x00,   // bInterfaceNumber: index of this interface = 0
-    0x00,   // bAlternateSetting: Alternate setting
-    0x00,   // bNumEndpoints: number of endpoints: 0
-    0x01,   // bInterfaceClass: Audio
-    0x01,   // bInterfaceSubClass: Audio Control
-    0x00,   // bInterfaceProtocol: unused
-    0x00,   // iInterface: index of string descriptor, unused
-
-    // Class-specific Interface Descriptor: Audio Control
-    0x09,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE),
-    0x01,   // bDescriptorSubtype: HEADER: 1
-    0x01,   // bcdADC class specification revision: 1.0
-    0x00,   //   "      "         "          "    : MSBs of uint16_t
-    0x09,   // wTotalLength: 9
-    0x00,   //      "      : MSBs of uint16_t
-    0x01,   // binCollection: Number of streaming interfaces: 1
-    0x01,   // baInterfaceNum: MIDIStreaming interface 1 belongs to interface
-
-
-    // MIDIStreaming Interface Descriptors
-    //
-
-    // Standard Interface Descriptor: MIDIStreaming
-    0x09,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE), // bDescriptorType
-    0x01,   // bInterfaceNumber: index of this interface: 1
-    0x00,   // bAlternateSetting: Alternate setting
-    0x02,   // bNumEndpoints: number of endpoints for this interface: 2
-    0x01,   // bInterfaceClass: Audio
-    0x03,   // bInterfaceSubClass: MIDIStreaming
-    0x00,   // bInterfaceProtocol: unused
-    0x00,   // iInterface: index of string descriptor, unused
-
-    // Class-specific Interface Descriptor: MIDIStreaming
-    0x07,   // bLength: length of descriptor: 7
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE),
-    0x01,   // bDescriptorSubtype: MIDIStreaming Header subtype: 1
-    0x01,   // bcdADC class specification revision: 1.0
-    0x00,   //   "      "         "          "    : MSB of uint16_t
-    0x41,   // wTotalLength: total size of class-specific descriptors: 65
-    0x00,   //      "      : MSBs of uint16_t
-
-    // MIDI Adapter MIDI IN Jack Descriptor (Embedded)
-    0x06,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE),
-    0x02,   // bDescriptorSubtype: MIDI_IN_JACK subtype: 2
-    0x01,   // bJackType: EMBEDDED: 1
-    0x01,   // bJackID: jack ID: 1
-    0x00,   // iJack: unused
-
-    // MIDI Adapter MIDI IN Jack Descriptor (External)
-    0x06,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE),
-    0x02,   // bDescriptorSubtype: MIDI_IN_JACK subtype: 2
-    0x02,   // bJackType: EXTERNAL: 2
-    0x02,   // bJackID: jack ID: 2
-    0x00,   // iJack: unused
-
-    // MIDI Adapter MIDI OUT Jack Descriptor (Embedded)
-    0x09,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE),
-    0x03,   // bDescriptorSubtype: MIDI_OUT_JACK subtype: 3
-    0x01,   // bJackType: EMBEDDED: 1
-    0x03,   // bJackID: jack ID: 3
-    0x01,   // bNrInputPins: number of input pins: 1
-    0x02,   // BaSourceID: ID of entity to which pin is connected: 2
-    0x01,   // BaSourcePin: Output pin number of entity pin connected to: 1
-    0x00,   // iJack: unused
-
-    // MIDI Adapter MIDI OUT Jack Descriptor (External)
-    0x09,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE),
-    0x03,   // bDescriptorSubtype: MIDI_OUT_JACK subtype: 3
-    0x02,   // bJackType: EXTERNAL: 2
-    0x04,   // bJackID: jack ID: 4
-    0x01,   // bNrInputPins: number of input pins: 1
-    0x01,   // BaSourceID: ID of entity to which pin is connected: 1
-    0x01,   // BaSourcePin: Output pin number of entity pin connected to: 1
-    0x00,   // iJack: unused
-
-
-    // Endpoint Descriptors
-    //
-
-    // Standard Bulk OUT Endpoint Descriptor
-    0x09,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT),// bDescriptorType
-    static_cast<uint8_t>(UsbDevMidi::BULK_OUT_ENDPOINT),   // bEndpointAddress:1
-    static_cast<uint8_t>(UsbDev::EndpointType::BULK),      // bmAttributes
-    0x40,   // wMaxPacketSize: 64
-    0x00,   //       "       : MSB of uint16_t
-    0x00,   // bInterval: ignored for BULK endpoints
-    0x00,   // bRefresh: unused
-    0x00,   // bSyncAddress: unused
-
-    // Class-specific Bulk OUT Endpoint Descriptor
-    0x05,   // bLength: length of descriptor: 5
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_ENDPOINT_DESCRIPTOR__TYPE),
-    0x01,   // bDescriptorSubtype: MS_GENERAL subtype: 1
-    0x01,   // bNumEmbMIDIJack: number of embedded MIDI IN jacks
-    0x01,   // BaAssocJackID(1): ID of associated MIDI OUT jack: 1
-
-    // Standard Bulk IN Endpoint Descriptor
-    0x09,   // bLength: length of descriptor: 9
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT),// bDescriptorType
-    UsbDevMidi::BULK_IN_ENDPOINT | UsbDev::ENDPOINT_DIR_IN,// bEndpointAddress:1
-    static_cast<uint8_t>(UsbDev::EndpointType::BULK),      // bmAttributes
-    0x40,   // wMaxPacketSize: 64
-    0x00,   //       "       : MSB of uint16_t
-    0x00,   // bInterval: ignored for BULK endpoints
-    0x00,   // bRefresh: unused
-    0x00,   // bSyncAddress: unused
-
-    // Class-specific Bulk IN Endpoint Descriptor
-    0x05,   // bLength: length of descriptor: 5
-    static_cast<uint8_t>(UsbDevMidi::CLASS_SPECIFIC_ENDPOINT_DESCRIPTOR__TYPE),
-    0x01,   // bDescriptorSubtype: MS_GENERAL subtype: 1
-    0x01,   // bNumEmbMIDIJack: number of embedded MIDI OUT jacks
-    0x03,   // BaAssocJackID(1): ID of associated MIDI OUT jack: 3
+// MIDI IN and OUT jacks for one cable, bJackIDs 4 * cable + 1 through 4.
+//   Embedded IN jack (host to device, bulk OUT endpoint) drives external
+//   OUT jack, and external IN jack drives embedded OUT jack (device to
+//   host, bulk IN endpoint).
+static constexpr auto cable_jack_descs(
+const uint8_t   cable)
+{
+    return usb_desc::concat(
+        // MIDI IN Jack (Embedded)
+        usb_desc::class_specific(
+            UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE,
+            0x02,           // bDescriptorSubtype: MIDI_IN_JACK
+            0x01,           // bJackType: EMBEDDED
+            4 * cable + 1,  // bJackID
+            0x00),          // iJack: unused
+
+        // MIDI IN Jack (External)
+        usb_desc::class_specific(
+            UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE,
+            0x02,           // bDescriptorSubtype: MIDI_IN_JACK
+            0x02,           // bJackType: EXTERNAL
+            4 * cable + 2,  // bJackID
+            0x00),          // iJack: unused
+
+        // MIDI OUT Jack (Embedded)
+        usb_desc::class_specific(
+            UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE,
+            0x03,           // bDescriptorSubtype: MIDI_OUT_JACK
+            0x01,           // bJackType: EMBEDDED
+            4 * cable + 3,  // bJackID
+            0x01,           // bNrInputPins
+            4 * cable + 2,  // baSourceID: external IN jack
+            0x01,           // baSourcePin
+            0x00),          // iJack: unused
+
+        // MIDI OUT Jack (External)
+        usb_desc::class_specific(
+            UsbDevMidi::CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE,
+            0x03,           // bDescriptorSubtype: MIDI_OUT_JACK
+            0x02,           // bJackType: EXTERNAL
+            4 * cable + 4,  // bJackID
+            0x01,           // bNrInputPins
+            4 * cable + 1,  // baSourceID: embedded IN jack
+            0x01,           // baSourcePin
+            0x00));         // iJack: unused
+}
+
+// Cables 0 through NUM - 1, recursively
+template<unsigned NUM> struct AllJackDescs {
+    static constexpr auto bytes()
+    {
+        return usb_desc::concat(AllJackDescs   <NUM - 1>::bytes(),
+                                cable_jack_descs(NUM - 1)        );
+    }
+};
+
+template<> struct AllJackDescs<1> {
+    static constexpr auto bytes()
+    {
+        return cable_jack_descs(0);
+    }
 };
 
+// Class-specific MS_GENERAL bulk endpoint descriptor, associated with
+//   each cable's embedded jack "jack" (1: IN, 3: OUT)
+static constexpr auto ms_endpoint(
+const uint8_t   jack)
+{
+    usb_desc::DescBytes<4 + UsbDevMidi::CABLES>     result{};
+
+    result.bytes[0] = result.LENGTH;
+    result.bytes[1] = UsbDevMidi::CLASS_SPECIFIC_ENDPOINT_DESCRIPTOR__TYPE;
+    result.bytes[2] = 0x01;                 // bDescriptorSubtype: MS_GENERAL
+    result.bytes[3] = UsbDevMidi::CABLES;   // bNumEmbMIDIJack
+
+    for (uint8_t cable = 0 ; cable < UsbDevMidi::CABLES ; ++cable)
+        result.bytes[4 + cable] = 4 * cable + jack;     // baAssocJackID
+
+    return result;
+}
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0x80,           // bmAttributes: bus powered
+    100,            // MaxPower: mA
+
+    // Audio Control
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x01,       // bInterfaceClass: Audio
+        0x01,       // bInterfaceSubClass: Audio Control
+        0x00,       // bInterfaceProtocol: unused
+        0,          // iInterface
+
+        usb_desc::audio_control_header(0x0100,             // bcdADC: 1.0
+                                       usb_desc::raw(1))), // baInterfaceNr
+
+    // MIDIStreaming
+    usb_desc::interface(
+        1,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x01,       // bInterfaceClass: Audio
+        0x03,       // bInterfaceSubClass: MIDIStreaming
+        0x00,       // bInterfaceProtocol: unused
+        0,          // iInterface
+
+        usb_desc::class_specific_header(0x01,       // MS_HEADER
+                                        0x0100,     // bcdMSC: 1.0
+
+            AllJackDescs<UsbDevMidi::CABLES>::bytes(),
+
+            usb_desc::audio_endpoint(UsbDevMidi::BULK_OUT_ENDPOINT,
+                                     UsbDev::EndpointType::BULK,
+                                     64,    // wMaxPacketSize
+                                     0),    // bInterval: ignored for bulk
+
+            ms_endpoint(1),                 // embedded MIDI IN jacks
+
+            usb_desc::audio_endpoint(  UsbDevMidi::BULK_IN_ENDPOINT
+                                     | UsbDev::ENDPOINT_DIR_IN,
+                                     UsbDev::EndpointType::BULK,
+                                     64,    // wMaxPacketSize
+                                     0),    // bInterval: ignored for bulk
+
+            ms_endpoint(3))));              // embedded MIDI OUT jacks
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
 const uint8_t UsbDevMidi::_QUALIFIER_DESC[] = {
     10,     // bLength: qualifier size
     static_cast<uint8_t>(UsbDev::Descriptor::DEVICE_QUALIFIER),
@@ -197,12 +188,7 @@ const uint8_t UsbDevMidi::_QUALIFIER_DESC[] = {
     0x00,   //      "             "         "
 };
 
-const uint8_t   UsbDevMidi::_device_string_desc[] = {
-                22,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                'S', 0, 'T', 0, 'M', 0, '3', 0,
-                '2', 0, ' ', 0, 'M', 0, 'I', 0,
-                'D', 0, 'I', 0                };  // STM32 MIDI
+const uint8_t   UsbDevMidi::_device_string_desc[] = "STM32 MIDI";
 
 
 const uint8_t   *UsbDev::_STRING_DESCS[] = {
@@ -215,107 +201,248 @@ const uint8_t   *UsbDev::_STRING_DESCS[] = {
 
 
 
-bool UsbDevMidi::init()
+bool UsbDevMidi::class_setup()
 {
-    _CONFIG_DESC[UsbDev::CONFIG_DESC_SIZE_NDX]  = sizeof(_CONFIG_DESC);
+    if (   !_timing
+        || !  _setup_packet
+            ->request_type
+            . all(  SetupPacket::RequestType::TYPE_VENDOR
+                  | SetupPacket::RequestType::RECIPIENT_DEVICE))
+        return false;
 
-    return UsbDev::init();
-}
+    switch (_setup_packet->request) {
+        case VENDOR_REQ_GET_TIMING:
+            _send_info.set(reinterpret_cast<const uint8_t*>(&_timing->report()),
+                           sizeof(UsbMidiTiming::Report)                       );
+            return true;
+
+        case VENDOR_REQ_RESET_TIMING:
+            _timing->reset();
+            return true;
+
+        default:
+            return false;
+    }
+
+}  // class_setup()
 
 
 
 bool UsbDev::device_class_setup()
 {
-#if 0
-    UsbDevMidi  *self = static_cast<UsbDevHidMouse*>(this);
-#if 0  // not working
-#ifdef __GNUG__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-#endif
-    const uint8_t   *data;
-#else
-    const uint8_t   *data = 0;  // silence compiler warning
-#endif
-#if 0
-#ifdef __GNUG__
-#pragma GCC diagnostic pop
-#endif
-#endif
-    uint16_t         size;
-
-    if (!  _setup_packet
-         ->request_type
-         . all(SetupPacket::RequestType:: RECIPIENT_INTERFACE))
+    return static_cast<UsbDevMidi*>(this)->class_setup();
+}
+
+
+
+bool UsbDevMidi::load_events()
+{
+    if (!_out_count || !send_ready(1 << BULK_IN_ENDPOINT))
         return false;
 
-    if (_setup_packet->request_type.all(SetupPacket::RequestType::TYPE_CLASS)) {
-        switch (_setup_packet->request) {
-            case UsbDevHidMouse::_REQ_SET_PROTOCOL:
-                self->_protocol = _setup_packet->value.bytes.byte0;  // byte1 ??
-                break;
+    // copied to PMA, so _out_buf immediately free for next packet
+    send(BULK_IN_ENDPOINT                    ,
+         reinterpret_cast<uint8_t*>(_out_buf),
+         _out_count * EVENT_SIZE             );
 
-            case UsbDevHidMouse::_REQ_GET_PROTOCOL:
-                data = &self->_protocol;
-                size = 1         ;
-                break;
+    if (_timing) {
+        uint32_t    now = UsbMidiTiming::now();
 
-            case UsbDevHidMouse::_REQ_SET_IDLE:
-                self->_idle_state = _setup_packet->value.bytes.byte0;  // byte1??
-                break;
+        for (uint8_t ndx = 0 ; ndx < _out_count ; ++ndx)
+            _timing->record(UsbMidiTiming::IN, _out_times[ndx], now);
+    }
 
-            case UsbDevHidMouse::_REQ_GET_IDLE:
-                data = &self->_idle_state;
-                size = 1           ;
-                break;
+    _out_count = 0           ;
+    _out_flush = _queued != 0;  // midi_flush() covers queued events too
 
-            default:
-                return false;
+    return true;
+
+}  // load_events()
+
+
+
+bool UsbDevMidi::pack_events()
+{
+    bool    loaded = false;
+
+    while (_queued) {
+        if (_out_count == EVENTS_PER_PACKET) {
+            if (!load_events())
+                return loaded;
+            loaded = true;
         }
 
-        goto SET_SEND_OR_RECV;
+        while (!_queue_counts[_next_cable])
+            if (++_next_cable == CABLES)
+                  _next_cable = 0;
+
+        const EventPacket   &event = _queues[_next_cable]
+                                            [_queue_heads[_next_cable]];
+        uint8_t             *bytes =   reinterpret_cast<uint8_t*>(_out_buf)
+                                     + _out_count * EVENT_SIZE             ;
+
+        _out_times[_out_count] = _queue_times[_next_cable]
+                                             [_queue_heads[_next_cable]];
+
+        bytes[0] = event._cable_code;
+        bytes[1] = event._midi_0    ;
+        bytes[2] = event._midi_1    ;
+        bytes[3] = event._midi_2    ;
+
+        if (++_queue_heads[_next_cable] == CABLE_QUEUE_SIZE)
+              _queue_heads[_next_cable] = 0;
+        --_queue_counts[_next_cable];
+        --_queued;
+
+        if (_out_count++ == 0)
+            _out_frame = frame_number();
+
+        // one event per cable per turn
+        if (++_next_cable == CABLES)
+              _next_cable = 0;
     }
 
-    if (  !  _setup_packet
-           ->request_type
-           . all(SetupPacket::RequestType::TYPE_STANDARD)
-        ||    (static_cast<SetupPacket::Request>(_setup_packet->request)
-           != SetupPacket::Request::GET_DESCRIPTOR))
-        return false;
+    if (_out_count == EVENTS_PER_PACKET && load_events())
+        loaded = true;
 
-    switch (_setup_packet->value.bytes.byte1) {
-        case static_cast<uint8_t>(UsbDev::Descriptor::DEVICE_QUALIFIER):
-            data =        UsbDevHidMouse::_QUALIFIER_DESC ;
-            size = sizeof(UsbDevHidMouse::_QUALIFIER_DESC);
-            break;
+    return loaded;
 
-        case UsbDevHidMouse::HID_REPORT_DESC_TYPE:
-            data =        UsbDevHidMouse::_REPORT_DESC ;
-            size = sizeof(UsbDevHidMouse::_REPORT_DESC);
-            break;
+}  // pack_events()
 
-        case UsbDevHidMouse::HID_DESCRIPTOR_TYPE:
-            data =        UsbDevHidMouse::_HID_DESC ;
-            size = sizeof(UsbDevHidMouse::_HID_DESC);
-            break;
 
-        default:
+
+bool UsbDevMidi::send_event(
+const EventPacket   &event)
+{
+    return send_event(event, _timing ? UsbMidiTiming::now() : 0);
+}
+
+
+
+bool UsbDevMidi::send_event(
+const EventPacket   &event,
+const uint32_t       time )
+{
+    uint8_t     cable = event.cable_number();
+
+    if (cable >= CABLES)
+        return false;
+
+    if (_queue_counts[cable] == CABLE_QUEUE_SIZE) {
+        pack_events();
+        if (_queue_counts[cable] == CABLE_QUEUE_SIZE)
             return false;
     }
 
-    SET_SEND_OR_RECV:
-    if (_setup_packet->request_type.any(   SetupPacket
-                                        ::RequestType
-                                        ::DIR_DEV_TO_HOST))
-        _send_info.set(data, size);
-    else
-        _recv_info.set(const_cast<uint8_t*>(data), size);
+    uint8_t     tail = _queue_heads[cable] + _queue_counts[cable];
+
+    if (tail >= CABLE_QUEUE_SIZE)
+        tail -= CABLE_QUEUE_SIZE;
+
+    _queues     [cable][tail] = event;
+    _queue_times[cable][tail] = time ;
+    ++_queue_counts[cable];
+    ++_queued;
+
+    pack_events();
 
     return true;
-#else
-    return false;
-#endif
-}
+
+}  // send_event()
+
+
+
+void UsbDevMidi::midi_flush()
+{
+    if (!_out_count && !_queued)
+        return;
+
+    _out_flush = true;
+    midi_poll();
+
+}  // midi_flush()
+
+
+
+bool UsbDevMidi::midi_poll()
+{
+    if (_timing)
+        _timing->sof_poll();
+
+    bool    loaded = pack_events();
+
+    if (   (_out_flush || (_out_count && frame_number() != _out_frame))
+        && load_events()                                              ) {
+        loaded = true;
+        pack_events();  // refill from queues
+    }
+
+    return loaded;
+
+}  // midi_poll()
+
+
+
+bool UsbDevMidi::recv_event(
+EventPacket     &event,
+uint32_t        &time )
+{
+    bool    received;
+
+    if (_timing)
+        _timing->sof_poll();
+
+    if (_scheduler)
+        received = _scheduler->release(*this, event, time);
+    else
+        received = unpack_event(event, time);
+
+    if (received && _timing)
+        _timing->record(UsbMidiTiming::OUT, time, UsbMidiTiming::now());
+
+    return received;
+
+}  // recv_event()
+
+
+
+bool UsbDevMidi::unpack_event(
+EventPacket     &event,
+uint32_t        &time )
+{
+    while (true) {
+        if (_in_ndx + EVENT_SIZE > _in_length) {
+            _in_ndx = 0;
+            if (!(_in_length = recv(BULK_OUT_ENDPOINT                   ,
+                                    reinterpret_cast<uint8_t*>(_in_buf))))
+                return false;
+
+            // no SOF or endpoint interrupt timestamp, so start of frame
+            //   in which packet was read
+            _in_time = _timing ? _timing->frame_time() : 0;
+
+            continue;  // check length
+        }
+
+        const uint8_t   *bytes =   reinterpret_cast<uint8_t*>(_in_buf)
+                                 + _in_ndx                            ;
+
+        _in_ndx += EVENT_SIZE;
+
+        if ((bytes[0] & 0x0f) == 0)  // reserved CIN, e.g. padding
+            continue;
+
+        event._cable_code = bytes[0];
+        event._midi_0     = bytes[1];
+        event._midi_1     = bytes[2];
+        event._midi_2     = bytes[3];
+        time              = _in_time;
+
+        return true;
+    }
+
+}  // unpack_event()
+
 
 
 void UsbDev::set_configuration() {}
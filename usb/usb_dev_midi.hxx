@@ -21,6 +21,17 @@
 #ifndef USB_DEV_MIDI_HXX
 #define USB_DEV_MIDI_HXX
 
+// Number of virtual cables (embedded/external MIDI IN and OUT jack pairs)
+//   in descriptors, 1 through 16
+#ifndef USB_DEV_MIDI_CABLES
+#define USB_DEV_MIDI_CABLES         1
+#endif
+
+// Events queued per cable while bulk IN endpoint and next packet are full
+#ifndef USB_DEV_MIDI_CABLE_QUEUE
+#define USB_DEV_MIDI_CABLE_QUEUE    16
+#endif
+
 #include <usb_dev.hxx>
 
 #if USB_DEV_MAJOR_VERSION == 1
@@ -34,6 +45,35 @@
 
 namespace stm32f10_12357_xx {
 
+class UsbMidiTiming   ;  // usb_midi_timing.hxx
+class UsbMidiScheduler;
+
+
+// Event packets sent with send_event() are queued and packed up to
+//   EVENTS_PER_PACKET per bulk IN packet. A packet is loaded into the
+//   endpoint when full, after midi_flush(), or by midi_poll() once the
+//   USB frame number (SOF count) has advanced since its first event was
+//   queued, so no event waits more than about 1 ms. While the endpoint
+//   is busy the next packet fills in RAM. recv_event() similarly unpacks
+//   received bulk OUT packets, one event per call.
+//
+// Descriptors have CABLES (USB_DEV_MIDI_CABLES) virtual cables sharing
+//   the bulk endpoints. When the next packet is full, events wait in a
+//   per-cable queue of CABLE_QUEUE_SIZE, and are packed from the queues
+//   round-robin, one event per cable per turn, so a busy cable gets only
+//   its share of the endpoint and send_event() fails only for a cable
+//   whose own queue is full.
+//
+// Optionally (timing()), events are timestamped on entry and their
+//   latency counted in UsbMidiTiming histograms, which the host reads
+//   with VENDOR_REQ_GET_TIMING (device recipient, returns
+//   UsbMidiTiming::Report) and clears with VENDOR_REQ_RESET_TIMING. With
+//   a UsbMidiScheduler (scheduler()) recv_event() returns each received
+//   event a fixed delay after its arrival.
+//
+// send_event(), midi_flush(), midi_poll(), and recv_event() must be
+//   called from a single context.
+//
 class UsbDevMidi : public UsbDev
 {
   public:
@@ -41,16 +81,40 @@ class UsbDevMidi : public UsbDev
                             CLASS_SPECIFIC_INTERFACE_DESCRIPTOR__TYPE   = 0x24,
                             CLASS_SPECIFIC_ENDPOINT_DESCRIPTOR__TYPE    = 0x25,
                             BULK_OUT_ENDPOINT = 1,
-                            BULK_IN_ENDPOINT  = 1;  // or'd with 0x80
+                            BULK_IN_ENDPOINT  = 1,  // or'd with 0x80
+                            BULK_PACKET_SIZE  = 64,
+                            EVENT_SIZE        =  4,
+                            EVENTS_PER_PACKET = BULK_PACKET_SIZE / EVENT_SIZE,
+                            CABLES            = USB_DEV_MIDI_CABLES,
+                            CABLE_QUEUE_SIZE  = USB_DEV_MIDI_CABLE_QUEUE,
+                            VENDOR_REQ_GET_TIMING   = 0x01,
+                            VENDOR_REQ_RESET_TIMING = 0x02;
+
+    static_assert(CABLES >= 1 && CABLES <= 16, "bad USB_DEV_MIDI_CABLES");
 
     constexpr UsbDevMidi()
-    :   UsbDev      ( ),
-        _protocol   (0),
-        _idle_state (0)
+    :   UsbDev          (     ),
+        _out_buf        {0    },
+        _in_buf         {0    },
+        _queues         (     ),
+        _queue_times    {     },
+        _out_times      {0    },
+        _in_time        (0    ),
+        _timing         (0    ),
+        _scheduler      (0    ),
+        _out_frame      (0    ),
+        _in_length      (0    ),
+        _in_ndx         (0    ),
+        _queued         (0    ),
+        _out_count      (0    ),
+        _queue_heads    {0    },
+        _queue_counts   {0    },
+        _next_cable     (0    ),
+        _out_flush      (false),
+        _protocol       (0    ),
+        _idle_state     (0    )
     {}
 
-    bool init();
-
 
     // need public accessor for static initialization of _NEW_STRING_DESCS
     //
@@ -72,6 +136,11 @@ class UsbDevMidi : public UsbDev
             NOTE_OFF                    = 0x8,
             NOTE_ON                     = 0x9,
             POLY_KEYPRESS               = 0xA,
+            CONTROL_CHANGE              = 0xB,
+            PROGRAM_CHANGE              = 0xC,
+            CHANNEL_PRESSURE            = 0xD,
+            PITCH_BEND_CHANGE           = 0xE,
+            SINGLE_BYTE                 = 0xF,
         };
 
        constexpr EventPacket()
@@ -112,6 +181,12 @@ class UsbDevMidi : public UsbDev
                    const_cast      <const EventPacket*>(this)));
         }
 
+        uint8_t     cable_number() const { return _cable_code >>   4; }
+        CodeIndex   code_index  () const
+        {
+            return static_cast<CodeIndex>(_cable_code & 0xf);
+        }
+
         uint8_t     _cable_code,
                     _midi_0    ,
                     _midi_1    ,
@@ -119,8 +194,68 @@ class UsbDevMidi : public UsbDev
     };
 
 
+    // Queue event for BULK_IN_ENDPOINT. False if event's cable queue full
+    //   (endpoint busy and next packet already full), call again after
+    //   midi_poll(), or if cable_number() >= CABLES.
+    bool    send_event(const EventPacket    &event);
+
+    // As send_event() above, but event entered at "time" (see
+    //   UsbMidiTiming::now()) instead of now, e.g. when its last byte
+    //   arrived on a DIN port
+    bool    send_event(const EventPacket    &event,
+                       const uint32_t        time );
+
+    // Send queued events as soon as endpoint is free, without waiting
+    //   for packet to fill or next frame
+    void    midi_flush();
+
+    // Loads queued events into endpoint if due (see above). Call
+    //   frequently. True if packet loaded.
+    bool    midi_poll();
+
+    // Next event received on BULK_OUT_ENDPOINT, false if none (or if
+    //   scheduler() attached, none due yet)
+    bool    recv_event(EventPacket  &event)
+    {
+        uint32_t    time;
+
+        return recv_event(event, time);
+    }
+
+    // As recv_event() above, also returning event's arrival time
+    bool    recv_event(EventPacket  &event,
+                       uint32_t     &time );
+
+
+    // Timing statistics and scheduled output (usb_midi_timing.hxx), 0
+    //   for none (default). Timing requires UsbMidiTiming::init().
+    void              timing   (UsbMidiTiming      *timing   )
+    {
+        _timing = timing;
+    }
+    UsbMidiTiming*    timing   ()                               const
+    {
+        return _timing;
+    }
+    void              scheduler(UsbMidiScheduler   *scheduler)
+    {
+        _scheduler = scheduler;
+    }
+
+
+
+
   protected:
-    friend class UsbDev;
+    friend class UsbDev          ;
+    friend class UsbMidiScheduler;
+
+    bool    class_setup(),  // UsbDev::device_class_setup()
+            load_events(),
+            pack_events();  // from cable queues, round-robin
+
+    // next received event and its arrival time, without scheduling
+    bool    unpack_event(EventPacket    &event,
+                         uint32_t       &time );
 
     struct LineCoding {
         uint32_t    baud       ;
@@ -140,6 +275,29 @@ class UsbDevMidi : public UsbDev
                             _HID_DESC          [],
                             _REPORT_DESC       [];
 
+    // uint32_t for 16-bit PMA copy alignment
+    uint32_t    _out_buf     [BULK_PACKET_SIZE / 4],  // events being packed
+                _in_buf      [BULK_PACKET_SIZE / 4];  // last received packet
+    EventPacket _queues      [CABLES]
+                             [CABLE_QUEUE_SIZE];  // waiting for _out_buf
+    uint32_t    _queue_times [CABLES]
+                             [CABLE_QUEUE_SIZE],  // entry, UsbMidiTiming
+                _out_times   [EVENTS_PER_PACKET], //   "          "
+                _in_time     ;                    // _in_buf arrival
+    UsbMidiTiming
+               *_timing      ;
+    UsbMidiScheduler
+               *_scheduler   ;
+    uint16_t    _out_frame   ,                    // first _out_buf event
+                _in_length   ,
+                _in_ndx      ,
+                _queued      ;                    // total in _queues
+    uint8_t     _out_count   ,                    // events in _out_buf
+                _queue_heads [CABLES]          ,
+                _queue_counts[CABLES]          ,
+                _next_cable  ;                    // round-robin
+    bool        _out_flush   ;
+
     uint8_t     _protocol  ,
                 _idle_state;
 
@@ -0,0 +1,630 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_dev_msc.hxx>
+#include <usb_dev_descriptors.hxx>
+
+namespace stm32f10_12357_xx {
+
+const uint8_t UsbDev::_DEVICE_DESC[] = {
+    0x12,   // bLength
+    static_cast<uint8_t>(UsbDev::DescriptorType::DEVICE),
+    0x00,
+    0x02,   // bcdUSB = 2.00
+    0x00,   // bDeviceClass: defined by interface
+    0x00,   // bDeviceSubClass
+    0x00,   // bDeviceProtocol
+    0x40,   // bMaxPacketSize0
+    0x83,   // idVendor = 0x0483
+    0x04,   //    "     = MSB of uint16_t
+    0x20,   // idProduct = 0x5720
+    0x57,   //     "     = MSB of uint16_t
+    0x00,   // bcdDevice = 2.00
+    0x02,   //     "     = MSB of uint16_t
+    1,      // Index of string descriptor describing manufacturer
+    2,      // Index of string descriptor describing product
+    3,      // Index of string descriptor describing device serial number
+    0x01    // bNumConfigurations
+};
+
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0x08,       // bInterfaceClass: Mass Storage
+        0x06,       // bInterfaceSubClass: SCSI transparent command set
+        0x50,       // bInterfaceProtocol: Bulk-Only Transport
+        0,          // iInterface
+
+        usb_desc::endpoint(  UsbDevMsc::BULK_IN_ENDPOINT
+                           | UsbDev::ENDPOINT_DIR_IN,
+                           UsbDev::EndpointType::BULK,
+                           UsbDevMsc::DATA_SIZE,
+                           0),                  // bInterval: ignored for bulk
+
+        usb_desc::endpoint(UsbDevMsc::BULK_OUT_ENDPOINT,
+                           UsbDev::EndpointType::BULK,
+                           UsbDevMsc::DATA_SIZE,
+                           0)));                // bInterval: ignored for bulk
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t   UsbDevMsc::_device_string_desc[] = "STM32 Mass Storage";
+
+const uint8_t   *UsbDev::_STRING_DESCS[] = {
+    UsbDev   ::  language_id_string_desc(),
+    UsbDev   ::       vendor_string_desc(),
+    UsbDevMsc::       device_string_desc(),
+    UsbDev   ::serial_number_string_desc(),
+};
+
+// SCSI SPC-2 standard INQUIRY data
+const uint8_t   UsbDevMsc::_INQUIRY_DATA[_INQUIRY_SIZE + 1] = // + 1 for '\0'
+    "\x00"                  // peripheral device type: direct access block
+    "\x80"                  // RMB: removable medium
+    "\x04"                  // version: SPC-2
+    "\x02"                  // response data format
+    "\x1f"                  // additional length
+    "\x00\x00\x00"
+    USB_DEV_MSC_VENDOR      // T10 vendor identification, 8 chars
+    USB_DEV_MSC_PRODUCT     // product identification, 16 chars
+    USB_DEV_MSC_REVISION;   // product revision level, 4 chars
+
+static_assert(sizeof(USB_DEV_MSC_VENDOR  ) ==  8 + 1 &&
+              sizeof(USB_DEV_MSC_PRODUCT ) == 16 + 1 &&
+              sizeof(USB_DEV_MSC_REVISION) ==  4 + 1,
+              "USB_DEV_MSC_VENDOR, _PRODUCT, or _REVISION wrong length");
+
+
+
+
+bool UsbDevMsc::class_setup()
+{
+    static const uint8_t    MAX_LUN = 0;  // single logical unit
+
+    if (!  _setup_packet
+         ->request_type
+         . all(  SetupPacket::RequestType::TYPE_CLASS
+               | SetupPacket::RequestType::RECIPIENT_INTERFACE))
+        return false;
+
+    switch (_setup_packet->request) {
+        case _GET_MAX_LUN:
+            _send_info.set(&MAX_LUN, sizeof(MAX_LUN));
+            return true;
+
+        case _BULK_ONLY_RESET:
+            // BOT 3.1: data toggles and halts unchanged, host clears them
+            unwedge(BULK_OUT_ENDPOINT                  );
+            unwedge(BULK_IN_ENDPOINT  | ENDPOINT_DIR_IN);
+            reset_endpoint(BULK_OUT_ENDPOINT                             ,
+                           false                                         ,
+                           halted(BULK_OUT_ENDPOINT                  )   );
+            reset_endpoint(BULK_IN_ENDPOINT  | ENDPOINT_DIR_IN           ,
+                           false                                         ,
+                           halted(BULK_IN_ENDPOINT  | ENDPOINT_DIR_IN)   );
+            _restart = true;
+            _recv_info.set(0, 0);
+            return true;
+
+        default:
+            return false;
+    }
+
+}  // class_setup()
+
+
+
+void UsbDevMsc::restart()
+{
+    // clear first so no SET_CONFIGURATION or reset is missed
+    _restart = false;
+
+    _state           = State::CBW      ;
+    _block_states[0] = BlockState::EMPTY;
+    _block_states[1] = BlockState::EMPTY;
+    _usb_blocks      = 0                ;
+    _io_blocks       = 0                ;
+
+}  // restart()
+
+
+
+// Check host's expected data stage (CBW dCBWDataTransferLength and
+//   direction) against device's, BOT 6.7 "thirteen cases"
+bool UsbDevMsc::data_phase(
+const uint32_t  bytes  ,
+const bool      to_host)
+{
+    if (bytes > _residue || (bytes && to_host != _to_host)) {
+        // host's data stage ended by STALL, CSW sent after it clears halt
+        if (_residue)
+            halt_endpoint(  _to_host
+                          ? BULK_IN_ENDPOINT | ENDPOINT_DIR_IN
+                          : BULK_OUT_ENDPOINT                 );
+        _status = _CSW_PHASE_ERROR;
+        _state  = State::CSW      ;
+        return false;
+    }
+
+    return true;
+
+}  // data_phase()
+
+
+
+// Finish data stage: host's remaining IN data ended by short (possibly
+//   zero-length) packet, remaining OUT data received and dropped
+void UsbDevMsc::end_data()
+{
+    if (!_residue)
+        _state = State::CSW;
+    else if (_to_host) {
+        _response_size = 0       ;
+        _state        = State::RESPONSE;
+    }
+    else
+        _state = State::DISCARD;
+
+}  // end_data()
+
+
+
+void UsbDevMsc::fail(
+const uint8_t   sense_key,
+const uint8_t   asc      )
+{
+    _sense_key = sense_key   ;
+    _sense_asc = asc         ;
+    _status    = _CSW_FAILED ;
+
+    end_data();
+
+}  // fail()
+
+
+
+// Response already built in _packet
+void UsbDevMsc::respond(
+      uint8_t   size      ,
+const uint16_t  allocation)  // CDB allocation length
+{
+    if (size > allocation)
+        size = allocation;
+
+    if (!data_phase(size, true))
+        return;
+
+    if (size) {
+        _response_size = size           ;
+        _state         = State::RESPONSE;
+    }
+    else
+        end_data();
+
+}  // respond()
+
+
+
+void UsbDevMsc::command(
+const uint16_t  length)
+{
+    const uint8_t   *cbw = packet()  ,
+                    *cdb = cbw + 15  ;  // CBWCB
+
+    // CBW fields at 4-byte aligned offsets, little-endian like MCU.
+    //   Invalid (BOT 6.2.1) or not meaningful (6.2.2: bCBWLUN,
+    //   bCBWCBLength) CBW halts both endpoints until reset recovery.
+    if (   length != _CBW_SIZE
+        || _packet[0] != _CBW_SIGNATURE
+        || (cbw[13] & 0x0f) != 0
+        || cbw[14] == 0
+        || cbw[14] >  16               ) {
+        halt_endpoint(BULK_IN_ENDPOINT | ENDPOINT_DIR_IN, true);
+        halt_endpoint(BULK_OUT_ENDPOINT                 , true);
+        return;
+    }
+    uint8_t         *response = packet();  // overwrites CBW
+    uint8_t          opcode   = cdb[0]  ;
+
+    _tag     =  _packet[1]               ;
+    _residue =  _packet[2]               ;  // dCBWDataTransferLength
+    _to_host =  cbw[12] & _CBW_DIR_IN    ;  // bmCBWFlags
+    _status  =  _CSW_PASSED              ;
+
+    if (opcode != _REQUEST_SENSE)
+        _sense_key = _sense_asc = 0;
+
+    switch (opcode) {
+        case _TEST_UNIT_READY:
+            if (medium_present())
+                end_data();
+            else
+                fail(_NOT_READY, _MEDIUM_NOT_PRESENT);
+            break;
+
+        case _REQUEST_SENSE: {
+            uint8_t     allocation = cdb[4];
+
+            for (uint8_t ndx = 0 ; ndx < _SENSE_SIZE ; ++ndx)
+                response[ndx] = 0;
+            response[ 0] = 0x70      ;  // current errors, fixed format
+            response[ 2] = _sense_key;
+            response[ 7] = _SENSE_SIZE - 8;  // additional sense length
+            response[12] = _sense_asc;
+
+            _sense_key = _sense_asc = 0;
+
+            respond(_SENSE_SIZE, allocation);
+            break;
+        }
+
+        case _INQUIRY: {
+            uint16_t    allocation = get16(cdb + 3);
+
+            if (cdb[1] & 0x01) {  // EVPD, vital product data not supported
+                fail(_ILLEGAL_REQUEST, _INVALID_FIELD_IN_CDB);
+                break;
+            }
+
+            for (uint8_t ndx = 0 ; ndx < _INQUIRY_SIZE ; ++ndx)
+                response[ndx] = _INQUIRY_DATA[ndx];
+
+            respond(_INQUIRY_SIZE, allocation);
+            break;
+        }
+
+        case _MODE_SENSE_6: {
+            uint8_t     allocation = cdb[4];
+
+            response[0] = 3   ;  // mode data length
+            response[1] = 0   ;  // medium type
+            response[2] = _block_device.write ? 0 : 0x80;  // WP
+            response[3] = 0   ;  // block descriptor length
+
+            respond(4, allocation);
+            break;
+        }
+
+        case _MODE_SENSE_10: {
+            uint16_t    allocation = get16(cdb + 7);
+
+            for (uint8_t ndx = 0 ; ndx < 8 ; ++ndx)
+                response[ndx] = 0;
+            response[1] = 6   ;  // mode data length
+            response[3] = _block_device.write ? 0 : 0x80;  // WP
+
+            respond(8, allocation);
+            break;
+        }
+
+        case _READ_CAPACITY_10:
+            if (!medium_present()) {
+                fail(_NOT_READY, _MEDIUM_NOT_PRESENT);
+                break;
+            }
+
+            put32(response    , _block_device.num_blocks - 1);  // last LBA
+            put32(response + 4, BLOCK_SIZE                  );
+
+            respond(8, 8);
+            break;
+
+        case _READ_10:
+        case _WRITE_10: {
+            uint32_t    lba   = get32(cdb + 2);
+            uint16_t    count = get16(cdb + 7);
+            bool        read  = opcode == _READ_10;
+
+            if (!data_phase(count * BLOCK_SIZE, read))
+                break;
+
+            if (!medium_present()) {
+                fail(_NOT_READY, _MEDIUM_NOT_PRESENT);
+                break;
+            }
+
+            if (   lba   >  _block_device.num_blocks
+                || count >  _block_device.num_blocks - lba) {
+                fail(_ILLEGAL_REQUEST, _LBA_OUT_OF_RANGE);
+                break;
+            }
+
+            if (!read && !_block_device.write) {
+                fail(_DATA_PROTECT, _WRITE_PROTECTED);
+                break;
+            }
+
+            if (!count) {
+                end_data();
+                break;
+            }
+
+            _lba             = lba              ;
+            _usb_blocks      = count            ;
+            _io_blocks       = count            ;
+            _usb_offset      = 0                ;
+            _usb_buffer      = 0                ;
+            _io_buffer       = 0                ;
+            _block_states[0] = BlockState::EMPTY;
+            _block_states[1] = BlockState::EMPTY;
+            _state           = read ? State::DATA_IN : State::DATA_OUT;
+            break;
+        }
+
+        case _PREVENT_ALLOW_REMOVAL:
+        case _START_STOP_UNIT:
+        case _SYNCHRONIZE_CACHE_10:
+        case _VERIFY_10:
+            end_data();
+            break;
+
+        default:
+            fail(_ILLEGAL_REQUEST, _INVALID_OPCODE);
+            break;
+    }
+
+}  // command()
+
+
+
+// Read one block, either the one waiting to be sent or the next one
+//   (prefetch, while current is being sent by send_blocks())
+void UsbDevMsc::read_blocks()
+{
+    if (!_io_blocks || _block_states[_io_buffer] != BlockState::EMPTY)
+        return;
+
+    switch (_block_device.read(_lba                     ,
+                               block(_io_buffer)        ,
+                               _block_device.user_data  )) {
+        case BlockStatus::OK:
+            _block_states[_io_buffer] = BlockState::FULL;
+            _io_buffer ^= 1;
+            ++_lba;
+            --_io_blocks;
+            break;
+
+        case BlockStatus::BUSY:
+            break;
+
+        case BlockStatus::ERROR:
+            _block_states[_io_buffer] = BlockState::ERROR;  // when sent
+            _io_blocks                = 0                ;
+            break;
+    }
+
+}  // read_blocks()
+
+
+
+void UsbDevMsc::send_blocks()
+{
+    // as many packets as endpoint buffers free (two, double-buffered)
+    while (   _block_states[_usb_buffer] == BlockState::FULL
+           && send(BULK_IN_ENDPOINT                    ,
+                   block(_usb_buffer) + _usb_offset    ,
+                   DATA_SIZE                           )) {
+        _usb_offset += DATA_SIZE;
+        _residue    -= DATA_SIZE;
+
+        if (_usb_offset < BLOCK_SIZE)
+            continue;
+
+        _block_states[_usb_buffer] = BlockState::EMPTY;
+        _usb_buffer ^= 1;
+        _usb_offset  = 0;
+
+        if (!--_usb_blocks) {
+            end_data();
+            return;
+        }
+    }
+
+    if (_block_states[_usb_buffer] == BlockState::ERROR) {
+        _block_states[_usb_buffer] = BlockState::EMPTY;
+        _usb_blocks                = 0                ;
+        fail(_MEDIUM_ERROR, _UNRECOVERED_READ_ERROR);
+    }
+
+}  // send_blocks()
+
+
+
+void UsbDevMsc::recv_blocks()
+{
+    while (   _usb_blocks
+           && _block_states[_usb_buffer] == BlockState::EMPTY
+           && recv_ready(1 << BULK_OUT_ENDPOINT)             ) {
+        uint16_t    length = recv(BULK_OUT_ENDPOINT                ,
+                                  block(_usb_buffer) + _usb_offset);
+
+        if (length != DATA_SIZE) {
+            // host ended data stage early, can't happen if CBW valid
+            _usb_blocks = _io_blocks = 0   ;
+            _residue    = 0                ;
+            _status     = _CSW_PHASE_ERROR ;
+            _state      = State::CSW       ;
+            return;
+        }
+
+        _usb_offset += DATA_SIZE;
+        _residue    -= DATA_SIZE;
+
+        if (_usb_offset == BLOCK_SIZE) {
+            _block_states[_usb_buffer] = BlockState::FULL;
+            _usb_buffer ^= 1;
+            _usb_offset  = 0;
+            --_usb_blocks;
+        }
+    }
+
+}  // recv_blocks()
+
+
+
+// Write one block while next is being received by recv_blocks()
+void UsbDevMsc::write_blocks()
+{
+    if (_block_states[_io_buffer] == BlockState::FULL) {
+        switch (_block_device.write(_lba                    ,
+                                    block(_io_buffer)       ,
+                                    _block_device.user_data )) {
+            case BlockStatus::OK:
+                _block_states[_io_buffer] = BlockState::EMPTY;
+                _io_buffer ^= 1;
+                ++_lba;
+                --_io_blocks;
+                break;
+
+            case BlockStatus::BUSY:
+                return;
+
+            case BlockStatus::ERROR:
+                _block_states[0] = BlockState::EMPTY;
+                _block_states[1] = BlockState::EMPTY;
+                _usb_blocks      = _io_blocks = 0   ;
+                fail(_MEDIUM_ERROR, _WRITE_ERROR);  // discards rest of data
+                return;
+        }
+    }
+
+    if (!_io_blocks)
+        end_data();
+
+}  // write_blocks()
+
+
+
+void UsbDevMsc::send_response()
+{
+    if (!send(BULK_IN_ENDPOINT, packet(), _response_size))
+        return;
+
+    _residue -= _response_size;
+
+    // full packet needs zero-length one after if host expects more
+    if (_response_size == DATA_SIZE)
+        end_data();
+    else
+        _state = State::CSW;
+
+}  // send_response()
+
+
+
+void UsbDevMsc::discard()
+{
+    while (recv_ready(1 << BULK_OUT_ENDPOINT)) {
+        uint16_t    length = recv(BULK_OUT_ENDPOINT, packet());
+
+        _residue = length < _residue ? _residue - length : 0;
+
+        if (length < DATA_SIZE || !_residue) {
+            _state = State::CSW;
+            return;
+        }
+    }
+
+}  // discard()
+
+
+
+void UsbDevMsc::send_csw()
+{
+    if (!send_ready(1 << BULK_IN_ENDPOINT))
+        return;
+
+    _packet[0]   = _CSW_SIGNATURE;  // little-endian like MCU
+    _packet[1]   = _tag          ;
+    _packet[2]   = _residue      ;  // dCSWDataResidue
+    packet()[12] = _status       ;
+
+    send(BULK_IN_ENDPOINT, packet(), _CSW_SIZE);
+
+    _state = State::CBW;
+
+}  // send_csw()
+
+
+
+void UsbDevMsc::msc_poll()
+{
+    if (_restart)
+        restart();
+
+    if (device_state() != DeviceState::CONFIGURED)
+        return;
+
+    switch (_state) {
+        case State::CBW:
+            if (recv_ready(1 << BULK_OUT_ENDPOINT))
+                command(recv(BULK_OUT_ENDPOINT, packet()));
+            break;
+
+        case State::DATA_IN:
+            send_blocks();
+            if (_state == State::DATA_IN)
+                read_blocks();  // prefetch next while above streams
+            break;
+
+        case State::DATA_OUT:
+            recv_blocks();
+            if (_state == State::DATA_OUT)
+                write_blocks();
+            break;
+
+        case State::RESPONSE:
+            send_response();
+            break;
+
+        case State::DISCARD:
+            discard();
+            break;
+
+        case State::CSW:
+            send_csw();
+            break;
+    }
+
+}  // msc_poll()
+
+
+
+bool UsbDev::device_class_setup()
+{
+    return static_cast<UsbDevMsc*>(this)->class_setup();
+}
+
+
+void UsbDev::set_configuration()
+{
+    static_cast<UsbDevMsc*>(this)->_restart = true;
+}
+
+void UsbDev::set_interface    () {}
+
+
+}  // namespace stm32f10_12357_xx {
@@ -0,0 +1,307 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DEV_MSC_HXX
+#define USB_DEV_MSC_HXX
+
+
+// SCSI INQUIRY identification strings, space padded to exactly 8, 16,
+//   and 4 characters
+#ifndef USB_DEV_MSC_VENDOR
+#define USB_DEV_MSC_VENDOR      "STM32   "
+#endif
+#ifndef USB_DEV_MSC_PRODUCT
+#define USB_DEV_MSC_PRODUCT     "Mass Storage    "
+#endif
+#ifndef USB_DEV_MSC_REVISION
+#define USB_DEV_MSC_REVISION    "1.3 "
+#endif
+
+
+#include <usb_dev.hxx>
+
+#if USB_DEV_MAJOR_VERSION == 1
+#if USB_DEV_MINOR_VERSION  < 0
+#warning USB_DEV_MINOR_VERSION < 0 with required USB_DEV_MAJOR_VERSION == 1
+#endif
+#else
+#error USB_DEV_MAJOR_VERSION != 1
+#endif
+
+
+
+namespace stm32f10_12357_xx {
+
+// USB Mass Storage Class, Bulk-Only Transport (BOT), SCSI transparent
+//   command set, single LUN, 512 byte blocks.
+//
+// SCSI commands: TEST UNIT READY, REQUEST SENSE, INQUIRY, MODE SENSE(6),
+//   MODE SENSE(10), READ CAPACITY(10), READ(10), WRITE(10), plus PREVENT
+//   ALLOW MEDIUM REMOVAL, START STOP UNIT, SYNCHRONIZE CACHE(10), and
+//   VERIFY(10) which are accepted and ignored. Others fail with ILLEGAL
+//   REQUEST sense.
+//
+// Storage is supplied by client's BlockDevice (see below). Data moves
+//   through two RAM block buffers so block device I/O overlaps USB
+//   transfers: while one block streams over bulk IN a packet at a time
+//   the next is read into the other buffer, and while one block is
+//   being written the next is received. Both bulk endpoints are
+//   double-buffered in PMA.
+//
+// Data stages the device ends early are terminated with a short packet
+//   (IN) or received and discarded (OUT), and the CSW residue reports
+//   the difference. Phase errors (BOT 6.7) STALL the host's data stage
+//   endpoint before the CSW. Invalid or not meaningful CBWs STALL both
+//   bulk endpoints until Bulk-Only Mass Storage Reset (BOT 6.6.1), see
+//   UsbDev::halt_endpoint().
+//
+// msc_poll() runs the BOT state machine and calls the BlockDevice
+//   functions. Call frequently from main loop (after UsbDev::poll() if
+//   not USB_DEV_INTERRUPT_DRIVEN).
+//
+class UsbDevMsc : public UsbDev
+{
+  public:
+    static const uint8_t    // have to be public for clients, static descriptors
+                            BULK_IN_ENDPOINT  =  1,
+                            BULK_OUT_ENDPOINT =  2,
+                            DATA_SIZE         = 64;
+
+    static const uint16_t   BLOCK_SIZE        = 512;
+
+    static_assert(BLOCK_SIZE % DATA_SIZE == 0,
+                  "BLOCK_SIZE must be multiple of DATA_SIZE");
+
+    // OK:      block transferred
+    // BUSY:    not done, call will be repeated with same arguments
+    // ERROR:   reported to host as medium error
+    enum class BlockStatus : uint8_t {
+        OK   ,
+        BUSY ,
+        ERROR,
+    };
+
+    // "block" is BLOCK_SIZE bytes, 4-byte aligned. Called from msc_poll().
+    typedef BlockStatus (*ReadBlock )(const uint32_t         lba      ,
+                                            uint8_t         *block    ,
+                                            void            *user_data);
+    typedef BlockStatus (*WriteBlock)(const uint32_t         lba      ,
+                                      const uint8_t         *block    ,
+                                            void            *user_data);
+
+    struct BlockDevice {
+        ReadBlock    read      ;  // 0 if no medium
+        WriteBlock   write     ;  // 0 if write protected
+        uint32_t     num_blocks;
+        void        *user_data ;
+    };
+
+    constexpr UsbDevMsc()
+    :   UsbDev         (  (1 << BULK_IN_ENDPOINT )
+                        | (1 << BULK_OUT_ENDPOINT)),
+        _block_device  {0, 0, 0, 0 },
+        _packet        {0          },
+        _blocks        {{0}        },
+        _block_states  {BlockState::EMPTY, BlockState::EMPTY},
+        _state         (State::CBW ),
+        _restart       (true       ),
+        _to_host       (false      ),
+        _status        (0          ),
+        _sense_key     (0          ),
+        _sense_asc     (0          ),
+        _tag           (0          ),
+        _residue       (0          ),
+        _lba           (0          ),
+        _usb_blocks    (0          ),
+        _io_blocks     (0          ),
+        _usb_offset    (0          ),
+        _usb_buffer    (0          ),
+        _io_buffer     (0          ),
+        _response_size (0          )
+    {}
+
+
+    // Set before host accesses medium (typically before init())
+    void block_device(
+    const BlockDevice   &block_device)
+    {
+        _block_device = block_device;
+    }
+
+    const BlockDevice& block_device() const { return _block_device; }
+
+    // Runs BOT state machine and block device I/O. Call frequently.
+    void    msc_poll();
+
+
+    // need public accessor for static initialization of _STRING_DESCS
+    //
+    static constexpr const uint8_t* device_string_desc()
+    {
+        return _device_string_desc;
+    }
+
+
+
+
+  protected:
+    friend class UsbDev;
+
+    enum class State : uint8_t {
+        CBW     ,   // waiting for command block wrapper
+        DATA_IN ,   // blocks to host
+        DATA_OUT,   // blocks from host
+        RESPONSE,   // _response_size bytes of _packet to host
+        DISCARD ,   // remaining OUT data stage
+        CSW     ,   // command status wrapper to host
+    };
+
+    enum class BlockState : uint8_t {
+        EMPTY,
+        FULL ,
+        ERROR,
+    };
+
+    // USB MSC BOT 1.0, 3.1 and 3.2
+    static const uint8_t    _GET_MAX_LUN            = 0xfe,
+                            _BULK_ONLY_RESET        = 0xff,
+                            _CBW_SIZE               = 31  ,
+                            _CSW_SIZE               = 13  ,
+                            _CBW_DIR_IN             = 0x80,
+                            _CSW_PASSED             = 0   ,
+                            _CSW_FAILED             = 1   ,
+                            _CSW_PHASE_ERROR        = 2   ;
+
+    static const uint32_t   _CBW_SIGNATURE          = 0x43425355,  // "USBC"
+                            _CSW_SIGNATURE          = 0x53425355;  // "USBS"
+
+    // SCSI operation codes
+    static const uint8_t    _TEST_UNIT_READY        = 0x00,
+                            _REQUEST_SENSE          = 0x03,
+                            _INQUIRY                = 0x12,
+                            _MODE_SENSE_6           = 0x1a,
+                            _START_STOP_UNIT        = 0x1b,
+                            _PREVENT_ALLOW_REMOVAL  = 0x1e,
+                            _READ_CAPACITY_10       = 0x25,
+                            _READ_10                = 0x28,
+                            _WRITE_10               = 0x2a,
+                            _VERIFY_10              = 0x2f,
+                            _SYNCHRONIZE_CACHE_10   = 0x35,
+                            _MODE_SENSE_10          = 0x5a;
+
+    // SCSI sense keys and additional sense codes
+    static const uint8_t    _NOT_READY              = 0x02,
+                            _MEDIUM_ERROR           = 0x03,
+                            _ILLEGAL_REQUEST        = 0x05,
+                            _DATA_PROTECT           = 0x07,
+                            _WRITE_ERROR            = 0x0c,  // ASCs
+                            _UNRECOVERED_READ_ERROR = 0x11,
+                            _INVALID_OPCODE         = 0x20,
+                            _LBA_OUT_OF_RANGE       = 0x21,
+                            _INVALID_FIELD_IN_CDB   = 0x24,
+                            _WRITE_PROTECTED        = 0x27,
+                            _MEDIUM_NOT_PRESENT     = 0x3a;
+
+    static const uint8_t    _SENSE_SIZE             = 18,
+                            _INQUIRY_SIZE           = 36;
+
+    static uint32_t get32(const uint8_t    *bytes)  // SCSI big-endian
+    {
+        return (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    }
+
+    static uint16_t get16(const uint8_t    *bytes)
+    {
+        return (bytes[0] << 8) | bytes[1];
+    }
+
+    static void put32(uint8_t   *bytes, const uint32_t    value)
+    {
+        bytes[0] = value >> 24        ;
+        bytes[1] = (value >> 16) & 0xff;
+        bytes[2] = (value >>  8) & 0xff;
+        bytes[3] = value         & 0xff;
+    }
+
+    uint8_t* packet()
+    {
+        return reinterpret_cast<uint8_t*>(_packet);
+    }
+
+    uint8_t* block(const uint8_t    ndx)
+    {
+        return reinterpret_cast<uint8_t*>(_blocks[ndx]);
+    }
+
+    bool medium_present() const
+    {
+        return _block_device.read != 0 && _block_device.num_blocks != 0;
+    }
+
+    bool    class_setup  ();  // UsbDev::device_class_setup()
+    void    restart      ();
+    void    command      (const uint16_t     length);
+    bool    data_phase   (const uint32_t     bytes ,
+                          const bool         to_host);
+    void    respond      (const uint8_t      size  ,
+                          const uint16_t     allocation);
+    void    fail         (const uint8_t      sense_key,
+                          const uint8_t      asc      );
+    void    end_data     ();
+    void    read_blocks  ();
+    void    write_blocks ();
+    void    send_blocks  ();
+    void    recv_blocks  ();
+    void    send_response();
+    void    discard      ();
+    void    send_csw     ();
+
+
+    static const uint8_t    _device_string_desc[],
+                            _INQUIRY_DATA      [];
+
+    BlockDevice             _block_device;
+
+    // CBW, CSW, and short responses, uint32_t for 16-bit PMA copy alignment
+    uint32_t                _packet      [DATA_SIZE / 4]               ;
+    uint32_t                _blocks      [2][BLOCK_SIZE / 4]           ;
+    BlockState              _block_states[2]                           ;
+
+    State                   _state        ;
+    volatile bool           _restart      ;  // set by interrupt
+    bool                    _to_host      ;  // CBW direction
+    uint8_t                 _status       ,  // CSW bCSWStatus
+                            _sense_key    ,
+                            _sense_asc    ;
+    uint32_t                _tag          ,  // CBW dCBWTag
+                            _residue      ,  // bytes of data stage left
+                            _lba          ,  // next block device I/O
+                            _usb_blocks   ,  // left to transfer on USB
+                            _io_blocks    ;  //   "   "  read/write
+    uint16_t                _usb_offset   ;  // in _usb_buffer
+    uint8_t                 _usb_buffer   ,  // block buffer on USB
+                            _io_buffer    ,  //   "     "    in I/O
+                            _response_size;
+
+};  // class UsbDevMsc
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DEV_MSC_HXX
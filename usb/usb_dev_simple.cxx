@@ -19,6 +19,7 @@
 
 
 #include <usb_dev_simple.hxx>
+#include <usb_dev_descriptors.hxx>
 
 namespace stm32f10_12357_xx {
 
@@ -43,55 +44,34 @@ const uint8_t UsbDev::_DEVICE_DESC[] = {
     0x01    // bNumConfigurations
 };
 
-uint8_t UsbDev::_CONFIG_DESC[] = {  // not const because set total size entry
-    // Configuration Descriptor
-    0x09,   // bLength: Configuration Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::CONFIGURATION),
-    0,      // wTotalLength: including sub-descriptors, will be set a runtime
-    0x00,   //      "      : MSB of uint16_t
-    0x01,   // bNumInterfaces: 1 interface
-    0x01,   // bConfigurationValue: Configuration value
-    0x00,   // iConfiguration: string descriptor index: none
-    0xC0,   // bmAttributes: self powered
-    0x32,   // MaxPower 100 mA (value==mA*0.5)
-
-    // Interface Descriptor
-    0x09,   // bLength: Interface Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::INTERFACE),
-    0x00,   // bInterfaceNumber: Number of Interface
-    0x00,   // bAlternateSetting: Alternate setting
-    0x02,   // bNumEndpoints: 2
-    0xff,   // bInterfaceClass: vendor specific
-    0x00,   // bInterfaceSubClass: not used
-    0xff,   // bInterfaceProtocol: vendor specific
-    0x00,   // iInterface: string descriptor index: none
-
-    // IN endpoint
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevSimple::IN_ENDPOINT | UsbDev::ENDPOINT_DIR_IN,    // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevSimple::IN_ENDPOINT_MAX_PACKET,   // wMaxPacketSize: 64 bytes
-    0x00,                                   //       "       : MSB of uint16_t
-    UsbDevSimple::IN_ENDPOINT_INTERVAL,     // bInterval: set in .hxx file
-
-    // OUT endpoint
-    0x07,   // bLength: Endpoint Descriptor size
-    static_cast<uint8_t>(UsbDev::DescriptorType::ENDPOINT), // bDescriptorType
-    UsbDevSimple::OUT_ENDPOINT,                             // bEndpointAddress
-    static_cast<uint8_t>(UsbDev::EndpointType::INTERRUPT),  // bmAttributes
-    UsbDevSimple::OUT_ENDPOINT_MAX_PACKET,  // wMaxPacketSize: 64 bytes
-    0x00,                                   //       "       : MSB of uint16_t
-    UsbDevSimple::OUT_ENDPOINT_INTERVAL,    // bInterval: set in .hxx file
-};
+static constexpr auto   config_desc = usb_desc::configuration(
+    1,              // bConfigurationValue
+    0,              // iConfiguration: no string descriptor
+    0xc0,           // bmAttributes: self powered
+    100,            // MaxPower: mA
+
+    usb_desc::interface(
+        0,          // bInterfaceNumber
+        0,          // bAlternateSetting
+        0xff,       // bInterfaceClass: vendor specific
+        0x00,       // bInterfaceSubClass: not used
+        0xff,       // bInterfaceProtocol: vendor specific
+        0,          // iInterface
+
+        usb_desc::endpoint(  UsbDevSimple::IN_ENDPOINT
+                           | UsbDev::ENDPOINT_DIR_IN,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevSimple::IN_ENDPOINT_MAX_PACKET,
+                           UsbDevSimple::IN_ENDPOINT_INTERVAL),
 
-const uint8_t   UsbDevSimple::_device_string_desc[] = {
-                34,
-                static_cast<uint8_t>(UsbDev::DescriptorType::STRING),
-                'S', 0, 'T', 0, 'M', 0, '3', 0,
-                '2', 0, ' ', 0, 'S', 0, 'i', 0,
-                'm', 0, 'p', 0, 'l', 0, 'e', 0,
-                ' ', 0, 'U', 0, 'S', 0, 'B', 0};     // "STM32 Simple USB"
+        usb_desc::endpoint(UsbDevSimple::OUT_ENDPOINT,
+                           UsbDev::EndpointType::INTERRUPT,
+                           UsbDevSimple::OUT_ENDPOINT_MAX_PACKET,
+                           UsbDevSimple::OUT_ENDPOINT_INTERVAL)));
+
+const uint8_t* const    UsbDev::_CONFIG_DESC = config_desc.bytes;
+
+const uint8_t   UsbDevSimple::_device_string_desc[] = "STM32 Simple USB";
 
 const uint8_t   *UsbDev::_STRING_DESCS[] = {
     UsbDev      ::  language_id_string_desc(),
@@ -102,15 +82,6 @@ const uint8_t   *UsbDev::_STRING_DESCS[] = {
 
 
 
-bool UsbDevSimple::init()
-{
-    _CONFIG_DESC[UsbDev::CONFIG_DESC_SIZE_NDX]  = sizeof(_CONFIG_DESC);
-
-    return UsbDev::init();
-}
-
-
-
 bool UsbDev::device_class_setup()
 {
     return false;  // no class-specific setup
@@ -50,8 +50,6 @@ class UsbDevSimple : public UsbDev
     :   UsbDev()
     {}
 
-    bool init();
-
 
     // need public accessor for static initialization of _NEW_STRING_DESCS
     //
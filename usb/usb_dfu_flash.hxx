@@ -0,0 +1,117 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_DFU_FLASH_HXX
+#define USB_DFU_FLASH_HXX
+
+#include <stm32f103xb.hxx>
+
+#include <usb_dev_dfu.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// STM32F103 internal flash as UsbDevDfu::Flash, e.g:
+//
+//       usb_dev.flash(UsbDfuFlash::flash());
+//
+// Flash is unlocked for each operation and locked again when status()
+//   reports it complete.
+//
+class UsbDfuFlash
+{
+  public:
+    static UsbDevDfu::Flash flash()
+    {
+        return UsbDevDfu::Flash{erase, program, status, memory, 0};
+    }
+
+
+  protected:
+    static const uint32_t   _KEY1 = 0x45670123,
+                            _KEY2 = 0xcdef89ab;
+
+    static void unlock()
+    {
+        if (stm32f103xb::flash->cr.any(stm32f103xb::Flash::Cr::LOCK)) {
+            stm32f103xb::flash->keyr = _KEY1;
+            stm32f103xb::flash->keyr = _KEY2;
+        }
+    }
+
+    static void erase(
+    const uint32_t   address  ,
+          void      *          )
+    {
+        unlock();
+
+        stm32f103xb::flash->cr.set(stm32f103xb::Flash::Cr::PER );
+        stm32f103xb::flash->ar = address;
+        stm32f103xb::flash->cr.set(stm32f103xb::Flash::Cr::STRT);
+    }
+
+    static void program(
+    const uint32_t   address  ,
+    const uint16_t   halfword ,
+          void      *          )
+    {
+        unlock();
+
+        stm32f103xb::flash->cr.set(stm32f103xb::Flash::Cr::PG);
+        *reinterpret_cast<volatile uint16_t*>(address) = halfword;
+    }
+
+    static UsbDevDfu::FlashStatus status(
+    void    *          )
+    {
+        if (stm32f103xb::flash->sr.any(stm32f103xb::Flash::Sr::BSY))
+            return UsbDevDfu::FlashStatus::BUSY;
+
+        bool    failed =    stm32f103xb::flash->sr.any(
+                                stm32f103xb::Flash::Sr::PGERR   )
+                         || stm32f103xb::flash->sr.any(
+                                stm32f103xb::Flash::Sr::WRPRTERR);
+
+        // status flags cleared by writing 1
+        stm32f103xb::flash->sr =   stm32f103xb::Flash::Sr::PGERR
+                                 | stm32f103xb::Flash::Sr::WRPRTERR
+                                 | stm32f103xb::Flash::Sr::EOP     ;
+
+        stm32f103xb::flash->cr.clr(stm32f103xb::Flash::Cr::PER );
+        stm32f103xb::flash->cr.clr(stm32f103xb::Flash::Cr::PG  );
+        stm32f103xb::flash->cr.set(stm32f103xb::Flash::Cr::LOCK);
+
+        return   failed
+               ? UsbDevDfu::FlashStatus::ERROR
+               : UsbDevDfu::FlashStatus::OK   ;
+    }
+
+    static const uint8_t* memory(
+    const uint32_t   address  ,
+          void      *          )
+    {
+        return reinterpret_cast<const uint8_t*>(address);
+    }
+
+};  // class UsbDfuFlash
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_DFU_FLASH_HXX
@@ -0,0 +1,420 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_HID_REPORT_HXX
+#define USB_HID_REPORT_HXX
+
+#include <usb_dev_descriptors.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Compile-time builders for HID report descriptors, and matching report
+//   layouts.
+//
+// Item builders (usage_page<>(), usage<>(), collection<>(), etc) return
+//   usb_desc::DescBytes blocks, using the shortest HID 1.11 short item
+//   encoding for their value. A report is declared as a Report<> of
+//   Field<> and Padding<> types, which gives both its descriptor items
+//   and its byte layout, e.g:
+//
+//      typedef hid_report::Field<1, 3, 0, 1>   Buttons;
+//      typedef hid_report::Padding<5>          Reserved;
+//      typedef hid_report::Field<8, 2, -127, 127,
+//                                  hid_report::VARIABLE
+//                                | hid_report::RELATIVE>   Motion;
+//      typedef hid_report::Report<0, Buttons, Reserved, Motion> MouseReport;
+//
+//      static constexpr auto   report_desc = usb_desc::concat(
+//          hid_report::usage_page<hid_report::GENERIC_DESKTOP_PAGE>(),
+//          hid_report::usage<hid_report::MOUSE>(),
+//          hid_report::collection<hid_report::APPLICATION>(
+//            MouseReport::items(
+//              Buttons::items(hid_report::usage_page<
+//                             hid_report::BUTTON_PAGE>(),
+//                             hid_report::usage_minimum<1>(),
+//                             hid_report::usage_maximum<3>()),
+//              Reserved::items(),
+//              Motion::items(hid_report::usage_page<
+//                            hid_report::GENERIC_DESKTOP_PAGE>(),
+//                            hid_report::usage<hid_report::X>(),
+//                            hid_report::usage<hid_report::Y>()))));
+//
+//      MouseReport     report;
+//      report.set<2>(-5, 1);   // field 2 (Motion), element 1 (Y)
+//      usb_dev.send(endpoint, report.bytes(), MouseReport::SIZE);
+//
+// Field value ranges and whole-byte report size are checked by
+//   static_assert. Accessors are unchecked (no test of element index)
+//   branch-free shifts and masks of a 3 byte window, so fields are limited
+//   to 16 bits.
+//
+// Requires C++14 (constexpr loops).
+//
+namespace hid_report {
+
+using usb_desc::DescBytes;
+
+// HID 1.11, 6.2.2.4 - 6.2.2.7 item prefixes, without size bits
+static const uint8_t    INPUT               = 0x80,
+                        OUTPUT              = 0x90,
+                        FEATURE             = 0xb0,
+                        COLLECTION          = 0xa0,
+                        END_COLLECTION      = 0xc0,
+                        USAGE_PAGE          = 0x04,
+                        LOGICAL_MINIMUM     = 0x14,
+                        LOGICAL_MAXIMUM     = 0x24,
+                        REPORT_SIZE         = 0x74,
+                        REPORT_ID           = 0x84,
+                        REPORT_COUNT        = 0x94,
+                        USAGE               = 0x08,
+                        USAGE_MINIMUM       = 0x18,
+                        USAGE_MAXIMUM       = 0x28;
+
+// Input, Output, and Feature item flags
+static const uint8_t    DATA                = 0x00,
+                        CONSTANT            = 0x01,
+                        ARRAY               = 0x00,
+                        VARIABLE            = 0x02,
+                        ABSOLUTE            = 0x00,
+                        RELATIVE            = 0x04;
+
+// Collection types
+static const uint8_t    PHYSICAL            = 0x00,
+                        APPLICATION         = 0x01,
+                        LOGICAL             = 0x02;
+
+// HID Usage Tables 1.12 usage pages ...
+static const uint16_t   GENERIC_DESKTOP_PAGE = 0x01,
+                        KEYBOARD_PAGE        = 0x07,
+                        LED_PAGE             = 0x08,
+                        BUTTON_PAGE          = 0x09,
+                        CONSUMER_PAGE        = 0x0c,
+                        VENDOR_PAGE          = 0xff00;
+
+// ... and usages
+static const uint16_t   POINTER              = 0x01,  // generic desktop
+                        MOUSE                = 0x02,  //    "       "
+                        JOYSTICK             = 0x04,  //    "       "
+                        GAMEPAD              = 0x05,  //    "       "
+                        KEYBOARD             = 0x06,  //    "       "
+                        X                    = 0x30,  //    "       "
+                        Y                    = 0x31,  //    "       "
+                        Z                    = 0x32,  //    "       "
+                        WHEEL                = 0x38,  //    "       "
+                        CONSUMER_CONTROL     = 0x01;  // consumer
+
+
+
+// bytes of item data for value
+constexpr unsigned data_size(
+const uint32_t  value)
+{
+    return value <= 0xff ? 1 : value <= 0xffff ? 2 : 4;
+}
+
+constexpr unsigned signed_data_size(
+const int32_t   value)
+{
+    return   value >=   -128 && value <=   127 ? 1
+           : value >= -32768 && value <= 32767 ? 2
+           :                                     4;
+}
+
+template<unsigned SIZE>
+constexpr DescBytes<1 + SIZE> encode(
+const uint8_t   prefix,
+const uint32_t  value )
+{
+    DescBytes<1 + SIZE>     result{};
+
+    result.bytes[0] = prefix | (SIZE == 4 ? 3 : SIZE);
+
+    for (unsigned ndx = 0 ; ndx < SIZE ; ++ndx)
+        result.bytes[1 + ndx] = (value >> (8 * ndx)) & 0xff;
+
+    return result;
+}
+
+
+
+template<uint8_t PREFIX, uint32_t VALUE>
+constexpr auto item()
+{
+    return encode<data_size(VALUE)>(PREFIX, VALUE);
+}
+
+template<uint8_t PREFIX, int32_t VALUE>
+constexpr auto signed_item()
+{
+    return encode<signed_data_size(VALUE)>(PREFIX,
+                                           static_cast<uint32_t>(VALUE));
+}
+
+
+template<uint16_t PAGE > constexpr auto usage_page   ()
+{ return item<USAGE_PAGE   , PAGE >(); }
+
+template<uint32_t ID   > constexpr auto usage        ()
+{ return item<USAGE        , ID   >(); }
+
+template<uint32_t ID   > constexpr auto usage_minimum()
+{ return item<USAGE_MINIMUM, ID   >(); }
+
+template<uint32_t ID   > constexpr auto usage_maximum()
+{ return item<USAGE_MAXIMUM, ID   >(); }
+
+template<uint8_t  ID   > constexpr auto report_id    ()
+{ return item<REPORT_ID    , ID   >(); }
+
+
+// Collection's usage item(s) must precede it
+template<uint8_t TYPE, typename... ITEMS>
+constexpr auto collection(
+const ITEMS&...     items)
+{
+    return   usb_desc::raw(COLLECTION | 1, TYPE)
+           + usb_desc::concat(items...)
+           + usb_desc::raw(END_COLLECTION);
+}
+
+
+
+// COUNT elements of BITS each, Input (or MAIN) item with FLAGS
+template<uint8_t    BITS                ,
+         uint8_t    COUNT               ,
+         int32_t    MIN                 ,
+         int32_t    MAX                 ,
+         uint8_t    FLAGS  = VARIABLE   ,
+         uint8_t    MAIN   = INPUT      >
+struct Field {
+    static const uint8_t    REPORT_SIZE  = BITS        ,
+                            REPORT_COUNT = COUNT       ;
+    static const unsigned   TOTAL_BITS   = BITS * COUNT;
+    static const bool       SIGNED       = MIN < 0     ;
+
+    static_assert(BITS >= 1 && BITS <= 16 && COUNT >= 1,
+                  "hid_report::Field BITS not 1..16 or COUNT 0");
+    static_assert(MIN <= MAX, "hid_report::Field MIN > MAX");
+    static_assert(  SIGNED
+                  ?    MIN >= -(1L << (BITS - 1))
+                    && MAX <   (1L << (BITS - 1))
+                  :    MAX <   (1L <<  BITS     ),
+                  "hid_report::Field MIN or MAX doesn't fit in BITS");
+
+    // Usage items (if any) for field, then its global and main items
+    template<typename... USAGES>
+    static constexpr auto items(
+    const USAGES&...    usages)
+    {
+        return usb_desc::concat(usages...                            ,
+                                signed_item<LOGICAL_MINIMUM, MIN>()      ,
+                                signed_item<LOGICAL_MAXIMUM, MAX>()      ,
+                                item<hid_report::REPORT_SIZE , BITS >(),
+                                item<hid_report::REPORT_COUNT, COUNT>(),
+                                item<MAIN                    , FLAGS>());
+    }
+};
+
+// Constant bits, e.g. to pad report to whole bytes
+template<uint8_t BITS, uint8_t MAIN = INPUT>
+struct Padding {
+    static const uint8_t    REPORT_SIZE  = BITS    ,
+                            REPORT_COUNT = 1       ;
+    static const unsigned   TOTAL_BITS   = BITS    ;
+    static const bool       SIGNED       = false   ;
+
+    static constexpr auto items()
+    {
+        return   item<hid_report::REPORT_SIZE , BITS    >()
+               + item<hid_report::REPORT_COUNT, 1       >()
+               + item<MAIN                    , CONSTANT>();
+    }
+};
+
+
+
+template<unsigned NDX, typename FIRST, typename... REST>
+struct NthField {
+    typedef typename NthField<NDX - 1, REST...>::type   type;
+};
+
+template<typename FIRST, typename... REST>
+struct NthField<0, FIRST, REST...> {
+    typedef FIRST   type;
+};
+
+template<uint8_t ID> struct ReportIdItems {
+    template<typename... ITEMS>
+    static constexpr auto items(const ITEMS&...  items)
+    {
+        return usb_desc::concat(report_id<ID>(), items...);
+    }
+};
+
+template<> struct ReportIdItems<0> {  // no Report ID item
+    template<typename... ITEMS>
+    static constexpr auto items(const ITEMS&...  items)
+    {
+        return usb_desc::concat(items...);
+    }
+};
+
+template<bool SIGNED> struct FieldValue         { typedef uint32_t  type; };
+template<>            struct FieldValue<true>   { typedef  int32_t  type; };
+
+
+
+// Report with ID (0 for none, only if device's reports have no IDs)
+//   consisting of FIELDS in order. bytes() is report as sent, SIZE
+//   bytes including ID (if any).
+template<uint8_t ID, typename... FIELDS>
+class Report
+{
+  public:
+    static const unsigned   ID_BYTES = ID ? 1 : 0;
+
+    static constexpr unsigned bits_before(
+    const unsigned  field)
+    {
+        const unsigned  bits[] = {0, FIELDS::TOTAL_BITS...};
+        unsigned        total  = 0                         ;
+
+        for (unsigned ndx = 1 ; ndx <= field ; ++ndx)
+            total += bits[ndx];
+
+        return total;
+    }
+
+    static const unsigned   NUM_FIELDS = sizeof...(FIELDS)                   ,
+                            SIZE       = ID_BYTES + bits_before(NUM_FIELDS) / 8;
+
+    static_assert(bits_before(NUM_FIELDS) % 8 == 0,
+                  "hid_report::Report fields not whole bytes, add Padding");
+
+    template<unsigned FIELD> using field_t
+                             = typename NthField<FIELD, FIELDS...>::type;
+
+    template<unsigned FIELD> using value_t
+                             = typename FieldValue<field_t<FIELD>::SIGNED>::type;
+
+
+    constexpr Report()
+    :   _bytes{ID}
+    {}
+
+
+    // Report ID item (if any) then fields' items(), one per field
+    template<typename... ITEMS>
+    static constexpr auto items(
+    const ITEMS&...     items)
+    {
+        static_assert(sizeof...(ITEMS) == NUM_FIELDS,
+                      "hid_report::Report::items() needs one per field");
+
+        return ReportIdItems<ID>::items(items...);
+    }
+
+
+    const uint8_t*  bytes() const { return _bytes; }
+          uint8_t*  bytes()       { return _bytes; }
+
+    void clear()
+    {
+        for (unsigned ndx = ID_BYTES ; ndx < SIZE ; ++ndx)
+            _bytes[ndx] = 0;
+    }
+
+    // Element "ndx" of field number FIELD
+    template<unsigned FIELD>
+    value_t<FIELD> get(
+    const unsigned  ndx = 0)
+    const
+    {
+        const unsigned  bit    = bit_offset<FIELD>(ndx)          ,
+                        shift  = bit % 8                         ;
+        const uint8_t  *window = &_bytes[bit / 8]                ;
+        uint32_t        value  =  (  window[0]
+                                   | (window[1] <<  8)
+                                   | (window[2] << 16))
+                                 >> shift                        ;
+
+        return extend<FIELD>(value & mask<FIELD>());
+    }
+
+    template<unsigned FIELD>
+    void set(
+    const value_t<FIELD>    value  ,
+    const unsigned          ndx = 0)
+    {
+        const unsigned  bit    = bit_offset<FIELD>(ndx)          ,
+                        shift  = bit % 8                         ;
+              uint8_t  *window = &_bytes[bit / 8]                ;
+        const uint32_t  field  = mask<FIELD>() << shift          ;
+        uint32_t        bits   =    window[0]
+                                 | (window[1] <<  8)
+                                 | (window[2] << 16)             ;
+
+        bits =   (bits                            & ~field)
+               | ((static_cast<uint32_t>(value) << shift) &  field);
+
+        window[0] =  bits        & 0xff;
+        window[1] = (bits >>  8) & 0xff;
+        window[2] = (bits >> 16) & 0xff;
+    }
+
+
+  protected:
+    template<unsigned FIELD>
+    static constexpr unsigned bit_offset(
+    const unsigned  ndx)
+    {
+        return   ID_BYTES * 8
+               + bits_before(FIELD)
+               + ndx * field_t<FIELD>::REPORT_SIZE;
+    }
+
+    template<unsigned FIELD>
+    static constexpr uint32_t mask()
+    {
+        return (1UL << field_t<FIELD>::REPORT_SIZE) - 1;
+    }
+
+    // sign-extend if field signed
+    template<unsigned FIELD>
+    static constexpr value_t<FIELD> extend(
+    const uint32_t  value)
+    {
+        return   static_cast<value_t<FIELD>>(
+                       value
+                    << (32 - field_t<FIELD>::REPORT_SIZE))
+              >> (32 - field_t<FIELD>::REPORT_SIZE);
+    }
+
+
+    uint8_t     _bytes[SIZE + 2];  // + 2 so accessors can use 3 byte window
+
+};  // template<uint8_t ID, typename... FIELDS> class Report
+
+}  // namespace hid_report
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_HID_REPORT_HXX
@@ -0,0 +1,243 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_KEY_MATRIX_HXX
+#define USB_KEY_MATRIX_HXX
+
+#include <stdint.h>
+
+#include <stm32f103xb.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Key matrix scanned by hardware: a general purpose timer's update event
+//   triggers a DMA channel which drives the next column low (one word
+//   per column written to the column GPIO port's BSRR), and its
+//   channel 1 compare event, late in each column period, triggers a
+//   second DMA channel which samples the row GPIO port's IDR into a
+//   per-column RAM buffer. Both run in circular mode with no CPU work
+//   or interrupts.
+//
+// scan() compares the buffer with the debounced state, one word per
+//   column, and calls the key callback only for changed keys. Debouncing
+//   is eager (a change is reported on first sample, then further changes
+//   of that column's changed keys are ignored for DEBOUNCE_MS), so
+//   key-to-report latency is one column period plus scan() call
+//   interval.
+//
+// Columns are open-drain outputs, rows inputs with pull-ups (pressed
+//   key reads low), with diodes if more than two keys may be down at
+//   once. Client application must:
+//   - enable timer, DMA1, and GPIO clocks, and configure pins
+//   - use the DMA channels for the timer's update and channel 1 requests
+//     (TIM2: 2 and 5, TIM3: 3 and 6), not used by USB_DEV_DMA_CHANNEL
+//   - call scan() frequently, from a single context
+//
+template<uint8_t NUM_COLUMNS, uint8_t DEBOUNCE_MS = 5> class UsbKeyMatrix
+{
+  public:
+    typedef void (*KeyCallback)(const uint8_t    column   ,
+                                const uint8_t    row      ,
+                                const bool       pressed  ,
+                                      void      *user_data);
+
+    constexpr
+    UsbKeyMatrix(
+    volatile stm32f103xb::Gpio*         const  column_gpio,
+    const    uint8_t*                   const  column_pins,  // NUM_COLUMNS
+    volatile stm32f103xb::Gpio*         const  row_gpio   ,
+    const    uint16_t                          row_mask   ,  // row pins
+    volatile stm32f103xb::GenTim_2_3_4* const  timer      ,
+    volatile stm32f103xb::DmaChannel*   const  drive_dma  ,  // timer UP
+    volatile stm32f103xb::DmaChannel*   const  sample_dma ,  // timer CH1
+    const    uint32_t                          timer_hz   )  // timer clock
+    :   _column_gpio    (column_gpio),
+        _column_pins    (column_pins),
+        _row_gpio       (row_gpio   ),
+        _row_mask       (row_mask   ),
+        _timer          (timer      ),
+        _drive_dma      (drive_dma  ),
+        _sample_dma     (sample_dma ),
+        _timer_hz       (timer_hz   ),
+        _key_callback   (0          ),
+        _user_data      (0          ),
+        _drives         {0          },
+        _samples        {0          },
+        _state          {0          },
+        _lock_masks     {0          },
+        _lock_times     {0          }
+    {}
+
+
+    void key_callback(
+    KeyCallback     callback ,
+    void           *user_data)
+    {
+        _key_callback = callback ;
+        _user_data    = user_data;
+    }
+
+
+    // Starts scanning, column_us microseconds per column (time for row
+    //   inputs to settle after column is driven, including pull-ups
+    //   charging line capacitance)
+    void init(
+    const uint16_t  column_us = 20)
+    {
+        using namespace stm32f103xb;
+
+        uint32_t    all_columns = 0;
+
+        for (uint8_t column = 0 ; column < NUM_COLUMNS ; ++column) {
+            all_columns     |= 1U << _column_pins[column];
+            _samples[column] = 0xffff;  // nothing pressed
+        }
+
+        // _drives[N] is written at end of column N period, so selects
+        //   column N+1. Column 0 driven below, before timer starts.
+        for (uint8_t column = 0 ; column < NUM_COLUMNS ; ++column) {
+            uint8_t     next = column + 1 == NUM_COLUMNS ? 0 : column + 1;
+
+            _drives[column] =   (all_columns & ~(1U << _column_pins[next]))
+                              | (1U << (_column_pins[next] + 16))          ;
+        }
+
+        _column_gpio->bsrr = _drives[NUM_COLUMNS - 1];
+
+        _timer->cr1   = 0                            ;
+        _timer->dier  = 0                            ;
+        _timer->psc   = _timer_hz / 1000000 - 1      ;  // 1 us ticks
+        _timer->arr   = column_us - 1                ;
+        _timer->ccr1  = column_us - 1 - column_us / 4;  // sample late
+        _timer->ccmr1 = 0                            ;  // frozen
+        _timer->egr   = GenTim_2_3_4::Egr::UG        ;  // load PSC
+        _timer->sr    = 0                            ;
+
+        _drive_dma->ccr = 0;
+        _drive_dma->pa  = reinterpret_cast<uintptr_t>(&_column_gpio->bsrr);
+        _drive_dma->ma  = reinterpret_cast<uintptr_t>(_drives            );
+        _drive_dma->ndt = NUM_COLUMNS                                      ;
+        _drive_dma->ccr =   DmaChannel::Ccr::DIR_MEM2PERIPH
+                          | DmaChannel::Ccr::PL_HIGH
+                          | DmaChannel::Ccr::MSIZE_32_BITS
+                          | DmaChannel::Ccr::PSIZE_32_BITS
+                          | DmaChannel::Ccr::MINC
+                          | DmaChannel::Ccr::CIRC
+                          | DmaChannel::Ccr::EN           ;
+
+        // 32 bit IDR read, low half stored
+        _sample_dma->ccr = 0;
+        _sample_dma->pa  = reinterpret_cast<uintptr_t>(&_row_gpio->idr);
+        _sample_dma->ma  = reinterpret_cast<uintptr_t>(_samples       );
+        _sample_dma->ndt = NUM_COLUMNS                                  ;
+        _sample_dma->ccr =   DmaChannel::Ccr::DIR_PERIPH2MEM
+                           | DmaChannel::Ccr::PL_HIGH
+                           | DmaChannel::Ccr::MSIZE_16_BITS
+                           | DmaChannel::Ccr::PSIZE_32_BITS
+                           | DmaChannel::Ccr::MINC
+                           | DmaChannel::Ccr::CIRC
+                           | DmaChannel::Ccr::EN           ;
+
+        _timer->dier = GenTim_2_3_4::Dier::UDE | GenTim_2_3_4::Dier::CC1DE;
+        _timer->cr1  = GenTim_2_3_4::Cr1::CEN                             ;
+
+    }  // init()
+
+
+    // Calls key callback for each debounced change since last call.
+    //   now_ms: millisecond time, 11 bits (e.g. UsbDev::frame_number()).
+    //   Returns number of changes.
+    uint8_t scan(
+    const uint16_t  now_ms)
+    {
+        uint8_t     changes = 0;
+
+        for (uint8_t column = 0 ; column < NUM_COLUMNS ; ++column) {
+            uint16_t    pressed = ~_samples[column] & _row_mask,
+                        changed;
+
+            if (   _lock_masks[column]
+                &&    ((now_ms - _lock_times[column]) & 0x7ff)
+                   >= DEBOUNCE_MS                            )
+                _lock_masks[column] = 0;
+
+            changed = (pressed ^ _state[column]) & ~_lock_masks[column];
+
+            if (!changed)
+                continue;
+
+            _state     [column] ^= changed;
+            _lock_masks[column] |= changed;
+            _lock_times[column]  = now_ms ;
+
+            while (changed) {
+                uint8_t     row = __builtin_ctz(changed);
+
+                changed &= changed - 1;
+                ++changes;
+
+                if (_key_callback)
+                    _key_callback(column                ,
+                                  row                   ,
+                                  (pressed >> row) & 1  ,
+                                  _user_data            );
+            }
+        }
+
+        return changes;
+
+    }  // scan()
+
+
+    // Debounced rows down in column, bit per row pin
+    uint16_t column_state(
+    const uint8_t   column)
+    const
+    {
+        return _state[column];
+    }
+
+
+
+  protected:
+    volatile stm32f103xb::Gpio*         const  _column_gpio;
+    const    uint8_t*                   const  _column_pins;
+    volatile stm32f103xb::Gpio*         const  _row_gpio   ;
+    const    uint16_t                          _row_mask   ;
+    volatile stm32f103xb::GenTim_2_3_4* const  _timer      ;
+    volatile stm32f103xb::DmaChannel*   const  _drive_dma  ,
+                                        * const  _sample_dma ;
+    const    uint32_t                          _timer_hz   ;
+
+    KeyCallback         _key_callback             ;
+    void               *_user_data                ;
+
+    uint32_t            _drives    [NUM_COLUMNS]  ;  // BSRR words
+    volatile uint16_t   _samples   [NUM_COLUMNS]  ;  // row IDR, by DMA
+    uint16_t            _state     [NUM_COLUMNS]  ,  // debounced, 1 == down
+                        _lock_masks[NUM_COLUMNS]  ,  // recently changed
+                        _lock_times[NUM_COLUMNS]  ;  //   at ms
+
+};  // template<uint8_t NUM_COLUMNS, uint8_t DEBOUNCE_MS> class UsbKeyMatrix
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_KEY_MATRIX_HXX
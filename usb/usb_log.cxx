@@ -0,0 +1,136 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+
+#include <usb_log.hxx>
+
+
+// Provided by linker for sections with C identifier names. Weak so
+//   applications without any USB_LOG() calls still link.
+extern "C" const char   __start_usb_log_formats[] __attribute__((weak));
+
+
+
+namespace stm32f10_12357_xx {
+
+using namespace stm32f103xb;
+
+
+uint32_t UsbLog::header(
+const char      *format  ,
+const uint8_t    num_args)
+{
+    return   ((format - __start_usb_log_formats) << 8)
+           | _HEADER_VALID
+           | num_args                                 ;
+}
+
+
+
+bool UsbLog::commit(
+const uint32_t  *words    ,
+const uint8_t    num_words)
+{
+    uint32_t    head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+
+    // reserve, racing other contexts
+    do {
+        if (  head + num_words - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)
+            > RING_WORDS                                                  ) {
+            __atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&_head                ,
+                                          &head                 ,
+                                          head + num_words      ,
+                                          true                  ,
+                                          __ATOMIC_ACQ_REL      ,
+                                          __ATOMIC_RELAXED      ));
+
+    for (uint8_t ndx = 1 ; ndx < num_words ; ++ndx)
+        _ring[(head + ndx) & (RING_WORDS - 1)] = words[ndx];
+
+    // commit: header last, poll() stops at zero header
+    __atomic_store_n(&_ring[head & (RING_WORDS - 1)], words[0], __ATOMIC_RELEASE);
+
+    return true;
+
+}  // commit()
+
+
+
+void UsbLog::poll()
+{
+    if (!(_usb_dev.send_readys() & (1 << _endpoint)))
+        return;
+
+    uint32_t    packet[16]                                    ,
+                tail       = _tail                            ,
+                head       = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+    uint8_t     count      = 0                                ,
+                left       = _record_left                     ;
+
+    // committed words only, records may span packets
+    while (count < _packet_words && tail + count != head) {
+        uint32_t    word = __atomic_load_n(&_ring[  (tail + count)
+                                                  & (RING_WORDS - 1)],
+                                           __ATOMIC_ACQUIRE          );
+
+        if (!left) {
+            if (!word)
+                break;  // reserved but not yet committed
+            left = 1 + (word & MAX_ARGS);
+        }
+
+        packet[count++] = word;
+        --left;
+    }
+
+    if (!count) {
+        _armed = false;
+        return;
+    }
+
+    // full packets always, partial only after deadline
+    if (count < _packet_words) {
+        if (!_armed) {
+            _deadline_frame = UsbDev::frame_number();
+            _armed          = true                  ;
+            return;
+        }
+
+        if (  ((UsbDev::frame_number() - _deadline_frame) & Usb::Fnr::FN_MASK)
+            < _flush_ms)
+            return;
+    }
+
+    _usb_dev.send(_endpoint, reinterpret_cast<uint8_t*>(packet), count * 4);
+
+    // free slots, zeroed for commit detection
+    for (uint8_t ndx = 0 ; ndx < count ; ++ndx)
+        _ring[(tail + ndx) & (RING_WORDS - 1)] = 0;
+
+    _record_left = left ;
+    _armed       = false;
+    __atomic_store_n(&_tail, tail + count, __ATOMIC_RELEASE);
+
+}  // poll()
+
+}  // namespace stm32f10_12357_xx
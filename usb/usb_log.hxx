@@ -0,0 +1,166 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_LOG_HXX
+#define USB_LOG_HXX
+
+// Log ring size in 32-bit words, must be power of 2
+#ifndef USB_LOG_RING_WORDS
+#define USB_LOG_RING_WORDS  256
+#endif
+
+#include <usb_dev.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Binary deferred-format logging.
+//
+// Call sites, via USB_LOG(), store only a record of 32-bit words: a
+//   header with the format string's offset in the "usb_log_formats" ELF
+//   section and the argument count, followed by the raw arguments. No
+//   text is formatted on the device -- examples/linux/usb_log_decode.cxx
+//   expands records using the format strings read from the
+//   application's ELF file. (The section can be made NOLOAD in the
+//   linker script to keep the strings out of flash.)
+//
+//       USB_LOG(usb_log, "adc %u = %d mV, temp %f", channel, mv, temp);
+//
+// Arguments are integers (%d %i %u %x %X %o %c), pointers (%p), or
+//   floats (%f %e %g, sent as 32-bit float), at most 15 per record.
+//   Width, precision, and flags are honored by the decoder. No %s.
+//
+// Logging is lock-free and can be done from any number of interrupt
+//   handlers and main loop at once: space is reserved by atomic
+//   compare-and-swap (LDREX/STREX), arguments written, then header
+//   written last to commit the record. Records are dropped (and counted,
+//   see dropped()) if the ring is full.
+//
+// poll() drains committed records to the given bulk IN endpoint of any
+//   UsbDev class (e.g. UsbDevCdcAcm::CDC_ENDPOINT_IN) in full packets,
+//   or partial ones after flush_ms USB frames. Call from main loop.
+//
+class UsbLog {
+  public:
+    static const uint16_t   RING_WORDS = USB_LOG_RING_WORDS;
+    static const uint8_t    MAX_ARGS   = 15                ;
+
+    static_assert((RING_WORDS & (RING_WORDS - 1)) == 0,
+                  "USB_LOG_RING_WORDS must be power of 2");
+
+    constexpr
+    UsbLog(
+    UsbDev          &usb_dev         ,
+    const uint8_t    endpoint        ,
+    const uint16_t   packet_size = 64,
+    const uint8_t    flush_ms    =  2)
+    :   _usb_dev       (usb_dev                                  ),
+        _endpoint      (endpoint                                 ),
+        _packet_words  (packet_size > 64 ? 16 : packet_size / 4  ),
+        _flush_ms      (flush_ms                                 ),
+        _ring          {0                                        },
+        _head          (0                                        ),
+        _tail          (0                                        ),
+        _dropped       (0                                        ),
+        _deadline_frame(0                                        ),
+        _record_left   (0                                        ),
+        _armed         (false                                    )
+    {}
+
+    // Use via USB_LOG() macro, below
+    template<typename... ARGS> bool write(
+    const char      *format,
+    const ARGS...    args  )
+    {
+        static_assert(sizeof...(ARGS) <= MAX_ARGS, "too many USB_LOG() args");
+
+        uint32_t    words[] = {header(format, sizeof...(ARGS)), word(args)...};
+
+        return commit(words, sizeof(words) / sizeof(words[0]));
+    }
+
+    uint32_t    dropped() const
+    {
+        return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+    }
+
+    // Sends committed records to host. Call from main loop.
+    void        poll();
+
+
+  protected:
+    // nonzero so uncommitted (zeroed) slots are recognizable
+    static const uint32_t   _HEADER_VALID = 0x80;
+
+    static uint32_t header(
+    const char      *format  ,
+    const uint8_t    num_args);
+
+    // integers and enums
+    template<typename T> static uint32_t word(const T   value)
+    {
+        return static_cast<uint32_t>(value);
+    }
+    template<typename T> static uint32_t word(T* const  value)
+    {
+        return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(value));
+    }
+    static uint32_t word(const float    value)
+    {
+        union { float f; uint32_t u; } bits = {value};
+        return bits.u;
+    }
+    static uint32_t word(const double   value)
+    {
+        return word(static_cast<float>(value));
+    }
+
+    bool    commit(const uint32_t   *words, const uint8_t  num_words);
+
+
+    UsbDev                  &_usb_dev                   ;
+    const uint8_t            _endpoint                  ,
+                             _packet_words              ;
+    uint8_t                  _flush_ms                  ;
+    volatile uint32_t        _ring[RING_WORDS]          ;
+    uint32_t                 _head                      ,  // atomic access
+                             _tail                      ,  //   "      "
+                             _dropped                   ;  //   "      "
+    uint16_t                 _deadline_frame            ;
+    uint8_t                  _record_left               ;  // words, sending
+    bool                     _armed                     ;
+
+};  // class UsbLog
+
+}  // namespace stm32f10_12357_xx
+
+
+
+// Format string literal is placed in "usb_log_formats" section (its
+//   offset is the record ID), and only the pointer is used at runtime
+#define USB_LOG(usb_log, format, ...)                                       \
+    do {                                                                    \
+        static const char   _usb_log_format[]                               \
+                        __attribute__((section("usb_log_formats"), used))   \
+                            = format;                                       \
+        (usb_log).write(_usb_log_format, ##__VA_ARGS__);                    \
+    } while (0)
+
+#endif  // ifndef USB_LOG_HXX
@@ -0,0 +1,244 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_midi_codec.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+typedef UsbDevMidi::EventPacket     EventPacket;
+
+
+const uint8_t   UsbMidiCodec::_CHANNEL_LENGTHS[8] = {
+    2,              // 0x8n note off
+    2,              // 0x9n note on
+    2,              // 0xan poly key pressure
+    2,              // 0xbn control change
+    1,              // 0xcn program change
+    1,              // 0xdn channel pressure
+    2,              // 0xen pitch bend
+    0,              // 0xfn system, not used
+};
+
+const uint8_t   UsbMidiCodec::_COMMON_LENGTHS[8] = {
+    _SYSEX    ,     // 0xf0 SysEx start
+    1         ,     // 0xf1 MTC quarter frame
+    2         ,     // 0xf2 song position pointer
+    1         ,     // 0xf3 song select
+    _UNDEFINED,     // 0xf4
+    _UNDEFINED,     // 0xf5
+    0         ,     // 0xf6 tune request
+    _UNDEFINED,     // 0xf7 SysEx end, not valid outside SysEx
+};
+
+const EventPacket::CodeIndex    UsbMidiCodec::_COMMON_CINS[3] = {
+    EventPacket::SINGLE_BYTE_SYSTEM_COMMON,
+    EventPacket::TWO_BYTE_SYSTEM_COMMON   ,
+    EventPacket::THREE_BYTE_SYSTEM_COMMON ,
+};
+
+const EventPacket::CodeIndex    UsbMidiCodec::_SYSEX_END_CINS[4] = {
+    EventPacket::SINGLE_BYTE                ,  // not used
+    EventPacket::SINGLE_BYTE_SYSTEM_COMMON  ,  // also "SysEx ends with 1"
+    EventPacket::SYS_EX_ENDS_FOLLOWING_TWO  ,
+    EventPacket::SYS_EX_ENDS_FOLLOWING_THREE,
+};
+
+const uint8_t   UsbMidiCodec::_CIN_LENGTHS[16] = {
+    0,              // 0x0 reserved (misc function codes)
+    0,              // 0x1 reserved (cable events)
+    2,              // 0x2 two-byte system common
+    3,              // 0x3 three-byte system common
+    3,              // 0x4 SysEx start or continue
+    1,              // 0x5 single-byte system common, or SysEx ends with 1
+    2,              // 0x6 SysEx ends with following two bytes
+    3,              // 0x7 SysEx ends with following three bytes
+    3,              // 0x8 note off
+    3,              // 0x9 note on
+    3,              // 0xa poly key pressure
+    3,              // 0xb control change
+    2,              // 0xc program change
+    2,              // 0xd channel pressure
+    3,              // 0xe pitch bend
+    1,              // 0xf single byte
+};
+
+
+
+
+uint8_t UsbMidiCodec::encode(
+const uint8_t           byte   ,
+      EventPacket      *packets)
+{
+    // real-time, anywhere including inside SysEx or other message
+    if (byte >= 0xf8) {
+        packets[0].populate(_cable_number, EventPacket::SINGLE_BYTE, byte, 0, 0);
+        return 1;
+    }
+
+    if (!(byte & 0x80)) {
+        if (_sysex) {
+            _data[_count++] = byte;
+
+            if (_count < 3)
+                return 0;
+
+            _count = 0;
+            packets[0].populate(_cable_number                         ,
+                                EventPacket::SYS_EX_START_OR_CONTINUE ,
+                                _data[0]                              ,
+                                _data[1]                              ,
+                                _data[2]                              );
+            return 1;
+        }
+
+        if (!_status)   // no status or running status, discard
+            return 0;
+
+        _data[_count++] = byte;
+
+        if (_count < _needed)
+            return 0;
+
+        _count = 0;
+        return message(packets);
+    }
+
+    // any status byte other than real-time ends SysEx
+    uint8_t     num_packets = 0;
+
+    if (_sysex) {
+        _sysex = false;
+
+        if (byte == 0xf7) {
+            _data[_count++] = byte;
+            return sysex_end(packets);
+        }
+
+        num_packets = sysex_end(packets);  // terminated without 0xf7
+    }
+
+    _count = 0;
+
+    if (byte < 0xf0) {
+        _status = byte                                ;
+        _needed = _CHANNEL_LENGTHS[(byte >> 4) & 0x7];
+        return num_packets;
+    }
+
+    // system common, cancels running status
+    uint8_t     length = _COMMON_LENGTHS[byte & 0x7];
+
+    _status = 0;
+
+    if (length == _SYSEX) {
+        _sysex    = true;
+        _data[0]  = byte;
+        _count    = 1   ;
+    }
+    else if (length == 0)
+        packets[num_packets++].populate(_cable_number  ,
+                                        _COMMON_CINS[0],
+                                        byte           ,
+                                        0              ,
+                                        0              );
+    else if (length != _UNDEFINED) {
+        _status = byte  ;
+        _needed = length;
+    }
+
+    return num_packets;
+
+}  // encode()
+
+
+
+uint8_t UsbMidiCodec::message(
+EventPacket     *packets)
+{
+    EventPacket::CodeIndex  cin;
+
+    if (_status < 0xf0)
+        cin = static_cast<EventPacket::CodeIndex>(_status >> 4);
+    else
+        cin = _COMMON_CINS[_needed];
+
+    packets[0].populate(_cable_number               ,
+                        cin                         ,
+                        _status                     ,
+                        _data[0]                    ,
+                        _needed > 1 ? _data[1] : 0  );
+
+    if (_status >= 0xf0)
+        _status = 0;  // no running status for system common
+
+    return 1;
+
+}  // message()
+
+
+
+uint8_t UsbMidiCodec::sysex_end(
+EventPacket     *packets)
+{
+    if (!_count)
+        return 0;
+
+    packets[0].populate(_cable_number               ,
+                        _SYSEX_END_CINS[_count]     ,
+                        _data[0]                    ,
+                        _count > 1 ? _data[1] : 0   ,
+                        _count > 2 ? _data[2] : 0   );
+
+    _count = 0;
+
+    return 1;
+
+}  // sysex_end()
+
+
+
+uint8_t UsbMidiCodec::decode(
+const EventPacket       &packet,
+      uint8_t           *bytes )
+{
+    EventPacket::CodeIndex  cin    = packet.code_index();
+    const uint8_t           length = _CIN_LENGTHS[cin]  ,
+                            status = packet._midi_0     ;
+    uint8_t                 skip   = 0                  ;
+
+    if (cin >= EventPacket::NOTE_OFF && cin <= EventPacket::PITCH_BEND_CHANGE) {
+        if (_running_out && status == _out_status)
+            skip = 1;
+        _out_status = status;
+    }
+    else if (length && status < 0xf8)
+        _out_status = 0;  // system common or SysEx, not real-time
+
+    const uint8_t   midi[3] = {packet._midi_0, packet._midi_1, packet._midi_2};
+
+    for (uint8_t ndx = skip ; ndx < length ; ++ndx)
+        bytes[ndx - skip] = midi[ndx];
+
+    return length - skip;
+
+}  // decode()
+
+}  // namespace stm32f10_12357_xx
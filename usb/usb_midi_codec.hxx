@@ -0,0 +1,134 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_MIDI_CODEC_HXX
+#define USB_MIDI_CODEC_HXX
+
+#include <usb_dev_midi.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Converts between MIDI 1.0 byte streams (e.g. DIN port) and USB-MIDI
+//   event packets (USB Device Class Definition for MIDI Devices 1.0,
+//   section 4), one cable number per instance. Message lengths and Code
+//   Index Numbers come from small constant tables, no allocation.
+//
+// encode(), byte stream to packets:
+//   - running status (data bytes without status byte) reuses last
+//     channel message status
+//   - real-time bytes (0xf8-0xff) are sent immediately as single-byte
+//     packets, including when received between SysEx data bytes,
+//     without disturbing the message or SysEx in progress
+//   - SysEx data is sent 3 bytes per packet (CIN 0x4), and its end with
+//     0xf7 in 1, 2, or 3 byte packets (CIN 0x5, 0x6, 0x7). A SysEx
+//     terminated by another status byte instead of 0xf7 is ended with
+//     the data received so far.
+//   - stray data bytes (no status) and undefined 0xf4/0xf5 are dropped
+//
+// decode(), packets to byte stream, optionally with running status
+//   (channel message status byte omitted if same as previous; any
+//   system common or SysEx cancels, real-time does not).
+//
+class UsbMidiCodec
+{
+  public:
+    static const uint8_t    MAX_ENCODE_PACKETS = 2,  // per encode() call
+                            MAX_DECODE_BYTES   = 3;  // per decode() call
+
+    constexpr
+    UsbMidiCodec(
+    const uint8_t   cable_number       = 0   ,
+    const bool      out_running_status = true)
+    :   _cable_number   (cable_number      ),
+        _running_out    (out_running_status),
+        _status         (0                 ),
+        _needed         (0                 ),
+        _count          (0                 ),
+        _sysex          (false             ),
+        _data           {0                 },
+        _out_status     (0                 )
+    {}
+
+
+    uint8_t cable_number() const { return _cable_number; }
+
+    // Next byte of MIDI stream. Returns number of complete packets
+    //   (0 to MAX_ENCODE_PACKETS) written to "packets".
+    uint8_t encode(const uint8_t                byte   ,
+                         UsbDevMidi::EventPacket  *packets);
+
+    // Returns number of MIDI bytes (0 to MAX_DECODE_BYTES) written to
+    //   "bytes". Packet's cable number not checked.
+    uint8_t decode(const UsbDevMidi::EventPacket    &packet,
+                         uint8_t                    *bytes );
+
+    // Forget partial message, running status, and SysEx in progress
+    void reset()
+    {
+        _status     = 0    ;
+        _count      = 0    ;
+        _sysex      = false;
+        _out_status = 0    ;
+    }
+
+
+
+  protected:
+    static const uint8_t    _UNDEFINED = 0xff,  // _COMMON_LENGTHS entries
+                            _SYSEX     = 0xfe;
+
+    // data bytes following status, by (status >> 4) & 0x7 for 0x80-0xef,
+    //   and by status & 0x7 for 0xf0-0xf7
+    static const uint8_t    _CHANNEL_LENGTHS[8],
+                            _COMMON_LENGTHS [8];
+
+    // packet Code Index Number by data bytes following system common
+    //   status, and by SysEx bytes (including 0xf7) in end packet
+    static const UsbDevMidi::EventPacket::CodeIndex
+                            _COMMON_CINS   [3],
+                            _SYSEX_END_CINS[4];
+
+    // MIDI bytes in packet by Code Index Number
+    static const uint8_t    _CIN_LENGTHS  [16];
+
+
+    // complete channel or system common message in packets[0]
+    uint8_t message  (UsbDevMidi::EventPacket  *packets);
+
+    // SysEx bytes in _data as end packet (with or without 0xf7)
+    uint8_t sysex_end(UsbDevMidi::EventPacket  *packets);
+
+
+    const uint8_t   _cable_number ;
+    const bool      _running_out  ;
+
+    uint8_t         _status       ,  // channel or system common, 0 if none
+                    _needed       ,  // data bytes for _status
+                    _count        ;  // data (or SysEx) bytes in _data
+    bool            _sysex        ;
+    uint8_t         _data      [3],
+                    _out_status   ;  // decode() running status
+
+};  // class UsbMidiCodec
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_MIDI_CODEC_HXX
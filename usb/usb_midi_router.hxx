@@ -0,0 +1,265 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_MIDI_ROUTER_HXX
+#define USB_MIDI_ROUTER_HXX
+
+#include <usb_midi_uart.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// Routing and merge matrix between UsbDevMidi's CABLES virtual cables and
+//   NUM_UARTS DIN ports (UsbMidiUart).
+//
+// Ports are numbered usb_port(0) through usb_port(CABLES - 1), then
+//   uart_port(0) through uart_port(NUM_UARTS - 1). Each source port has
+//   a mask of destination ports (port_mask()), so one input can feed
+//   several outputs (split) and several inputs one output (merge). No
+//   routes are set initially.
+//
+// Each source holds one event until every destination has taken it, so
+//   a full destination (DIN transmit ring, or cable queue in UsbDevMidi)
+//   delays only the sources routed to it. Events from host arrive on the
+//   shared bulk OUT endpoint and are demultiplexed by cable number; the
+//   endpoint is only held off while the next event's cable still has
+//   an undelivered one. Sources are serviced round-robin.
+//
+// Merging is per message: SysEx spans several event packets, so while
+//   one source is sending SysEx to a destination, other sources' events
+//   for it (except real-time, which may be interleaved anywhere) wait
+//   until the SysEx ends. A long DIN SysEx dump merged with another DIN
+//   input can therefore delay the latter longer than its RX ring holds.
+//
+// Events keep their arrival times (see UsbDevMidi::timing()) through the
+//   router, so UsbMidiTiming latency to USB destinations includes time
+//   held here.
+//
+// Client application must call poll() and UsbDevMidi::midi_poll() from
+//   main loop (instead of UsbMidiUart::poll()), after UsbMidiUart::init().
+//
+template<uint8_t NUM_UARTS> class UsbMidiRouter
+{
+  public:
+    typedef UsbDevMidi::EventPacket     EventPacket;
+
+    static const uint8_t    NUM_CABLES = UsbDevMidi::CABLES         ,
+                            NUM_PORTS  = NUM_CABLES + NUM_UARTS     ,
+                            NO_PORT    = 0xff                       ;
+    static const uint32_t   ALL_PORTS  = ~0U >> (32 - NUM_PORTS)    ;
+
+    static_assert(NUM_PORTS <= 32, "more than 32 UsbMidiRouter ports");
+
+    static constexpr uint8_t  usb_port (const uint8_t cable) { return cable; }
+    static constexpr uint8_t  uart_port(const uint8_t uart )
+    {
+        return NUM_CABLES + uart;
+    }
+    static constexpr uint32_t port_mask(const uint8_t port ) { return 1U << port; }
+
+    constexpr
+    UsbMidiRouter(
+    UsbDevMidi                 &usb_dev,
+    UsbMidiUart*  const* const  uarts  )    // NUM_UARTS
+    :   _usb_dev        (usb_dev),
+        _uarts          (uarts  ),
+        _routes         {0      },
+        _remaining      {0      },
+        _pending        (       ),
+        _usb_event      (       ),
+        _times          {0      },
+        _usb_time       (0      ),
+        _owners         {0      },
+        _next_source    (0      ),
+        _usb_held       (false  )
+    {
+        for (uint8_t port = 0 ; port < NUM_PORTS ; ++port)
+            _owners[port] = NO_PORT;
+    }
+
+
+    // Destination ports for "source", port_mask() bits
+    void     route(const uint8_t   source  ,
+                   const uint32_t  dest_mask)
+    {
+        _routes[source] = dest_mask & ALL_PORTS;
+    }
+
+    uint32_t route(const uint8_t   source) const { return _routes[source]; }
+
+    void     connect   (const uint8_t   source,
+                        const uint8_t   dest  )
+    {
+        _routes[source] |=  port_mask(dest);
+    }
+
+    void     disconnect(const uint8_t   source,
+                        const uint8_t   dest  )
+    {
+        _routes[source] &= ~port_mask(dest);
+    }
+
+
+    // Moves events from all sources to their destinations until none can
+    //   make progress. Call from main loop.
+    void poll()
+    {
+        bool    progress = true;
+
+        while (progress) {
+            progress = false;
+
+            usb_sources ();
+            uart_sources();
+
+            for (uint8_t count = 0 ; count < NUM_PORTS ; ++count) {
+                uint8_t     source = _next_source;
+
+                if (++_next_source == NUM_PORTS)
+                      _next_source = 0;
+
+                if (_remaining[source] && forward(source))
+                    progress = true;
+            }
+        }
+
+        for (uint8_t uart = 0 ; uart < NUM_UARTS ; ++uart)
+            _uarts[uart]->tx_poll();
+
+    }  // poll()
+
+
+
+  protected:
+    // host events to per-cable sources, stopping at cable still pending
+    void usb_sources()
+    {
+        while (true) {
+            if (   !_usb_held
+                && !(_usb_held = _usb_dev.recv_event(_usb_event, _usb_time)))
+                return;
+
+            uint8_t     cable = _usb_event.cable_number();
+
+            if (cable < NUM_CABLES) {
+                if (_remaining[cable])
+                    return;  // head of line, host NAKed until delivered
+
+                _pending  [cable] = _usb_event    ;
+                _times    [cable] = _usb_time     ;
+                _remaining[cable] = _routes[cable];
+            }
+            // else not in descriptors, dropped
+
+            _usb_held = false;
+        }
+    }
+
+
+    void uart_sources()
+    {
+        for (uint8_t uart = 0 ; uart < NUM_UARTS ; ++uart) {
+            uint8_t     source = uart_port(uart);
+
+            // unrouted events dropped
+            while (   !_remaining[source]
+                   && _uarts[uart]->recv_event(_pending[source],
+                                               _times  [source]))
+                _remaining[source] = _routes[source];
+        }
+    }
+
+
+    // Offers source's pending event to its remaining destinations. True
+    //   if all now have it.
+    bool forward(
+    const uint8_t   source)
+    {
+        const EventPacket   &event     = _pending  [source];
+        uint32_t             remaining = _remaining[source];
+
+        for (uint32_t dests = remaining ; dests ; dests &= dests - 1) {
+            uint8_t     dest = __builtin_ctz(dests);
+
+            if (deliver(source, dest, event))
+                remaining &= ~port_mask(dest);
+        }
+
+        _remaining[source] = remaining;
+
+        return !remaining;
+
+    }  // forward()
+
+
+    bool deliver(
+    const uint8_t        source,
+    const uint8_t        dest  ,
+    const EventPacket   &event )
+    {
+        EventPacket::CodeIndex  cin      = event.code_index();
+        bool                    realtime =    cin == EventPacket::SINGLE_BYTE
+                                           && event._midi_0 >= 0xf8         ,
+                                sent                                        ;
+
+        if (!realtime && _owners[dest] != NO_PORT && _owners[dest] != source)
+            return false;  // other source's SysEx in progress
+
+        if (dest < NUM_CABLES) {
+            EventPacket     packet = event;
+
+            packet._cable_code = (dest << 4) | cin;
+            sent               = _usb_dev.send_event(packet, _times[source]);
+        }
+        else
+            sent = _uarts[dest - NUM_CABLES]->send_event(event);
+
+        if (!sent)
+            return false;
+
+        // SysEx end, or any other message (SysEx aborted), releases
+        if (!realtime)
+            _owners[dest] =   cin == EventPacket::SYS_EX_START_OR_CONTINUE
+                            ? source
+                            : NO_PORT                                   ;
+
+        return true;
+
+    }  // deliver()
+
+
+    UsbDevMidi                     &_usb_dev                 ;
+    UsbMidiUart*  const* const      _uarts                   ;
+
+    uint32_t                        _routes    [NUM_PORTS]   ,
+                                    _remaining [NUM_PORTS]   ;  // dests
+    EventPacket                     _pending   [NUM_PORTS]   ,
+                                    _usb_event               ;  // held
+    uint32_t                        _times     [NUM_PORTS]   ,  // arrival
+                                    _usb_time                ;
+    uint8_t                         _owners    [NUM_PORTS]   ,  // SysEx
+                                    _next_source             ;
+    bool                            _usb_held                ;
+
+};  // template<uint8_t NUM_UARTS> class UsbMidiRouter
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_MIDI_ROUTER_HXX
@@ -0,0 +1,269 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_MIDI_TIMING_HXX
+#define USB_MIDI_TIMING_HXX
+
+// Latency and jitter histogram bins per direction, last one counts all
+//   longer times
+#ifndef USB_MIDI_TIMING_BINS
+#define USB_MIDI_TIMING_BINS        16
+#endif
+
+// Events held by UsbMidiScheduler. Must cover host-to-device event rate
+//   times output delay.
+#ifndef USB_MIDI_SCHEDULE_SIZE
+#define USB_MIDI_SCHEDULE_SIZE      64
+#endif
+
+#include <core_cm3.hxx>
+
+#include <usb_dev_midi.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// UsbDevMidi event timing statistics, attached with UsbDevMidi::timing().
+//
+// Times are DWT cycle counter values (processor clock, 32 bits, so
+//   wrapping every 59 s at 72 MHz) from now(), after init(). Events are
+//   timestamped on entry: device-to-host (IN) at UsbMidiUart byte
+//   arrival or UsbDevMidi::send_event() call, host-to-device (OUT) at
+//   the start of the USB frame (SOF) in which their bulk OUT packet was
+//   received. SOF times come from sof_poll() noticing the frame number
+//   change, as there is no SOF interrupt, so are late by up to the
+//   interval between calls (UsbDevMidi::midi_poll() and recv_event()
+//   call it).
+//
+// Latency is from entry to loading into the bulk IN endpoint (IN), or to
+//   return from UsbDevMidi::recv_event() (OUT). Jitter is the difference
+//   between consecutive events' latencies. Both are counted per direction
+//   into histograms of BINS bins, "bin_us" microseconds wide, which the
+//   host reads with a vendor request (see UsbDevMidi).
+//
+class UsbMidiTiming
+{
+  public:
+    static const uint8_t    BINS       = USB_MIDI_TIMING_BINS,
+                            IN         = 0                   ,
+                            OUT        = 1                   ,
+                            DIRECTIONS = 2                   ;
+
+    // UsbDevMidi::VENDOR_REQ_GET_TIMING data, little-endian
+    struct Report {
+        uint32_t    cycles_per_us                   ;
+        uint16_t    bin_us                          ,
+                    output_delay_us                 ;  // 0 if none
+        uint8_t     bins                            ,
+                    directions                      ;
+        uint16_t    reserved                        ;
+        uint32_t    events      [DIRECTIONS]        ,
+                    max_latency [DIRECTIONS]        ,  // us
+                    latency     [DIRECTIONS][BINS]  ,  // counts
+                    jitter      [DIRECTIONS][BINS]  ;  //   "
+    };
+
+    constexpr
+    UsbMidiTiming(
+    const uint32_t  cpu_hz     ,
+    const uint16_t  bin_us = 250)  // 0 taken as 1
+    :   _report         {cpu_hz / 1000000              ,  // cycles_per_us
+                         bin_us ? bin_us : uint16_t(1) ,  // bin_us
+                         0                             ,  // output_delay_us
+                         BINS                          ,  // bins
+                         DIRECTIONS                    ,  // directions
+                         0                             ,  // reserved
+                         {0}                           ,  // events
+                         {0}                           ,  // max_latency
+                         {{0}}                         ,  // latency
+                         {{0}}                         },  // jitter
+        _last_latency   {0                             },
+        _delay_cycles   (0                             ),
+        _sof_time       (0                             ),
+        _sof_frame      (0                             )
+    {}
+
+
+    // Starts DWT cycle counter
+    static void init()
+    {
+        arm::core_debug->demcr |= arm::CoreDebug::Demcr::TRCENA;
+        arm::dwt       ->cyccnt = 0                             ;
+        arm::dwt       ->ctrl  |= arm::Dwt::Ctrl::CYCCNTENA     ;
+    }
+
+    static uint32_t now() { return arm::dwt->cyccnt; }
+
+
+    // Notes time of frame number change. Call frequently.
+    void sof_poll()
+    {
+        uint16_t    frame = UsbDev::frame_number();
+
+        if (frame != _sof_frame) {
+            _sof_frame = frame;
+            _sof_time  = now();
+        }
+    }
+
+    // Start of current frame, as of last sof_poll()
+    uint32_t frame_time() const { return _sof_time; }
+
+
+    // Fixed host-to-device latency if UsbMidiScheduler attached, 0 for
+    //   none
+    void     output_delay(const uint16_t   us)
+    {
+        _report.output_delay_us = us                          ;
+        _delay_cycles           = us * _report.cycles_per_us  ;
+    }
+
+    uint32_t output_delay_cycles() const { return _delay_cycles; }
+
+
+    // Event which entered at "entry" time left at "exit" time
+    void record(
+    const uint8_t   direction,
+    const uint32_t  entry    ,
+    const uint32_t  exit     )
+    {
+        uint32_t    latency  = (exit - entry) / _report.cycles_per_us,
+                    previous = _last_latency[direction]             ;
+
+        if (_report.events[direction]++)
+            ++_report.jitter[direction][bin(  latency > previous
+                                            ? latency - previous
+                                            : previous - latency)];
+
+        ++_report.latency[direction][bin(latency)];
+
+        if (latency > _report.max_latency[direction])
+            _report.max_latency[direction] = latency;
+
+        _last_latency[direction] = latency;
+    }
+
+    void reset()
+    {
+        for (uint8_t direction = 0 ; direction < DIRECTIONS ; ++direction) {
+            _report.events     [direction] = 0;
+            _report.max_latency[direction] = 0;
+
+            for (uint8_t ndx = 0 ; ndx < BINS ; ++ndx) {
+                _report.latency[direction][ndx] = 0;
+                _report.jitter [direction][ndx] = 0;
+            }
+        }
+    }
+
+    // Not a consistent snapshot if events recorded during transfer to
+    //   host
+    const Report& report() const { return _report; }
+
+
+
+  protected:
+    uint8_t bin(
+    const uint32_t  us)
+    const
+    {
+        uint32_t    ndx = us / _report.bin_us;  // never 0, see constructor
+
+        return ndx < BINS ? ndx : BINS - 1;
+    }
+
+
+    Report      _report                  ;
+    uint32_t    _last_latency[DIRECTIONS],  // us
+                _delay_cycles            ,
+                _sof_time                ;
+    uint16_t    _sof_frame               ;
+
+};  // class UsbMidiTiming
+
+
+
+// Scheduled host-to-device output, attached with UsbDevMidi::scheduler().
+//   UsbDevMidi::recv_event() then reads received events into a ring as
+//   they arrive, and returns each only UsbMidiTiming::output_delay()
+//   after its entry time, so with a delay longer than the worst case
+//   bulk OUT and main loop latency every event has the same latency.
+//
+class UsbMidiScheduler
+{
+  public:
+    static const uint8_t    SIZE = USB_MIDI_SCHEDULE_SIZE;
+
+    constexpr
+    UsbMidiScheduler(
+    UsbMidiTiming   &timing)
+    :   _timing     (timing),
+        _events     (      ),
+        _times      {0     },
+        _head       (0     ),
+        _count      (0     )
+    {}
+
+
+    // UsbDevMidi::recv_event() implementation
+    bool release(
+    UsbDevMidi                  &usb_dev,
+    UsbDevMidi::EventPacket     &event  ,
+    uint32_t                    &time   )
+    {
+        while (_count < SIZE) {
+            uint8_t     tail = (_head + _count) % SIZE;
+
+            if (!usb_dev.unpack_event(_events[tail], _times[tail]))
+                break;
+
+            ++_count;
+        }
+
+        if (   !_count
+            ||    UsbMidiTiming::now() - _times[_head]
+               <  _timing.output_delay_cycles()      )
+            return false;
+
+        event = _events[_head];
+        time  = _times [_head];
+
+        if (++_head == SIZE)
+              _head = 0;
+        --_count;
+
+        return true;
+    }
+
+
+
+  protected:
+    UsbMidiTiming               &_timing      ;
+
+    UsbDevMidi::EventPacket      _events[SIZE];
+    uint32_t                     _times [SIZE];
+    uint8_t                      _head        ,
+                                 _count       ;
+
+};  // class UsbMidiScheduler
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_MIDI_TIMING_HXX
@@ -0,0 +1,176 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_midi_uart.hxx>
+#include <usb_midi_timing.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+using namespace stm32f103xb;
+
+
+void UsbMidiUart::init()
+{
+    _usart->cr1 = 0;
+
+    // mantissa and 4-bit fraction, rounded. 8 data bits, no parity,
+    //   1 stop bit (reset values of CR1 M/PCE, CR2 STOP)
+    _usart->brr = (_pclk_hz + MIDI_BAUD / 2) / MIDI_BAUD;
+    _usart->cr2 = 0;
+    _usart->cr3 = Usart::Cr3::DMAR | Usart::Cr3::DMAT;
+
+    _tx_dma->ccr = 0;
+    _tx_dma->pa  = reinterpret_cast<uintptr_t>(&_usart->dr);
+    _tx_dma->ccr =   DmaChannel::Ccr::DIR_MEM2PERIPH
+                   | DmaChannel::Ccr::PL_HIGH
+                   | DmaChannel::Ccr::MSIZE_8_BITS
+                   | DmaChannel::Ccr::PSIZE_8_BITS
+                   | DmaChannel::Ccr::MINC        ;
+
+    _rx_dma->ccr = 0;
+    _rx_dma->pa  = reinterpret_cast<uintptr_t>(&_usart->dr);
+    _rx_dma->ma  = reinterpret_cast<uintptr_t>(_rx_ring   );
+    _rx_dma->ndt = RX_RING_SIZE                             ;
+    _rx_dma->ccr =   DmaChannel::Ccr::DIR_PERIPH2MEM
+                   | DmaChannel::Ccr::PL_VERY_HIGH
+                   | DmaChannel::Ccr::MSIZE_8_BITS
+                   | DmaChannel::Ccr::PSIZE_8_BITS
+                   | DmaChannel::Ccr::MINC
+                   | DmaChannel::Ccr::CIRC
+                   | DmaChannel::Ccr::EN          ;
+
+    _usart->cr1 = Usart::Cr1::UE | Usart::Cr1::TE | Usart::Cr1::RE;
+
+}  // init()
+
+
+
+bool UsbMidiUart::send_event(
+const UsbDevMidi::EventPacket   &event)
+{
+    uint16_t    used = (_tx_head - _tx_tail + TX_RING_SIZE) % TX_RING_SIZE;
+    uint8_t     bytes[UsbMidiCodec::MAX_DECODE_BYTES],
+                length;
+
+    // check before decode() changes running status
+    if (TX_RING_SIZE - 1 - used < UsbMidiCodec::MAX_DECODE_BYTES)
+        return false;
+
+    length = _codec.decode(event, bytes);
+
+    for (uint8_t ndx = 0 ; ndx < length ; ++ndx) {
+        _tx_ring[_tx_head] = bytes[ndx];
+        if (++_tx_head == TX_RING_SIZE)
+              _tx_head = 0;
+    }
+
+    tx_start();
+
+    return true;
+
+}  // send_event()
+
+
+
+void UsbMidiUart::tx_start()
+{
+    if (_tx_length) {
+        if (_tx_dma->ndt)
+            return;  // still sending
+
+        if ((_tx_tail += _tx_length) == TX_RING_SIZE)
+            _tx_tail = 0;
+        _tx_length = 0;
+    }
+
+    if (_tx_head == _tx_tail)
+        return;
+
+    // contiguous, up to end of ring
+    _tx_length = _tx_head > _tx_tail ? _tx_head     - _tx_tail
+                                     : TX_RING_SIZE - _tx_tail;
+
+    _tx_dma->ccr -= DmaChannel::Ccr::EN                              ;
+    _tx_dma->ma   = reinterpret_cast<uintptr_t>(_tx_ring + _tx_tail);
+    _tx_dma->ndt  = _tx_length                                       ;
+    _tx_dma->ccr |= DmaChannel::Ccr::EN                              ;
+
+}  // tx_start()
+
+
+
+void UsbMidiUart::usb_to_din()
+{
+    if (!_out_pending)
+        _out_pending = _usb_dev.recv_event(_out_packet);
+
+    if (_out_pending && send_event(_out_packet))
+        _out_pending = false;
+
+    tx_start();
+
+}  // usb_to_din()
+
+
+
+bool UsbMidiUart::next_event()
+{
+    while (_in_ndx == _in_count) {
+        uint16_t    head = RX_RING_SIZE - _rx_dma->ndt;
+
+        if (head >= RX_RING_SIZE)
+            head = 0;
+
+        if (_rx_tail == head)
+            return false;
+
+        _in_count = _codec.encode(_rx_ring[_rx_tail], _in_packets);
+        _in_ndx   = 0                                              ;
+
+        if (++_rx_tail == RX_RING_SIZE)
+              _rx_tail = 0;
+
+        if (_in_count && _usb_dev.timing()) {
+            // bytes received since, at least BYTE_US apart
+            uint16_t    behind = (head - _rx_tail + RX_RING_SIZE) % RX_RING_SIZE;
+
+            _in_time =   UsbMidiTiming::now()
+                       -   behind
+                         * BYTE_US
+                         * _usb_dev.timing()->report().cycles_per_us;
+        }
+    }
+
+    return true;
+
+}  // next_event()
+
+
+
+void UsbMidiUart::din_to_usb()
+{
+    // packet stays in _in_packets until bulk IN queue accepts it
+    while (next_event() && _usb_dev.send_event(_in_packets[_in_ndx], _in_time))
+        ++_in_ndx;
+
+}  // din_to_usb()
+
+}  // namespace stm32f10_12357_xx
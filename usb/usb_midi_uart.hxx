@@ -0,0 +1,182 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_MIDI_UART_HXX
+#define USB_MIDI_UART_HXX
+
+// DIN MIDI receive DMA ring, bytes. Must hold data arriving while USB
+//   bulk IN endpoint is busy (31250 baud == 3.125 bytes/ms).
+#ifndef USB_MIDI_UART_RX_RING_SIZE
+#define USB_MIDI_UART_RX_RING_SIZE  128
+#endif
+
+// DIN MIDI transmit ring, bytes. USB host can send far faster than DIN
+//   port, send_event() fails when full.
+#ifndef USB_MIDI_UART_TX_RING_SIZE
+#define USB_MIDI_UART_TX_RING_SIZE  256
+#endif
+
+#include <usb_midi_codec.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// DIN MIDI port (STM32F103 USART at 31250 baud, 8N1) to UsbDevMidi
+//   bridge, one cable number.
+//
+// USART RX is received by circular DMA into a RAM ring, and poll()
+//   parses it with UsbMidiCodec into event packets queued with
+//   UsbDevMidi::send_event(). Event packets from the host are converted
+//   back to MIDI bytes (with running status) into a transmit RAM ring,
+//   sent by DMA to USART TX one contiguous segment at a time.
+// If UsbDevMidi::timing() attached, DIN events are timestamped with the
+//   arrival of their last byte, estimated from the number of bytes
+//   received after it (each takes 320 us at 31250 baud).
+// No interrupts. CPU work is a few dozen instructions per MIDI byte
+//   (a fully loaded DIN port is 3125 bytes/s, well under 1% of a 72 MHz
+//   CPU), plus one packet copy to/from PMA per 16 events.
+//
+// Client application must:
+//   - enable DMA1, USART, and GPIO clocks and configure TX/RX pins
+//   - use DMA channels matching the USART (USART1 TX/RX: 4/5,
+//     USART2: 7/6, USART3: 2/3) not used by USB_DEV_DMA_CHANNEL
+//   - call poll() (which calls UsbDevMidi::recv_event()) and
+//     UsbDevMidi::midi_poll() from main loop, frequently enough that
+//     RX_RING_SIZE bytes can't arrive between calls
+// or, to connect several ports and cables (see UsbMidiRouter), use
+//   recv_event(), send_event(), and tx_poll() instead of poll().
+//
+class UsbMidiUart {
+  public:
+    static const uint32_t   MIDI_BAUD    = 31250                     ,
+                            BYTE_US      = 10 * 1000000 / MIDI_BAUD  ;  // 8N1
+    static const uint16_t   RX_RING_SIZE = USB_MIDI_UART_RX_RING_SIZE,
+                            TX_RING_SIZE = USB_MIDI_UART_TX_RING_SIZE;
+
+    constexpr
+    UsbMidiUart(
+    UsbDevMidi                              &usb_dev     ,
+    volatile stm32f103xb::Usart*      const  usart       ,
+    volatile stm32f103xb::DmaChannel* const  tx_dma      ,
+    volatile stm32f103xb::DmaChannel* const  rx_dma      ,
+    const    uint32_t                        pclk_hz     ,  // USART's APBx clock
+    const    uint8_t                         cable_number = 0)
+    :   _usb_dev        (usb_dev     ),
+        _usart          (usart       ),
+        _tx_dma         (tx_dma      ),
+        _rx_dma         (rx_dma      ),
+        _pclk_hz        (pclk_hz     ),
+        _codec          (cable_number),
+        _rx_ring        {0           },
+        _tx_ring        {0           },
+        _in_packets     (            ),
+        _out_packet     (            ),
+        _in_time        (0           ),
+        _rx_tail        (0           ),
+        _tx_head        (0           ),
+        _tx_tail        (0           ),
+        _tx_length      (0           ),
+        _in_count       (0           ),
+        _in_ndx         (0           ),
+        _out_pending    (false       )
+    {}
+
+    // Configures USART and starts receive DMA
+    void init();
+
+    // Moves data in both directions. Call from main loop.
+    void poll()
+    {
+        usb_to_din();
+        din_to_usb();
+    }
+
+    // Queue host event packet for DIN port, regardless of cable number.
+    //   False if transmit ring full, call again after poll().
+    bool send_event(const UsbDevMidi::EventPacket   &event);
+
+    // Next event packet parsed from DIN port (with constructor's
+    //   cable_number), false if none
+    bool recv_event(UsbDevMidi::EventPacket         &event)
+    {
+        if (!next_event())
+            return false;
+
+        event = _in_packets[_in_ndx++];
+        return true;
+    }
+
+    // As recv_event() above, also returning event's arrival time (see
+    //   UsbMidiTiming::now(), 0 if no UsbDevMidi::timing())
+    bool recv_event(UsbDevMidi::EventPacket         &event,
+                    uint32_t                        &time )
+    {
+        if (!recv_event(event))
+            return false;
+
+        time = _in_time;
+        return true;
+    }
+
+    // Starts sending next part of transmit ring when previous done
+    void tx_poll() { tx_start(); }
+
+
+
+  protected:
+    bool    next_event();  // in _in_packets[_in_ndx]
+
+    void    din_to_usb(),
+            usb_to_din(),
+            tx_start  ();
+
+
+    UsbDevMidi                              &_usb_dev ;
+    volatile stm32f103xb::Usart*      const  _usart   ;
+    volatile stm32f103xb::DmaChannel* const  _tx_dma  ,
+                                    * const  _rx_dma  ;
+    const    uint32_t                        _pclk_hz ;
+
+    UsbMidiCodec            _codec                                       ;
+
+    uint8_t                 _rx_ring   [RX_RING_SIZE]                    ,
+                            _tx_ring   [TX_RING_SIZE]                    ;
+
+    // encoded from DIN but not yet accepted by UsbDevMidi::send_event()
+    UsbDevMidi::EventPacket _in_packets[UsbMidiCodec::MAX_ENCODE_PACKETS];
+
+    // received from host but not yet fit in _tx_ring
+    UsbDevMidi::EventPacket _out_packet                                  ;
+
+    uint32_t                _in_time                                     ;  // _in_packets
+
+    uint16_t                _rx_tail                                     ,
+                            _tx_head                                     ,
+                            _tx_tail                                     ,
+                            _tx_length                                   ;  // DMA
+    uint8_t                 _in_count                                    ,
+                            _in_ndx                                      ;
+    bool                    _out_pending                                 ;
+
+};  // class UsbMidiUart
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_MIDI_UART_HXX
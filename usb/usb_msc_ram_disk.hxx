@@ -0,0 +1,98 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_MSC_RAM_DISK_HXX
+#define USB_MSC_RAM_DISK_HXX
+
+#include <usb_dev_msc.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// NUM_BLOCKS * UsbDevMsc::BLOCK_SIZE bytes of RAM as UsbDevMsc block
+//   device, e.g:
+//
+//       UsbMscRamDisk<24>   ram_disk;
+//       ...
+//       usb_dev.block_device(ram_disk.block_device());
+//
+// Contents are zero until host (or application, via block()) writes them.
+//
+template<uint32_t NUM_BLOCKS> class UsbMscRamDisk
+{
+  public:
+    static const uint16_t   BLOCK_WORDS = UsbDevMsc::BLOCK_SIZE / 4;
+
+    constexpr UsbMscRamDisk()
+    :   _blocks{{0}}
+    {}
+
+    UsbDevMsc::BlockDevice block_device()
+    {
+        return UsbDevMsc::BlockDevice{read, write, NUM_BLOCKS, this};
+    }
+
+    uint8_t* block(const uint32_t   lba)  // no check for valid lba
+    {
+        return reinterpret_cast<uint8_t*>(_blocks[lba]);
+    }
+
+
+  protected:
+    // UsbDevMsc block buffers are 4-byte aligned
+    static void copy(      uint32_t     *dst,
+                     const uint32_t     *src)
+    {
+        for (uint16_t ndx = 0 ; ndx < BLOCK_WORDS ; ++ndx)
+            dst[ndx] = src[ndx];
+    }
+
+    static UsbDevMsc::BlockStatus read(
+    const uint32_t   lba      ,
+          uint8_t   *block    ,
+          void      *user_data)
+    {
+        UsbMscRamDisk   *self = static_cast<UsbMscRamDisk*>(user_data);
+
+        copy(reinterpret_cast<uint32_t*>(block), self->_blocks[lba]);
+
+        return UsbDevMsc::BlockStatus::OK;
+    }
+
+    static UsbDevMsc::BlockStatus write(
+    const uint32_t   lba      ,
+    const uint8_t   *block    ,
+          void      *user_data)
+    {
+        UsbMscRamDisk   *self = static_cast<UsbMscRamDisk*>(user_data);
+
+        copy(self->_blocks[lba], reinterpret_cast<const uint32_t*>(block));
+
+        return UsbDevMsc::BlockStatus::OK;
+    }
+
+
+    uint32_t    _blocks[NUM_BLOCKS][BLOCK_WORDS];
+
+};  // template<uint32_t NUM_BLOCKS> class UsbMscRamDisk
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_MSC_RAM_DISK_HXX
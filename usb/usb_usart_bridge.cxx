@@ -0,0 +1,251 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#include <usb_usart_bridge.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+using namespace stm32f103xb;
+
+
+void UsbUsartBridge::init()
+{
+    // EIE: framing, noise, and overrun error interrupts with DMA reception
+    _usart->cr3 = Usart::Cr3::DMAR | Usart::Cr3::DMAT | Usart::Cr3::EIE;
+
+    _tx_dma->ccr = 0;
+    _tx_dma->pa  = reinterpret_cast<uintptr_t>(&_usart->dr);
+    _tx_dma->ccr =   DmaChannel::Ccr::DIR_MEM2PERIPH
+                   | DmaChannel::Ccr::PL_HIGH
+                   | DmaChannel::Ccr::MSIZE_8_BITS
+                   | DmaChannel::Ccr::PSIZE_8_BITS
+                   | DmaChannel::Ccr::MINC
+                   | DmaChannel::Ccr::TCIE        ;
+
+    _rx_dma->ccr = 0;
+    _rx_dma->pa  = reinterpret_cast<uintptr_t>(&_usart->dr);
+    _rx_dma->ma  = reinterpret_cast<uintptr_t>(_rx_ring   );
+    _rx_dma->ndt = RX_RING_SIZE                             ;
+    _rx_dma->ccr =   DmaChannel::Ccr::DIR_PERIPH2MEM
+                   | DmaChannel::Ccr::PL_VERY_HIGH
+                   | DmaChannel::Ccr::MSIZE_8_BITS
+                   | DmaChannel::Ccr::PSIZE_8_BITS
+                   | DmaChannel::Ccr::MINC
+                   | DmaChannel::Ccr::CIRC
+                   | DmaChannel::Ccr::HTIE
+                   | DmaChannel::Ccr::TCIE
+                   | DmaChannel::Ccr::EN          ;
+
+    UsbDevCdcAcm::line_coding_baud(line_coding(UsbDevCdcAcm::line_coding()));
+
+    UsbDevCdcAcm::line_coding_callback(line_coding_changed, this);
+
+}  // init()
+
+
+
+uint32_t UsbUsartBridge::line_coding(
+const UsbDevCdcAcm::LineCoding  &coding)
+{
+    if (!coding.baud)
+        return 0;
+
+    // mantissa and 4-bit fraction, rounded, limited to 16-bit register
+    //   and minimum mantissa of 1
+    uint32_t    brr = (_pclk_hz + coding.baud / 2) / coding.baud;
+
+    if      (brr > 0xffff) brr = 0xffff;
+    else if (brr < 0x0010) brr = 0x0010;
+
+    _usart->cr1 -= Usart::Cr1::UE;
+
+    _usart->brr = brr;
+
+    // USART word length includes parity bit. Only none, odd, and even
+    //   parity supported, and 7 or 8 data bits (or 8 data bits, no parity
+    //   for anything else).
+    bool        parity =    (coding.parity_code == 1 || coding.parity_code == 2)
+                         && (coding.bits        == 7 || coding.bits        == 8);
+    uint32_t    cr1    = (  Usart::Cr1::UE
+                          | Usart::Cr1::TE
+                          | Usart::Cr1::RE
+                          | Usart::Cr1::IDLEIE
+                          | Usart::Cr1::PEIE  ).bits();
+
+    if (parity) {
+        cr1 |= Usart::Cr1::PCE.bits();
+        if (coding.parity_code == 1)
+            cr1 |= Usart::Cr1::PS_ODD.bits();
+        if (coding.bits == 8)
+            cr1 |= Usart::Cr1::M_9_BITS.bits();
+    }
+
+    switch (coding.stop_bits) {
+        case 1:  _usart->cr2.ins(Usart::Cr2::STOP_1_5_BITS); break;
+        case 2:  _usart->cr2.ins(Usart::Cr2::STOP_2_BITS  ); break;
+        default: _usart->cr2.ins(Usart::Cr2::STOP_1_BIT   ); break;
+    }
+
+    _usart->cr1 = cr1;
+
+    return (_pclk_hz + brr / 2) / brr;
+
+}  // line_coding()
+
+
+
+// Apply host's SET_LINE_CODING once data queued at old rate/format is
+//   sent (usb_to_usart() doesn't start new transmissions meanwhile)
+//
+void UsbUsartBridge::new_line_coding()
+{
+    if (   _tx_busy
+        || (_usart->cr1.any(Usart::Cr1::UE) && !_usart->sr.any(Usart::Sr::TC)))
+        return;
+
+    _new_coding = false;  // before reading, so later change not missed
+
+    uint32_t    baud = line_coding(UsbDevCdcAcm::line_coding());
+
+    if (baud)
+        UsbDevCdcAcm::line_coding_baud(baud);
+
+}  // new_line_coding()
+
+
+
+void UsbUsartBridge::usart_irq()
+{
+    uint32_t    sr     = _usart->sr.word();
+    uint16_t    events = 0;
+
+    if (sr & Usart::Sr::ORE.bits()) events |= UsbDevCdcAcm::SERIAL_STATE_OVERRUN;
+    if (sr & Usart::Sr::FE .bits()) events |= UsbDevCdcAcm::SERIAL_STATE_FRAMING;
+    if (sr & Usart::Sr::PE .bits()) events |= UsbDevCdcAcm::SERIAL_STATE_PARITY ;
+
+    if (events)
+        _usb_dev.serial_state_event(events);  // sent by poll()
+
+    if (sr & (  Usart::Sr::IDLE
+              | Usart::Sr::ORE
+              | Usart::Sr::FE
+              | Usart::Sr::NE
+              | Usart::Sr::PE  ).bits()) {
+        // flags cleared by reading SR (above) followed by DR
+        // (DMA may already have read DR, clearing them, in which case
+        //  this is harmless)
+        uint16_t    dr = _usart->dr;
+        (void)dr;
+
+        _rx_flush = true;
+    }
+
+}  // usart_irq()
+
+
+
+void UsbUsartBridge::rx_dma_irq()
+{
+    // CGIFn clears all channel's flags
+    dma1->ifcr = 1U << dma_flags_pos(_rx_dma);
+
+    _rx_flush = true;
+}
+
+
+
+void UsbUsartBridge::usart_to_usb()
+{
+    if (!(_usb_dev.send_readys() & (1 << UsbDevCdcAcm::CDC_ENDPOINT_IN)))
+        return;
+
+    // clear before reading DMA position so no event is missed
+    bool        flush = _rx_flush;
+    _rx_flush         = false    ;
+
+    uint16_t    head  = RX_RING_SIZE - _rx_dma->ndt,
+                avail;
+
+    if (head >= RX_RING_SIZE)
+        head = 0;
+
+    // contiguous, up to end of ring
+    avail = head >= _rx_tail ? head - _rx_tail : RX_RING_SIZE - _rx_tail;
+
+    if (avail > UsbDevCdcAcm::CDC_IN_DATA_SIZE)
+        avail = UsbDevCdcAcm::CDC_IN_DATA_SIZE;
+
+    // full packets always, partial only after idle line or DMA event
+    if (avail == UsbDevCdcAcm::CDC_IN_DATA_SIZE || (avail && flush)) {
+        const uint8_t   *data =   reinterpret_cast<uint8_t*>(_rx_ring)
+                                + _rx_tail                           ;
+
+        // partial packet left tail odd: copy to even address for PMA copy
+        if (_rx_tail & 0x1) {
+            uint8_t     *stage = reinterpret_cast<uint8_t*>(_rx_stage);
+
+            for (uint16_t ndx = 0 ; ndx < avail ; ++ndx)
+                stage[ndx] = data[ndx];
+
+            data = stage;
+        }
+
+        _usb_dev.send(UsbDevCdcAcm::CDC_ENDPOINT_IN, data, avail);
+
+        if ((_rx_tail += avail) == RX_RING_SIZE)
+            _rx_tail = 0;
+    }
+
+    if (flush && _rx_tail != head)
+        _rx_flush = true;  // more to send when IN endpoint ready again
+
+}  // usart_to_usb()
+
+
+
+void UsbUsartBridge::usb_to_usart()
+{
+    if (_tx_busy && _tx_dma->ndt == 0) {
+        _tx_busy                  = false;
+        _tx_lengths[_tx_dma_ndx]  = 0    ;
+        _tx_dma_ndx              ^= 1    ;
+    }
+
+    // refill buffer not being sent (OUT endpoint NAKs host until then)
+    uint8_t     recv_ndx = _tx_busy ? _tx_dma_ndx ^ 1 : _tx_dma_ndx;
+
+    if (!_tx_lengths[recv_ndx])
+          _tx_lengths[recv_ndx]
+        = _usb_dev.recv(UsbDevCdcAcm::CDC_ENDPOINT_OUT,
+                        reinterpret_cast<uint8_t*>(_tx_bufs[recv_ndx]));
+
+    // hold new data for USART reconfiguration, see new_line_coding()
+    if (!_tx_busy && _tx_lengths[_tx_dma_ndx] && !_new_coding) {
+        _tx_dma->ccr -= DmaChannel::Ccr::EN                                ;
+        _tx_dma->ma   = reinterpret_cast<uintptr_t>(_tx_bufs[_tx_dma_ndx]) ;
+        _tx_dma->ndt  =                             _tx_lengths[_tx_dma_ndx];
+        _tx_dma->ccr |= DmaChannel::Ccr::EN                                ;
+        _tx_busy      = true                                               ;
+    }
+
+}  // usb_to_usart()
+
+}  // namespace stm32f10_12357_xx
@@ -0,0 +1,174 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+#ifndef USB_USART_BRIDGE_HXX
+#define USB_USART_BRIDGE_HXX
+
+// USART receive DMA ring, bytes. Must hold data arriving during worst-case
+//   USB host polling latency (e.g. 2 Mbaud == 200 bytes/ms)
+#ifndef USB_USART_BRIDGE_RX_RING_SIZE
+#define USB_USART_BRIDGE_RX_RING_SIZE   1024
+#endif
+
+#include <usb_dev_cdc_acm.hxx>
+
+
+namespace stm32f10_12357_xx {
+
+// USB CDC-ACM virtual COM port to STM32F103 USART bridge.
+//
+// USART RX is received by circular DMA into a RAM ring, and drained to
+//   the CDC bulk IN endpoint in full packets, or in partial ones after
+//   an idle line, DMA half-transfer, or DMA transfer-complete event.
+// CDC bulk OUT packets are copied from PMA to one of two RAM buffers
+//   and sent by DMA to USART TX while the other buffer is refilled.
+// No per-byte CPU work in either direction. (PMA's 16-bit-per-32-bit-word
+//   layout prevents DMA directly between PMA and the 8-bit USART data
+//   register, so UsbDev::recv()/send() copy whole packets -- with DMA if
+//   USB_DEV_DMA_PMA defined -- instead.)
+// Host SET_LINE_CODING requests reprogram the USART from poll(), after
+//   any data already queued for transmission has been sent at the old
+//   rate and format.
+//
+// Client application must:
+//   - enable DMA1, USART, and GPIO clocks and configure TX/RX pins
+//   - use DMA channels matching the USART (USART1 TX/RX: 4/5,
+//     USART2: 7/6, USART3: 2/3) not used by USB_DEV_DMA_CHANNEL
+//   - call usart_irq(), rx_dma_irq(), and tx_dma_irq() from the USART's
+//     and DMA channels' interrupt handlers, and enable those in NVIC
+//   - call poll() from main loop, e.g. after each interrupt
+//
+class UsbUsartBridge {
+  public:
+    static const uint16_t   RX_RING_SIZE = USB_USART_BRIDGE_RX_RING_SIZE;
+
+    static_assert(RX_RING_SIZE % 4 == 0, "RX_RING_SIZE must be multiple of 4");
+
+    constexpr
+    UsbUsartBridge(
+    UsbDevCdcAcm                            &usb_dev,
+    volatile stm32f103xb::Usart*      const  usart  ,
+    volatile stm32f103xb::DmaChannel* const  tx_dma ,
+    volatile stm32f103xb::DmaChannel* const  rx_dma ,
+    const    uint32_t                        pclk_hz)   // USART's APBx clock
+    :   _usb_dev     (usb_dev),
+        _usart       (usart  ),
+        _tx_dma      (tx_dma ),
+        _rx_dma      (rx_dma ),
+        _pclk_hz     (pclk_hz),
+        _rx_ring     {0      },
+        _rx_tail     (0      ),
+        _rx_flush    (false  ),
+        _rx_stage    {0      },
+        _tx_bufs     {{0}    },
+        _tx_lengths  {0      },
+        _tx_dma_ndx  (0      ),
+        _tx_busy     (false  ),
+        _new_coding  (false  )
+    {}
+
+    // Configures USART from current CDC line coding, starts receive DMA,
+    //   and registers for host line coding changes
+    void init();
+
+    // Reprogram USART baud rate, data bits, parity, and stop bits.
+    // Immediate: caller must ensure no transmission in progress.
+    // Baud rates outside USART range (pclk_hz/65535 to pclk_hz/16) are
+    //   clamped. Returns rate actually set, 0 if coding.baud is 0 (ignored).
+    uint32_t line_coding(const UsbDevCdcAcm::LineCoding    &line_coding);
+
+    // Call from USART interrupt handler (idle line, receive errors --
+    //   latter reported to host as SERIAL_STATE notifications)
+    void usart_irq();
+
+    // Call from receive DMA channel interrupt handler (half/full ring)
+    void rx_dma_irq();
+
+    // Call from transmit DMA channel interrupt handler (wakes main loop
+    //   to start next buffer, see poll())
+    void tx_dma_irq()
+    {
+        stm32f103xb::dma1->ifcr = 1U << dma_flags_pos(_tx_dma);
+    }
+
+    // Moves data in both directions, and sends any pending line status
+    //   change to host. Call from main loop.
+    void poll()
+    {
+        usb_to_usart();
+        if (_new_coding)
+            new_line_coding();
+        usart_to_usb();
+        _usb_dev.serial_state_poll();
+    }
+
+
+  protected:
+    // Control transfer callback, possibly in interrupt context: defer
+    //   to poll()
+    static void line_coding_changed(const UsbDevCdcAcm::LineCoding  &coding   ,
+                                          void                      *user_data)
+    {
+        (void)coding;  // re-read by new_line_coding()
+
+        static_cast<UsbUsartBridge*>(user_data)->_new_coding = true;
+    }
+
+    void    new_line_coding(),
+            usart_to_usb   (),
+            usb_to_usart   ();
+
+    // Dma::Ifcr CGIFn bit position for channel
+    static uint8_t dma_flags_pos(
+    volatile stm32f103xb::DmaChannel* const     dma_channel)
+    {
+        return 4 * (  (  reinterpret_cast<uintptr_t>(dma_channel)
+                       - stm32f103xb::DMA1_CHANNEL1_BASE        )
+                    / (  stm32f103xb::DMA1_CHANNEL2_BASE
+                       - stm32f103xb::DMA1_CHANNEL1_BASE        ));
+    }
+
+
+    UsbDevCdcAcm                            &_usb_dev ;
+    volatile stm32f103xb::Usart*      const  _usart   ;
+    volatile stm32f103xb::DmaChannel* const  _tx_dma  ,
+                                    * const  _rx_dma  ;
+    const    uint32_t                        _pclk_hz ;
+
+    // uint32_t for 16-bit PMA copy alignment, UsbDev::recv()/send()
+    //   copy whole 16-bit PMA words
+    uint32_t            _rx_ring   [RX_RING_SIZE / 4]               ;
+    uint16_t            _rx_tail                                    ;
+    volatile bool       _rx_flush                                   ;
+    // copy of packet starting at odd _rx_tail
+    uint32_t            _rx_stage  [(UsbDevCdcAcm::CDC_IN_DATA_SIZE + 3)
+                                    / 4                            ];
+    uint32_t            _tx_bufs   [2][(UsbDevCdcAcm::CDC_OUT_DATA_SIZE + 3)
+                                       / 4                         ];
+    uint16_t            _tx_lengths[2]                              ;
+    uint8_t             _tx_dma_ndx                                 ;
+    bool                _tx_busy                                    ;
+    volatile bool       _new_coding                                 ;
+
+};  // class UsbUsartBridge
+
+}  // namespace stm32f10_12357_xx
+
+#endif  // ifndef USB_USART_BRIDGE_HXX
@@ -0,0 +1,183 @@
+// papoon_usb: "Not Insane" USB library for STM32F103xx MCUs
+// Copyright (C) 2019,2020 Mark R. Rubin
+//
+// This file is part of papoon_usb.
+//
+// The papoon_usb program is free software: you can redistribute it
+// and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// The papoon_usb program is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// (LICENSE.txt) along with the papoon_usb program.  If not, see
+// <https://www.gnu.org/licenses/gpl.html>
+
+
+
+#ifndef RING_BUFFER_HXX
+#define RING_BUFFER_HXX
+
+#include <stdint.h>
+
+namespace bitops {
+
+// Single-producer, single-consumer byte FIFO. SIZE must be power of 2
+//   (<= 32768). Free-running 16-bit indices, so all SIZE bytes usable.
+// Not interrupt-safe unless producer and consumer are each only in one
+//   context (e.g. main loop and one interrupt) and INDEX accesses are
+//   atomic (true for 16-bit on Cortex-M).
+template <unsigned SIZE> class RingBuffer {
+  public:
+    static_assert((SIZE & (SIZE - 1)) == 0 && SIZE <= 32768,
+                  "RingBuffer SIZE must be power of 2, <= 32768");
+
+    constexpr
+    RingBuffer()
+    :   _head  (0  ),
+        _tail  (0  ),
+        _buffer{0  }
+    {}
+
+    uint16_t size () const { return static_cast<uint16_t>(_head - _tail); }
+    uint16_t space() const { return SIZE - size()                       ; }
+    bool     empty() const { return _head == _tail                      ; }
+
+    void clear() { _tail = _head; }
+
+    // discard oldest bytes, returns number discarded
+    uint16_t skip(
+    uint16_t    length)
+    {
+        if (length > size())
+            length = size();
+
+        _tail += length;
+
+        return length;
+    }
+
+    // returns number of bytes written, less than length if not enough room
+    uint16_t write(
+    const uint8_t   *data  ,
+          uint16_t   length)
+    {
+        if (length > space())
+            length = space();
+
+        for (uint16_t count = 0 ; count < length ; ++count)
+            _buffer[(_head + count) & (SIZE - 1)] = data[count];
+
+        _head += length;   // after data, for other-context consumer
+
+        return length;
+    }
+
+    // returns number of bytes read, less than length if not enough data
+    uint16_t read(
+    uint8_t     *data  ,
+    uint16_t     length)
+    {
+        if (length > size())
+            length = size();
+
+        for (uint16_t count = 0 ; count < length ; ++count)
+            data[count] = _buffer[(_tail + count) & (SIZE - 1)];
+
+        _tail += length;   // after data, for other-context producer
+
+        return length;
+    }
+
+
+  protected:
+    volatile uint16_t   _head        ,
+                        _tail        ;
+             uint8_t    _buffer[SIZE];
+
+};  // template <unsigned SIZE> class RingBuffer
+
+
+
+// As RingBuffer, but on client-supplied memory of size set at runtime
+//   (rounded down to power of 2, <= 32768). Empty and unusable until
+//   buffer() called.
+class RingBufferSpan {
+  public:
+    constexpr
+    RingBufferSpan()
+    :   _head  (0),
+        _tail  (0),
+        _mask  (0),
+        _limit (0),
+        _buffer(0)
+    {}
+
+    void buffer(
+    uint8_t     *buffer,
+    uint16_t     size  )
+    {
+        if (size > 32768)
+            size = 32768;
+        while (size & (size - 1))
+            size &= size - 1;   // clear lowest set bit
+
+        _buffer = buffer                 ;
+        _mask   = size ? size - 1 : 0    ;
+        _limit  = buffer ? size : 0      ;
+        _head   = _tail = 0              ;
+    }
+
+    uint16_t size () const { return static_cast<uint16_t>(_head - _tail); }
+    uint16_t space() const { return _limit - size()                     ; }
+    bool     empty() const { return _head == _tail                      ; }
+
+    void clear() { _tail = _head; }
+
+    uint16_t write(
+    const uint8_t   *data  ,
+          uint16_t   length)
+    {
+        if (length > space())
+            length = space();
+
+        for (uint16_t count = 0 ; count < length ; ++count)
+            _buffer[(_head + count) & _mask] = data[count];
+
+        _head += length;
+
+        return length;
+    }
+
+    uint16_t read(
+    uint8_t     *data  ,
+    uint16_t     length)
+    {
+        if (length > size())
+            length = size();
+
+        for (uint16_t count = 0 ; count < length ; ++count)
+            data[count] = _buffer[(_tail + count) & _mask];
+
+        _tail += length;
+
+        return length;
+    }
+
+
+  protected:
+    volatile uint16_t   _head  ,
+                        _tail  ;
+             uint16_t   _mask  ,
+                        _limit ;
+             uint8_t   *_buffer;
+
+};  // class RingBufferSpan
+
+}  // namespace bitops
+
+#endif  // ifndef RING_BUFFER_HXX